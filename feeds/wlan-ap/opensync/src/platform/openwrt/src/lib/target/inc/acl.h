@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_ACL_H_INCLUDED
+#define TARGET_ACL_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "schema.h"
+
+/*
+ * MAC address filtering.
+ *
+ * The VIF's mac_list_type picks the policy, whitelist or blacklist, and
+ * maps to the wireless "macfilter" option. The list itself lives in a
+ * file per VIF that hostapd reads at start, UCI only changes with the
+ * policy. List updates are applied to the running hostapd as single
+ * ACCEPT_ACL/DENY_ACL ADD_MAC and DEL_MAC commands for the addresses
+ * that changed, a client losing access is kicked right away and nobody
+ * else notices.
+ */
+
+#ifndef ACL_FILE_FMT
+#define ACL_FILE_FMT        "/var/run/opensync-%s.maclist"
+#endif
+
+enum acl_policy
+{
+    ACL_POLICY_NONE = 0,
+    ACL_POLICY_WHITELIST,
+    ACL_POLICY_BLACKLIST,
+};
+
+bool acl_vif_apply(int ssid_index, const struct schema_Wifi_VIF_Config *vconf);
+bool acl_vif_state(int ssid_index, struct schema_Wifi_VIF_State *vstate);
+int acl_vif_count(const char *ifname);
+void acl_resync(void);
+void acl_cleanup(void);
+
+#endif /* TARGET_ACL_H_INCLUDED */
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_ACS_H_INCLUDED
+#define TARGET_ACS_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ds_tree.h"
+
+/*
+ * Local automatic channel selection.
+ *
+ * Every radio is periodically scored from its survey counters, the
+ * neighbors seen in scan results (RSSI, width, BSS Load IE) and the DFS
+ * state of each channel. The best channel/width is exposed as a
+ * recommendation in Wifi_Radio_State:hw_params and, when the radio's
+ * "acs_mode" UCI option is "auto", applied with a CSA once it has been
+ * stable for a few rounds.
+ *
+ * DFS channels still needing a CAC only compete with a penalty, and the
+ * result says when the chosen block needs one. In "auto" mode they are
+ * left out: the CSA refuses them, and a restart would take the BSS down
+ * for the whole CAC.
+ *
+ * acs_survey_apply(), acs_nbr_apply(), acs_chan_cost(), acs_score() and
+ * acs_select() only work on the data passed in, so they can be fed
+ * recorded survey and scan data offline.
+ */
+
+struct wifi_survey;
+
+enum acs_mode
+{
+    ACS_MODE_OFF = 0,
+    ACS_MODE_RECOMMEND,
+    ACS_MODE_AUTO,
+};
+
+/* Measured input for one 20 MHz channel */
+struct acs_chan
+{
+    int             chan;
+    bool            excluded;   /* disabled, no-IR or in radar NOP */
+    bool            needs_cac;
+    int             busy;       /* % of air time used by others */
+    int             nbr_count;
+    int             nbr_cost;   /* RSSI weighted neighbor cost */
+    int             bss_load;   /* highest advertised utilization, % */
+};
+
+struct acs_result
+{
+    int             channel;
+    int             width;
+    int             score;
+    int             cur_score;
+    bool            needs_cac;  /* the block has to pass a CAC first */
+    bool            switch_recommended;
+};
+
+void acs_survey_apply(
+        struct acs_chan *chans,
+        int n,
+        const struct wifi_survey *survey,
+        int num,
+        const struct wifi_survey *prev,
+        int n_prev);
+void acs_nbr_apply(struct acs_chan *chans, int n, ds_tree_t *nbrs);
+int acs_chan_cost(const struct acs_chan *c);
+int acs_score(const struct acs_chan *chans, int n, int primary, int width);
+bool acs_select(
+        const struct acs_chan *chans,
+        int n,
+        int cur_chan,
+        int cur_width,
+        int max_width,
+        struct acs_result *res);
+
+bool acs_init(void);
+void acs_cleanup(void);
+bool acs_get(int radioIndex, struct acs_result *res);
+
+#endif /* TARGET_ACS_H_INCLUDED */
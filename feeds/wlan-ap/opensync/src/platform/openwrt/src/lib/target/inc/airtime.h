@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_AIRTIME_H_INCLUDED
+#define TARGET_AIRTIME_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Airtime fairness weights.
+ *
+ * On phys with the airtime fairness feature mac80211 schedules stations
+ * by weight. Weights come from the VIF's "airtime_weight" UCI option, or
+ * a per-client "airtime_sta_weight" list entry, and are pushed with
+ * SET_STATION when a client associates and when a VIF config pass finds
+ * them changed. Wifi_VIF_Config has no column for either option, they
+ * are set in UCI directly. Per-client air time is read with the client
+ * stats dump.
+ */
+
+#define AIRTIME_DEFAULT_WEIGHT  256
+
+bool airtime_init(void);
+bool airtime_apply(int ssid_index);
+
+#endif /* TARGET_AIRTIME_H_INCLUDED */
@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_FT_H_INCLUDED
+#define TARGET_FT_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "schema.h"
+
+/*
+ * 802.11r key holders.
+ *
+ * With an "ft_key" (32 or 64 hex digits) in the VIF's security map every
+ * AP of the mobility domain shares the key for PMK-R0/R1 transfers and
+ * FT works for WPA-EAP as well. Only known peers are key holders, there
+ * are no wildcard entries.
+ *
+ * "ft_peer-<n>" entries name the BSSIDs of known peers. They become
+ * explicit r0kh/r1kh lists in the same UCI commit as the other FT
+ * options, and new ones are also added to the running hostapd over its
+ * control socket, which lets it push PMK-R1s to them ahead of a roam.
+ * hostapd can't forget a key holder: a removed peer is gone from UCI
+ * right away but stays known until hostapd next starts. A hostapd that
+ * started after the lists were last committed has them all and gets
+ * nothing pushed. Peers are expected to use their BSSID as NAS-ID.
+ */
+
+#define OVSDB_SECURITY_FT_KEY   "ft_key"
+#define FT_PEER_PREFIX          "ft_peer-"
+#define FT_MAX_PEERS            32
+#define FT_NAS_ID_LEN           13
+
+enum ft_mode
+{
+    FT_MODE_OFF = 0,
+    FT_MODE_LOCAL,      /* PSK only, PMK-R1 derived from the passphrase */
+    FT_MODE_KEYS,       /* key holders sharing ft_key */
+};
+
+bool ft_init(void);
+void ft_cleanup(void);
+void ft_nas_id(const char *bssid, char *out);
+int ft_vif_mode(const struct schema_Wifi_VIF_Config *vconf, const char **key);
+int ft_vif_peers(const struct schema_Wifi_VIF_Config *vconf, char (*peers)[18], int max);
+bool ft_vif_apply(int ssid_index, const struct schema_Wifi_VIF_Config *vconf);
+int ft_peer_count(const char *ifname);
+void ft_resync(void);
+
+#endif /* TARGET_FT_H_INCLUDED */
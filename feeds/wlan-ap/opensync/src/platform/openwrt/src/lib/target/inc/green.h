@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_GREEN_H_INCLUDED
+#define TARGET_GREEN_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ev.h>
+
+/*
+ * Idle power saving.
+ *
+ * A radio with the UCI option green_idle set (seconds) that has had no
+ * associated client for that long lowers its tx power by green_txpower
+ * dB. The chains are left alone: mac80211 refuses new antenna masks
+ * while the radio is up, and taking it down would stop it from hearing
+ * the probes that wake it. While idle
+ * the radio's hostapd instances are monitored, a probe request heard
+ * above GREEN_PROBE_RSSI or any station event brings the full setup back
+ * right away, from the event callback.
+ */
+
+#define GREEN_PROBE_RSSI    -85
+
+enum green_mode
+{
+    GREEN_MODE_ACTIVE = 0,
+    GREEN_MODE_IDLE,
+};
+
+struct green_state
+{
+    int         mode;
+    uint64_t    active_ms;      /* time spent in each mode */
+    uint64_t    idle_ms;
+    int         wakeups;
+};
+
+bool green_init(struct ev_loop *loop);
+void green_cleanup(void);
+bool green_get(int radioIndex, struct green_state *state);
+bool green_is_idle(int radioIndex);
+
+#endif /* TARGET_GREEN_H_INCLUDED */
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_HOSTAPD_H_INCLUDED
+#define TARGET_HOSTAPD_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifndef HOSTAPD_CTRL_DIR
+#define HOSTAPD_CTRL_DIR    "/var/run/hostapd"
+#endif
+
+/*
+ * Minimal hostapd control interface client. Every call opens a fresh
+ * datagram socket, sends one command and waits for the reply, so it is
+ * only meant for rare, short commands issued from the manager's loop.
+ */
+int hostapd_cli(const char *ifname, const char *cmd, char *reply, size_t reply_len);
+bool hostapd_cli_ok(const char *ifname, const char *cmd);
+
+/*
+ * Tells hostapd instances apart: the inode of the control socket, which
+ * a restarted hostapd creates anew, 0 while none is running.
+ * hostapd_ctrl_start() is when that socket was created, in wall clock
+ * seconds.
+ */
+ino_t hostapd_ctrl_ino(const char *ifname);
+time_t hostapd_ctrl_start(const char *ifname);
+
+/*
+ * Event monitor, an ATTACHed control socket that hostapd pushes its
+ * events to. hostapd_monitor_recv() returns the event text without the
+ * priority prefix, 0 when nothing is queued and -1 on error. A restarted
+ * hostapd does not error out the old monitor, it just goes quiet; users
+ * compare hostapd_ctrl_ino() with the one they attached to.
+ */
+int hostapd_monitor_open(const char *ifname);
+void hostapd_monitor_close(const char *ifname, int fd);
+int hostapd_monitor_recv(int fd, char *event, size_t event_len);
+
+#endif /* TARGET_HOSTAPD_H_INCLUDED */
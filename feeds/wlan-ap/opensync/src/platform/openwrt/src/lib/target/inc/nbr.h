@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_NBR_H_INCLUDED
+#define TARGET_NBR_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#include "ds_tree.h"
+
+/*
+ * Per-phy cache of neighboring BSSes, filled from nl80211 scan results
+ * whenever a scan on one of the phy's interfaces completes, whoever
+ * triggered it. Entries not seen for NBR_MAX_AGE_MS are dropped.
+ */
+
+#define NBR_MAX_AGE_MS      (15 * 60 * 1000)
+
+struct wifi_nbr
+{
+    char            bssid[18];
+    char            ssid[33];
+    int             primary;
+    int             lo;         /* lowest and highest 20 MHz channel used */
+    int             hi;
+    int             rssi;
+    int             load;       /* BSS Load utilization in %, -1 if not advertised */
+    int64_t         seen;
+    ds_tree_node_t  node;
+};
+
+bool nbr_init(void);
+void nbr_cleanup(void);
+
+void nbr_refresh(const char *phy, const char *ifname);
+ds_tree_t *nbr_get(const char *phy);
+
+#endif /* TARGET_NBR_H_INCLUDED */
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_NL80211_H_INCLUDED
+#define TARGET_NL80211_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ev.h>
+
+#include <netlink/genl/genl.h>
+#include <netlink/genl/family.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+#include <linux/nl80211.h>
+
+/*
+ * Thin nl80211 transport used by the target layer.
+ *
+ * Requests are sent on a private blocking socket and answered synchronously,
+ * multicast events ("config", "mlme", "regulatory", "scan") arrive on a second
+ * socket that is attached to the manager's libev loop by nl80211_init().
+ */
+
+/*
+ * Airtime attributes (Linux 5.1) are newer than the mac80211 backport
+ * headers we build against; the values are fixed by the kernel ABI and
+ * older kernels simply never report them.
+ */
+#define NL80211_COMPAT_STA_INFO_TX_DURATION         39
+#define NL80211_COMPAT_STA_INFO_AIRTIME_WEIGHT      40
+#define NL80211_COMPAT_STA_INFO_MAX                 40
+#define NL80211_COMPAT_ATTR_AIRTIME_WEIGHT          274
+#define NL80211_COMPAT_EXT_FEATURE_AIRTIME_FAIRNESS 33
+
+/* HE capabilities (Linux 4.19), nested per interface type in each band */
+#define NL80211_COMPAT_BAND_ATTR_IFTYPE_DATA        9
+#define NL80211_COMPAT_BAND_IFTYPE_ATTR_HE_CAP_PHY  3
+
+typedef int (*nl80211_resp_cb_t)(struct nl_msg *msg, void *arg);
+typedef void (*nl80211_event_cb_t)(uint8_t cmd, struct nlattr **tb, void *arg);
+
+bool nl80211_init(struct ev_loop *loop);
+void nl80211_cleanup(void);
+
+struct nl_msg *nl80211_msg(uint8_t cmd, int flags);
+int nl80211_send(struct nl_msg *msg, nl80211_resp_cb_t cb, void *arg);
+int nl80211_parse(struct nl_msg *msg, struct nlattr **tb);
+
+struct nl_sock *nl80211_sock_open(void);
+void nl80211_sock_close(struct nl_sock *sock);
+int nl80211_send_sock(struct nl_sock *sock, struct nl_msg *msg, nl80211_resp_cb_t cb, void *arg);
+
+bool nl80211_event_register(uint8_t cmd, nl80211_event_cb_t cb, void *arg);
+
+#endif /* TARGET_NL80211_H_INCLUDED */
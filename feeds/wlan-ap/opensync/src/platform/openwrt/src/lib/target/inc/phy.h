@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_PHY_H_INCLUDED
+#define TARGET_PHY_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#include "ds_tree.h"
+#include "nl80211.h"
+
+#define PHY_MAX_CHANNELS    64
+
+struct wifi_chan
+{
+    uint32_t        freq;
+    int             chan;
+    bool            disabled;
+    bool            radar;
+    bool            no_ir;
+    uint32_t        dfs_state;
+    int             max_eirp;
+};
+
+/*
+ * Per-phy capability cache, filled from NL80211_CMD_GET_WIPHY and kept
+ * up to date from wiphy events. Lookups never touch the driver unless the
+ * phy is not cached yet, and a name the last full dump did not find stays
+ * unknown until the next NEW_WIPHY. Channel flags and the country come from the
+ * regulatory domain and are refreshed on REG_CHANGE.
+ */
+struct wifi_phy
+{
+    char            name[IFNAMSIZ];
+    uint32_t        wiphy;
+
+    uint32_t        tx_ant_avail;
+    uint32_t        rx_ant_avail;
+    uint32_t        tx_ant;
+    uint32_t        rx_ant;
+
+    uint16_t        ht_capa;
+    uint32_t        vht_capa;
+    int             ht_streams;
+    int             vht_streams;
+    bool            he;
+
+    bool            band_2g;
+    bool            band_5g;
+    bool            airtime_fairness;
+
+    struct wifi_chan chans[PHY_MAX_CHANNELS];
+    int             n_chans;
+    uint32_t        cac_low;        /* 20 MHz channels under CAC, 0 if none */
+    uint32_t        cac_high;
+
+    char            country[3];
+
+    ds_tree_node_t  node;
+};
+
+/* Operating state of a phy, as seen on its first active interface */
+struct wifi_oper
+{
+    char            ifname[IFNAMSIZ];
+    uint32_t        freq;
+    uint32_t        center_freq1;
+    uint32_t        center_freq2;
+    int             width;
+    int             channel;
+    int             txpower;
+    bool            txpower_valid;
+};
+
+/* One NL80211_CMD_GET_SURVEY entry, counters are cumulative and in ms */
+struct wifi_survey
+{
+    uint32_t        freq;
+    bool            in_use;
+    int             noise;
+    uint64_t        time;
+    uint64_t        busy;
+    uint64_t        busy_ext;
+    uint64_t        rx;
+    uint64_t        tx;
+};
+
+bool phy_init(void);
+void phy_cleanup(void);
+
+struct wifi_phy *phy_get(const char *name);
+bool phy_refresh(const char *name);
+
+int phy_from_path(const char *path, char *phy, size_t len);
+int phy_from_ifindex(uint32_t ifindex, char *phy, size_t len);
+
+int phy_allowed_channels(const struct wifi_phy *phy, int *chans, int max);
+const struct wifi_chan *phy_chan_get(const struct wifi_phy *phy, int chan);
+
+struct wifi_phy *phy_radar_event(struct nlattr **tb);
+const char *phy_chan_dfs_state(const struct wifi_phy *phy, const struct wifi_chan *chan);
+
+uint32_t phy_tx_chainmask(const struct wifi_phy *phy);
+uint32_t phy_rx_chainmask(const struct wifi_phy *phy);
+int phy_max_streams(const struct wifi_phy *phy);
+
+/*
+ * Interface lookups are served from a cache filled by one GET_INTERFACE
+ * dump and kept current from NEW_INTERFACE, DEL_INTERFACE and
+ * CH_SWITCH_NOTIFY. AP start and tx power changes send no event, so an
+ * entry older than a few seconds is read again with a single unicast
+ * request when its phy is asked for.
+ */
+bool phy_get_oper(const char *name, struct wifi_oper *oper);
+int phy_get_ifaces(const char *name, char (*ifnames)[IFNAMSIZ], int max);
+bool phy_get_addr(const char *name, const char *ifname, char *mac, size_t len);
+bool phy_set_txpower(const char *name, int dbm);
+int phy_survey_get(const char *ifname, struct wifi_survey *survey, int max);
+int phy_freq_to_channel(uint32_t freq);
+uint32_t phy_channel_to_freq(int chan);
+const char *phy_width_to_htmode(int width);
+
+#endif /* TARGET_PHY_H_INCLUDED */
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_PSK_H_INCLUDED
+#define TARGET_PSK_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "schema.h"
+
+/*
+ * Multi-PSK.
+ *
+ * Besides its "key", a WPA-PSK VIF accepts any number of extra
+ * passphrases: "key-<n>" entries of its security map, labelled by an
+ * optional "oftag-key-<n>", and the key of every Wifi_Credential_Config
+ * row for the same SSID. They are handed to hostapd in a wpa_psk_file.
+ *
+ * The keys of each VIF are kept in memory and the file is only touched
+ * when the set changes, new keys are appended and removals rewrite it
+ * under a temporary name. hostapd rereads it on RELOAD_WPA_PSK, the BSS
+ * and its clients stay up. A hostapd that can't takes the keys at its
+ * next start. UCI only changes when a VIF gets its first extra key or
+ * loses its last one.
+ */
+
+#ifndef PSK_FILE_FMT
+#define PSK_FILE_FMT        "/var/run/hostapd-%s.psk"
+#endif
+#define PSK_KEY_PREFIX      "key-"
+#define PSK_TAG_PREFIX      "oftag-"
+#define PSK_KEYID_MAX       32
+
+bool psk_vif_apply(int ssid_index,
+                   const struct schema_Wifi_VIF_Config *vconf,
+                   const struct schema_Wifi_Credential_Config *cconfs,
+                   int num_cconfs);
+int psk_vif_state(struct schema_Wifi_VIF_State *vstate, int index);
+int psk_vif_count(const char *ifname);
+void psk_resync(void);
+void psk_cleanup(void);
+
+#endif /* TARGET_PSK_H_INCLUDED */
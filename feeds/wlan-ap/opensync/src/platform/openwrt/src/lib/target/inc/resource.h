@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_RESOURCE_H_INCLUDED
+#define TARGET_RESOURCE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ev.h>
+
+/*
+ * Device resource telemetry.
+ *
+ * Every RESOURCE_INTERVAL the system CPU, memory and load, and the CPU
+ * time and RSS of every manager in target_managers_config[] are sampled.
+ * The /proc files stay open and are re-read with pread(); a manager's are
+ * reopened when it restarts. Figures are deltas over the last interval.
+ *
+ * The collector runs in WM. The SM device report of this OpenSync
+ * version has no room for these figures, so the latest sample goes out
+ * with the first radio's Wifi_Radio_State hw_params instead, refreshed
+ * by the periodic radio resync. A summary is also logged once per
+ * RESOURCE_REPORT_MS, so a slow AP can be pinned on a manager without
+ * SSH access.
+ */
+
+#define RESOURCE_MAX_MANAGERS   8
+
+struct resource_mgr
+{
+    char            name[16];
+    int             pid;
+    uint32_t        cpu;            /* % of all CPUs over the interval */
+    uint32_t        rss_kb;
+    int32_t         rss_delta_kb;   /* since the previous sample */
+};
+
+struct resource_stats
+{
+    uint32_t        cpu;            /* % busy over the interval */
+    uint32_t        mem_total_kb;
+    uint32_t        mem_avail_kb;
+    uint32_t        mem_pressure;   /* % of memory not available */
+    double          load[3];
+    struct resource_mgr mgr[RESOURCE_MAX_MANAGERS];
+    int             n_mgr;
+};
+
+bool resource_init(struct ev_loop *loop);
+void resource_cleanup(void);
+bool resource_get(struct resource_stats *stats);
+
+#endif /* TARGET_RESOURCE_H_INCLUDED */
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_RRM_H_INCLUDED
+#define TARGET_RRM_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "schema.h"
+
+/*
+ * 802.11k neighbor reports.
+ *
+ * A VIF with rrm set answers neighbor report requests from the list kept
+ * here. The list holds the device's other VIFs with the same SSID and
+ * the same-SSID BSSes in the scan cache of nbr.h. When the controller
+ * names the network's APs ("ft_peer-<n>", see ft.h) only those scanned
+ * BSSes are taken, anything else using the SSID is not ours. Neighbors
+ * are assumed to run the VIF's own security and FT settings.
+ *
+ * Entries go to the running hostapd as SET_NEIGHBOR/REMOVE_NEIGHBOR for
+ * what changed, rechecked every RRM_INTERVAL as channels move and scans
+ * come in, and in full after hostapd restarts.
+ */
+
+#define RRM_MAX_NEIGHBORS   16
+
+bool rrm_init(void);
+void rrm_cleanup(void);
+bool rrm_vif_apply(int ssid_index, const struct schema_Wifi_VIF_Config *vconf);
+int rrm_neighbor_count(const char *ifname);
+void rrm_resync(void);
+
+#endif /* TARGET_RRM_H_INCLUDED */
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_RTNL_H_INCLUDED
+#define TARGET_RTNL_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ev.h>
+#include <net/if.h>
+
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+#include <linux/rtnetlink.h>
+
+/*
+ * rtnetlink link events and a cache of per-netdev static attributes.
+ *
+ * A socket subscribed to RTNLGRP_LINK is attached to the manager's loop.
+ * Link addresses are read from sysfs once per interface and afterwards
+ * only updated from RTM_NEWLINK/RTM_DELLINK events.
+ *
+ * A second socket carries requests. VLAN bridges are set up with all
+ * their links in one batch, so a VIF forwards as soon as the kernel has
+ * acked it instead of after netifd rebuilt the network.
+ */
+
+typedef void (*rtnl_event_cb_t)(struct nlmsghdr *nlh, void *arg);
+
+bool rtnl_init(struct ev_loop *loop);
+void rtnl_cleanup(void);
+bool rtnl_event_register(uint16_t type, rtnl_event_cb_t cb, void *arg);
+
+int rtnl_link_addr(const char *ifname, char *mac, size_t len);
+
+int rtnl_vlan_attach(const char *bridge, const char *lower, int vlan_id,
+                     const char (*ports)[IFNAMSIZ], int num_ports);
+int rtnl_vlan_detach(const char *bridge, const char *lower, int vlan_id);
+
+#endif /* TARGET_RTNL_H_INCLUDED */
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_SAMPLER_H_INCLUDED
+#define TARGET_SAMPLER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <net/if.h>
+
+/*
+ * High resolution client sampling.
+ *
+ * A worker thread polls the station counters of every watched interface
+ * at a sub-second rate, on its own nl80211 socket, and keeps the newest
+ * SAMPLER_RING_SIZE samples of each client in a ring. Min/max/average and
+ * throughput cover the whole report interval through running
+ * accumulators, the RSSI percentiles the samples still in the ring.
+ *
+ * The main loop watches interfaces and takes its client report from the
+ * latest poll at report time, no station dump of its own; reporting a
+ * client restarts its interval. Other users only peek at the latest poll.
+ * Each user watches at its own interval and an interface is polled at the
+ * shortest of them. Interfaces are unwatched when nl80211 deletes them.
+ */
+
+#define SAMPLER_RING_SIZE       128
+#define SAMPLER_DEFAULT_MS      250
+#define SAMPLER_MIN_MS          50
+
+enum sampler_user
+{
+    SAMPLER_USER_STATS = 0,
+    SAMPLER_USER_STEER,
+    SAMPLER_USER_TPC,
+    SAMPLER_USER_MAX,
+};
+
+struct nlattr;
+
+/* One station as the driver last reported it */
+struct sampler_sta
+{
+    uint8_t         mac[6];
+    int             signal;         /* dBm, last frame */
+    int             rssi;           /* dBm, averaged when the driver has it */
+    uint64_t        tx_bytes;
+    uint64_t        rx_bytes;
+    uint32_t        tx_packets;
+    uint32_t        rx_packets;
+    uint32_t        tx_retries;
+    uint32_t        tx_failed;
+    uint32_t        tx_rate;        /* 100 kbit/s */
+    uint32_t        rx_rate;
+    uint64_t        tx_duration_us;
+    uint64_t        rx_duration_us;
+    uint16_t        airtime_weight;
+};
+
+struct sampler_agg
+{
+    uint32_t        samples;
+    int             rssi_min;
+    int             rssi_max;
+    int             rssi_avg;
+    int             rssi_p10;
+    int             rssi_p50;
+    int             rssi_p90;
+    uint64_t        tx_bps_avg;     /* bytes per second */
+    uint64_t        rx_bps_avg;
+    uint64_t        tx_bps_peak;
+    uint64_t        rx_bps_peak;
+    uint32_t        retry_pct;      /* retried out of sent frames */
+};
+
+typedef void sampler_report_cb_t(const struct sampler_sta *sta, const struct sampler_agg *agg, void *arg);
+typedef void sampler_sta_cb_t(const struct sampler_sta *sta, void *arg);
+
+void sampler_cleanup(void);
+bool sampler_watch(const char *ifname, int user, int interval_ms);
+void sampler_unwatch(const char *ifname, int user);
+int sampler_report(const char *ifname, sampler_report_cb_t *cb, void *arg);
+int sampler_peek(const char *ifname, sampler_sta_cb_t *cb, void *arg);
+bool sampler_sta_parse(const uint8_t *mac, struct nlattr *sta_info, struct sampler_sta *sta);
+
+#endif /* TARGET_SAMPLER_H_INCLUDED */
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_SENSOR_H_INCLUDED
+#define TARGET_SENSOR_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <net/if.h>
+
+/*
+ * hwmon temperature sensor registry.
+ *
+ * Sensors are discovered once from /sys/class/hwmon: a sensor whose
+ * device also carries an ieee80211 phy is registered under the phy name,
+ * the others under the hwmon "name". Their temp1_input stays open and is
+ * read with pread(); every read older than SENSOR_MAX_AGE_MS triggers one
+ * pass over all sensors, so a stats round costs one batch of reads.
+ */
+
+#define SENSOR_MAX_AGE_MS   1000
+
+bool sensor_init(void);
+void sensor_cleanup(void);
+int sensor_sample(void);
+bool sensor_temp_get(const char *key, int *millideg);
+
+#endif /* TARGET_SENSOR_H_INCLUDED */
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_SPECTRAL_H_INCLUDED
+#define TARGET_SPECTRAL_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Spectral scan ingestion for ath9k/ath10k radios.
+ *
+ * Radios with the UCI option spectral '1' run the driver's background
+ * spectral scan. The FFT samples are read from the debugfs spectral_scan0
+ * relay in large batches and folded into per-channel accumulators, which
+ * are turned into compact summaries: per-bin power, duty cycle and a
+ * guess at non-Wi-Fi interferers.
+ *
+ * spectral_parse() and spectral_summarize() only work on the buffers and
+ * accumulators they are given, so recorded sample files can be replayed
+ * through them on any host.
+ */
+
+#define SPECTRAL_MAX_BINS   256
+#define SPECTRAL_MAX_CHANS  8
+
+enum spectral_interferer
+{
+    SPECTRAL_INTF_NONE = 0,
+    SPECTRAL_INTF_MICROWAVE,    /* mains-periodic bursts on 2.4 GHz */
+    SPECTRAL_INTF_CONTINUOUS,   /* always-on, non-OFDM: video senders */
+    SPECTRAL_INTF_NARROWBAND,   /* peaky, intermittent: BT, FHSS, Zigbee */
+};
+
+struct spectral_acc
+{
+    /* Linear power per bin, summed over samples: kept first and aligned
+     * so the per-sample loop vectorizes */
+    float           pwr[SPECTRAL_MAX_BINS] __attribute__((aligned(16)));
+    uint32_t        freq;
+    int             n_bins;
+    uint32_t        samples;
+    uint32_t        busy;
+    int64_t         noise_sum;
+    uint64_t        last_busy_tsf;
+    uint64_t        burst_start_tsf;
+    uint64_t        period_sum_us;
+    uint32_t        periods;
+};
+
+struct spectral_summary
+{
+    int             chan;
+    uint32_t        freq;
+    uint32_t        samples;
+    int             noise;          /* dBm */
+    int             avg_power;      /* dBm over the whole channel */
+    int             peak_power;     /* dBm of the strongest bin */
+    int             flatness;       /* dB between strongest and average bin */
+    int             duty;           /* % of samples above the busy threshold */
+    int             period_ms;      /* burst repetition, 0 if none */
+    enum spectral_interferer interferer;
+};
+
+size_t spectral_parse(const uint8_t *buf, size_t len, struct spectral_acc *acc, int n_acc);
+bool spectral_summarize(const struct spectral_acc *acc, struct spectral_summary *sum);
+const char *spectral_interferer_str(enum spectral_interferer intf);
+
+bool spectral_init(void);
+void spectral_cleanup(void);
+int spectral_get(int radioIndex, struct spectral_summary *sum, int max);
+
+#endif /* TARGET_SPECTRAL_H_INCLUDED */
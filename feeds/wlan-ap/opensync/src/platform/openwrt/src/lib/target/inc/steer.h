@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_STEER_H_INCLUDED
+#define TARGET_STEER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <net/if.h>
+#include <ev.h>
+
+/*
+ * Band steering backend for BM, bsal.c maps the BSAL target API onto it
+ * call for call.
+ *
+ * Every steered interface gets an ATTACHed hostapd control socket on the
+ * manager's loop. Probe requests, associations, disassociations and BSS
+ * transition responses are turned into events straight from the io
+ * callback. A restarted hostapd leaves the old socket silent rather than
+ * failing it, the attach task compares the control socket's inode and
+ * reattaches.
+ *
+ * A client is kept off an interface by putting it on that BSS's deny
+ * list, either for good (blocked) or while its RSSI sits outside the
+ * configured window, re-evaluated with every probe request. The deny
+ * list only rejects authentication, hostapd still answers the client's
+ * probes. Blocks are lifted when the client config goes away and at
+ * cleanup. hostapd reports nothing on its control socket when it rejects
+ * an authentication, so there is no auth failure event.
+ *
+ * Associated clients are evaluated every inact_check_sec from the
+ * sampler's latest poll: ACTIVITY when the traffic counters start or stop
+ * moving for inact_tmout_sec, RSSI_XING when the signal crosses one of
+ * the inact/high/low thresholds between two polls.
+ *
+ * RSSI values are in dBm, 0 disables a threshold.
+ */
+
+#define STEER_MAX_NEIGHBORS     8
+
+enum steer_band
+{
+    STEER_BAND_24G = 0,
+    STEER_BAND_5G,
+};
+
+enum steer_event_type
+{
+    STEER_EVENT_PROBE_REQ = 0,
+    STEER_EVENT_CONNECT,
+    STEER_EVENT_DISCONNECT,
+    STEER_EVENT_RSSI,
+    STEER_EVENT_BTM_RESP,
+    STEER_EVENT_ACTIVITY,
+    STEER_EVENT_RSSI_XING,
+};
+
+enum steer_xing
+{
+    STEER_XING_NONE = 0,
+    STEER_XING_HIGHER,
+    STEER_XING_LOWER,
+};
+
+enum steer_kick
+{
+    STEER_KICK_DEAUTH = 0,
+    STEER_KICK_DISASSOC,
+};
+
+struct steer_event
+{
+    int         type;
+    char        ifname[IFNAMSIZ];
+    int         band;
+    char        mac[18];
+    int         rssi;           /* PROBE_REQ, RSSI, RSSI_XING */
+    bool        active;         /* ACTIVITY */
+    int         inact_xing;     /* RSSI_XING, enum steer_xing */
+    int         high_xing;
+    int         low_xing;
+    int         status;         /* BTM_RESP status code */
+    int         dialog_token;   /* BTM_RESP */
+    int         term_delay;     /* BTM_RESP, minutes */
+    char        target_bssid[18];   /* BTM_RESP, empty when the client named none */
+};
+
+typedef void steer_event_cb_t(const struct steer_event *event);
+
+struct steer_client_cfg
+{
+    int         probe_hwm;      /* keep away at or above this, too close for this band */
+    int         probe_lwm;      /* keep away below this */
+    int         auth_hwm;
+    int         auth_lwm;
+    bool        blocked;        /* keep away regardless of RSSI */
+    int         inact_xing;     /* override the interface's, 0 keeps it */
+    int         high_xing;
+    int         low_xing;
+};
+
+struct steer_iface_cfg
+{
+    int         inact_check_sec;    /* 0 disables activity and crossing events */
+    int         inact_tmout_sec;    /* 0 never turns a client inactive */
+    int         inact_xing;
+    int         high_xing;
+    int         low_xing;
+};
+
+struct steer_neighbor
+{
+    char        bssid[18];
+    uint32_t    bssid_info;
+    int         op_class;
+    int         channel;
+    int         phy_type;
+};
+
+struct steer_btm
+{
+    struct steer_neighbor   neighbors[STEER_MAX_NEIGHBORS];
+    int                     n_neighbors;
+    int                     valid_int;          /* beacon intervals */
+    int                     disassoc_timer;     /* beacon intervals, 0 for none */
+    bool                    disassoc_imminent;
+    bool                    abridged;
+};
+
+struct steer_client_info
+{
+    bool        connected;
+    int         rssi;
+    uint64_t    rx_bytes;
+    uint64_t    tx_bytes;
+};
+
+bool steer_init(struct ev_loop *loop);
+void steer_cleanup(void);
+void steer_event_cb_set(steer_event_cb_t *cb);
+
+bool steer_iface_add(const char *ifname, int band, const struct steer_iface_cfg *cfg);
+bool steer_iface_remove(const char *ifname);
+
+bool steer_client_set(const char *ifname, const char *mac, const struct steer_client_cfg *cfg);
+bool steer_client_remove(const char *ifname, const char *mac);
+bool steer_client_measure(const char *ifname, const char *mac);
+bool steer_client_rssi(const char *ifname, const char *mac, int *rssi);
+bool steer_client_info(const char *ifname, const char *mac, struct steer_client_info *info);
+bool steer_client_kick(const char *ifname, const char *mac, int type, int reason);
+bool steer_btm_request(const char *ifname, const char *mac, const struct steer_btm *btm);
+
+#endif /* TARGET_STEER_H_INCLUDED */
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "dpp_client.h"
 #include "dpp_survey.h"
+#include "dpp_capacity.h"
 
 #define TARGET_CERT_PATH            "/var/run/openvswitch/certs"
 #define TARGET_MANAGERS_PID_PATH    "/tmp/dmpid"
@@ -39,6 +40,19 @@ typedef struct
 {
     DPP_TARGET_CLIENT_RECORD_COMMON_STRUCT;
     dpp_client_stats_t  stats;
+    uint64_t            airtime_tx_us;  /* cumulative, from mac80211 */
+    uint64_t            airtime_rx_us;
+    int                 airtime_weight;
+    int32_t             rssi_min;       /* from the sampler, see sampler.h */
+    int32_t             rssi_max;
+    int32_t             rssi_p10;
+    int32_t             rssi_p50;
+    int32_t             rssi_p90;
+    uint64_t            tx_bps_peak;
+    uint64_t            rx_bps_peak;
+    uint32_t            retry_pct;
+    uint32_t            samples;
+    int                 vlan_id;        /* VIF or RADIUS assigned, 0 if none */
 } target_client_record_t;
 
 typedef struct
@@ -46,7 +60,20 @@ typedef struct
     DPP_TARGET_SURVEY_RECORD_COMMON_STRUCT;
 } target_survey_record_t;
 
-typedef void target_capacity_data_t;
+/*
+ * Cumulative counters, target_stats_capacity_convert() turns them into
+ * deltas. Traffic counters are running sums of per-station deltas.
+ */
+typedef struct
+{
+    uint64_t    chan_active;                    /* ms on channel */
+    uint64_t    chan_tx;                        /* ms spent transmitting */
+    uint64_t    bytes_tx;
+    uint64_t    queue_bytes[RADIO_QUEUE_MAX_QTY];
+    uint64_t    queue_frames[RADIO_QUEUE_MAX_QTY];
+    uint32_t    backlog_bytes[RADIO_QUEUE_MAX_QTY];  /* queued at sample time */
+    uint32_t    backlog_frames[RADIO_QUEUE_MAX_QTY];
+} target_capacity_data_t;
 
 /******************************************************************************
  *  MANAGERS definitions
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_THERMAL_H_INCLUDED
+#define TARGET_THERMAL_H_INCLUDED
+
+#include <stdbool.h>
+
+/*
+ * Thermal mitigation.
+ *
+ * Radios with a temperature sensor and the UCI option thermal_mode left
+ * at "auto" are stepped through mitigation levels while they run hot:
+ *
+ *   1  tx power lowered by THERMAL_TXPOWER_STEP_DB
+ *   2  channel width halved with a channel switch announcement
+ *   3  tx duty cycle limited through the driver's cooling device
+ *
+ * Level n is entered at thermal_limit + (n - 1) * THERMAL_STEP_C degrees
+ * and left again THERMAL_HYST_C below that. Levels move one at a time and
+ * are undone in reverse order, so the configuration comes back as it was.
+ * The level is the highest step actually in effect: a step with nothing
+ * to shed is passed over, one that fails is retried after the holdoff,
+ * and a radio restart that brings the full width back drops level 2.
+ *
+ * Shedding tx chains is not a step, mac80211 refuses new antenna masks
+ * while the radio is up.
+ */
+
+#define THERMAL_DEFAULT_LIMIT_C     100
+#define THERMAL_STEP_C              5
+#define THERMAL_HYST_C              5
+#define THERMAL_TXPOWER_STEP_DB     6
+
+enum thermal_level
+{
+    THERMAL_LEVEL_NONE = 0,
+    THERMAL_LEVEL_TXPOWER,
+    THERMAL_LEVEL_WIDTH,
+    THERMAL_LEVEL_DUTY,
+    THERMAL_LEVEL_MAX = THERMAL_LEVEL_DUTY,
+};
+
+struct thermal_state
+{
+    int     level;
+    int     temp;           /* degrees C, last reading */
+    int     max_temp;
+    int     changes;
+};
+
+bool thermal_init(void);
+void thermal_cleanup(void);
+bool thermal_get(int radioIndex, struct thermal_state *state);
+int thermal_level(int radioIndex);
+int thermal_max_width(int radioIndex);
+
+#endif /* TARGET_THERMAL_H_INCLUDED */
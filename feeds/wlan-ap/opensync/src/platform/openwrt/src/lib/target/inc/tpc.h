@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_TPC_H_INCLUDED
+#define TARGET_TPC_H_INCLUDED
+
+#include <stdbool.h>
+
+/*
+ * Transmit power control.
+ *
+ * Radios with the UCI option tpc_mode set to "auto" get their tx power
+ * adjusted at runtime with NL80211_CMD_SET_WIPHY. Power is lowered while
+ * same-SSID APs are heard loudly on the channel and every client still
+ * has margin, and raised again when cell-edge clients show up. The
+ * configured tx_power stays the upper bound. Client RSSI is peeked from
+ * the sampler's polls and neighbors from the scan cache, a round does no
+ * driver dump of its own.
+ */
+
+struct tpc_metrics
+{
+    int     txpower;        /* dBm currently applied, 0 if untouched */
+    int     max_txpower;
+    int     dense_aps;      /* same-SSID APs above the density threshold */
+    int     clients;
+    int     edge_clients;   /* clients below the cell edge RSSI */
+    int     weakest_rssi;   /* 10th percentile client RSSI */
+    int     changes;
+};
+
+bool tpc_init(void);
+void tpc_cleanup(void);
+bool tpc_get(int radioIndex, struct tpc_metrics *metrics);
+bool tpc_restore_txpower(int radioIndex);
+
+#endif /* TARGET_TPC_H_INCLUDED */
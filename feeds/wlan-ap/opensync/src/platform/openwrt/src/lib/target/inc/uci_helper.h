@@ -26,6 +26,21 @@
         } \
 })
 
+struct uci_vif_batch
+{
+    struct uci_context  *ctx;
+    struct uci_ptr      ptr;        /* the wifi-iface section */
+    int                 ssid_index;
+    bool                changed;
+    bool                failed;
+};
+
+bool uci_vif_batch_open(struct uci_vif_batch *b, int ssid_index);
+void uci_vif_batch_set(struct uci_vif_batch *b, const char *option, const char *value);
+void uci_vif_batch_list(struct uci_vif_batch *b, const char *option,
+                        const char *const *values, int n);
+bool uci_vif_batch_commit(struct uci_vif_batch *b);
+
 #define UCI_BUFFER_SIZE 80
 #define DEFAULT_ENC_MODE        "TKIPandAESEncryption"
 #define UCI_MAX_RADIOS 4
@@ -79,6 +94,16 @@ int wifi_getRadioBeaconInterval(int radio_idx, int *beacon_int);
 int wifi_getRadioFreqBand(int *allowedChannels, int numberOfChannels, char *freq_band);
 int wifi_getRadioHtMode(int radio_idx, char *ht_mode);
 int wifi_getRadioHwMode(int radio_idx, char *hw_mode);
+int wifi_getRadioPhyName(int radio_idx, char *phy, size_t phy_len);
+int wifi_getRadioIndexByPhy(const char *phy, int *radio_idx);
+int wifi_getRadioAcsMode(int radio_idx, char *mode, size_t mode_len);
+int wifi_getRadioTpcMode(int radio_idx, char *mode, size_t mode_len);
+int wifi_getRadioSpectralEnable(int radio_idx, bool *enabled);
+int wifi_getRadioClientSampleMs(int radio_idx, int *ms);
+int wifi_getRadioThermalMode(int radio_idx, char *mode, size_t mode_len);
+int wifi_getRadioThermalLimit(int radio_idx, int *celsius);
+int wifi_getRadioGreenIdle(int radio_idx, int *seconds);
+int wifi_getRadioGreenTxPower(int radio_idx, int *db);
 int wifi_getTxChainMask(int radioIndex, int *txChainMask);
 int wifi_getRadioAllowedChannel(int radioIndex, int *allowedChannelList, int *allowedChannelListLen);
 int wifi_getRadioMacaddress(int radio_idx, char *mac);
@@ -110,6 +135,12 @@ bool wifi_getApSecurityModeEnabled(int ssid_index, char *buf, size_t buf_len);
 bool wifi_getApSecurityRadiusServer(int ssid_index, char *radius_ip, char *radius_port, char *radius_secret);
 bool wifi_setFtMode(int ssid_index, const struct schema_Wifi_VIF_Config *vconf);
 bool wifi_getApVlanId(int ssidIndex, int *vlan_id);
+int wifi_getApAirtimeWeight(int ssid_index, const char *mac, int *weight);
+uint32_t wifi_getApAirtimeHash(int ssid_index);
+int wifi_getApWpaPskFile(int ssid_index, char *buf, size_t buf_len);
+int wifi_getApMacFilter(int ssid_index, char *buf, size_t buf_len);
+int wifi_getNeighborReportActivation(int ssid_index, bool *activate);
+int wifi_getBSSTransitionActivation(int ssid_index, bool *activate);
 
 /*
  *  Functions to set SSID parameters
@@ -120,7 +151,14 @@ bool wifi_setApSsidAdvertisementEnable(int ssid_index, bool enabled);
 bool wifi_setApIsolationEnable(int ssid_index, bool enabled);
 bool wifi_setSsidEnabled(int ssid_index, bool enabled);
 bool wifi_setApBridgeInfo(int ssid_index, char *bridge_info);
-bool wifi_setApVlanNetwork(int ssid_index, int vlan_id);
+bool wifi_setApWpaPskFile(int ssid_index, const char *path);
+bool wifi_setApMacFilter(int ssid_index, const char *filter, const char *file);
+bool wifi_setApRrmBtm(int ssid_index, bool rrm, bool btm);
+
+/*
+ *  Radio functions
+ */
+bool radio_channel_switch(int radioIndex, int channel, const char *ht_mode);
 
 /*
  * Functions to access OVSDB callbacks
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_VLAN_H_INCLUDED
+#define TARGET_VLAN_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * VLAN network provisioning.
+ *
+ * Every VLAN a VIF is put on gets a "vlan<id>" bridge interface in the
+ * network package (and a switch_vlan on boards with a switch). The
+ * provisioned VLANs live in a bitmap and carry a reference count of the
+ * VIFs using them. Changes are only recorded when they are asked for and
+ * written out together, network and wireless in one commit each, shortly
+ * after the burst of VIF updates is over. VLANs no VIF refers to any more
+ * are removed in the same pass.
+ *
+ * VLAN 1 and 2 are the board's lan and wan and never provisioned.
+ *
+ * RADIUS assigned VLANs (hostapd dynamic_vlan) show up as AP_VLAN
+ * interfaces named <vif>.<vid>. Their bridge and tagged uplink are set
+ * up over rtnetlink when the first one appears and taken down with the
+ * last, unless a static VLAN still holds them. They never reach UCI.
+ */
+
+#define VLAN_ID_MAX         4095
+#define VLAN_ID_MIN_PROV    3
+#define VLAN_BRIDGE_PREFIX  "br-vlan"
+
+bool vlan_init(void);
+void vlan_cleanup(void);
+bool vlan_vif_set(int ssid_index, int vlan_id);
+void vlan_flush(void);
+int vlan_count(void);
+const char *vlan_uplink(void);
+int vlan_ap_vlan_parse(const char *ifname, char *parent, size_t len);
+
+#endif /* TARGET_VLAN_H_INCLUDED */
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TARGET_WORKER_H_INCLUDED
+#define TARGET_WORKER_H_INCLUDED
+
+#include <stdbool.h>
+#include <ev.h>
+
+/*
+ * Worker pool for blocking target operations.
+ *
+ * Jobs run on one of WORKER_THREADS threads, in no particular order. The
+ * optional done callback runs afterwards on the manager's loop: finished
+ * jobs are pushed to a lock-free list and the loop is woken through an
+ * ev_async. Jobs must not touch UCI, nl80211 or OVSDB state owned by the
+ * loop; they get everything they need through arg. Jobs run external
+ * commands with worker_exec(), which returns their exit status or -1, or
+ * with worker_exec_out() to collect their output in a file.
+ *
+ * worker_init() also starts a loop stall monitor: time spent between two
+ * polls of the loop is tracked and summarized in the log.
+ */
+
+#define WORKER_THREADS          2
+
+typedef void (*worker_fn_t)(void *arg);
+
+bool worker_init(struct ev_loop *loop);
+void worker_cleanup(void);
+bool worker_submit(worker_fn_t fn, worker_fn_t done, void *arg);
+int worker_exec(char *const argv[]);
+
+/*
+ * Ordering of hostapd pushes against reloads. reload_config runs on a
+ * worker, while psk, acl, ft and rrm push hostapd commands straight from
+ * the loop. A push made while a reload is queued or running may go to an
+ * instance the reload is about to replace, and the replacement may have
+ * read its files before they were rewritten. The rule: push right away,
+ * then once the last queued reload finished, the done hook re-syncs the
+ * instance now running from the pushers' own state.
+ */
+bool worker_reload_config(void);
+void worker_reload_done_set(worker_fn_t fn, void *arg);
+int worker_exec_out(char *const argv[], const char *path);
+
+#endif /* TARGET_WORKER_H_INCLUDED */
@@ -24,6 +24,9 @@
 
 $(info xxx $(OVERRIDE_DIR))
 UNIT_CFLAGS  += -I$(OVERRIDE_DIR)/inc
+UNIT_CFLAGS  += -I$(STAGING_DIR)/usr/include/libnl-tiny
+# nl80211.h from the mac80211 backport, the kernel's own lacks TXQ stats
+UNIT_CFLAGS  += -I$(STAGING_DIR)/usr/include/mac80211/uapi
 
 UNIT_EXPORT_CFLAGS := $(UNIT_CFLAGS)
 
@@ -33,6 +36,28 @@ UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/stats.c
 UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/uci_helper.c
 UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/target.c
 UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/vif.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/nl80211.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/phy.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/hostapd.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/nbr.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/acs.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/tpc.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/spectral.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/airtime.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/sampler.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/worker.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/rtnl.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/sensor.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/resource.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/thermal.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/green.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/vlan.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/psk.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/ft.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/acl.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/steer.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/bsal.c
+UNIT_SRC_TOP += $(OVERRIDE_DIR)/src/rrm.c
 
 CONFIG_USE_KCONFIG=y
 CONFIG_INET_ETH_LINUX=y
@@ -50,5 +75,8 @@ UNIT_SRC := $(filter-out src/target_dhcp.c,$(UNIT_SRC))
 UNIT_DEPS := $(filter-out src/lib/inet,$(UNIT_DEPS))
 UNIT_DEPS += src/lib/evsched
 UNIT_LDFLAGS += -luci
-UNIT_LDFLAGS += -libiwinfo
+UNIT_LDFLAGS += -lnl-tiny
+UNIT_LDFLAGS += -lm
+UNIT_LDFLAGS += -lpthread
+UNIT_EXPORT_LDFLAGS := $(UNIT_LDFLAGS)
 UNIT_DEPS_CFLAGS += src/lib/inet
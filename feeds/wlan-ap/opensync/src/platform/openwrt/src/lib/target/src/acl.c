@@ -0,0 +1,453 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "acl.h"
+
+#define MAC_STR_LEN     18
+
+struct acl_mac
+{
+    char            mac[MAC_STR_LEN];
+    bool            seen;
+    bool            fresh;          /* not known to hostapd yet */
+    ds_tree_node_t  node;
+};
+
+struct acl_vif
+{
+    char            ifname[IFNAMSIZ];
+    int             policy;
+    ds_tree_t       macs;
+    int             count;
+    ino_t           ctrl_ino;       /* hostapd instance last updated */
+    ds_tree_node_t  node;
+};
+
+static c_item_t map_acl_modes[] =
+{
+    C_ITEM_STR(ACL_POLICY_NONE,         "none"),
+    C_ITEM_STR(ACL_POLICY_WHITELIST,    "whitelist"),
+    C_ITEM_STR(ACL_POLICY_BLACKLIST,    "blacklist"),
+};
+
+/* The wireless "macfilter" values */
+static c_item_t map_acl_uci[] =
+{
+    C_ITEM_STR(ACL_POLICY_NONE,         "disable"),
+    C_ITEM_STR(ACL_POLICY_WHITELIST,    "allow"),
+    C_ITEM_STR(ACL_POLICY_BLACKLIST,    "deny"),
+};
+
+static ds_tree_t acl_vif_tree = DS_TREE_INIT(ds_str_cmp, struct acl_vif, node);
+
+static bool acl_mac_parse(const char *str, char *mac, size_t len)
+{
+    unsigned int b[6];
+    char end;
+
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x%c",
+               &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &end) != 6)
+        return false;
+
+    snprintf(mac, len, "%02x:%02x:%02x:%02x:%02x:%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+
+    return true;
+}
+
+static struct acl_mac *acl_mac_add(struct acl_vif *vif, const char *mac)
+{
+    struct acl_mac *entry;
+
+    entry = ds_tree_find(&vif->macs, (void *)mac);
+    if (entry)
+        return entry;
+
+    entry = calloc(1, sizeof(*entry));
+    if (!entry)
+        return NULL;
+
+    STRSCPY(entry->mac, mac);
+    entry->fresh = true;
+    ds_tree_insert(&vif->macs, entry, entry->mac);
+    vif->count++;
+
+    return entry;
+}
+
+static void acl_macs_free(struct acl_vif *vif)
+{
+    struct acl_mac *entry;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&vif->macs, entry, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(entry);
+    }
+
+    vif->count = 0;
+}
+
+static int acl_policy_get(int ssid_index)
+{
+    char buf[16];
+    c_item_t *citem;
+
+    memset(buf, 0, sizeof(buf));
+    if (UCI_OK != wifi_getApMacFilter(ssid_index, buf, sizeof(buf) - 1))
+        return ACL_POLICY_NONE;
+
+    citem = c_get_item_by_str(map_acl_uci, buf);
+
+    return citem ? (int)citem->key : ACL_POLICY_NONE;
+}
+
+/*
+ * What hostapd runs with: the policy from UCI and the list from the file
+ * it was started with, which is kept in sync below.
+ */
+static struct acl_vif *acl_vif_load(int ssid_index, const char *ifname)
+{
+    struct acl_mac *entry;
+    struct acl_vif *vif;
+    char path[64];
+    char line[64];
+    char mac[MAC_STR_LEN];
+    FILE *f;
+
+    vif = calloc(1, sizeof(*vif));
+    if (!vif)
+        return NULL;
+
+    STRSCPY(vif->ifname, ifname);
+    ds_tree_init(&vif->macs, ds_str_cmp, struct acl_mac, node);
+    ds_tree_insert(&acl_vif_tree, vif, vif->ifname);
+
+    vif->policy = acl_policy_get(ssid_index);
+    if (vif->policy == ACL_POLICY_NONE)
+        return vif;
+
+    snprintf(path, sizeof(path), ACL_FILE_FMT, ifname);
+    f = fopen(path, "r");
+    if (!f)
+        return vif;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!acl_mac_parse(line, mac, sizeof(mac)))
+            continue;
+        entry = acl_mac_add(vif, mac);
+        if (entry)
+            entry->fresh = false;
+    }
+    fclose(f);
+
+    LOGD("%s: acl: %d entries restored", ifname, vif->count);
+
+    return vif;
+}
+
+static bool acl_file_write(struct acl_vif *vif)
+{
+    struct acl_mac *entry;
+    char path[64];
+    char tmp[80];
+    FILE *f;
+    int fd;
+
+    snprintf(path, sizeof(path), ACL_FILE_FMT, vif->ifname);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !(f = fdopen(fd, "w")))
+    {
+        LOGE("%s: acl: can't open %s: %s", vif->ifname, tmp, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    ds_tree_foreach(&vif->macs, entry)
+        fprintf(f, "%s\n", entry->mac);
+
+    if (fclose(f) || rename(tmp, path))
+    {
+        LOGE("%s: acl: failed to write %s: %s", vif->ifname, path, strerror(errno));
+        unlink(tmp);
+        return false;
+    }
+
+    return true;
+}
+
+/* Disconnect a client that just lost access, if it is there at all */
+static void acl_kick(const char *ifname, const char *mac)
+{
+    char cmd[64];
+    char reply[64];
+
+    snprintf(cmd, sizeof(cmd), "STA %s", mac);
+    if (hostapd_cli(ifname, cmd, reply, sizeof(reply)) <= 0 || strncmp(reply, mac, strlen(mac)))
+        return;
+
+    snprintf(cmd, sizeof(cmd), "DEAUTHENTICATE %s", mac);
+    if (hostapd_cli_ok(ifname, cmd))
+        LOGI("%s: acl: %s kicked", ifname, mac);
+}
+
+static const char *acl_list(const struct acl_vif *vif)
+{
+    return vif->policy == ACL_POLICY_WHITELIST ? "ACCEPT_ACL" : "DENY_ACL";
+}
+
+static void acl_update(struct acl_vif *vif, const char *mac, bool add)
+{
+    char cmd[64];
+
+    vif->ctrl_ino = hostapd_ctrl_ino(vif->ifname);
+
+    snprintf(cmd, sizeof(cmd), "%s %s %s", acl_list(vif), add ? "ADD_MAC" : "DEL_MAC", mac);
+    if (!hostapd_cli_ok(vif->ifname, cmd))
+    {
+        /* Not running, it reads the file when it comes up */
+        LOGD("%s: acl: %s failed", vif->ifname, cmd);
+        return;
+    }
+
+    if (add == (vif->policy == ACL_POLICY_BLACKLIST))
+        acl_kick(vif->ifname, mac);
+}
+
+bool acl_vif_apply(int ssid_index, const struct schema_Wifi_VIF_Config *vconf)
+{
+    struct acl_mac *entry;
+    struct acl_vif *vif;
+    ds_tree_iter_t iter;
+    c_item_t *citem;
+    char mac[MAC_STR_LEN];
+    char path[64];
+    int policy = ACL_POLICY_NONE;
+    int removed = 0;
+    int added = 0;
+    int i;
+
+    if (vconf->mac_list_type_exists)
+    {
+        if (!(citem = c_get_item_by_str(map_acl_modes, vconf->mac_list_type)))
+        {
+            LOGE("%s: acl: unknown mac_list_type '%s'", vconf->if_name, vconf->mac_list_type);
+            return false;
+        }
+        policy = (int)citem->key;
+    }
+
+    vif = ds_tree_find(&acl_vif_tree, (void *)vconf->if_name);
+    if (!vif)
+        vif = acl_vif_load(ssid_index, vconf->if_name);
+    if (!vif)
+        return false;
+
+    snprintf(path, sizeof(path), ACL_FILE_FMT, vif->ifname);
+
+    if (policy == ACL_POLICY_NONE)
+    {
+        if (vif->policy == ACL_POLICY_NONE)
+            return true;
+
+        acl_macs_free(vif);
+        vif->policy = ACL_POLICY_NONE;
+        unlink(path);
+        LOGI("%s: acl: disabled", vif->ifname);
+
+        return wifi_setApMacFilter(ssid_index, NULL, NULL);
+    }
+
+    ds_tree_foreach(&vif->macs, entry)
+        entry->seen = false;
+
+    for (i = 0; i < vconf->mac_list_len; i++)
+    {
+        if (!acl_mac_parse(vconf->mac_list[i], mac, sizeof(mac)))
+        {
+            LOGW("%s: acl: malformed MAC '%s'", vif->ifname, vconf->mac_list[i]);
+            continue;
+        }
+
+        entry = acl_mac_add(vif, mac);
+        if (entry)
+            entry->seen = true;
+    }
+
+    /* A new policy means a new hostapd, it takes the whole file */
+    if (policy != vif->policy)
+    {
+        ds_tree_foreach_iter(&vif->macs, entry, &iter)
+        {
+            if (entry->seen)
+            {
+                entry->fresh = false;
+                continue;
+            }
+            ds_tree_iremove(&iter);
+            free(entry);
+            vif->count--;
+        }
+
+        vif->policy = policy;
+        if (!acl_file_write(vif))
+            return false;
+
+        LOGI("%s: acl: %s with %d entries", vif->ifname,
+             c_get_str_by_key(map_acl_modes, policy), vif->count);
+
+        return wifi_setApMacFilter(ssid_index, c_get_str_by_key(map_acl_uci, policy), path);
+    }
+
+    ds_tree_foreach_iter(&vif->macs, entry, &iter)
+    {
+        if (entry->fresh)
+        {
+            acl_update(vif, entry->mac, true);
+            entry->fresh = false;
+            added++;
+            continue;
+        }
+
+        if (entry->seen)
+            continue;
+
+        acl_update(vif, entry->mac, false);
+        ds_tree_iremove(&iter);
+        free(entry);
+        vif->count--;
+        removed++;
+    }
+
+    if (!added && !removed)
+        return true;
+
+    LOGI("%s: acl: %d entries (+%d -%d)", vif->ifname, vif->count, added, removed);
+
+    return acl_file_write(vif);
+}
+
+bool acl_vif_state(int ssid_index, struct schema_Wifi_VIF_State *vstate)
+{
+    struct acl_mac *entry;
+    struct acl_vif *vif;
+    int max = ARRAY_SIZE(vstate->mac_list);
+    int i = 0;
+
+    vif = ds_tree_find(&acl_vif_tree, vstate->if_name);
+    if (!vif)
+        vif = acl_vif_load(ssid_index, vstate->if_name);
+    if (!vif)
+        return false;
+
+    STRSCPY(vstate->mac_list_type, c_get_str_by_key(map_acl_modes, vif->policy));
+    vstate->mac_list_type_exists = true;
+
+    ds_tree_foreach(&vif->macs, entry)
+    {
+        if (i >= max)
+        {
+            LOGW("%s: acl: only %d of %d entries reported", vif->ifname, max, vif->count);
+            break;
+        }
+        STRSCPY(vstate->mac_list[i], entry->mac);
+        i++;
+    }
+    vstate->mac_list_len = i;
+
+    return true;
+}
+
+/*
+ * Brings an instance that started while updates were going out in line
+ * with the set: its list comes from whichever file it read, SHOW tells
+ * which. Addresses are listed as "<mac> VLAN_ID=<n>".
+ */
+static void acl_vif_resync(struct acl_vif *vif)
+{
+    struct acl_mac *entry;
+    char reply[4096];
+    char mac[MAC_STR_LEN];
+    char cmd[32];
+    char *line;
+    char *save;
+    ino_t ino;
+
+    ino = hostapd_ctrl_ino(vif->ifname);
+    if (vif->policy == ACL_POLICY_NONE || !ino || ino == vif->ctrl_ino)
+        return;
+
+    snprintf(cmd, sizeof(cmd), "%s SHOW", acl_list(vif));
+    if (hostapd_cli(vif->ifname, cmd, reply, sizeof(reply)) < 0)
+        return;
+
+    ds_tree_foreach(&vif->macs, entry)
+        entry->seen = false;
+
+    for (line = strtok_r(reply, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        line[strcspn(line, " ")] = '\0';
+        if (!acl_mac_parse(line, mac, sizeof(mac)))
+            continue;
+
+        entry = ds_tree_find(&vif->macs, mac);
+        if (entry)
+            entry->seen = true;
+        else
+            acl_update(vif, mac, false);
+    }
+
+    ds_tree_foreach(&vif->macs, entry)
+        if (!entry->seen)
+            acl_update(vif, entry->mac, true);
+
+    vif->ctrl_ino = ino;
+}
+
+void acl_resync(void)
+{
+    struct acl_vif *vif;
+
+    ds_tree_foreach(&acl_vif_tree, vif)
+        acl_vif_resync(vif);
+}
+
+int acl_vif_count(const char *ifname)
+{
+    struct acl_vif *vif;
+
+    vif = ds_tree_find(&acl_vif_tree, (void *)ifname);
+
+    return vif ? vif->count : 0;
+}
+
+void acl_cleanup(void)
+{
+    struct acl_vif *vif;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&acl_vif_tree, vif, &iter)
+    {
+        ds_tree_iremove(&iter);
+        acl_macs_free(vif);
+        free(vif);
+    }
+}
@@ -0,0 +1,519 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "log.h"
+#include "const.h"
+#include "evsched.h"
+#include "os_time.h"
+#include "uci_helper.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "nbr.h"
+#include "acs.h"
+#include "thermal.h"
+
+#define ACS_INTERVAL            EVSCHED_SEC(60)
+/* A better channel must beat the current one by this much, in % ... */
+#define ACS_HYSTERESIS_PCT      25
+/* ... and by at least this many points */
+#define ACS_MIN_GAIN            10
+/* Rounds a recommendation must hold before it is applied */
+#define ACS_STABLE_ROUNDS       3
+/* Minimum time between two automatic switches */
+#define ACS_HOLDOFF_MS          (30 * 60 * 1000)
+/* Channels that still need a CAC cost this much more */
+#define ACS_CAC_PENALTY         20
+
+struct acs_radio
+{
+    char                phy[IFNAMSIZ];
+    struct wifi_survey  prev[PHY_MAX_CHANNELS];
+    int                 n_prev;
+    struct acs_result   res;
+    bool                valid;
+    int                 stable;
+    int64_t             last_switch;
+};
+
+static struct acs_radio g_acs[UCI_MAX_RADIOS];
+static bool acs_running = false;
+
+/******************************************************************************
+ *  Scoring
+ *****************************************************************************/
+
+int acs_chan_cost(const struct acs_chan *c)
+{
+    int cost;
+
+    cost = c->busy + c->nbr_cost + c->bss_load / 2;
+    if (c->needs_cac)
+        cost += ACS_CAC_PENALTY;
+
+    return cost > 100 ? 100 : cost;
+}
+
+static const struct acs_chan *acs_chan_find(const struct acs_chan *chans, int n, int chan)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (chans[i].chan == chan)
+            return &chans[i];
+    }
+
+    return NULL;
+}
+
+/* First 20 MHz channel of the block of the given width holding primary */
+static int acs_block_start(int primary, int width)
+{
+    int span = width / 5;
+    int base;
+
+    if (primary <= 14)
+        return primary;
+
+    if (width == 160)
+        base = 36;
+    else
+        base = primary >= 149 ? 149 : 36;
+
+    return base + (primary - base) / span * span;
+}
+
+/*
+ * Expected capacity of a primary channel at a given width: the free air
+ * time averaged over the bonded channels, scaled by the width. Returns -1
+ * if the block is not usable.
+ */
+int acs_score(const struct acs_chan *chans, int n, int primary, int width)
+{
+    const struct acs_chan *c;
+    int start;
+    int num;
+    int cost = 0;
+    int i;
+
+    if (primary <= 14)
+    {
+        if (width > 40)
+            return -1;
+
+        c = acs_chan_find(chans, n, primary);
+        if (!c || c->excluded)
+            return -1;
+
+        cost = acs_chan_cost(c);
+        if (width == 40)
+        {
+            c = acs_chan_find(chans, n, primary <= 7 ? primary + 4 : primary - 4);
+            if (!c || c->excluded)
+                return -1;
+            cost = (cost + acs_chan_cost(c)) / 2;
+        }
+
+        return width / 20 * (100 - cost);
+    }
+
+    start = acs_block_start(primary, width);
+    num = width / 20;
+
+    for (i = 0; i < num; i++)
+    {
+        c = acs_chan_find(chans, n, start + i * 4);
+        if (!c || c->excluded)
+            return -1;
+        cost += acs_chan_cost(c);
+    }
+
+    return num * (100 - cost / num);
+}
+
+static bool acs_block_needs_cac(const struct acs_chan *chans, int n, int primary, int width)
+{
+    const struct acs_chan *c;
+    int start;
+    int i;
+
+    if (primary <= 14)
+        return false;
+
+    start = acs_block_start(primary, width);
+    for (i = 0; i < width / 20; i++)
+    {
+        c = acs_chan_find(chans, n, start + i * 4);
+        if (c && c->needs_cac)
+            return true;
+    }
+
+    return false;
+}
+
+bool acs_select(
+        const struct acs_chan *chans,
+        int n,
+        int cur_chan,
+        int cur_width,
+        int max_width,
+        struct acs_result *res)
+{
+    static const int widths[] = { 20, 40, 80, 160 };
+    bool non_overlapping = false;
+    unsigned int w;
+    int score;
+    int gain;
+    int i;
+
+    memset(res, 0, sizeof(*res));
+    res->score = -1;
+
+    /* On 2.4 GHz only 1, 6 and 11 are worth starting on when available */
+    if (n && chans[0].chan <= 14)
+    {
+        non_overlapping = acs_chan_find(chans, n, 1) &&
+                          acs_chan_find(chans, n, 6) &&
+                          acs_chan_find(chans, n, 11);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (non_overlapping && chans[i].chan != 1 && chans[i].chan != 6 &&
+            chans[i].chan != 11)
+            continue;
+
+        for (w = 0; w < ARRAY_SIZE(widths) && widths[w] <= max_width; w++)
+        {
+            score = acs_score(chans, n, chans[i].chan, widths[w]);
+            if (score < 0)
+                continue;
+
+            /* Ties go to the current channel, then to the narrower width */
+            if (score > res->score ||
+                (score == res->score && chans[i].chan == cur_chan && res->channel != cur_chan))
+            {
+                res->channel = chans[i].chan;
+                res->width = widths[w];
+                res->score = score;
+            }
+        }
+    }
+
+    if (res->score < 0)
+        return false;
+
+    res->needs_cac = acs_block_needs_cac(chans, n, res->channel, res->width);
+    res->cur_score = acs_score(chans, n, cur_chan, cur_width);
+    if (res->channel == cur_chan && res->width == cur_width)
+        return true;
+
+    if (res->cur_score < 0)
+    {
+        /* The current channel is not usable any more, anything is better */
+        res->switch_recommended = true;
+        return true;
+    }
+
+    gain = res->score - res->cur_score;
+    res->switch_recommended = gain >= ACS_MIN_GAIN &&
+                              gain * 100 > ACS_HYSTERESIS_PCT * (res->cur_score ? res->cur_score : 1);
+
+    return true;
+}
+
+/******************************************************************************
+ *  Measurements
+ *****************************************************************************/
+
+static int acs_width_mhz(int nl_width)
+{
+    switch (nl_width)
+    {
+        case NL80211_CHAN_WIDTH_40:
+            return 40;
+        case NL80211_CHAN_WIDTH_80:
+        case NL80211_CHAN_WIDTH_80P80:
+            return 80;
+        case NL80211_CHAN_WIDTH_160:
+            return 160;
+        default:
+            return 20;
+    }
+}
+
+static int acs_htmode_mhz(const char *ht_mode)
+{
+    while (*ht_mode && (*ht_mode < '0' || *ht_mode > '9'))
+        ht_mode++;
+
+    return *ht_mode ? atoi(ht_mode) : 20;
+}
+
+void acs_nbr_apply(struct acs_chan *chans, int n, ds_tree_t *nbrs)
+{
+    struct wifi_nbr *nbr;
+    int cost;
+    int d;
+    int i;
+
+    ds_tree_foreach(nbrs, nbr)
+    {
+        /* -95 dBm costs nothing, -55 dBm and above costs 20 */
+        cost = nbr->rssi + 95;
+        cost = (cost < 0 ? 0 : cost > 40 ? 40 : cost) / 2;
+
+        for (i = 0; i < n; i++)
+        {
+            if (chans[i].chan <= 14)
+            {
+                /* 2.4 GHz channels overlap up to 4 channels away */
+                d = abs(chans[i].chan - nbr->primary);
+                if (d >= 5)
+                    continue;
+                chans[i].nbr_cost += cost * (5 - d) / 5;
+            }
+            else if (chans[i].chan == nbr->primary)
+            {
+                chans[i].nbr_cost += cost;
+            }
+            else if (chans[i].chan >= nbr->lo && chans[i].chan <= nbr->hi)
+            {
+                /* Secondary channels are only used for wide transmissions */
+                chans[i].nbr_cost += cost / 2;
+            }
+            else
+            {
+                continue;
+            }
+
+            chans[i].nbr_count++;
+            if (chans[i].chan == nbr->primary && nbr->load > chans[i].bss_load)
+                chans[i].bss_load = nbr->load;
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (chans[i].nbr_cost > 100)
+            chans[i].nbr_cost = 100;
+    }
+}
+
+/* Busy air time of others, over the time since prev when the counters moved */
+void acs_survey_apply(
+        struct acs_chan *chans,
+        int n,
+        const struct wifi_survey *survey,
+        int num,
+        const struct wifi_survey *prev,
+        int n_prev)
+{
+    const struct wifi_survey *last;
+    uint64_t time;
+    uint64_t busy;
+    int chan;
+    int i;
+    int j;
+
+    for (i = 0; i < num; i++)
+    {
+        chan = phy_freq_to_channel(survey[i].freq);
+
+        last = NULL;
+        for (j = 0; j < n_prev; j++)
+        {
+            if (prev[j].freq == survey[i].freq)
+                last = &prev[j];
+        }
+
+        time = survey[i].time;
+        busy = survey[i].busy - survey[i].tx;
+        if (last && survey[i].time > last->time && survey[i].busy >= last->busy &&
+            survey[i].tx >= last->tx)
+        {
+            time = survey[i].time - last->time;
+            busy = (survey[i].busy - last->busy) - (survey[i].tx - last->tx);
+        }
+
+        if (!time || busy > time)
+            continue;
+
+        for (j = 0; j < n; j++)
+        {
+            if (chans[j].chan == chan)
+                chans[j].busy = busy * 100 / time;
+        }
+    }
+}
+
+static void acs_apply_survey(struct acs_radio *radio, const char *ifname,
+                             struct acs_chan *chans, int n)
+{
+    struct wifi_survey survey[PHY_MAX_CHANNELS];
+    int num;
+
+    num = phy_survey_get(ifname, survey, ARRAY_SIZE(survey));
+    if (num < 0)
+        return;
+
+    acs_survey_apply(chans, n, survey, num, radio->prev, radio->n_prev);
+
+    memcpy(radio->prev, survey, num * sizeof(survey[0]));
+    radio->n_prev = num;
+}
+
+static int acs_chans_build(const struct wifi_phy *phy, struct acs_chan *chans)
+{
+    const struct wifi_chan *c;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < phy->n_chans; i++)
+    {
+        c = &phy->chans[i];
+        if (c->disabled)
+            continue;
+
+        memset(&chans[n], 0, sizeof(chans[n]));
+        chans[n].chan = c->chan;
+        chans[n].needs_cac = c->radar && c->dfs_state != NL80211_DFS_AVAILABLE;
+        chans[n].excluded = (c->radar && c->dfs_state == NL80211_DFS_UNAVAILABLE) ||
+                            (c->no_ir && !c->radar);
+        n++;
+    }
+
+    return n;
+}
+
+static void acs_radio_run(int radioIndex)
+{
+    struct acs_radio *radio = &g_acs[radioIndex];
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    struct acs_result res;
+    struct wifi_oper oper;
+    struct wifi_phy *phy;
+    ds_tree_t *nbrs;
+    char ht_mode[16];
+    char mode[16];
+    int max_width = 20;
+    int n;
+    int i;
+
+    radio->valid = false;
+
+    wifi_getRadioAcsMode(radioIndex, mode, sizeof(mode));
+    if (!strcmp(mode, "off"))
+        return;
+
+    wifi_getRadioPhyName(radioIndex, radio->phy, sizeof(radio->phy));
+    phy = phy_get(radio->phy);
+    if (!phy || !phy_get_oper(radio->phy, &oper))
+        return;
+
+    if (UCI_OK == wifi_getRadioHtMode(radioIndex, ht_mode))
+        max_width = acs_htmode_mhz(ht_mode);
+    if (thermal_max_width(radioIndex) && thermal_max_width(radioIndex) < max_width)
+        max_width = thermal_max_width(radioIndex);
+
+    n = acs_chans_build(phy, chans);
+    acs_apply_survey(radio, oper.ifname, chans, n);
+    nbr_refresh(radio->phy, oper.ifname);
+    nbrs = nbr_get(radio->phy);
+    if (nbrs)
+        acs_nbr_apply(chans, n, nbrs);
+
+    /* Only what a CSA can reach, see radio_csa_start() */
+    if (!strcmp(mode, "auto"))
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (chans[i].needs_cac)
+                chans[i].excluded = true;
+        }
+    }
+
+    if (!acs_select(chans, n, oper.channel, acs_width_mhz(oper.width), max_width, &res))
+        return;
+
+    if (res.channel != radio->res.channel || res.width != radio->res.width)
+    {
+        radio->stable = 0;
+        LOGI("%s: ACS prefers channel %d/%d (score %d, current %d/%d scores %d)",
+             radio->phy, res.channel, res.width, res.score, oper.channel,
+             acs_width_mhz(oper.width), res.cur_score);
+    }
+
+    radio->res = res;
+    radio->valid = true;
+
+    if (!res.switch_recommended)
+    {
+        radio->stable = 0;
+        return;
+    }
+
+    if (++radio->stable < ACS_STABLE_ROUNDS || strcmp(mode, "auto"))
+        return;
+
+    if (radio->last_switch && clock_mono_ms() - radio->last_switch < ACS_HOLDOFF_MS)
+        return;
+
+    snprintf(ht_mode, sizeof(ht_mode), "HT%d", res.width);
+    LOGN("%s: ACS moving to channel %d %s", radio->phy, res.channel, ht_mode);
+
+    radio->last_switch = clock_mono_ms();
+    radio->stable = 0;
+    if (!radio_channel_switch(radioIndex, res.channel, ht_mode))
+        LOGW("%s: ACS channel switch failed", radio->phy);
+}
+
+static void acs_task(void *arg)
+{
+    int rnum;
+    int r;
+
+    if (UCI_OK == wifi_getRadioNumberOfEntries(&rnum))
+    {
+        for (r = 0; r < rnum && r < UCI_MAX_RADIOS; r++)
+            acs_radio_run(r);
+    }
+
+    evsched_task_reschedule_ms(ACS_INTERVAL);
+}
+
+bool acs_get(int radioIndex, struct acs_result *res)
+{
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS || !g_acs[radioIndex].valid)
+        return false;
+
+    *res = g_acs[radioIndex].res;
+
+    return true;
+}
+
+bool acs_init(void)
+{
+    if (acs_running)
+        return true;
+
+    memset(g_acs, 0, sizeof(g_acs));
+    nbr_init();
+    evsched_task(&acs_task, NULL, ACS_INTERVAL);
+    acs_running = true;
+
+    return true;
+}
+
+void acs_cleanup(void)
+{
+    if (!acs_running)
+        return;
+
+    evsched_task_cancel_by_find(&acs_task, NULL, EVSCHED_FIND_BY_FUNC);
+    acs_running = false;
+}
@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "uci_helper.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "airtime.h"
+
+#define AIRTIME_MAX_STAS    256
+#define MAC_FMT             "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC_ARG(m)          (m)[0], (m)[1], (m)[2], (m)[3], (m)[4], (m)[5]
+
+struct airtime_dump_ctx
+{
+    uint8_t     (*macs)[ETH_ALEN];
+    int         max;
+    int         num;
+};
+
+/* Weights last pushed to the stations of a VIF */
+struct airtime_vif
+{
+    char            ifname[IFNAMSIZ];
+    unsigned int    ifindex;
+    uint32_t        hash;
+    ds_tree_node_t  node;
+};
+
+static bool airtime_registered = false;
+static ds_tree_t airtime_vifs = DS_TREE_INIT(ds_str_cmp, struct airtime_vif, node);
+
+static bool airtime_supported(unsigned int ifindex)
+{
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+
+    if (phy_from_ifindex(ifindex, phy_name, sizeof(phy_name)) < 0)
+        return false;
+
+    phy = phy_get(phy_name);
+
+    return phy && phy->airtime_fairness;
+}
+
+static bool airtime_sta_set(const char *ifname, unsigned int ifindex, const uint8_t *mac, int weight)
+{
+    struct nl_msg *msg;
+    int ret;
+
+    msg = nl80211_msg(NL80211_CMD_SET_STATION, 0);
+    if (!msg)
+        return false;
+
+    nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+    nla_put(msg, NL80211_ATTR_MAC, ETH_ALEN, mac);
+    nla_put_u16(msg, NL80211_COMPAT_ATTR_AIRTIME_WEIGHT, weight);
+
+    ret = nl80211_send(msg, NULL, NULL);
+    if (ret)
+    {
+        LOGW("%s: failed to set airtime weight %d for "MAC_FMT": %d",
+             ifname, weight, MAC_ARG(mac), ret);
+        return false;
+    }
+
+    LOGD("%s: airtime weight %d for "MAC_FMT, ifname, weight, MAC_ARG(mac));
+    return true;
+}
+
+/* Configured weight for one client, the kernel default if there is none */
+static int airtime_weight_get(int ssid_index, const uint8_t *mac)
+{
+    char mac_str[18];
+    int weight;
+
+    snprintf(mac_str, sizeof(mac_str), MAC_FMT, MAC_ARG(mac));
+    if (wifi_getApAirtimeWeight(ssid_index, mac_str, &weight) != UCI_OK)
+        return AIRTIME_DEFAULT_WEIGHT;
+
+    /* NL80211_ATTR_AIRTIME_WEIGHT is a u16 and must not be 0 */
+    if (weight > UINT16_MAX)
+        weight = UINT16_MAX;
+
+    return weight;
+}
+
+static int airtime_ifname_to_ssid(const char *ifname)
+{
+    char vif[IFNAMSIZ];
+    int snum;
+    int s;
+
+    if (wifi_getSSIDNumberOfEntries(&snum) != UCI_OK)
+        return -1;
+
+    for (s = 0; s < snum; s++)
+    {
+        memset(vif, 0, sizeof(vif));
+        if (wifi_getVIFName(s, vif, sizeof(vif)) == UCI_OK && !strcmp(vif, ifname))
+            return s;
+    }
+
+    return -1;
+}
+
+static int airtime_dump_cb(struct nl_msg *msg, void *arg)
+{
+    struct airtime_dump_ctx *ctx = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+
+    if (ctx->num >= ctx->max)
+        return NL_SKIP;
+
+    nl80211_parse(msg, tb);
+
+    if (tb[NL80211_ATTR_MAC])
+        memcpy(ctx->macs[ctx->num++], nla_data(tb[NL80211_ATTR_MAC]), ETH_ALEN);
+
+    return NL_SKIP;
+}
+
+/*
+ * Runs on every VIF config pass. Stations keep their weight until the
+ * configured weights change, or the netdev is recreated; new stations get
+ * theirs when they associate.
+ */
+bool airtime_apply(int ssid_index)
+{
+    static uint8_t macs[AIRTIME_MAX_STAS][ETH_ALEN];
+    struct airtime_dump_ctx ctx = { macs, AIRTIME_MAX_STAS, 0 };
+    struct airtime_vif *vif;
+    char ifname[IFNAMSIZ];
+    struct nl_msg *msg;
+    unsigned int ifindex;
+    uint32_t hash;
+    bool ok = true;
+    int i;
+
+    memset(ifname, 0, sizeof(ifname));
+    if (wifi_getVIFName(ssid_index, ifname, sizeof(ifname)) != UCI_OK)
+        return false;
+
+    ifindex = if_nametoindex(ifname);
+    if (!ifindex || !airtime_supported(ifindex))
+        return true;
+
+    hash = wifi_getApAirtimeHash(ssid_index);
+    vif = ds_tree_find(&airtime_vifs, ifname);
+    if (vif && vif->ifindex == ifindex && vif->hash == hash)
+        return true;
+
+    msg = nl80211_msg(NL80211_CMD_GET_STATION, NLM_F_DUMP);
+    if (!msg)
+        return false;
+
+    nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+    if (nl80211_send(msg, airtime_dump_cb, &ctx))
+        return false;
+
+    for (i = 0; i < ctx.num; i++)
+        ok &= airtime_sta_set(ifname, ifindex, macs[i], airtime_weight_get(ssid_index, macs[i]));
+
+    /* Partial failures are retried on the next pass */
+    if (!ok)
+        return false;
+
+    if (!vif)
+    {
+        vif = calloc(1, sizeof(*vif));
+        if (!vif)
+            return true;
+        STRSCPY(vif->ifname, ifname);
+        ds_tree_insert(&airtime_vifs, vif, vif->ifname);
+    }
+    vif->ifindex = ifindex;
+    vif->hash = hash;
+
+    return true;
+}
+
+/* New clients start at the default weight, push the configured one */
+static void airtime_new_sta_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    char ifname[IFNAMSIZ];
+    unsigned int ifindex;
+    const uint8_t *mac;
+    int ssid_index;
+    int weight;
+
+    if (!tb[NL80211_ATTR_IFINDEX] || !tb[NL80211_ATTR_MAC])
+        return;
+
+    ifindex = nla_get_u32(tb[NL80211_ATTR_IFINDEX]);
+    mac = nla_data(tb[NL80211_ATTR_MAC]);
+
+    if (!if_indextoname(ifindex, ifname) || !airtime_supported(ifindex))
+        return;
+
+    ssid_index = airtime_ifname_to_ssid(ifname);
+    if (ssid_index < 0)
+        return;
+
+    weight = airtime_weight_get(ssid_index, mac);
+    if (weight != AIRTIME_DEFAULT_WEIGHT)
+        airtime_sta_set(ifname, ifindex, mac, weight);
+}
+
+bool airtime_init(void)
+{
+    if (airtime_registered)
+        return true;
+
+    if (!nl80211_event_register(NL80211_CMD_NEW_STATION, airtime_new_sta_cb, NULL))
+    {
+        LOGE("airtime: failed to register station event callback");
+        return false;
+    }
+
+    airtime_registered = true;
+    return true;
+}
@@ -0,0 +1,347 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "target.h"
+#include "phy.h"
+#include "rtnl.h"
+#include "steer.h"
+
+/*
+ * BSAL talks SNR, steer.h and hostapd talk dBm. Without a per-channel
+ * noise figure at hand a fixed floor is used both ways.
+ */
+#define BSAL_NOISE_FLOOR    (-95)
+
+/* 802.11 management header, then category, action and the BTM response fixed fields */
+#define BSAL_MGMT_HDR_LEN   24
+#define BSAL_FC_ACTION      0xd0
+#define BSAL_CAT_WNM        10
+#define BSAL_WNM_BTM_RESP   8
+
+static bsal_event_cb_t bsal_cb = NULL;
+
+static int bsal_snr_to_rssi(uint8_t snr)
+{
+    return snr ? snr + BSAL_NOISE_FLOOR : 0;
+}
+
+static uint8_t bsal_rssi_to_snr(int rssi)
+{
+    if (!rssi || rssi <= BSAL_NOISE_FLOOR)
+        return 0;
+
+    return rssi - BSAL_NOISE_FLOOR;
+}
+
+static void bsal_mac_str(const uint8_t *mac, char *str, size_t len)
+{
+    snprintf(str, len, "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static void bsal_mac_addr(const char *str, uint8_t *mac)
+{
+    unsigned int b[6];
+    int i;
+
+    memset(mac, 0, BSAL_MAC_ADDR_LEN);
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+        return;
+
+    for (i = 0; i < BSAL_MAC_ADDR_LEN; i++)
+        mac[i] = b[i];
+}
+
+static int bsal_xing(int xing)
+{
+    switch (xing)
+    {
+        case STEER_XING_HIGHER:
+            return BSAL_RSSI_HIGHER;
+        case STEER_XING_LOWER:
+            return BSAL_RSSI_LOWER;
+        default:
+            return BSAL_RSSI_UNCHANGED;
+    }
+}
+
+/*
+ * BM takes BSS transition responses as the raw action frame, hostapd only
+ * hands out the parsed fields. Rebuild the frame as the client sent it.
+ */
+static void bsal_btm_frame(const struct steer_event *sev, bsal_ev_action_frame_t *frame)
+{
+    uint8_t *p = frame->data;
+    char bssid[18] = "";
+
+    rtnl_link_addr(sev->ifname, bssid, sizeof(bssid));
+
+    p[0] = BSAL_FC_ACTION;
+    bsal_mac_addr(bssid, p + 4);
+    bsal_mac_addr(sev->mac, p + 10);
+    bsal_mac_addr(bssid, p + 16);
+    p += BSAL_MGMT_HDR_LEN;
+
+    *p++ = BSAL_CAT_WNM;
+    *p++ = BSAL_WNM_BTM_RESP;
+    *p++ = sev->dialog_token;
+    *p++ = sev->status;
+    *p++ = sev->term_delay;
+    if (!sev->status && sev->target_bssid[0])
+    {
+        bsal_mac_addr(sev->target_bssid, p);
+        p += BSAL_MAC_ADDR_LEN;
+    }
+
+    frame->data_len = p - frame->data;
+}
+
+static void bsal_event_forward(const struct steer_event *sev)
+{
+    bsal_event_t event;
+
+    if (!bsal_cb)
+        return;
+
+    memset(&event, 0, sizeof(event));
+    STRSCPY(event.ifname, sev->ifname);
+    event.band = sev->band == STEER_BAND_5G ? BSAL_BAND_5G : BSAL_BAND_24G;
+
+    switch (sev->type)
+    {
+        case STEER_EVENT_PROBE_REQ:
+            event.type = BSAL_EVENT_PROBE_REQ;
+            bsal_mac_addr(sev->mac, event.data.probe_req.client_addr);
+            event.data.probe_req.rssi = bsal_rssi_to_snr(sev->rssi);
+            /* The deny list rejects authentication, the probe was answered */
+            event.data.probe_req.blocked = false;
+            break;
+
+        case STEER_EVENT_CONNECT:
+            event.type = BSAL_EVENT_CLIENT_CONNECT;
+            bsal_mac_addr(sev->mac, event.data.connect.client_addr);
+            break;
+
+        case STEER_EVENT_DISCONNECT:
+            event.type = BSAL_EVENT_CLIENT_DISCONNECT;
+            bsal_mac_addr(sev->mac, event.data.disconnect.client_addr);
+            event.data.disconnect.source = BSAL_DISC_SOURCE_REMOTE;
+            event.data.disconnect.type = BSAL_DISC_TYPE_DISASSOC;
+            break;
+
+        case STEER_EVENT_RSSI:
+            event.type = BSAL_EVENT_RSSI;
+            bsal_mac_addr(sev->mac, event.data.rssi.client_addr);
+            event.data.rssi.rssi = bsal_rssi_to_snr(sev->rssi);
+            break;
+
+        case STEER_EVENT_ACTIVITY:
+            event.type = BSAL_EVENT_CLIENT_ACTIVITY;
+            bsal_mac_addr(sev->mac, event.data.activity.client_addr);
+            event.data.activity.active = sev->active;
+            break;
+
+        case STEER_EVENT_RSSI_XING:
+            event.type = BSAL_EVENT_RSSI_XING;
+            bsal_mac_addr(sev->mac, event.data.rssi_change.client_addr);
+            event.data.rssi_change.rssi = bsal_rssi_to_snr(sev->rssi);
+            event.data.rssi_change.inact_xing = bsal_xing(sev->inact_xing);
+            event.data.rssi_change.high_xing = bsal_xing(sev->high_xing);
+            event.data.rssi_change.low_xing = bsal_xing(sev->low_xing);
+            break;
+
+        case STEER_EVENT_BTM_RESP:
+            event.type = BSAL_EVENT_ACTION_FRAME;
+            bsal_btm_frame(sev, &event.data.action_frame);
+            break;
+
+        default:
+            return;
+    }
+
+    bsal_cb(&event);
+}
+
+/* 5 GHz only radios steer as 5G, anything that can do 2.4 GHz as 2.4G */
+static int bsal_iface_band(const char *ifname)
+{
+    struct wifi_phy *phy;
+    char name[IFNAMSIZ];
+    unsigned int ifindex;
+
+    ifindex = if_nametoindex(ifname);
+    if (!ifindex || phy_from_ifindex(ifindex, name, sizeof(name)))
+        return STEER_BAND_24G;
+
+    phy = phy_get(name);
+    if (!phy || phy->band_2g || !phy->band_5g)
+        return STEER_BAND_24G;
+
+    return STEER_BAND_5G;
+}
+
+static void bsal_client_cfg(const bsal_client_config_t *conf, struct steer_client_cfg *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->probe_hwm = bsal_snr_to_rssi(conf->rssi_probe_hwm);
+    cfg->probe_lwm = bsal_snr_to_rssi(conf->rssi_probe_lwm);
+    cfg->auth_hwm = bsal_snr_to_rssi(conf->rssi_auth_hwm);
+    cfg->auth_lwm = bsal_snr_to_rssi(conf->rssi_auth_lwm);
+    cfg->blocked = conf->blacklist;
+    cfg->inact_xing = bsal_snr_to_rssi(conf->rssi_inact_xing);
+    cfg->high_xing = bsal_snr_to_rssi(conf->rssi_high_xing);
+    cfg->low_xing = bsal_snr_to_rssi(conf->rssi_low_xing);
+}
+
+/*
+ * There are no channel utilization events, so an interface is never
+ * overloaded and inact_tmout_sec_overload goes unused.
+ */
+static void bsal_iface_cfg(const bsal_ifconfig_t *ifcfg, struct steer_iface_cfg *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->inact_check_sec = ifcfg->inact_check_sec;
+    cfg->inact_tmout_sec = ifcfg->inact_tmout_sec_normal;
+    cfg->inact_xing = bsal_snr_to_rssi(ifcfg->def_rssi_inact_xing);
+    cfg->high_xing = bsal_snr_to_rssi(ifcfg->def_rssi_xing);
+    cfg->low_xing = bsal_snr_to_rssi(ifcfg->def_rssi_low_xing);
+}
+
+int target_bsal_init(bsal_event_cb_t event_cb, struct ev_loop *loop)
+{
+    if (!steer_init(loop))
+        return -1;
+
+    bsal_cb = event_cb;
+    steer_event_cb_set(bsal_event_forward);
+
+    return 0;
+}
+
+int target_bsal_cleanup(void)
+{
+    steer_cleanup();
+    bsal_cb = NULL;
+
+    return 0;
+}
+
+int target_bsal_iface_add(const bsal_ifconfig_t *ifcfg)
+{
+    struct steer_iface_cfg cfg;
+
+    bsal_iface_cfg(ifcfg, &cfg);
+
+    return steer_iface_add(ifcfg->ifname, bsal_iface_band(ifcfg->ifname), &cfg) ? 0 : -1;
+}
+
+int target_bsal_iface_update(const bsal_ifconfig_t *ifcfg)
+{
+    return target_bsal_iface_add(ifcfg);
+}
+
+int target_bsal_iface_remove(const bsal_ifconfig_t *ifcfg)
+{
+    return steer_iface_remove(ifcfg->ifname) ? 0 : -1;
+}
+
+int target_bsal_client_add(const char *ifname, const uint8_t *mac_addr,
+                           const bsal_client_config_t *conf)
+{
+    struct steer_client_cfg cfg;
+    char mac[18];
+
+    bsal_mac_str(mac_addr, mac, sizeof(mac));
+    bsal_client_cfg(conf, &cfg);
+
+    return steer_client_set(ifname, mac, &cfg) ? 0 : -1;
+}
+
+int target_bsal_client_update(const char *ifname, const uint8_t *mac_addr,
+                              const bsal_client_config_t *conf)
+{
+    return target_bsal_client_add(ifname, mac_addr, conf);
+}
+
+int target_bsal_client_remove(const char *ifname, const uint8_t *mac_addr)
+{
+    char mac[18];
+
+    bsal_mac_str(mac_addr, mac, sizeof(mac));
+
+    return steer_client_remove(ifname, mac) ? 0 : -1;
+}
+
+/* One sample is all the driver has, num_samples is not averaged over */
+int target_bsal_client_measure(const char *ifname, const uint8_t *mac_addr, int num_samples)
+{
+    char mac[18];
+
+    bsal_mac_str(mac_addr, mac, sizeof(mac));
+
+    return steer_client_measure(ifname, mac) ? 0 : -1;
+}
+
+int target_bsal_client_disconnect(const char *ifname, const uint8_t *mac_addr,
+                                  bsal_disc_type_t type, uint8_t reason)
+{
+    char mac[18];
+
+    bsal_mac_str(mac_addr, mac, sizeof(mac));
+
+    return steer_client_kick(ifname, mac,
+                             type == BSAL_DISC_TYPE_DEAUTH ? STEER_KICK_DEAUTH : STEER_KICK_DISASSOC,
+                             reason) ? 0 : -1;
+}
+
+int target_bsal_client_info(const char *ifname, const uint8_t *mac_addr, bsal_client_info_t *info)
+{
+    struct steer_client_info sinfo;
+    char mac[18];
+
+    bsal_mac_str(mac_addr, mac, sizeof(mac));
+    if (!steer_client_info(ifname, mac, &sinfo))
+        return -1;
+
+    memset(info, 0, sizeof(*info));
+    info->connected = sinfo.connected;
+    info->snr = bsal_rssi_to_snr(sinfo.rssi);
+    info->tx_bytes = sinfo.tx_bytes;
+    info->rx_bytes = sinfo.rx_bytes;
+
+    return 0;
+}
+
+int target_bsal_bss_tm_request(const char *ifname, const uint8_t *mac_addr,
+                               const bsal_btm_params_t *btm_params)
+{
+    const bsal_neigh_info_t *neigh;
+    struct steer_btm btm;
+    char mac[18];
+    int i;
+
+    memset(&btm, 0, sizeof(btm));
+    btm.valid_int = btm_params->valid_int;
+    btm.abridged = btm_params->abridged;
+    btm.disassoc_imminent = btm_params->disassoc_imminent;
+
+    for (i = 0; i < btm_params->num_neigh && i < BSAL_MAX_TM_NEIGHBORS; i++)
+    {
+        neigh = &btm_params->neigh[i];
+        bsal_mac_str(neigh->bssid, btm.neighbors[i].bssid, sizeof(btm.neighbors[i].bssid));
+        btm.neighbors[i].bssid_info = neigh->bssid_info;
+        btm.neighbors[i].op_class = neigh->op_class;
+        btm.neighbors[i].channel = neigh->channel;
+        btm.neighbors[i].phy_type = neigh->phy_type;
+        btm.n_neighbors++;
+    }
+
+    bsal_mac_str(mac_addr, mac, sizeof(mac));
+
+    return steer_btm_request(ifname, mac, &btm) ? 0 : -1;
+}
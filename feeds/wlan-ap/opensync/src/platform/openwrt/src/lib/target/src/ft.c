@@ -0,0 +1,305 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "evsched.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "rtnl.h"
+#include "ft.h"
+
+#define FT_INTERVAL     EVSCHED_SEC(10)
+
+struct ft_vif
+{
+    char            ifname[IFNAMSIZ];
+    char            key[65];
+    char            peers[FT_MAX_PEERS][18];
+    bool            pushed[FT_MAX_PEERS];
+    int             n_peers;
+    ino_t           ctrl_ino;   /* hostapd instance the peers went to */
+    time_t          committed;  /* last change of the key holders in UCI */
+    ds_tree_node_t  node;
+};
+
+static ds_tree_t ft_vif_tree = DS_TREE_INIT(ds_str_cmp, struct ft_vif, node);
+static bool ft_running = false;
+
+static bool ft_key_valid(const char *key)
+{
+    size_t len = strlen(key);
+    size_t i;
+
+    if (len != 32 && len != 64)
+        return false;
+
+    for (i = 0; i < len; i++)
+        if (!isxdigit((unsigned char)key[i]))
+            return false;
+
+    return true;
+}
+
+static bool ft_mac_parse(const char *str, char *mac, size_t len)
+{
+    unsigned int b[6];
+
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+        return false;
+
+    snprintf(mac, len, "%02x:%02x:%02x:%02x:%02x:%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+
+    return true;
+}
+
+/* NAS-ID is the peer's BSSID without colons, out takes FT_NAS_ID_LEN */
+void ft_nas_id(const char *bssid, char *out)
+{
+    snprintf(out, FT_NAS_ID_LEN, "%.2s%.2s%.2s%.2s%.2s%.2s",
+             bssid, bssid + 3, bssid + 6, bssid + 9, bssid + 12, bssid + 15);
+}
+
+int ft_vif_mode(const struct schema_Wifi_VIF_Config *vconf, const char **key)
+{
+    const char *encryption = SCHEMA_KEY_VAL_NULL(vconf->security, OVSDB_SECURITY_ENCRYPTION);
+    const char *ft_key = SCHEMA_KEY_VAL_NULL(vconf->security, OVSDB_SECURITY_FT_KEY);
+
+    *key = NULL;
+
+    if (!vconf->ft_mobility_domain || !encryption ||
+        !strcmp(encryption, OVSDB_SECURITY_ENCRYPTION_OPEN))
+        return FT_MODE_OFF;
+
+    if (ft_key && ft_key_valid(ft_key))
+    {
+        *key = ft_key;
+        return FT_MODE_KEYS;
+    }
+
+    if (ft_key)
+        LOGW("%s: ft: ft_key must be 32 or 64 hex digits", vconf->if_name);
+
+    /* Without a shared key the R0KH can't hand out anything but PSK derived keys */
+    if (!strcmp(encryption, OVSDB_SECURITY_ENCRYPTION_WPA_EAP))
+    {
+        LOGW("%s: ft: WPA-EAP needs an ft_key, fast transition disabled", vconf->if_name);
+        return FT_MODE_OFF;
+    }
+
+    return FT_MODE_LOCAL;
+}
+
+static void ft_push(struct ft_vif *vif)
+{
+    char nas_id[FT_NAS_ID_LEN];
+    char cmd[160];
+    bool configured;
+    ino_t ino;
+    int i;
+
+    ino = hostapd_ctrl_ino(vif->ifname);
+    if (!ino)
+    {
+        /* Not running, everything goes to the next instance */
+        vif->ctrl_ino = 0;
+        return;
+    }
+
+    /* One started after the last commit read every key holder from its config */
+    if (ino != vif->ctrl_ino)
+    {
+        configured = hostapd_ctrl_start(vif->ifname) > vif->committed;
+        for (i = 0; i < vif->n_peers; i++)
+            vif->pushed[i] = configured;
+        vif->ctrl_ino = ino;
+    }
+
+    for (i = 0; i < vif->n_peers; i++)
+    {
+        if (vif->pushed[i])
+            continue;
+
+        ft_nas_id(vif->peers[i], nas_id);
+        snprintf(cmd, sizeof(cmd), "SET r0kh %s %s %s", vif->peers[i], nas_id, vif->key);
+        if (!hostapd_cli_ok(vif->ifname, cmd))
+            break;
+
+        snprintf(cmd, sizeof(cmd), "SET r1kh %s %s %s", vif->peers[i], vif->peers[i], vif->key);
+        if (!hostapd_cli_ok(vif->ifname, cmd))
+            break;
+
+        vif->pushed[i] = true;
+        LOGD("%s: ft: key holder %s added", vif->ifname, vif->peers[i]);
+    }
+
+    if (i < vif->n_peers)
+        LOGW("%s: ft: hostapd refused key holder %s", vif->ifname, vif->peers[i]);
+}
+
+static void ft_vif_del(struct ft_vif *vif)
+{
+    ds_tree_remove(&ft_vif_tree, vif);
+    free(vif);
+}
+
+/* Peer BSSIDs from the "ft_peer-<n>" entries, our own left out */
+int ft_vif_peers(const struct schema_Wifi_VIF_Config *vconf, char (*peers)[18], int max)
+{
+    char own[18] = "";
+    int n = 0;
+    int i;
+
+    rtnl_link_addr(vconf->if_name, own, sizeof(own));
+
+    for (i = 0; i < vconf->security_len && n < max; i++)
+    {
+        if (strncmp(vconf->security_keys[i], FT_PEER_PREFIX, strlen(FT_PEER_PREFIX)))
+            continue;
+
+        if (!ft_mac_parse(vconf->security[i], peers[n], sizeof(peers[n])))
+        {
+            LOGW("%s: ft: ignoring peer '%s'", vconf->if_name, vconf->security[i]);
+            continue;
+        }
+
+        if (!strcasecmp(peers[n], own))
+            continue;
+        n++;
+    }
+
+    return n;
+}
+
+bool ft_vif_apply(int ssid_index, const struct schema_Wifi_VIF_Config *vconf)
+{
+    char peers[FT_MAX_PEERS][18];
+    bool pushed[FT_MAX_PEERS];
+    struct ft_vif *vif;
+    const char *key;
+    int removed;
+    int n;
+    int i;
+    int j;
+
+    vif = ds_tree_find(&ft_vif_tree, (void *)vconf->if_name);
+
+    if (ft_vif_mode(vconf, &key) != FT_MODE_KEYS)
+    {
+        if (vif)
+            ft_vif_del(vif);
+        return true;
+    }
+
+    n = ft_vif_peers(vconf, peers, FT_MAX_PEERS);
+
+    if (!vif)
+    {
+        vif = calloc(1, sizeof(*vif));
+        if (!vif)
+            return false;
+        STRSCPY(vif->ifname, vconf->if_name);
+        ds_tree_insert(&ft_vif_tree, vif, vif->ifname);
+    }
+
+    /* A new key comes with a new config and thus a new hostapd */
+    if (strcmp(vif->key, key))
+    {
+        STRSCPY(vif->key, key);
+        memset(vif->pushed, 0, sizeof(vif->pushed));
+        vif->committed = time(NULL);
+    }
+
+    memset(pushed, 0, sizeof(pushed));
+    removed = vif->n_peers;
+    for (i = 0; i < vif->n_peers; i++)
+    {
+        for (j = 0; j < n; j++)
+        {
+            if (strcmp(vif->peers[i], peers[j]))
+                continue;
+            pushed[j] = vif->pushed[i];
+            removed--;
+            break;
+        }
+    }
+
+    /* wifi_setFtMode() just rewrote the lists */
+    if (removed || n != vif->n_peers - removed)
+        vif->committed = time(NULL);
+
+    if (removed)
+        LOGN("%s: ft: %d key holders removed, hostapd keeps them until its next start",
+             vif->ifname, removed);
+
+    memcpy(vif->peers, peers, sizeof(peers));
+    memcpy(vif->pushed, pushed, sizeof(pushed));
+    vif->n_peers = n;
+
+    ft_push(vif);
+
+    return true;
+}
+
+void ft_resync(void)
+{
+    struct ft_vif *vif;
+
+    ds_tree_foreach(&ft_vif_tree, vif)
+        ft_push(vif);
+}
+
+int ft_peer_count(const char *ifname)
+{
+    struct ft_vif *vif;
+
+    vif = ds_tree_find(&ft_vif_tree, (void *)ifname);
+
+    return vif ? vif->n_peers : 0;
+}
+
+/* Catches hostapd restarts, its control socket is created anew */
+static void ft_task(void *arg)
+{
+    ft_resync();
+
+    evsched_task_reschedule_ms(FT_INTERVAL);
+}
+
+bool ft_init(void)
+{
+    if (ft_running)
+        return true;
+
+    evsched_task(&ft_task, NULL, FT_INTERVAL);
+    ft_running = true;
+
+    return true;
+}
+
+void ft_cleanup(void)
+{
+    struct ft_vif *vif;
+    ds_tree_iter_t iter;
+
+    if (!ft_running)
+        return;
+
+    evsched_task_cancel_by_find(&ft_task, NULL, EVSCHED_FIND_BY_FUNC);
+
+    ds_tree_foreach_iter(&ft_vif_tree, vif, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(vif);
+    }
+
+    ft_running = false;
+}
@@ -0,0 +1,364 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "evsched.h"
+#include "os_time.h"
+#include "uci_helper.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "hostapd.h"
+#include "tpc.h"
+#include "thermal.h"
+#include "green.h"
+
+#define GREEN_INTERVAL      EVSCHED_SEC(5)
+#define GREEN_MAX_IFACES    16
+#define GREEN_MIN_DBM       6
+
+struct green_mon
+{
+    ev_io       io;         /* first, the watcher is cast back */
+    int         radioIndex;
+    char        ifname[IFNAMSIZ];
+    ino_t       ino;        /* hostapd instance listened to */
+};
+
+struct green_radio
+{
+    struct green_state  s;
+    bool                valid;
+    char                phy[IFNAMSIZ];
+    int64_t             last_busy;  /* last time a client was associated */
+    int64_t             mode_since;
+    bool                power;      /* tx power lowered */
+    struct green_mon    mon[GREEN_MAX_IFACES];
+    int                 n_mon;
+};
+
+static struct green_radio g_green[UCI_MAX_RADIOS];
+static struct ev_loop *green_loop = NULL;
+static bool green_running = false;
+static bool green_registered = false;
+
+static int green_sta_cb(struct nl_msg *msg, void *arg)
+{
+    (*(int *)arg)++;
+
+    return NL_SKIP;
+}
+
+static int green_clients(const char *phy)
+{
+    char ifnames[GREEN_MAX_IFACES][IFNAMSIZ];
+    struct nl_msg *msg;
+    unsigned int ifindex;
+    int clients = 0;
+    int n;
+    int i;
+
+    n = phy_get_ifaces(phy, ifnames, GREEN_MAX_IFACES);
+    for (i = 0; i < n; i++)
+    {
+        ifindex = if_nametoindex(ifnames[i]);
+        if (!ifindex)
+            continue;
+
+        msg = nl80211_msg(NL80211_CMD_GET_STATION, NLM_F_DUMP);
+        if (!msg)
+            continue;
+
+        nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+        nl80211_send(msg, green_sta_cb, &clients);
+    }
+
+    return clients;
+}
+
+static void green_account(struct green_radio *radio)
+{
+    int64_t now = clock_mono_ms();
+
+    if (radio->mode_since)
+    {
+        if (radio->s.mode == GREEN_MODE_IDLE)
+            radio->s.idle_ms += now - radio->mode_since;
+        else
+            radio->s.active_ms += now - radio->mode_since;
+    }
+
+    radio->mode_since = now;
+}
+
+/* A restarted hostapd doesn't error out the old monitor, it goes quiet */
+static bool green_mon_stale(struct green_radio *radio)
+{
+    int i;
+
+    for (i = 0; i < radio->n_mon; i++)
+    {
+        if (hostapd_ctrl_ino(radio->mon[i].ifname) != radio->mon[i].ino)
+            return true;
+    }
+
+    return false;
+}
+
+static void green_mon_close(struct green_radio *radio)
+{
+    int i;
+
+    for (i = 0; i < radio->n_mon; i++)
+    {
+        ev_io_stop(green_loop, &radio->mon[i].io);
+        hostapd_monitor_close(radio->mon[i].ifname, radio->mon[i].io.fd);
+    }
+
+    radio->n_mon = 0;
+}
+
+static void green_wake(struct green_radio *radio, int radioIndex, const char *reason)
+{
+    if (radio->s.mode != GREEN_MODE_IDLE)
+        return;
+
+    if (radio->power)
+    {
+        tpc_restore_txpower(radioIndex);
+        radio->power = false;
+    }
+
+    green_mon_close(radio);
+    green_account(radio);
+
+    radio->s.mode = GREEN_MODE_ACTIVE;
+    radio->s.wakeups++;
+    radio->last_busy = clock_mono_ms();
+
+    LOGI("%s: green: back to full power (%s)", radio->phy, reason);
+}
+
+static void green_mon_cb(struct ev_loop *loop, ev_io *io, int revents)
+{
+    struct green_mon *mon = (struct green_mon *)io;
+    struct green_radio *radio = &g_green[mon->radioIndex];
+    char event[256];
+    const char *p;
+    int ret;
+
+    while ((ret = hostapd_monitor_recv(io->fd, event, sizeof(event))) > 0)
+    {
+        if (!strncmp(event, "RX-PROBE-REQUEST ", 17))
+        {
+            p = strstr(event, "signal=");
+            if (p && atoi(p + 7) < GREEN_PROBE_RSSI)
+                continue;
+
+            green_wake(radio, mon->radioIndex, "probe request");
+            return;
+        }
+
+        if (!strncmp(event, "AP-STA-", 7))
+        {
+            green_wake(radio, mon->radioIndex, "station event");
+            return;
+        }
+    }
+
+    if (ret < 0)
+    {
+        /* hostapd went away, don't stay deaf */
+        green_wake(radio, mon->radioIndex, "monitor lost");
+    }
+}
+
+static void green_sleep(struct green_radio *radio, int radioIndex)
+{
+    char ifnames[GREEN_MAX_IFACES][IFNAMSIZ];
+    struct wifi_oper oper;
+    int reduce = 0;
+    int target;
+    int n;
+    int i;
+    int fd;
+
+    /* Without a way to hear probes the radio would wake too late */
+    n = phy_get_ifaces(radio->phy, ifnames, GREEN_MAX_IFACES);
+    for (i = 0; i < n; i++)
+    {
+        radio->mon[radio->n_mon].ino = hostapd_ctrl_ino(ifnames[i]);
+        fd = hostapd_monitor_open(ifnames[i]);
+        if (fd < 0)
+            continue;
+
+        STRSCPY(radio->mon[radio->n_mon].ifname, ifnames[i]);
+        radio->mon[radio->n_mon].radioIndex = radioIndex;
+        ev_io_init(&radio->mon[radio->n_mon].io, green_mon_cb, fd, EV_READ);
+        ev_io_start(green_loop, &radio->mon[radio->n_mon].io);
+        radio->n_mon++;
+    }
+
+    if (!radio->n_mon)
+        return;
+
+    wifi_getRadioGreenTxPower(radioIndex, &reduce);
+    if (reduce > 0 && phy_get_oper(radio->phy, &oper) && oper.txpower_valid)
+    {
+        target = oper.txpower - reduce;
+        if (target < GREEN_MIN_DBM)
+            target = GREEN_MIN_DBM;
+        if (target < oper.txpower && phy_set_txpower(radio->phy, target))
+            radio->power = true;
+    }
+
+    green_account(radio);
+    radio->s.mode = GREEN_MODE_IDLE;
+
+    LOGI("%s: green: idle%s", radio->phy, radio->power ? ", tx power lowered" : "");
+}
+
+static void green_radio_run(int radioIndex)
+{
+    struct green_radio *radio = &g_green[radioIndex];
+    int64_t now = clock_mono_ms();
+    int idle_s = 0;
+
+    wifi_getRadioGreenIdle(radioIndex, &idle_s);
+    if (idle_s <= 0)
+    {
+        if (radio->valid)
+        {
+            green_wake(radio, radioIndex, "disabled");
+            memset(radio, 0, sizeof(*radio));
+        }
+        return;
+    }
+
+    if (!radio->valid)
+    {
+        wifi_getRadioPhyName(radioIndex, radio->phy, sizeof(radio->phy));
+        radio->last_busy = now;
+        radio->mode_since = now;
+        radio->valid = true;
+    }
+
+    /* Thermal mitigation owns the radio while it is engaged */
+    if (thermal_level(radioIndex) > THERMAL_LEVEL_NONE)
+    {
+        green_wake(radio, radioIndex, "thermal mitigation");
+        radio->last_busy = now;
+        return;
+    }
+
+    if (green_clients(radio->phy))
+    {
+        green_wake(radio, radioIndex, "clients associated");
+        radio->last_busy = now;
+        return;
+    }
+
+    if (radio->s.mode == GREEN_MODE_IDLE && green_mon_stale(radio))
+    {
+        green_wake(radio, radioIndex, "hostapd restarted");
+        radio->last_busy = now;
+        return;
+    }
+
+    if (radio->s.mode == GREEN_MODE_ACTIVE && now - radio->last_busy >= idle_s * 1000LL)
+        green_sleep(radio, radioIndex);
+}
+
+static void green_task(void *arg)
+{
+    int rnum;
+    int r;
+
+    if (UCI_OK == wifi_getRadioNumberOfEntries(&rnum))
+    {
+        for (r = 0; r < rnum && r < UCI_MAX_RADIOS; r++)
+            green_radio_run(r);
+    }
+
+    evsched_task_reschedule_ms(GREEN_INTERVAL);
+}
+
+/* Stations can authenticate without a probe, catch them at association */
+static void green_new_sta_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    char phy[IFNAMSIZ];
+    int r;
+
+    if (!tb[NL80211_ATTR_IFINDEX] ||
+        phy_from_ifindex(nla_get_u32(tb[NL80211_ATTR_IFINDEX]), phy, sizeof(phy)))
+        return;
+
+    for (r = 0; r < UCI_MAX_RADIOS; r++)
+    {
+        if (g_green[r].valid && !strcmp(g_green[r].phy, phy))
+            green_wake(&g_green[r], r, "association");
+    }
+}
+
+bool green_get(int radioIndex, struct green_state *state)
+{
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS || !g_green[radioIndex].valid)
+        return false;
+
+    green_account(&g_green[radioIndex]);
+    *state = g_green[radioIndex].s;
+
+    return true;
+}
+
+bool green_is_idle(int radioIndex)
+{
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS)
+        return false;
+
+    return g_green[radioIndex].s.mode == GREEN_MODE_IDLE;
+}
+
+bool green_init(struct ev_loop *loop)
+{
+    if (green_running)
+        return true;
+
+    memset(g_green, 0, sizeof(g_green));
+    green_loop = loop;
+
+    if (!green_registered)
+    {
+        if (!nl80211_event_register(NL80211_CMD_NEW_STATION, green_new_sta_cb, NULL))
+        {
+            LOGE("green: failed to register station event callback");
+            return false;
+        }
+        green_registered = true;
+    }
+
+    evsched_task(&green_task, NULL, GREEN_INTERVAL);
+    green_running = true;
+
+    return true;
+}
+
+void green_cleanup(void)
+{
+    int r;
+
+    if (!green_running)
+        return;
+
+    evsched_task_cancel_by_find(&green_task, NULL, EVSCHED_FIND_BY_FUNC);
+
+    for (r = 0; r < UCI_MAX_RADIOS; r++)
+        green_wake(&g_green[r], r, "shutdown");
+
+    green_running = false;
+}
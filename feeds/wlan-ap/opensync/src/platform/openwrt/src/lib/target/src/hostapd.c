@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "log.h"
+#include "const.h"
+#include "hostapd.h"
+
+#define HOSTAPD_CLI_TIMEOUT_MS  2000
+
+/* Datagram socket bound to its own path, hostapd answers to the sender's address */
+static int hostapd_ctrl_open(const char *ifname, const char *tag, struct sockaddr_un *local)
+{
+    struct sockaddr_un dest = { .sun_family = AF_UNIX };
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    local->sun_family = AF_UNIX;
+    snprintf(local->sun_path, sizeof(local->sun_path), "/tmp/opensync_%s_%d_%s",
+             tag, getpid(), ifname);
+    unlink(local->sun_path);
+    if (bind(fd, (struct sockaddr *)local, sizeof(*local)))
+    {
+        LOGE("%s: hostapd ctrl bind failed: %s", ifname, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    snprintf(dest.sun_path, sizeof(dest.sun_path), HOSTAPD_CTRL_DIR "/%s", ifname);
+    if (connect(fd, (struct sockaddr *)&dest, sizeof(dest)))
+    {
+        LOGD("%s: hostapd ctrl connect failed: %s", ifname, strerror(errno));
+        unlink(local->sun_path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int hostapd_cli(const char *ifname, const char *cmd, char *reply, size_t reply_len)
+{
+    struct sockaddr_un local;
+    struct pollfd pfd;
+    ssize_t len;
+    int ret = -1;
+    int fd;
+
+    if (!reply_len)
+        return -1;
+
+    fd = hostapd_ctrl_open(ifname, "hapd", &local);
+    if (fd < 0)
+        return -1;
+
+    if (send(fd, cmd, strlen(cmd), 0) < 0)
+    {
+        LOGE("%s: hostapd ctrl send failed: %s", ifname, strerror(errno));
+        goto out_unlink;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    /* Skip unsolicited "<N>" event messages, they are not our reply */
+    for (;;)
+    {
+        if (poll(&pfd, 1, HOSTAPD_CLI_TIMEOUT_MS) <= 0)
+        {
+            LOGW("%s: hostapd did not answer '%s'", ifname, cmd);
+            goto out_unlink;
+        }
+
+        len = recv(fd, reply, reply_len - 1, 0);
+        if (len < 0)
+            goto out_unlink;
+
+        reply[len] = '\0';
+        if (len == 0 || reply[0] != '<')
+            break;
+    }
+
+    ret = len;
+
+out_unlink:
+    unlink(local.sun_path);
+    close(fd);
+
+    return ret;
+}
+
+bool hostapd_cli_ok(const char *ifname, const char *cmd)
+{
+    char reply[64];
+
+    if (hostapd_cli(ifname, cmd, reply, sizeof(reply)) < 0)
+        return false;
+
+    if (strncmp(reply, "OK", 2))
+    {
+        LOGW("%s: hostapd rejected '%s': %s", ifname, cmd, reply);
+        return false;
+    }
+
+    return true;
+}
+
+ino_t hostapd_ctrl_ino(const char *ifname)
+{
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    struct stat st;
+
+    snprintf(path, sizeof(path), HOSTAPD_CTRL_DIR "/%s", ifname);
+    if (stat(path, &st))
+        return 0;
+
+    return st.st_ino;
+}
+
+time_t hostapd_ctrl_start(const char *ifname)
+{
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    struct stat st;
+
+    snprintf(path, sizeof(path), HOSTAPD_CTRL_DIR "/%s", ifname);
+    if (stat(path, &st))
+        return 0;
+
+    return st.st_mtime;
+}
+
+int hostapd_monitor_open(const char *ifname)
+{
+    struct sockaddr_un local;
+    struct pollfd pfd;
+    char reply[16];
+    ssize_t len;
+    int fd;
+
+    fd = hostapd_ctrl_open(ifname, "hapd_mon", &local);
+    if (fd < 0)
+        return -1;
+
+    if (send(fd, "ATTACH", 6, 0) < 0)
+        goto err;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, HOSTAPD_CLI_TIMEOUT_MS) <= 0)
+        goto err;
+
+    len = recv(fd, reply, sizeof(reply) - 1, 0);
+    if (len < 2 || strncmp(reply, "OK", 2))
+        goto err;
+
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK))
+        goto err;
+
+    return fd;
+
+err:
+    LOGW("%s: hostapd monitor attach failed", ifname);
+    unlink(local.sun_path);
+    close(fd);
+
+    return -1;
+}
+
+void hostapd_monitor_close(const char *ifname, int fd)
+{
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+    if (fd < 0)
+        return;
+
+    /* Best effort, hostapd drops monitors it can't reach anyway */
+    send(fd, "DETACH", 6, MSG_DONTWAIT);
+    close(fd);
+
+    snprintf(path, sizeof(path), "/tmp/opensync_hapd_mon_%d_%s", getpid(), ifname);
+    unlink(path);
+}
+
+int hostapd_monitor_recv(int fd, char *event, size_t event_len)
+{
+    char buf[512];
+    const char *p;
+    ssize_t len;
+
+    if (!event_len)
+        return -1;
+
+    len = recv(fd, buf, sizeof(buf) - 1, 0);
+    if (len < 0)
+        return errno == EAGAIN ? 0 : -1;
+
+    buf[len] = '\0';
+
+    /* Drop the "<level>" prefix */
+    p = buf;
+    if (*p == '<' && (p = strchr(p, '>')) != NULL)
+        p++;
+    else
+        p = buf;
+
+    snprintf(event, event_len, "%s", p);
+
+    return strlen(event);
+}
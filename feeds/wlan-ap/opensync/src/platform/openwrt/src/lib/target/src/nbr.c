@@ -0,0 +1,268 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "log.h"
+#include "const.h"
+#include "os_time.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "nbr.h"
+
+#define WLAN_EID_SSID           0
+#define WLAN_EID_BSS_LOAD       11
+#define WLAN_EID_HT_OPERATION   61
+#define WLAN_EID_VHT_OPERATION  192
+
+struct nbr_phy
+{
+    char            name[IFNAMSIZ];
+    ds_tree_t       nbrs;
+    ds_tree_node_t  node;
+};
+
+static ds_tree_t nbr_phy_tree = DS_TREE_INIT(ds_str_cmp, struct nbr_phy, node);
+static bool nbr_events_registered = false;
+
+static struct nbr_phy *nbr_phy_get(const char *name)
+{
+    struct nbr_phy *phy;
+
+    phy = ds_tree_find(&nbr_phy_tree, (void *)name);
+    if (phy)
+        return phy;
+
+    phy = calloc(1, sizeof(*phy));
+    if (!phy)
+        return NULL;
+
+    STRSCPY(phy->name, name);
+    ds_tree_init(&phy->nbrs, ds_str_cmp, struct wifi_nbr, node);
+    ds_tree_insert(&nbr_phy_tree, phy, phy->name);
+
+    return phy;
+}
+
+static void nbr_parse_ies(struct wifi_nbr *nbr, const uint8_t *ie, int len)
+{
+    int seg0;
+    int seg1;
+
+    while (len >= 2 && ie[1] + 2 <= len)
+    {
+        switch (ie[0])
+        {
+            case WLAN_EID_SSID:
+                if (ie[1] < sizeof(nbr->ssid))
+                {
+                    memcpy(nbr->ssid, ie + 2, ie[1]);
+                    nbr->ssid[ie[1]] = '\0';
+                }
+                break;
+
+            case WLAN_EID_BSS_LOAD:
+                if (ie[1] >= 5)
+                    nbr->load = ie[4] * 100 / 255;
+                break;
+
+            case WLAN_EID_HT_OPERATION:
+                if (ie[1] >= 2 && (ie[3] & 0x04))
+                {
+                    if ((ie[3] & 0x03) == 1)
+                        nbr->hi = nbr->primary + 4;
+                    else if ((ie[3] & 0x03) == 3)
+                        nbr->lo = nbr->primary - 4;
+                }
+                break;
+
+            case WLAN_EID_VHT_OPERATION:
+                if (ie[1] >= 3 && ie[2] == 1)
+                {
+                    seg0 = ie[3];
+                    seg1 = ie[4];
+                    if (seg1 && abs(seg1 - seg0) == 8)
+                    {
+                        nbr->lo = seg1 - 14;
+                        nbr->hi = seg1 + 14;
+                    }
+                    else
+                    {
+                        nbr->lo = seg0 - 6;
+                        nbr->hi = seg0 + 6;
+                    }
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        len -= ie[1] + 2;
+        ie += ie[1] + 2;
+    }
+}
+
+static int nbr_scan_cb(struct nl_msg *msg, void *arg)
+{
+    struct nbr_phy *phy = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct nlattr *bss[NL80211_BSS_MAX + 1];
+    struct wifi_nbr *nbr;
+    const uint8_t *mac;
+    char bssid[18];
+    int64_t now = clock_mono_ms();
+    uint32_t age = 0;
+
+    nl80211_parse(msg, tb);
+
+    if (!tb[NL80211_ATTR_BSS])
+        return NL_SKIP;
+
+    if (nla_parse_nested(bss, NL80211_BSS_MAX, tb[NL80211_ATTR_BSS], NULL))
+        return NL_SKIP;
+
+    if (!bss[NL80211_BSS_BSSID] || !bss[NL80211_BSS_FREQUENCY])
+        return NL_SKIP;
+
+    if (bss[NL80211_BSS_SEEN_MS_AGO])
+        age = nla_get_u32(bss[NL80211_BSS_SEEN_MS_AGO]);
+
+    mac = nla_data(bss[NL80211_BSS_BSSID]);
+    snprintf(bssid, sizeof(bssid), "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    nbr = ds_tree_find(&phy->nbrs, bssid);
+    if (!nbr)
+    {
+        nbr = calloc(1, sizeof(*nbr));
+        if (!nbr)
+            return NL_SKIP;
+        STRSCPY(nbr->bssid, bssid);
+        ds_tree_insert(&phy->nbrs, nbr, nbr->bssid);
+    }
+    else if (now - (int64_t)age <= nbr->seen)
+    {
+        /* Nothing newer than what we already have */
+        return NL_SKIP;
+    }
+
+    nbr->primary = phy_freq_to_channel(nla_get_u32(bss[NL80211_BSS_FREQUENCY]));
+    nbr->lo = nbr->primary;
+    nbr->hi = nbr->primary;
+    nbr->rssi = bss[NL80211_BSS_SIGNAL_MBM] ?
+                (int32_t)nla_get_u32(bss[NL80211_BSS_SIGNAL_MBM]) / 100 : -95;
+    nbr->load = -1;
+    nbr->ssid[0] = '\0';
+    nbr->seen = now - age;
+
+    if (bss[NL80211_BSS_INFORMATION_ELEMENTS])
+        nbr_parse_ies(nbr, nla_data(bss[NL80211_BSS_INFORMATION_ELEMENTS]),
+                      nla_len(bss[NL80211_BSS_INFORMATION_ELEMENTS]));
+
+    return NL_SKIP;
+}
+
+static void nbr_scan_read(struct nbr_phy *phy, uint32_t ifindex)
+{
+    struct nl_msg *msg;
+
+    msg = nl80211_msg(NL80211_CMD_GET_SCAN, NLM_F_DUMP);
+    if (!msg)
+        return;
+
+    nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+
+    if (nl80211_send(msg, nbr_scan_cb, phy))
+        LOGD("%s: scan dump failed", phy->name);
+}
+
+static void nbr_scan_event_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    char phy_name[IFNAMSIZ];
+    struct nbr_phy *phy;
+    uint32_t ifindex;
+
+    if (!tb[NL80211_ATTR_IFINDEX])
+        return;
+
+    ifindex = nla_get_u32(tb[NL80211_ATTR_IFINDEX]);
+    if (phy_from_ifindex(ifindex, phy_name, sizeof(phy_name)))
+        return;
+
+    phy = nbr_phy_get(phy_name);
+    if (phy)
+        nbr_scan_read(phy, ifindex);
+}
+
+void nbr_refresh(const char *phy_name, const char *ifname)
+{
+    struct nbr_phy *phy;
+    unsigned int ifindex;
+
+    ifindex = if_nametoindex(ifname);
+    if (!ifindex)
+        return;
+
+    phy = nbr_phy_get(phy_name);
+    if (phy)
+        nbr_scan_read(phy, ifindex);
+}
+
+ds_tree_t *nbr_get(const char *phy_name)
+{
+    struct nbr_phy *phy;
+    struct wifi_nbr *nbr;
+    ds_tree_iter_t iter;
+    int64_t now = clock_mono_ms();
+
+    phy = nbr_phy_get(phy_name);
+    if (!phy)
+        return NULL;
+
+    ds_tree_foreach_iter(&phy->nbrs, nbr, &iter)
+    {
+        if (now - nbr->seen <= NBR_MAX_AGE_MS)
+            continue;
+
+        ds_tree_iremove(&iter);
+        free(nbr);
+    }
+
+    return &phy->nbrs;
+}
+
+bool nbr_init(void)
+{
+    if (!nbr_events_registered)
+    {
+        nl80211_event_register(NL80211_CMD_NEW_SCAN_RESULTS, nbr_scan_event_cb, NULL);
+        nbr_events_registered = true;
+    }
+
+    return true;
+}
+
+void nbr_cleanup(void)
+{
+    struct nbr_phy *phy;
+    struct wifi_nbr *nbr;
+    ds_tree_iter_t iter;
+    ds_tree_iter_t niter;
+
+    ds_tree_foreach_iter(&nbr_phy_tree, phy, &iter)
+    {
+        ds_tree_foreach_iter(&phy->nbrs, nbr, &niter)
+        {
+            ds_tree_iremove(&niter);
+            free(nbr);
+        }
+
+        ds_tree_iremove(&iter);
+        free(phy);
+    }
+
+    nbr_events_registered = false;
+}
@@ -0,0 +1,440 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "log.h"
+#include "const.h"
+#include "nl80211.h"
+
+#define NL80211_HANDLER_MAX     32
+
+struct nl80211_handler
+{
+    uint8_t                 cmd;
+    nl80211_event_cb_t      cb;
+    void                    *arg;
+};
+
+struct nl80211_req
+{
+    nl80211_resp_cb_t       cb;
+    void                    *arg;
+    int                     err;
+    bool                    done;
+};
+
+static struct nl_sock *nl_cmd_sock = NULL;
+static struct nl_sock *nl_evt_sock = NULL;
+static struct nl_cb *nl_evt_cb = NULL;
+static int nl80211_id = -1;
+
+static struct ev_loop *nl_evt_loop = NULL;
+static ev_io nl_evt_io;
+
+static struct nl80211_handler nl_handlers[NL80211_HANDLER_MAX];
+static int nl_handlers_num = 0;
+
+static const char *nl80211_mcast_groups[] =
+{
+    "config",
+    "mlme",
+    "regulatory",
+    "scan",
+};
+
+static struct nl_sock *nl80211_sock_alloc(void)
+{
+    struct nl_sock *sock;
+
+    sock = nl_socket_alloc();
+    if (!sock)
+    {
+        LOGE("nl80211: failed to allocate netlink socket");
+        return NULL;
+    }
+
+    if (genl_connect(sock))
+    {
+        LOGE("nl80211: failed to connect generic netlink");
+        nl_socket_free(sock);
+        return NULL;
+    }
+
+    nl_socket_set_buffer_size(sock, 256 * 1024, 0);
+
+    return sock;
+}
+
+static bool nl80211_cmd_sock_get(void)
+{
+    if (nl_cmd_sock)
+        return true;
+
+    nl_cmd_sock = nl80211_sock_alloc();
+    if (!nl_cmd_sock)
+        return false;
+
+    nl80211_id = genl_ctrl_resolve(nl_cmd_sock, "nl80211");
+    if (nl80211_id < 0)
+    {
+        LOGE("nl80211: family not found");
+        nl_socket_free(nl_cmd_sock);
+        nl_cmd_sock = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static int nl80211_finish_cb(struct nl_msg *msg, void *arg)
+{
+    struct nl80211_req *req = arg;
+
+    req->done = true;
+    return NL_SKIP;
+}
+
+static int nl80211_ack_cb(struct nl_msg *msg, void *arg)
+{
+    struct nl80211_req *req = arg;
+
+    req->done = true;
+    return NL_STOP;
+}
+
+static int nl80211_error_cb(struct sockaddr_nl *nla, struct nlmsgerr *err, void *arg)
+{
+    struct nl80211_req *req = arg;
+
+    req->err = err->error;
+    req->done = true;
+    return NL_STOP;
+}
+
+static int nl80211_valid_cb(struct nl_msg *msg, void *arg)
+{
+    struct nl80211_req *req = arg;
+
+    if (req->cb)
+        return req->cb(msg, req->arg);
+
+    return NL_SKIP;
+}
+
+static int nl80211_no_seq_check(struct nl_msg *msg, void *arg)
+{
+    return NL_OK;
+}
+
+struct nl_msg *nl80211_msg(uint8_t cmd, int flags)
+{
+    struct nl_msg *msg;
+
+    if (!nl80211_cmd_sock_get())
+        return NULL;
+
+    msg = nlmsg_alloc();
+    if (!msg)
+        return NULL;
+
+    if (!genlmsg_put(msg, 0, 0, nl80211_id, 0, flags, cmd, 0))
+    {
+        nlmsg_free(msg);
+        return NULL;
+    }
+
+    return msg;
+}
+
+int nl80211_send_sock(struct nl_sock *sock, struct nl_msg *msg, nl80211_resp_cb_t cb, void *arg)
+{
+    struct nl80211_req req = { .cb = cb, .arg = arg, .err = 0, .done = false };
+    struct nl_cb *nlcb;
+    int ret;
+
+    if (!msg)
+        return -EINVAL;
+
+    if (!sock)
+    {
+        nlmsg_free(msg);
+        return -ENOTCONN;
+    }
+
+    nlcb = nl_cb_alloc(NL_CB_DEFAULT);
+    if (!nlcb)
+    {
+        nlmsg_free(msg);
+        return -ENOMEM;
+    }
+
+    nl_cb_set(nlcb, NL_CB_VALID, NL_CB_CUSTOM, nl80211_valid_cb, &req);
+    nl_cb_set(nlcb, NL_CB_FINISH, NL_CB_CUSTOM, nl80211_finish_cb, &req);
+    nl_cb_set(nlcb, NL_CB_ACK, NL_CB_CUSTOM, nl80211_ack_cb, &req);
+    nl_cb_err(nlcb, NL_CB_CUSTOM, nl80211_error_cb, &req);
+
+    ret = nl_send_auto_complete(sock, msg);
+    if (ret < 0)
+    {
+        LOGE("nl80211: failed to send command %d", genlmsg_hdr(nlmsg_hdr(msg))->cmd);
+        goto out;
+    }
+
+    while (!req.done)
+    {
+        ret = nl_recvmsgs(sock, nlcb);
+        if (ret < 0)
+            break;
+    }
+
+    if (ret >= 0)
+        ret = req.err;
+
+out:
+    nl_cb_put(nlcb);
+    nlmsg_free(msg);
+
+    return ret;
+}
+
+int nl80211_send(struct nl_msg *msg, nl80211_resp_cb_t cb, void *arg)
+{
+    if (!nl80211_cmd_sock_get())
+    {
+        nlmsg_free(msg);
+        return -ENOTCONN;
+    }
+
+    return nl80211_send_sock(nl_cmd_sock, msg, cb, arg);
+}
+
+/*
+ * Sockets are not shared between threads, a worker gets its own. Must be
+ * called from the main thread: it resolves the family id nl80211_msg()
+ * relies on.
+ */
+struct nl_sock *nl80211_sock_open(void)
+{
+    if (!nl80211_cmd_sock_get())
+        return NULL;
+
+    return nl80211_sock_alloc();
+}
+
+void nl80211_sock_close(struct nl_sock *sock)
+{
+    if (sock)
+        nl_socket_free(sock);
+}
+
+int nl80211_parse(struct nl_msg *msg, struct nlattr **tb)
+{
+    struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+
+    return nla_parse(tb, NL80211_ATTR_MAX, genlmsg_attrdata(gnlh, 0),
+                     genlmsg_attrlen(gnlh, 0), NULL);
+}
+
+bool nl80211_event_register(uint8_t cmd, nl80211_event_cb_t cb, void *arg)
+{
+    if (nl_handlers_num >= NL80211_HANDLER_MAX)
+    {
+        LOGE("nl80211: too many event handlers");
+        return false;
+    }
+
+    nl_handlers[nl_handlers_num].cmd = cmd;
+    nl_handlers[nl_handlers_num].cb = cb;
+    nl_handlers[nl_handlers_num].arg = arg;
+    nl_handlers_num++;
+
+    return true;
+}
+
+static int nl80211_event_cb(struct nl_msg *msg, void *arg)
+{
+    struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    int i;
+
+    nl80211_parse(msg, tb);
+
+    for (i = 0; i < nl_handlers_num; i++)
+    {
+        if (nl_handlers[i].cmd == gnlh->cmd)
+            nl_handlers[i].cb(gnlh->cmd, tb, nl_handlers[i].arg);
+    }
+
+    return NL_SKIP;
+}
+
+static void nl80211_evt_io_cb(struct ev_loop *loop, ev_io *io, int revents)
+{
+    int ret;
+
+    ret = nl_recvmsgs(nl_evt_sock, nl_evt_cb);
+    if (ret < 0 && ret != -NLE_AGAIN)
+        LOGW("nl80211: event receive failed: %d", ret);
+}
+
+struct nl80211_mcast_req
+{
+    const char  *group;
+    int         id;
+};
+
+static int nl80211_family_cb(struct nl_msg *msg, void *arg)
+{
+    struct nl80211_mcast_req *req = arg;
+    struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+    struct nlattr *tb[CTRL_ATTR_MAX + 1];
+    struct nlattr *grp;
+    int rem;
+
+    nla_parse(tb, CTRL_ATTR_MAX, genlmsg_attrdata(gnlh, 0),
+              genlmsg_attrlen(gnlh, 0), NULL);
+
+    if (!tb[CTRL_ATTR_MCAST_GROUPS])
+        return NL_SKIP;
+
+    nla_for_each_nested(grp, tb[CTRL_ATTR_MCAST_GROUPS], rem)
+    {
+        struct nlattr *tb_grp[CTRL_ATTR_MCAST_GRP_MAX + 1];
+
+        nla_parse(tb_grp, CTRL_ATTR_MCAST_GRP_MAX, nla_data(grp), nla_len(grp), NULL);
+
+        if (!tb_grp[CTRL_ATTR_MCAST_GRP_NAME] || !tb_grp[CTRL_ATTR_MCAST_GRP_ID])
+            continue;
+
+        if (strcmp(nla_get_string(tb_grp[CTRL_ATTR_MCAST_GRP_NAME]), req->group))
+            continue;
+
+        req->id = nla_get_u32(tb_grp[CTRL_ATTR_MCAST_GRP_ID]);
+        break;
+    }
+
+    return NL_SKIP;
+}
+
+static int nl80211_mcast_id(const char *group)
+{
+    struct nl80211_mcast_req req = { .group = group, .id = -ENOENT };
+    struct nl80211_req ctx = { .cb = nl80211_family_cb, .arg = &req };
+    struct nl_msg *msg;
+    struct nl_cb *nlcb;
+    int ctrl_id;
+    int ret;
+
+    ctrl_id = genl_ctrl_resolve(nl_cmd_sock, "nlctrl");
+    if (ctrl_id < 0)
+        return ctrl_id;
+
+    msg = nlmsg_alloc();
+    if (!msg)
+        return -ENOMEM;
+
+    nlcb = nl_cb_alloc(NL_CB_DEFAULT);
+    if (!nlcb)
+    {
+        nlmsg_free(msg);
+        return -ENOMEM;
+    }
+
+    genlmsg_put(msg, 0, 0, ctrl_id, 0, 0, CTRL_CMD_GETFAMILY, 0);
+    nla_put_string(msg, CTRL_ATTR_FAMILY_NAME, "nl80211");
+
+    nl_cb_set(nlcb, NL_CB_VALID, NL_CB_CUSTOM, nl80211_valid_cb, &ctx);
+    nl_cb_set(nlcb, NL_CB_FINISH, NL_CB_CUSTOM, nl80211_finish_cb, &ctx);
+    nl_cb_set(nlcb, NL_CB_ACK, NL_CB_CUSTOM, nl80211_ack_cb, &ctx);
+    nl_cb_err(nlcb, NL_CB_CUSTOM, nl80211_error_cb, &ctx);
+
+    ret = nl_send_auto_complete(nl_cmd_sock, msg);
+    while (ret >= 0 && !ctx.done)
+        ret = nl_recvmsgs(nl_cmd_sock, nlcb);
+
+    nl_cb_put(nlcb);
+    nlmsg_free(msg);
+
+    if (ret < 0)
+        return ret;
+    if (ctx.err)
+        return ctx.err;
+
+    return req.id;
+}
+
+bool nl80211_init(struct ev_loop *loop)
+{
+    unsigned int i;
+    int fd;
+    int id;
+
+    if (nl_evt_sock)
+        return true;
+
+    if (!nl80211_cmd_sock_get())
+        return false;
+
+    nl_evt_sock = nl80211_sock_alloc();
+    if (!nl_evt_sock)
+        return false;
+
+    for (i = 0; i < ARRAY_SIZE(nl80211_mcast_groups); i++)
+    {
+        id = nl80211_mcast_id(nl80211_mcast_groups[i]);
+        if (id < 0)
+        {
+            LOGW("nl80211: multicast group %s not found", nl80211_mcast_groups[i]);
+            continue;
+        }
+
+        if (nl_socket_add_membership(nl_evt_sock, id))
+            LOGW("nl80211: failed to join multicast group %s", nl80211_mcast_groups[i]);
+    }
+
+    nl_evt_cb = nl_cb_alloc(NL_CB_DEFAULT);
+    if (!nl_evt_cb)
+    {
+        nl_socket_free(nl_evt_sock);
+        nl_evt_sock = NULL;
+        return false;
+    }
+
+    nl_cb_set(nl_evt_cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, nl80211_no_seq_check, NULL);
+    nl_cb_set(nl_evt_cb, NL_CB_VALID, NL_CB_CUSTOM, nl80211_event_cb, NULL);
+
+    fd = nl_socket_get_fd(nl_evt_sock);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    nl_evt_loop = loop;
+    ev_io_init(&nl_evt_io, nl80211_evt_io_cb, fd, EV_READ);
+    ev_io_start(nl_evt_loop, &nl_evt_io);
+
+    LOGI("nl80211: listening for events");
+
+    return true;
+}
+
+void nl80211_cleanup(void)
+{
+    if (nl_evt_sock)
+    {
+        ev_io_stop(nl_evt_loop, &nl_evt_io);
+        nl_cb_put(nl_evt_cb);
+        nl_socket_free(nl_evt_sock);
+        nl_evt_cb = NULL;
+        nl_evt_sock = NULL;
+    }
+
+    if (nl_cmd_sock)
+    {
+        nl_socket_free(nl_cmd_sock);
+        nl_cmd_sock = NULL;
+    }
+
+    nl_handlers_num = 0;
+}
@@ -0,0 +1,1214 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "os_time.h"
+#include "nl80211.h"
+#include "phy.h"
+
+#define PHY_SYSFS_PATH      "/sys/class/ieee80211"
+#define PHY_DEVICES_PATH    "/sys/devices/"
+
+/* Not known to older uapi headers */
+#define PHY_RADAR_CAC_STARTED   5
+
+/* Tx power and AP start/stop send no event, entries older get read again */
+#define PHY_IFACE_MAX_AGE_MS    10000
+
+static ds_tree_t phy_tree = DS_TREE_INIT(ds_str_cmp, struct wifi_phy, node);
+static bool phy_events_registered = false;
+/* The last full dump found every phy, a miss needs no new dump */
+static bool phy_tree_complete = false;
+
+/* Cached interface, keyed by ifindex as a rename keeps it */
+struct phy_iface
+{
+    int             ifindex;
+    char            ifname[IFNAMSIZ];
+    uint32_t        wiphy;
+    uint8_t         addr[6];
+    bool            addr_valid;
+    struct wifi_oper oper;          /* freq 0 while not on a channel */
+    int64_t         read_ms;
+    bool            seen;
+    ds_tree_node_t  node;
+};
+
+static ds_tree_t phy_iface_tree = DS_TREE_INIT(ds_int_cmp, struct phy_iface, node);
+/* Filled by a full dump and kept so by the interface events */
+static bool phy_iface_complete = false;
+
+struct phy_dump_ctx
+{
+    ds_tree_t       seen;
+};
+
+struct phy_seen
+{
+    char            name[IFNAMSIZ];
+    ds_tree_node_t  node;
+};
+
+static int popcount32(uint32_t v)
+{
+    int n = 0;
+
+    while (v)
+    {
+        v &= v - 1;
+        n++;
+    }
+
+    return n;
+}
+
+static struct wifi_phy *phy_find_idx(uint32_t wiphy)
+{
+    struct wifi_phy *phy;
+
+    ds_tree_foreach(&phy_tree, phy)
+    {
+        if (phy->wiphy == wiphy)
+            return phy;
+    }
+
+    return NULL;
+}
+
+static struct wifi_phy *phy_lookup_or_add(const char *name, uint32_t wiphy)
+{
+    struct wifi_phy *phy;
+
+    phy = ds_tree_find(&phy_tree, (void *)name);
+    if (phy)
+        return phy;
+
+    /* A renamed phy keeps its index, drop the stale entry */
+    phy = phy_find_idx(wiphy);
+    if (phy)
+    {
+        ds_tree_remove(&phy_tree, phy);
+        free(phy);
+    }
+
+    phy = calloc(1, sizeof(*phy));
+    if (!phy)
+        return NULL;
+
+    STRSCPY(phy->name, name);
+    phy->wiphy = wiphy;
+    ds_tree_insert(&phy_tree, phy, phy->name);
+
+    return phy;
+}
+
+static void phy_reset_caps(struct wifi_phy *phy)
+{
+    phy->tx_ant_avail = 0;
+    phy->rx_ant_avail = 0;
+    phy->tx_ant = 0;
+    phy->rx_ant = 0;
+    phy->ht_capa = 0;
+    phy->vht_capa = 0;
+    phy->ht_streams = 0;
+    phy->vht_streams = 0;
+    phy->he = false;
+    phy->band_2g = false;
+    phy->band_5g = false;
+    phy->airtime_fairness = false;
+    phy->n_chans = 0;
+}
+
+static int phy_ht_streams(const uint8_t *mcs)
+{
+    int streams = 0;
+    int i;
+
+    /* rx mcs bitmask, one byte per spatial stream */
+    for (i = 0; i < 4; i++)
+    {
+        if (mcs[i])
+            streams = i + 1;
+    }
+
+    return streams;
+}
+
+static int phy_vht_streams(const uint8_t *mcs)
+{
+    uint16_t map = mcs[0] | (mcs[1] << 8);
+    int streams = 0;
+    int i;
+
+    /* rx mcs map, two bits per spatial stream, 3 means not supported */
+    for (i = 0; i < 8; i++)
+    {
+        if (((map >> (i * 2)) & 3) != 3)
+            streams = i + 1;
+    }
+
+    return streams;
+}
+
+static void phy_parse_freq(struct wifi_phy *phy, struct nlattr *freq)
+{
+    struct nlattr *tb[NL80211_FREQUENCY_ATTR_MAX + 1];
+    struct wifi_chan *chan;
+
+    nla_parse(tb, NL80211_FREQUENCY_ATTR_MAX, nla_data(freq), nla_len(freq), NULL);
+
+    if (!tb[NL80211_FREQUENCY_ATTR_FREQ])
+        return;
+
+    if (phy->n_chans >= PHY_MAX_CHANNELS)
+    {
+        LOGW("%s: too many channels", phy->name);
+        return;
+    }
+
+    chan = &phy->chans[phy->n_chans++];
+    memset(chan, 0, sizeof(*chan));
+    chan->freq = nla_get_u32(tb[NL80211_FREQUENCY_ATTR_FREQ]);
+    chan->chan = phy_freq_to_channel(chan->freq);
+    chan->disabled = !!tb[NL80211_FREQUENCY_ATTR_DISABLED];
+    chan->radar = !!tb[NL80211_FREQUENCY_ATTR_RADAR];
+    chan->no_ir = !!tb[NL80211_FREQUENCY_ATTR_NO_IR];
+    if (tb[NL80211_FREQUENCY_ATTR_MAX_TX_POWER])
+        /* reported in mBm */
+        chan->max_eirp = nla_get_u32(tb[NL80211_FREQUENCY_ATTR_MAX_TX_POWER]) / 100;
+    if (tb[NL80211_FREQUENCY_ATTR_DFS_STATE])
+        chan->dfs_state = nla_get_u32(tb[NL80211_FREQUENCY_ATTR_DFS_STATE]);
+}
+
+static void phy_parse_band(struct wifi_phy *phy, struct nlattr *band)
+{
+    struct nlattr *tb[NL80211_BAND_ATTR_MAX + 1];
+    struct nlattr *freq;
+    struct nlattr *attr;
+    struct nlattr *iftype;
+    struct nlattr *cap;
+    int streams;
+    int rem;
+    int rem2;
+    int rem3;
+
+    nla_parse(tb, NL80211_BAND_ATTR_MAX, nla_data(band), nla_len(band), NULL);
+
+    switch (nla_type(band))
+    {
+        case NL80211_BAND_2GHZ:
+            phy->band_2g = true;
+            break;
+        case NL80211_BAND_5GHZ:
+            phy->band_5g = true;
+            break;
+        default:
+            break;
+    }
+
+    if (tb[NL80211_BAND_ATTR_HT_CAPA])
+        phy->ht_capa |= nla_get_u16(tb[NL80211_BAND_ATTR_HT_CAPA]);
+
+    if (tb[NL80211_BAND_ATTR_HT_MCS_SET] && nla_len(tb[NL80211_BAND_ATTR_HT_MCS_SET]) >= 16)
+    {
+        streams = phy_ht_streams(nla_data(tb[NL80211_BAND_ATTR_HT_MCS_SET]));
+        if (streams > phy->ht_streams)
+            phy->ht_streams = streams;
+    }
+
+    if (tb[NL80211_BAND_ATTR_VHT_CAPA])
+        phy->vht_capa |= nla_get_u32(tb[NL80211_BAND_ATTR_VHT_CAPA]);
+
+    if (tb[NL80211_BAND_ATTR_VHT_MCS_SET] && nla_len(tb[NL80211_BAND_ATTR_VHT_MCS_SET]) >= 8)
+    {
+        streams = phy_vht_streams(nla_data(tb[NL80211_BAND_ATTR_VHT_MCS_SET]));
+        if (streams > phy->vht_streams)
+            phy->vht_streams = streams;
+    }
+
+    if (tb[NL80211_BAND_ATTR_FREQS])
+    {
+        nla_for_each_nested(freq, tb[NL80211_BAND_ATTR_FREQS], rem)
+            phy_parse_freq(phy, freq);
+    }
+
+    /* Past NL80211_BAND_ATTR_MAX of older headers, walk the band by hand */
+    nla_for_each_nested(attr, band, rem)
+    {
+        if (nla_type(attr) != NL80211_COMPAT_BAND_ATTR_IFTYPE_DATA)
+            continue;
+
+        nla_for_each_nested(iftype, attr, rem2)
+        {
+            nla_for_each_nested(cap, iftype, rem3)
+            {
+                if (nla_type(cap) == NL80211_COMPAT_BAND_IFTYPE_ATTR_HE_CAP_PHY && nla_len(cap) > 0)
+                    phy->he = true;
+            }
+        }
+    }
+}
+
+static bool phy_ext_feature(struct nlattr *attr, int feature)
+{
+    const uint8_t *bits = nla_data(attr);
+
+    if (feature / 8 >= nla_len(attr))
+        return false;
+
+    return bits[feature / 8] & (1 << (feature % 8));
+}
+
+static int phy_dump_cb(struct nl_msg *msg, void *arg)
+{
+    struct phy_dump_ctx *ctx = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct wifi_phy *phy;
+    struct phy_seen *seen;
+    struct nlattr *band;
+    const char *name;
+    int rem;
+
+    nl80211_parse(msg, tb);
+
+    if (!tb[NL80211_ATTR_WIPHY] || !tb[NL80211_ATTR_WIPHY_NAME])
+        return NL_SKIP;
+
+    name = nla_get_string(tb[NL80211_ATTR_WIPHY_NAME]);
+    phy = phy_lookup_or_add(name, nla_get_u32(tb[NL80211_ATTR_WIPHY]));
+    if (!phy)
+        return NL_SKIP;
+
+    /* Split dumps spread one phy over many messages, reset on the first */
+    if (!ds_tree_find(&ctx->seen, phy->name))
+    {
+        seen = calloc(1, sizeof(*seen));
+        if (seen)
+        {
+            STRSCPY(seen->name, phy->name);
+            ds_tree_insert(&ctx->seen, seen, seen->name);
+        }
+        phy_reset_caps(phy);
+    }
+
+    if (tb[NL80211_ATTR_WIPHY_ANTENNA_AVAIL_TX])
+        phy->tx_ant_avail = nla_get_u32(tb[NL80211_ATTR_WIPHY_ANTENNA_AVAIL_TX]);
+    if (tb[NL80211_ATTR_WIPHY_ANTENNA_AVAIL_RX])
+        phy->rx_ant_avail = nla_get_u32(tb[NL80211_ATTR_WIPHY_ANTENNA_AVAIL_RX]);
+    if (tb[NL80211_ATTR_WIPHY_ANTENNA_TX])
+        phy->tx_ant = nla_get_u32(tb[NL80211_ATTR_WIPHY_ANTENNA_TX]);
+    if (tb[NL80211_ATTR_WIPHY_ANTENNA_RX])
+        phy->rx_ant = nla_get_u32(tb[NL80211_ATTR_WIPHY_ANTENNA_RX]);
+
+    if (tb[NL80211_ATTR_EXT_FEATURES])
+        phy->airtime_fairness = phy_ext_feature(tb[NL80211_ATTR_EXT_FEATURES],
+                                                NL80211_COMPAT_EXT_FEATURE_AIRTIME_FAIRNESS);
+
+    if (tb[NL80211_ATTR_WIPHY_BANDS])
+    {
+        nla_for_each_nested(band, tb[NL80211_ATTR_WIPHY_BANDS], rem)
+            phy_parse_band(phy, band);
+    }
+
+    return NL_SKIP;
+}
+
+static void phy_check_antennas(const struct wifi_phy *phy)
+{
+    int chains;
+    int streams;
+
+    if (phy->tx_ant & ~phy->tx_ant_avail)
+        LOGW("%s: tx antenna mask 0x%x exceeds available 0x%x",
+             phy->name, phy->tx_ant, phy->tx_ant_avail);
+
+    if (phy->rx_ant & ~phy->rx_ant_avail)
+        LOGW("%s: rx antenna mask 0x%x exceeds available 0x%x",
+             phy->name, phy->rx_ant, phy->rx_ant_avail);
+
+    chains = popcount32(phy_tx_chainmask(phy));
+    streams = phy_max_streams(phy);
+    if (chains && streams && chains < streams)
+        LOGW("%s: only %d tx chains enabled for %d spatial streams",
+             phy->name, chains, streams);
+}
+
+static int phy_reg_cb(struct nl_msg *msg, void *arg)
+{
+    struct wifi_phy *phy = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+
+    nl80211_parse(msg, tb);
+
+    if (tb[NL80211_ATTR_REG_ALPHA2])
+        STRSCPY(phy->country, nla_get_string(tb[NL80211_ATTR_REG_ALPHA2]));
+
+    return NL_SKIP;
+}
+
+/* Self-managed phys have their own domain, the others report the global one */
+static void phy_reg_get(struct wifi_phy *phy)
+{
+    struct nl_msg *msg;
+    int ret;
+
+    msg = nl80211_msg(NL80211_CMD_GET_REG, 0);
+    if (!msg)
+        return;
+
+    nla_put_u32(msg, NL80211_ATTR_WIPHY, phy->wiphy);
+
+    ret = nl80211_send(msg, phy_reg_cb, phy);
+    if (ret)
+        LOGW("%s: failed to get regulatory domain: %d", phy->name, ret);
+    else
+        LOGD("%s: country %s", phy->name, phy->country);
+}
+
+static bool phy_dump(int64_t wiphy)
+{
+    struct phy_dump_ctx ctx;
+    struct phy_seen *seen;
+    struct wifi_phy *phy;
+    ds_tree_iter_t iter;
+    struct nl_msg *msg;
+    int ret;
+
+    msg = nl80211_msg(NL80211_CMD_GET_WIPHY, NLM_F_DUMP);
+    if (!msg)
+        return false;
+
+    nla_put_flag(msg, NL80211_ATTR_SPLIT_WIPHY_DUMP);
+    if (wiphy >= 0)
+        nla_put_u32(msg, NL80211_ATTR_WIPHY, (uint32_t)wiphy);
+
+    ds_tree_init(&ctx.seen, ds_str_cmp, struct phy_seen, node);
+
+    ret = nl80211_send(msg, phy_dump_cb, &ctx);
+
+    /* A full dump also tells us which phys are gone */
+    if (!ret && wiphy < 0)
+    {
+        phy_tree_complete = true;
+        ds_tree_foreach_iter(&phy_tree, phy, &iter)
+        {
+            if (ds_tree_find(&ctx.seen, phy->name))
+                continue;
+
+            LOGI("%s: phy removed", phy->name);
+            ds_tree_iremove(&iter);
+            free(phy);
+        }
+    }
+
+    ds_tree_foreach_iter(&ctx.seen, seen, &iter)
+    {
+        phy = ds_tree_find(&phy_tree, seen->name);
+        if (phy)
+        {
+            phy_check_antennas(phy);
+            phy_reg_get(phy);
+        }
+
+        ds_tree_iremove(&iter);
+        free(seen);
+    }
+
+    if (ret)
+    {
+        LOGE("nl80211: wiphy dump failed: %d", ret);
+        return false;
+    }
+
+    return true;
+}
+
+/* Copy the channel of an interface reply or CH_SWITCH_NOTIFY */
+static void phy_iface_chan(struct wifi_oper *oper, struct nlattr **tb)
+{
+    oper->freq = nla_get_u32(tb[NL80211_ATTR_WIPHY_FREQ]);
+    oper->channel = phy_freq_to_channel(oper->freq);
+    oper->width = NL80211_CHAN_WIDTH_20_NOHT;
+    oper->center_freq1 = 0;
+    oper->center_freq2 = 0;
+
+    if (tb[NL80211_ATTR_CHANNEL_WIDTH])
+        oper->width = nla_get_u32(tb[NL80211_ATTR_CHANNEL_WIDTH]);
+    if (tb[NL80211_ATTR_CENTER_FREQ1])
+        oper->center_freq1 = nla_get_u32(tb[NL80211_ATTR_CENTER_FREQ1]);
+    if (tb[NL80211_ATTR_CENTER_FREQ2])
+        oper->center_freq2 = nla_get_u32(tb[NL80211_ATTR_CENTER_FREQ2]);
+}
+
+/* NEW_INTERFACE carries the same attributes as a GET_INTERFACE reply */
+static struct phy_iface *phy_iface_parse(struct nlattr **tb)
+{
+    struct phy_iface *iface;
+    int ifindex;
+
+    if (!tb[NL80211_ATTR_IFINDEX] || !tb[NL80211_ATTR_IFNAME] || !tb[NL80211_ATTR_WIPHY])
+        return NULL;
+
+    ifindex = nla_get_u32(tb[NL80211_ATTR_IFINDEX]);
+    iface = ds_tree_find(&phy_iface_tree, &ifindex);
+    if (!iface)
+    {
+        iface = calloc(1, sizeof(*iface));
+        if (!iface)
+            return NULL;
+
+        iface->ifindex = ifindex;
+        ds_tree_insert(&phy_iface_tree, iface, &iface->ifindex);
+    }
+
+    STRSCPY(iface->ifname, nla_get_string(tb[NL80211_ATTR_IFNAME]));
+    iface->wiphy = nla_get_u32(tb[NL80211_ATTR_WIPHY]);
+
+    iface->addr_valid = tb[NL80211_ATTR_MAC] && nla_len(tb[NL80211_ATTR_MAC]) >= 6;
+    if (iface->addr_valid)
+        memcpy(iface->addr, nla_data(tb[NL80211_ATTR_MAC]), sizeof(iface->addr));
+
+    /* Interfaces that are down carry no channel */
+    memset(&iface->oper, 0, sizeof(iface->oper));
+    STRSCPY(iface->oper.ifname, iface->ifname);
+    if (tb[NL80211_ATTR_WIPHY_FREQ])
+        phy_iface_chan(&iface->oper, tb);
+
+    if (tb[NL80211_ATTR_WIPHY_TX_POWER_LEVEL])
+    {
+        /* reported in mBm */
+        iface->oper.txpower = nla_get_u32(tb[NL80211_ATTR_WIPHY_TX_POWER_LEVEL]) / 100;
+        iface->oper.txpower_valid = true;
+    }
+
+    iface->read_ms = clock_mono_ms();
+    iface->seen = true;
+
+    return iface;
+}
+
+static int phy_iface_cb(struct nl_msg *msg, void *arg)
+{
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+
+    nl80211_parse(msg, tb);
+    phy_iface_parse(tb);
+
+    return NL_SKIP;
+}
+
+static bool phy_iface_dump(void)
+{
+    struct phy_iface *iface;
+    ds_tree_iter_t iter;
+    struct nl_msg *msg;
+    int ret;
+
+    msg = nl80211_msg(NL80211_CMD_GET_INTERFACE, NLM_F_DUMP);
+    if (!msg)
+        return false;
+
+    ds_tree_foreach(&phy_iface_tree, iface)
+        iface->seen = false;
+
+    ret = nl80211_send(msg, phy_iface_cb, NULL);
+    if (ret)
+    {
+        LOGE("nl80211: interface dump failed: %d", ret);
+        return false;
+    }
+
+    ds_tree_foreach_iter(&phy_iface_tree, iface, &iter)
+    {
+        if (iface->seen)
+            continue;
+
+        ds_tree_iremove(&iter);
+        free(iface);
+    }
+    phy_iface_complete = true;
+
+    return true;
+}
+
+/* Read one interface again, false when it is gone */
+static bool phy_iface_refresh(struct phy_iface *iface)
+{
+    struct nl_msg *msg;
+    int ret;
+
+    msg = nl80211_msg(NL80211_CMD_GET_INTERFACE, 0);
+    if (!msg)
+        return true;
+
+    nla_put_u32(msg, NL80211_ATTR_IFINDEX, iface->ifindex);
+
+    ret = nl80211_send(msg, phy_iface_cb, NULL);
+    if (ret)
+    {
+        LOGD("%s: interface lookup failed: %d", iface->ifname, ret);
+        /* Could also be a transient error, let the next miss dump again */
+        phy_iface_complete = false;
+        return false;
+    }
+
+    return true;
+}
+
+/* Bring the cached interfaces of a wiphy up to date before a lookup */
+static void phy_iface_update(uint32_t wiphy)
+{
+    struct phy_iface *iface;
+    ds_tree_iter_t iter;
+    int64_t now;
+
+    if (!phy_iface_complete)
+    {
+        phy_iface_dump();
+        return;
+    }
+
+    now = clock_mono_ms();
+    ds_tree_foreach_iter(&phy_iface_tree, iface, &iter)
+    {
+        if (iface->wiphy != wiphy || now - iface->read_ms < PHY_IFACE_MAX_AGE_MS)
+            continue;
+
+        if (phy_iface_refresh(iface))
+            continue;
+
+        ds_tree_iremove(&iter);
+        free(iface);
+    }
+}
+
+static void phy_iface_event_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    struct phy_iface *iface;
+    int ifindex;
+
+    if (!tb[NL80211_ATTR_IFINDEX])
+        return;
+
+    ifindex = nla_get_u32(tb[NL80211_ATTR_IFINDEX]);
+
+    switch (cmd)
+    {
+        case NL80211_CMD_NEW_INTERFACE:
+            iface = phy_iface_parse(tb);
+            if (iface)
+                LOGD("%s: interface added on wiphy %u", iface->ifname, iface->wiphy);
+            break;
+
+        case NL80211_CMD_DEL_INTERFACE:
+            iface = ds_tree_find(&phy_iface_tree, &ifindex);
+            if (iface)
+            {
+                LOGD("%s: interface removed", iface->ifname);
+                ds_tree_remove(&phy_iface_tree, iface);
+                free(iface);
+            }
+            break;
+
+        case NL80211_CMD_CH_SWITCH_NOTIFY:
+            iface = ds_tree_find(&phy_iface_tree, &ifindex);
+            if (iface && tb[NL80211_ATTR_WIPHY_FREQ])
+                phy_iface_chan(&iface->oper, tb);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void phy_event_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    struct wifi_phy *phy;
+
+    /* A global domain change affects every phy that is not self-managed */
+    if (cmd == NL80211_CMD_REG_CHANGE)
+    {
+        LOGI("nl80211: regulatory domain changed to %s",
+             tb[NL80211_ATTR_REG_ALPHA2] ? nla_get_string(tb[NL80211_ATTR_REG_ALPHA2]) : "?");
+        phy_dump(-1);
+        return;
+    }
+
+    if (!tb[NL80211_ATTR_WIPHY])
+        return;
+
+    switch (cmd)
+    {
+        case NL80211_CMD_NEW_WIPHY:
+            /* Also sent for a renamed phy, names missing so far may exist now */
+            phy_tree_complete = false;
+            LOGD("nl80211: wiphy %u changed", nla_get_u32(tb[NL80211_ATTR_WIPHY]));
+            phy_dump(nla_get_u32(tb[NL80211_ATTR_WIPHY]));
+            break;
+
+        case NL80211_CMD_WIPHY_REG_CHANGE:
+            LOGI("nl80211: wiphy %u regulatory domain changed",
+                 nla_get_u32(tb[NL80211_ATTR_WIPHY]));
+            phy_dump(nla_get_u32(tb[NL80211_ATTR_WIPHY]));
+            break;
+
+        case NL80211_CMD_DEL_WIPHY:
+            phy = phy_find_idx(nla_get_u32(tb[NL80211_ATTR_WIPHY]));
+            if (phy)
+            {
+                LOGI("%s: phy removed", phy->name);
+                ds_tree_remove(&phy_tree, phy);
+                free(phy);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool phy_init(void)
+{
+    if (!phy_events_registered)
+    {
+        nl80211_event_register(NL80211_CMD_NEW_WIPHY, phy_event_cb, NULL);
+        nl80211_event_register(NL80211_CMD_DEL_WIPHY, phy_event_cb, NULL);
+        nl80211_event_register(NL80211_CMD_REG_CHANGE, phy_event_cb, NULL);
+        nl80211_event_register(NL80211_CMD_WIPHY_REG_CHANGE, phy_event_cb, NULL);
+        nl80211_event_register(NL80211_CMD_NEW_INTERFACE, phy_iface_event_cb, NULL);
+        nl80211_event_register(NL80211_CMD_DEL_INTERFACE, phy_iface_event_cb, NULL);
+        nl80211_event_register(NL80211_CMD_CH_SWITCH_NOTIFY, phy_iface_event_cb, NULL);
+        phy_events_registered = true;
+    }
+
+    return phy_dump(-1);
+}
+
+void phy_cleanup(void)
+{
+    struct phy_iface *iface;
+    struct wifi_phy *phy;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&phy_tree, phy, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(phy);
+    }
+    phy_tree_complete = false;
+
+    ds_tree_foreach_iter(&phy_iface_tree, iface, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(iface);
+    }
+    phy_iface_complete = false;
+}
+
+struct wifi_phy *phy_get(const char *name)
+{
+    struct wifi_phy *phy;
+
+    phy = ds_tree_find(&phy_tree, (void *)name);
+    if (phy || phy_tree_complete)
+        return phy;
+
+    if (!phy_dump(-1))
+        return NULL;
+
+    return ds_tree_find(&phy_tree, (void *)name);
+}
+
+bool phy_refresh(const char *name)
+{
+    struct wifi_phy *phy;
+
+    phy = ds_tree_find(&phy_tree, (void *)name);
+    if (!phy)
+        return phy_dump(-1);
+
+    return phy_dump(phy->wiphy);
+}
+
+int phy_from_path(const char *path, char *phy, size_t len)
+{
+    char link[PATH_MAX];
+    char real[PATH_MAX];
+    struct dirent *de;
+    DIR *dir;
+    int ret = -1;
+
+    if (!path || !*path)
+        return -1;
+
+    dir = opendir(PHY_SYSFS_PATH);
+    if (!dir)
+        return -1;
+
+    while ((de = readdir(dir)) != NULL)
+    {
+        if (de->d_name[0] == '.')
+            continue;
+
+        snprintf(link, sizeof(link), PHY_SYSFS_PATH "/%s/device", de->d_name);
+        if (!realpath(link, real))
+            continue;
+
+        if (strncmp(real, PHY_DEVICES_PATH, strlen(PHY_DEVICES_PATH)))
+            continue;
+
+        if (strcmp(real + strlen(PHY_DEVICES_PATH), path))
+            continue;
+
+        strscpy(phy, de->d_name, len);
+        ret = 0;
+        break;
+    }
+
+    closedir(dir);
+
+    return ret;
+}
+
+int phy_from_ifindex(uint32_t ifindex, char *phy, size_t len)
+{
+    char ifname[IF_NAMESIZE];
+    char path[PATH_MAX];
+    FILE *fp;
+    int ret = -1;
+
+    if (!if_indextoname(ifindex, ifname))
+        return -1;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/phy80211/name", ifname);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    if (fgets(path, sizeof(path), fp))
+    {
+        path[strcspn(path, "\n")] = '\0';
+        strscpy(phy, path, len);
+        ret = 0;
+    }
+
+    fclose(fp);
+
+    return ret;
+}
+
+int phy_allowed_channels(const struct wifi_phy *phy, int *chans, int max)
+{
+    int i;
+    int n = 0;
+
+    for (i = 0; i < phy->n_chans && n < max; i++)
+    {
+        if (!phy->chans[i].disabled)
+            chans[n++] = phy->chans[i].chan;
+    }
+
+    return n;
+}
+
+const struct wifi_chan *phy_chan_get(const struct wifi_phy *phy, int chan)
+{
+    int i;
+
+    for (i = 0; i < phy->n_chans; i++)
+    {
+        if (phy->chans[i].chan == chan)
+            return &phy->chans[i];
+    }
+
+    return NULL;
+}
+
+static int phy_width_mhz(int nl_width)
+{
+    switch (nl_width)
+    {
+        case NL80211_CHAN_WIDTH_40:
+            return 40;
+        case NL80211_CHAN_WIDTH_80:
+        case NL80211_CHAN_WIDTH_80P80:
+            return 80;
+        case NL80211_CHAN_WIDTH_160:
+            return 160;
+        default:
+            return 20;
+    }
+}
+
+struct wifi_phy *phy_radar_event(struct nlattr **tb)
+{
+    struct wifi_phy *phy;
+    uint32_t freq = 0;
+    uint32_t center;
+    uint32_t event;
+    int width = 20;
+
+    if (!tb[NL80211_ATTR_WIPHY] || !tb[NL80211_ATTR_RADAR_EVENT])
+        return NULL;
+
+    phy = phy_find_idx(nla_get_u32(tb[NL80211_ATTR_WIPHY]));
+    if (!phy)
+        return NULL;
+
+    event = nla_get_u32(tb[NL80211_ATTR_RADAR_EVENT]);
+    if (tb[NL80211_ATTR_WIPHY_FREQ])
+        freq = nla_get_u32(tb[NL80211_ATTR_WIPHY_FREQ]);
+    if (tb[NL80211_ATTR_CHANNEL_WIDTH])
+        width = phy_width_mhz(nla_get_u32(tb[NL80211_ATTR_CHANNEL_WIDTH]));
+    center = freq;
+    if (tb[NL80211_ATTR_CENTER_FREQ1])
+        center = nla_get_u32(tb[NL80211_ATTR_CENTER_FREQ1]);
+
+    switch (event)
+    {
+        case NL80211_RADAR_DETECTED:
+            LOGW("%s: radar detected on %u MHz", phy->name, freq);
+            break;
+        case NL80211_RADAR_CAC_FINISHED:
+            LOGI("%s: CAC finished on %u MHz", phy->name, freq);
+            phy->cac_low = phy->cac_high = 0;
+            break;
+        case NL80211_RADAR_CAC_ABORTED:
+            LOGI("%s: CAC aborted on %u MHz", phy->name, freq);
+            phy->cac_low = phy->cac_high = 0;
+            break;
+        case NL80211_RADAR_NOP_FINISHED:
+            LOGI("%s: NOP finished on %u MHz", phy->name, freq);
+            break;
+        case PHY_RADAR_CAC_STARTED:
+            LOGI("%s: CAC started on %u MHz, %d MHz wide", phy->name, freq, width);
+            /* Every 20 MHz channel of the block is under CAC */
+            phy->cac_low = center - width / 2 + 10;
+            phy->cac_high = center + width / 2 - 10;
+            break;
+        default:
+            LOGD("%s: radar event %u on %u MHz", phy->name, event, freq);
+            break;
+    }
+
+    /* The kernel has already updated every affected channel, reread them */
+    phy_dump(phy->wiphy);
+
+    return phy;
+}
+
+const char *phy_chan_dfs_state(const struct wifi_phy *phy, const struct wifi_chan *chan)
+{
+    if (!chan->radar)
+        return "allowed";
+
+    switch (chan->dfs_state)
+    {
+        case NL80211_DFS_UNAVAILABLE:
+            return "nop_started";
+        case NL80211_DFS_AVAILABLE:
+            return "cac_completed";
+        case NL80211_DFS_USABLE:
+        default:
+            /* Usable once a CAC passes, also after a NOP has run out */
+            if (chan->freq >= phy->cac_low && chan->freq <= phy->cac_high)
+                return "cac_started";
+            return "allowed";
+    }
+}
+
+uint32_t phy_tx_chainmask(const struct wifi_phy *phy)
+{
+    return phy->tx_ant ? phy->tx_ant : phy->tx_ant_avail;
+}
+
+uint32_t phy_rx_chainmask(const struct wifi_phy *phy)
+{
+    return phy->rx_ant ? phy->rx_ant : phy->rx_ant_avail;
+}
+
+int phy_max_streams(const struct wifi_phy *phy)
+{
+    return phy->vht_streams > phy->ht_streams ? phy->vht_streams : phy->ht_streams;
+}
+
+int phy_freq_to_channel(uint32_t freq)
+{
+    if (freq == 2484)
+        return 14;
+    if (freq >= 2412 && freq < 2484)
+        return (freq - 2407) / 5;
+    if (freq >= 4910 && freq <= 4980)
+        return (freq - 4000) / 5;
+    if (freq >= 5000 && freq < 5950)
+        return (freq - 5000) / 5;
+
+    return 0;
+}
+
+uint32_t phy_channel_to_freq(int chan)
+{
+    if (chan == 14)
+        return 2484;
+    if (chan >= 1 && chan < 14)
+        return 2407 + chan * 5;
+    if (chan >= 182 && chan <= 196)
+        return 4000 + chan * 5;
+    if (chan >= 32 && chan < 182)
+        return 5000 + chan * 5;
+
+    return 0;
+}
+
+const char *phy_width_to_htmode(int width)
+{
+    switch (width)
+    {
+        case NL80211_CHAN_WIDTH_20_NOHT:
+        case NL80211_CHAN_WIDTH_20:
+            return "HT20";
+        case NL80211_CHAN_WIDTH_40:
+            return "HT40";
+        case NL80211_CHAN_WIDTH_80:
+            return "HT80";
+        case NL80211_CHAN_WIDTH_80P80:
+            return "HT80+80";
+        case NL80211_CHAN_WIDTH_160:
+            return "HT160";
+        default:
+            return NULL;
+    }
+}
+
+static struct phy_iface *phy_iface_find(uint32_t wiphy, const char *ifname)
+{
+    struct phy_iface *iface;
+
+    ds_tree_foreach(&phy_iface_tree, iface)
+    {
+        if (iface->wiphy == wiphy && !strcmp(iface->ifname, ifname))
+            return iface;
+    }
+
+    return NULL;
+}
+
+bool phy_get_oper(const char *name, struct wifi_oper *oper)
+{
+    struct phy_iface *iface;
+    struct wifi_phy *phy;
+
+    phy = phy_get(name);
+    if (!phy)
+        return false;
+
+    phy_iface_update(phy->wiphy);
+
+    ds_tree_foreach(&phy_iface_tree, iface)
+    {
+        if (iface->wiphy != phy->wiphy || !iface->oper.freq)
+            continue;
+
+        *oper = iface->oper;
+        return true;
+    }
+
+    return false;
+}
+
+/* Names of the phy's interfaces that are up on a channel */
+int phy_get_ifaces(const char *name, char (*ifnames)[IFNAMSIZ], int max)
+{
+    struct phy_iface *iface;
+    struct wifi_phy *phy;
+    int num = 0;
+
+    phy = phy_get(name);
+    if (!phy)
+        return -1;
+
+    phy_iface_update(phy->wiphy);
+
+    ds_tree_foreach(&phy_iface_tree, iface)
+    {
+        if (num >= max)
+            break;
+
+        if (iface->wiphy != phy->wiphy || !iface->oper.freq)
+            continue;
+
+        STRSCPY(ifnames[num], iface->ifname);
+        num++;
+    }
+
+    return num;
+}
+
+/*
+ * MAC address of an interface, or with ifname NULL of the phy's first
+ * one, which carries the phy's own address.
+ */
+bool phy_get_addr(const char *name, const char *ifname, char *mac, size_t len)
+{
+    struct phy_iface *iface = NULL;
+    struct phy_iface *it;
+    struct wifi_phy *phy;
+    const uint8_t *a;
+
+    phy = phy_get(name);
+    if (!phy)
+        return false;
+
+    phy_iface_update(phy->wiphy);
+
+    if (ifname)
+    {
+        iface = phy_iface_find(phy->wiphy, ifname);
+    }
+    else
+    {
+        ds_tree_foreach(&phy_iface_tree, it)
+        {
+            if (it->wiphy == phy->wiphy && it->addr_valid)
+            {
+                iface = it;
+                break;
+            }
+        }
+    }
+
+    if (!iface || !iface->addr_valid)
+        return false;
+
+    a = iface->addr;
+    snprintf(mac, len, "%02x:%02x:%02x:%02x:%02x:%02x",
+             a[0], a[1], a[2], a[3], a[4], a[5]);
+
+    return true;
+}
+
+/* Runtime tx power limit, dbm <= 0 hands control back to the driver */
+bool phy_set_txpower(const char *name, int dbm)
+{
+    struct phy_iface *iface;
+    struct wifi_phy *phy;
+    struct nl_msg *msg;
+    int ret;
+
+    phy = phy_get(name);
+    if (!phy)
+        return false;
+
+    msg = nl80211_msg(NL80211_CMD_SET_WIPHY, 0);
+    if (!msg)
+        return false;
+
+    nla_put_u32(msg, NL80211_ATTR_WIPHY, phy->wiphy);
+    if (dbm > 0)
+    {
+        nla_put_u32(msg, NL80211_ATTR_WIPHY_TX_POWER_SETTING, NL80211_TX_POWER_LIMITED);
+        nla_put_u32(msg, NL80211_ATTR_WIPHY_TX_POWER_LEVEL, dbm * 100);
+    }
+    else
+    {
+        nla_put_u32(msg, NL80211_ATTR_WIPHY_TX_POWER_SETTING, NL80211_TX_POWER_AUTOMATIC);
+    }
+
+    ret = nl80211_send(msg, NULL, NULL);
+    if (ret)
+    {
+        LOGE("%s: failed to set tx power %d dBm: %d", name, dbm, ret);
+        return false;
+    }
+
+    ds_tree_foreach(&phy_iface_tree, iface)
+    {
+        if (iface->wiphy == phy->wiphy)
+            iface->read_ms = 0;
+    }
+
+    return true;
+}
+
+struct phy_survey_ctx
+{
+    struct wifi_survey  *survey;
+    int                 max;
+    int                 num;
+};
+
+static int phy_survey_cb(struct nl_msg *msg, void *arg)
+{
+    struct phy_survey_ctx *ctx = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct nlattr *si[NL80211_SURVEY_INFO_MAX + 1];
+    struct wifi_survey *survey;
+
+    if (ctx->num >= ctx->max)
+        return NL_SKIP;
+
+    nl80211_parse(msg, tb);
+
+    if (!tb[NL80211_ATTR_SURVEY_INFO])
+        return NL_SKIP;
+
+    if (nla_parse_nested(si, NL80211_SURVEY_INFO_MAX, tb[NL80211_ATTR_SURVEY_INFO], NULL))
+        return NL_SKIP;
+
+    if (!si[NL80211_SURVEY_INFO_FREQUENCY])
+        return NL_SKIP;
+
+    survey = &ctx->survey[ctx->num++];
+    memset(survey, 0, sizeof(*survey));
+    survey->freq = nla_get_u32(si[NL80211_SURVEY_INFO_FREQUENCY]);
+    survey->in_use = !!si[NL80211_SURVEY_INFO_IN_USE];
+
+    if (si[NL80211_SURVEY_INFO_NOISE])
+        survey->noise = (int8_t)nla_get_u8(si[NL80211_SURVEY_INFO_NOISE]);
+    if (si[NL80211_SURVEY_INFO_TIME])
+        survey->time = nla_get_u64(si[NL80211_SURVEY_INFO_TIME]);
+    if (si[NL80211_SURVEY_INFO_TIME_BUSY])
+        survey->busy = nla_get_u64(si[NL80211_SURVEY_INFO_TIME_BUSY]);
+    if (si[NL80211_SURVEY_INFO_TIME_EXT_BUSY])
+        survey->busy_ext = nla_get_u64(si[NL80211_SURVEY_INFO_TIME_EXT_BUSY]);
+    if (si[NL80211_SURVEY_INFO_TIME_RX])
+        survey->rx = nla_get_u64(si[NL80211_SURVEY_INFO_TIME_RX]);
+    if (si[NL80211_SURVEY_INFO_TIME_TX])
+        survey->tx = nla_get_u64(si[NL80211_SURVEY_INFO_TIME_TX]);
+
+    return NL_SKIP;
+}
+
+/* Returns the number of entries filled, or -1 if the dump failed */
+int phy_survey_get(const char *ifname, struct wifi_survey *survey, int max)
+{
+    struct phy_survey_ctx ctx = { .survey = survey, .max = max, .num = 0 };
+    struct nl_msg *msg;
+    unsigned int ifindex;
+
+    ifindex = if_nametoindex(ifname);
+    if (!ifindex)
+        return -1;
+
+    msg = nl80211_msg(NL80211_CMD_GET_SURVEY, NLM_F_DUMP);
+    if (!msg)
+        return -1;
+
+    nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+
+    if (nl80211_send(msg, phy_survey_cb, &ctx))
+    {
+        LOGW("%s: survey dump failed", ifname);
+        return -1;
+    }
+
+    return ctx.num;
+}
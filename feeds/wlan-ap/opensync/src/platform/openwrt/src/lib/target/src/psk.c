@@ -0,0 +1,435 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "psk.h"
+
+/* Any station may use the key, hostapd tries them all at the 4-way handshake */
+#define PSK_ANY_STA         "00:00:00:00:00:00"
+#define PSK_NAME_MAX        16
+
+struct psk_entry
+{
+    char            name[PSK_NAME_MAX];     /* security map key, empty for credentials */
+    char            keyid[PSK_KEYID_MAX + 1];
+    char            key[65];
+    bool            seen;
+    bool            fresh;                  /* not in the file yet */
+    ds_tree_node_t  node;
+    char            line[];                 /* as written to the file, tree key */
+};
+
+struct psk_vif
+{
+    char            ifname[IFNAMSIZ];
+    ds_tree_t       entries;
+    int             count;
+    bool            written;                /* file matches the entries */
+    ino_t           ctrl_ino;               /* hostapd instance last told to reread it */
+    ds_tree_node_t  node;
+};
+
+static ds_tree_t psk_vif_tree = DS_TREE_INIT(ds_str_cmp, struct psk_vif, node);
+
+/* 8..63 printable characters or 64 hex digits, as hostapd takes them */
+static bool psk_key_valid(const char *key)
+{
+    size_t len = strlen(key);
+    size_t i;
+
+    if (len == 64)
+    {
+        for (i = 0; i < len; i++)
+            if (!isxdigit((unsigned char)key[i]))
+                return false;
+        return true;
+    }
+
+    if (len < 8 || len > 63)
+        return false;
+
+    for (i = 0; i < len; i++)
+        if (key[i] < 32 || key[i] > 126)
+            return false;
+
+    return true;
+}
+
+/* keyid= ends at the first blank, anything odd is left out of the line */
+static bool psk_keyid_valid(const char *keyid)
+{
+    size_t len = strlen(keyid);
+    size_t i;
+
+    if (!len || len > PSK_KEYID_MAX)
+        return false;
+
+    for (i = 0; i < len; i++)
+        if (!isgraph((unsigned char)keyid[i]))
+            return false;
+
+    return true;
+}
+
+static struct psk_vif *psk_vif_get(const char *ifname)
+{
+    struct psk_vif *vif;
+
+    vif = ds_tree_find(&psk_vif_tree, (void *)ifname);
+    if (vif)
+        return vif;
+
+    vif = calloc(1, sizeof(*vif));
+    if (!vif)
+        return NULL;
+
+    STRSCPY(vif->ifname, ifname);
+    ds_tree_init(&vif->entries, ds_str_cmp, struct psk_entry, node);
+    ds_tree_insert(&psk_vif_tree, vif, vif->ifname);
+
+    return vif;
+}
+
+static void psk_entries_free(struct psk_vif *vif)
+{
+    struct psk_entry *entry;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&vif->entries, entry, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(entry);
+    }
+}
+
+static void psk_vif_free(struct psk_vif *vif)
+{
+    psk_entries_free(vif);
+    ds_tree_remove(&psk_vif_tree, vif);
+    free(vif);
+}
+
+static void psk_entry_add(struct psk_vif *vif, const char *name,
+                          const char *keyid, const char *key, int *added)
+{
+    struct psk_entry *entry;
+    char line[PSK_KEYID_MAX + 128];
+
+    if (!psk_key_valid(key))
+    {
+        LOGW("%s: multi-psk: ignoring invalid key %s", vif->ifname, name[0] ? name : "(credential)");
+        return;
+    }
+
+    if (keyid && !psk_keyid_valid(keyid))
+    {
+        LOGW("%s: multi-psk: ignoring keyid '%s'", vif->ifname, keyid);
+        keyid = NULL;
+    }
+
+    if (keyid)
+        snprintf(line, sizeof(line), "keyid=%s %s %s", keyid, PSK_ANY_STA, key);
+    else
+        snprintf(line, sizeof(line), "%s %s", PSK_ANY_STA, key);
+
+    entry = ds_tree_find(&vif->entries, line);
+    if (entry)
+    {
+        entry->seen = true;
+        /* The same key may come from the VIF and a credential, report it once */
+        if (name[0])
+            STRSCPY(entry->name, name);
+        return;
+    }
+
+    entry = calloc(1, sizeof(*entry) + strlen(line) + 1);
+    if (!entry)
+        return;
+
+    strcpy(entry->line, line);
+    STRSCPY(entry->name, name);
+    STRSCPY(entry->key, key);
+    if (keyid)
+        STRSCPY(entry->keyid, keyid);
+    entry->seen = true;
+    entry->fresh = true;
+
+    ds_tree_insert(&vif->entries, entry, entry->line);
+    vif->count++;
+    (*added)++;
+}
+
+static void psk_collect(struct psk_vif *vif,
+                        const struct schema_Wifi_VIF_Config *vconf,
+                        const struct schema_Wifi_Credential_Config *cconfs,
+                        int num_cconfs,
+                        int *added)
+{
+    const char *keyid;
+    const char *key;
+    char tag[PSK_NAME_MAX + sizeof(PSK_TAG_PREFIX)];
+    int i;
+
+    for (i = 0; i < vconf->security_len; i++)
+    {
+        if (strncmp(vconf->security_keys[i], PSK_KEY_PREFIX, strlen(PSK_KEY_PREFIX)) ||
+            strlen(vconf->security_keys[i]) >= PSK_NAME_MAX)
+            continue;
+
+        snprintf(tag, sizeof(tag), PSK_TAG_PREFIX "%s", vconf->security_keys[i]);
+        keyid = SCHEMA_KEY_VAL_NULL(vconf->security, tag);
+
+        psk_entry_add(vif, vconf->security_keys[i], keyid, vconf->security[i], added);
+    }
+
+    for (i = 0; cconfs && i < num_cconfs; i++)
+    {
+        if (strcmp(cconfs[i].ssid, vconf->ssid))
+            continue;
+
+        key = SCHEMA_KEY_VAL_NULL(cconfs[i].security, OVSDB_SECURITY_KEY);
+        if (!key)
+            continue;
+
+        keyid = SCHEMA_KEY_VAL_NULL(cconfs[i].security, OVSDB_SECURITY_OFTAG);
+        psk_entry_add(vif, "", keyid, key, added);
+    }
+}
+
+static bool psk_file_write(struct psk_vif *vif, const char *path, bool append)
+{
+    struct psk_entry *entry;
+    char tmp[80];
+    FILE *f;
+    int fd;
+
+    if (append)
+    {
+        fd = open(path, O_WRONLY | O_APPEND);
+    }
+    else
+    {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    }
+
+    if (fd < 0 || !(f = fdopen(fd, "w")))
+    {
+        LOGE("%s: multi-psk: can't open %s: %s", vif->ifname, path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    ds_tree_foreach(&vif->entries, entry)
+    {
+        if (append && !entry->fresh)
+            continue;
+        fprintf(f, "%s\n", entry->line);
+        entry->fresh = false;
+    }
+
+    if (fclose(f))
+    {
+        LOGE("%s: multi-psk: failed to write %s: %s", vif->ifname, path, strerror(errno));
+        return false;
+    }
+
+    /* hostapd never sees a half written file */
+    if (!append && rename(tmp, path))
+    {
+        LOGE("%s: multi-psk: can't rename %s: %s", vif->ifname, tmp, strerror(errno));
+        unlink(tmp);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Never fall back to RELOAD, it tears down the BSS and every client on
+ * it. A hostapd without RELOAD_WPA_PSK picks the keys up when it starts.
+ */
+static void psk_reload(struct psk_vif *vif)
+{
+    vif->ctrl_ino = hostapd_ctrl_ino(vif->ifname);
+
+    if (!hostapd_cli_ok(vif->ifname, "RELOAD_WPA_PSK"))
+        LOGW("%s: multi-psk: RELOAD_WPA_PSK failed, keys apply at the next start", vif->ifname);
+}
+
+static bool psk_vif_drop(struct psk_vif *vif, int ssid_index)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), PSK_FILE_FMT, vif->ifname);
+    unlink(path);
+    if (vif->written)
+        LOGI("%s: multi-psk: disabled", vif->ifname);
+    psk_vif_free(vif);
+
+    return wifi_setApWpaPskFile(ssid_index, NULL);
+}
+
+bool psk_vif_apply(int ssid_index,
+                   const struct schema_Wifi_VIF_Config *vconf,
+                   const struct schema_Wifi_Credential_Config *cconfs,
+                   int num_cconfs)
+{
+    struct psk_entry *entry;
+    struct psk_vif *vif;
+    ds_tree_iter_t iter;
+    const char *encryption;
+    char current[64];
+    char path[64];
+    bool configured;
+    int removed = 0;
+    int added = 0;
+
+    vif = ds_tree_find(&psk_vif_tree, (void *)vconf->if_name);
+
+    encryption = SCHEMA_KEY_VAL_NULL(vconf->security, OVSDB_SECURITY_ENCRYPTION);
+    if (!encryption || strcmp(encryption, OVSDB_SECURITY_ENCRYPTION_WPA_PSK))
+    {
+        if (vif)
+            return psk_vif_drop(vif, ssid_index);
+        return true;
+    }
+
+    vif = psk_vif_get(vconf->if_name);
+    if (!vif)
+        return false;
+
+    ds_tree_foreach(&vif->entries, entry)
+        entry->seen = false;
+
+    psk_collect(vif, vconf, cconfs, num_cconfs, &added);
+
+    ds_tree_foreach_iter(&vif->entries, entry, &iter)
+    {
+        if (entry->seen)
+            continue;
+        ds_tree_iremove(&iter);
+        free(entry);
+        vif->count--;
+        removed++;
+    }
+
+    if (!vif->count)
+        return psk_vif_drop(vif, ssid_index);
+
+    snprintf(path, sizeof(path), PSK_FILE_FMT, vif->ifname);
+    memset(current, 0, sizeof(current));
+    configured = UCI_OK == wifi_getApWpaPskFile(ssid_index, current, sizeof(current) - 1) &&
+                 !strcmp(current, path);
+
+    if (vif->written && configured && !added && !removed)
+        return true;
+
+    /* Only additions keep what hostapd already has, anything else starts over */
+    if (!psk_file_write(vif, path, vif->written && !removed))
+    {
+        vif->written = false;
+        return false;
+    }
+    vif->written = true;
+
+    LOGI("%s: multi-psk: %d keys (+%d -%d)", vif->ifname, vif->count, added, removed);
+
+    /* The first extra key changes the config, hostapd reads the file when it restarts */
+    if (!configured)
+        return wifi_setApWpaPskFile(ssid_index, path);
+
+    psk_reload(vif);
+
+    return true;
+}
+
+/*
+ * An instance that came up while the file was being replaced may have
+ * read the previous one, rereading it is harmless for the clients.
+ */
+void psk_resync(void)
+{
+    struct psk_vif *vif;
+    ino_t ino;
+
+    ds_tree_foreach(&psk_vif_tree, vif)
+    {
+        ino = hostapd_ctrl_ino(vif->ifname);
+        if (!vif->written || !ino || ino == vif->ctrl_ino)
+            continue;
+        psk_reload(vif);
+    }
+}
+
+/* Echo the VIF's own extra keys, the state table can't hold more than the config */
+int psk_vif_state(struct schema_Wifi_VIF_State *vstate, int index)
+{
+    struct psk_entry *entry;
+    struct psk_vif *vif;
+    int max = ARRAY_SIZE(vstate->security_keys);
+
+    vif = ds_tree_find(&psk_vif_tree, vstate->if_name);
+    if (!vif)
+        return index;
+
+    ds_tree_foreach(&vif->entries, entry)
+    {
+        if (!entry->name[0])
+            continue;
+
+        if (index >= max)
+            break;
+        STRSCPY(vstate->security_keys[index], entry->name);
+        STRSCPY(vstate->security[index], entry->key);
+        index++;
+
+        if (!entry->keyid[0] || index >= max)
+            continue;
+        snprintf(vstate->security_keys[index], sizeof(vstate->security_keys[index]),
+                 PSK_TAG_PREFIX "%s", entry->name);
+        STRSCPY(vstate->security[index], entry->keyid);
+        index++;
+    }
+
+    vstate->security_len = index;
+
+    return index;
+}
+
+int psk_vif_count(const char *ifname)
+{
+    struct psk_vif *vif;
+
+    vif = ds_tree_find(&psk_vif_tree, (void *)ifname);
+
+    return vif ? vif->count : 0;
+}
+
+/* The files stay, hostapd keeps using them */
+void psk_cleanup(void)
+{
+    struct psk_vif *vif;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&psk_vif_tree, vif, &iter)
+    {
+        ds_tree_iremove(&iter);
+        psk_entries_free(vif);
+        free(vif);
+    }
+}
@@ -25,22 +25,307 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 #include <target.h>
 #include "log.h"
 #include "evsched.h"
 #include "uci_helper.h"
+#include "phy.h"
+#include "worker.h"
+#include "hostapd.h"
+#include "acs.h"
+#include "tpc.h"
+#include "spectral.h"
+#include "airtime.h"
+#include "thermal.h"
+#include "green.h"
+#include "resource.h"
+
+/* Beacons announcing the switch before it happens */
+#define RADIO_CSA_COUNT         5
+/* If the driver has not moved by then, fall back to a reload */
+#define RADIO_CSA_TIMEOUT       EVSCHED_SEC(5)
+
+struct radio_csa
+{
+    bool            pending;
+    int             channel;
+    bool            modes;      /* width changed too, persist the modes */
+    char            freq_band[8];
+    char            ht_mode[8];
+    char            hw_mode[8];
+    struct timespec start;
+    int64_t         latency_ms;
+};
 
 static bool needReset = true;  /* On start-up, we need to initialize DB from  the UCI */
 
 static struct target_radio_ops g_rops;
 static bool g_resync_ongoing = false;
+static bool dfs_event_cb_registered = false;
+static struct radio_csa g_csa[UCI_MAX_RADIOS];
+
+
+static void radio_state_hw_param_str(
+        struct schema_Wifi_Radio_State *rstate,
+        const char *key,
+        const char *value)
+{
+    int i = rstate->hw_params_len;
+
+    if (i >= (int)ARRAY_SIZE(rstate->hw_params))
+        return;
+
+    STRSCPY(rstate->hw_params_keys[i], key);
+    STRSCPY(rstate->hw_params[i], value);
+    rstate->hw_params_len = i + 1;
+}
+
+static void radio_state_hw_param(
+        struct schema_Wifi_Radio_State *rstate,
+        const char *key,
+        uint32_t value)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%u", value);
+    radio_state_hw_param_str(rstate, key, buf);
+}
+
+static void radio_state_hw_config(
+        struct schema_Wifi_Radio_State *rstate,
+        const char *key,
+        const char *value)
+{
+    int i = rstate->hw_config_len;
+
+    if (i >= (int)ARRAY_SIZE(rstate->hw_config))
+        return;
+
+    STRSCPY(rstate->hw_config_keys[i], key);
+    STRSCPY(rstate->hw_config[i], value);
+    rstate->hw_config_len = i + 1;
+}
+
+static const char *radio_state_hw_config_get(
+        const struct schema_Wifi_Radio_State *rstate,
+        const char *key)
+{
+    int i;
+
+    for (i = 0; i < rstate->hw_config_len; i++)
+    {
+        if (!strcmp(rstate->hw_config_keys[i], key))
+            return rstate->hw_config[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * The UCI values are only what we asked for. ACS, DFS radar moves and
+ * regulatory limits can leave the radio elsewhere, so the driver's view
+ * is reported as state and the UCI values are kept in hw_config.
+ */
+static void radio_state_get_oper(
+        int radioIndex,
+        struct schema_Wifi_Radio_State *rstate)
+{
+    struct wifi_oper oper;
+    const char *ht_mode;
+    char phy_name[IFNAMSIZ];
+    char buf[16];
+
+    if (rstate->channel_exists)
+    {
+        snprintf(buf, sizeof(buf), "%d", rstate->channel);
+        radio_state_hw_config(rstate, "channel", buf);
+    }
+    if (rstate->ht_mode_exists)
+        radio_state_hw_config(rstate, "ht_mode", rstate->ht_mode);
+    if (rstate->tx_power_exists)
+    {
+        snprintf(buf, sizeof(buf), "%d", rstate->tx_power);
+        radio_state_hw_config(rstate, "tx_power", buf);
+    }
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+    if (!phy_get_oper(phy_name, &oper))
+    {
+        LOGD("%s: not operating, reporting configured values", phy_name);
+        return;
+    }
+
+    if (oper.channel)
+    {
+        rstate->channel = oper.channel;
+        rstate->channel_exists = true;
+    }
+
+    ht_mode = phy_width_to_htmode(oper.width);
+    if (ht_mode)
+        SCHEMA_SET_STR(rstate->ht_mode, ht_mode);
+
+    if (oper.txpower_valid)
+    {
+        rstate->tx_power = oper.txpower;
+        if (rstate->tx_power < 1)   rstate->tx_power = 1;
+        if (rstate->tx_power > 32)  rstate->tx_power = 32;
+        rstate->tx_power_exists = true;
+    }
+
+    radio_state_hw_param(rstate, "freq", oper.freq);
+    radio_state_hw_param(rstate, "center_freq1", oper.center_freq1);
+    if (oper.center_freq2)
+        radio_state_hw_param(rstate, "center_freq2", oper.center_freq2);
+
+    LOGN("%s: operating on channel %d (%u MHz) %s, tx power %d",
+         phy_name, rstate->channel, oper.freq, rstate->ht_mode, rstate->tx_power);
+}
+
+static void radio_state_get_antennas(
+        int radioIndex,
+        struct schema_Wifi_Radio_State *rstate)
+{
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
 
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+    phy = phy_get(phy_name);
+    if (!phy)
+    {
+        LOGW("%s: cannot get antenna capabilities", phy_name);
+        return;
+    }
+
+    rstate->tx_chainmask = phy_tx_chainmask(phy);
+    rstate->tx_chainmask_exists = true;
+    LOGN("tx_chainmask: %d", rstate->tx_chainmask);
+
+    radio_state_hw_param(rstate, "tx_antenna_avail", phy->tx_ant_avail);
+    radio_state_hw_param(rstate, "rx_antenna_avail", phy->rx_ant_avail);
+    radio_state_hw_param(rstate, "tx_antenna", phy_tx_chainmask(phy));
+    radio_state_hw_param(rstate, "rx_antenna", phy_rx_chainmask(phy));
+    radio_state_hw_param(rstate, "max_streams", phy_max_streams(phy));
+}
+
+/* Interference summary of the channels the spectral scan covered */
+static void radio_state_get_spectral(
+        int radioIndex,
+        struct schema_Wifi_Radio_State *rstate)
+{
+    struct spectral_summary sum[2];
+    char key[32];
+    char val[128];
+    int n;
+    int i;
+
+    n = spectral_get(radioIndex, sum, ARRAY_SIZE(sum));
+    for (i = 0; i < n; i++)
+    {
+        snprintf(key, sizeof(key), "spectral_%d", sum[i].chan);
+        snprintf(val, sizeof(val), "duty=%d,avg=%d,peak=%d,noise=%d,flat=%d,intf=%s",
+                 sum[i].duty, sum[i].avg_power, sum[i].peak_power, sum[i].noise,
+                 sum[i].flatness, spectral_interferer_str(sum[i].interferer));
+        radio_state_hw_param_str(rstate, key, val);
+    }
+}
+
+/* Per-channel DFS state, in the format the cloud expects in Wifi_Radio_State:channels */
+static void radio_state_get_channels(
+        int radioIndex,
+        struct schema_Wifi_Radio_State *rstate)
+{
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+    int i;
+    int n = 0;
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+    phy = phy_get(phy_name);
+    if (!phy)
+        return;
+
+    for (i = 0; i < phy->n_chans && n < (int)ARRAY_SIZE(rstate->channels); i++)
+    {
+        if (phy->chans[i].disabled)
+            continue;
+
+        snprintf(rstate->channels_keys[n], sizeof(rstate->channels_keys[n]),
+                 "%d", phy->chans[i].chan);
+        snprintf(rstate->channels[n], sizeof(rstate->channels[n]),
+                 "{\"state\": \"%s\"}",
+                 phy_chan_dfs_state(phy, &phy->chans[i]));
+        n++;
+    }
+
+    rstate->channels_len = n;
+}
+
+static void radio_state_get_country(
+        int radioIndex,
+        struct schema_Wifi_Radio_State *rstate)
+{
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+    phy = phy_get(phy_name);
+    if (!phy || !phy->country[0])
+        return;
+
+    STRSCPY(rstate->country, phy->country);
+    rstate->country_exists = true;
+    LOGN("radio country: %s", rstate->country);
+}
+
+/*
+ * Device and per-manager resource usage. It is the same for every radio
+ * and only goes out with the first one.
+ */
+static void radio_state_get_resources(
+        int radioIndex,
+        struct schema_Wifi_Radio_State *rstate)
+{
+    struct resource_stats res;
+    struct resource_mgr *m;
+    char key[32];
+    char val[128];
+    int i;
+
+    if (radioIndex || !resource_get(&res))
+        return;
+
+    snprintf(val, sizeof(val), "cpu=%u,load=%.2f,mem_avail=%u,mem_total=%u,mem_pressure=%u",
+             res.cpu, res.load[0], res.mem_avail_kb, res.mem_total_kb, res.mem_pressure);
+    radio_state_hw_param_str(rstate, "resources", val);
+
+    for (i = 0; i < res.n_mgr; i++)
+    {
+        m = &res.mgr[i];
+        snprintf(key, sizeof(key), "resources_%s", m->name);
+        if (m->pid)
+            snprintf(val, sizeof(val), "pid=%d,cpu=%u,rss=%u,rss_delta=%d",
+                     m->pid, m->cpu, m->rss_kb, m->rss_delta_kb);
+        else
+            STRSCPY(val, "down");
+        radio_state_hw_param_str(rstate, key, val);
+    }
+}
 
 static bool radio_state_get(
         int radioIndex,
         struct schema_Wifi_Radio_State *rstate)
 {
+    struct acs_result acs;
+    struct tpc_metrics tpc;
+    struct thermal_state thermal;
+    struct green_state green;
+
     memset(rstate, 0, sizeof(*rstate));
     schema_Wifi_Radio_State_mark_all_present(rstate);
     rstate->_partial_update = true;
@@ -112,10 +397,7 @@ static bool radio_state_get(
         LOGN("radio freq band: %s", rstate->freq_band);
     }
 
-    if(wifi_getTxChainMask(radioIndex, &(rstate->tx_chainmask))) {
-	rstate->tx_chainmask_exists = true;
-        LOGN("tx_chainmask: %d", rstate->tx_chainmask);
-    }
+    radio_state_get_antennas(radioIndex, rstate);
 
     if (UCI_OK == wifi_getRadioHtMode(radioIndex, rstate->ht_mode)) {
         rstate->ht_mode_exists = true;
@@ -126,12 +408,52 @@ static bool radio_state_get(
         rstate->hw_mode_exists = true;
         LOGN("radio hw mode: %s", rstate->hw_mode);
     }
+    radio_state_get_oper(radioIndex, rstate);
+    radio_state_get_channels(radioIndex, rstate);
+    radio_state_get_spectral(radioIndex, rstate);
+    radio_state_get_resources(radioIndex, rstate);
+
+    if (radioIndex < UCI_MAX_RADIOS && g_csa[radioIndex].latency_ms > 0)
+        radio_state_hw_param(rstate, "csa_latency_ms", g_csa[radioIndex].latency_ms);
+
+    if (acs_get(radioIndex, &acs))
+    {
+        radio_state_hw_param(rstate, "acs_channel", acs.channel);
+        radio_state_hw_param(rstate, "acs_width", acs.width);
+        radio_state_hw_param(rstate, "acs_score", acs.score);
+        radio_state_hw_param(rstate, "acs_cac", acs.needs_cac);
+        radio_state_hw_param(rstate, "acs_switch", acs.switch_recommended);
+    }
+
+    if (tpc_get(radioIndex, &tpc))
+    {
+        radio_state_hw_param(rstate, "tpc_max_txpower", tpc.max_txpower);
+        radio_state_hw_param(rstate, "tpc_dense_aps", tpc.dense_aps);
+        radio_state_hw_param(rstate, "tpc_edge_clients", tpc.edge_clients);
+        radio_state_hw_param(rstate, "tpc_changes", tpc.changes);
+    }
+
+    if (thermal_get(radioIndex, &thermal))
+    {
+        radio_state_hw_param(rstate, "thermal_level", thermal.level);
+        radio_state_hw_param(rstate, "thermal_temp", thermal.temp);
+        radio_state_hw_param(rstate, "thermal_max_temp", thermal.max_temp);
+        radio_state_hw_param(rstate, "thermal_changes", thermal.changes);
+    }
+
+    if (green_get(radioIndex, &green))
+    {
+        radio_state_hw_param(rstate, "green_mode", green.mode);
+        radio_state_hw_param(rstate, "green_active_s", green.active_ms / 1000);
+        radio_state_hw_param(rstate, "green_idle_s", green.idle_ms / 1000);
+        radio_state_hw_param(rstate, "green_wakeups", green.wakeups);
+    }
+
     if(UCI_OK == wifi_getRadioMacaddress(radioIndex, rstate->mac)){
         rstate->mac_exists = true;
         LOGN("radio mac address:%s", rstate->mac);
     }
-    snprintf(rstate->country, sizeof(rstate->country),"CA");
-    rstate->country_exists = true;
+    radio_state_get_country(radioIndex, rstate);
 
     return true;
 }
@@ -157,6 +479,8 @@ static bool radio_copy_config_from_state(
         struct schema_Wifi_Radio_State *rstate,
         struct schema_Wifi_Radio_Config *rconf)
 {
+    const char *val;
+
     memset(rconf, 0, sizeof(*rconf));
     schema_Wifi_Radio_Config_mark_all_present(rconf);
     rconf->_partial_update = true;
@@ -170,13 +494,18 @@ static bool radio_copy_config_from_state(
     LOGT("rconf->hw_type = %s", rconf->hw_type);
     SCHEMA_SET_INT(rconf->enabled, rstate->enabled);
     LOGT("rconf->enabled = %d", rconf->enabled);
-    SCHEMA_SET_INT(rconf->channel, rstate->channel);
+    /* Seed the config with the configured intent, not the live values */
+    val = radio_state_hw_config_get(rstate, "channel");
+    SCHEMA_SET_INT(rconf->channel, val ? atoi(val) : rstate->channel);
     LOGT("rconf->channel = %d", rconf->channel);
-    SCHEMA_SET_INT(rconf->tx_power, rstate->tx_power);
+    val = radio_state_hw_config_get(rstate, "tx_power");
+    SCHEMA_SET_INT(rconf->tx_power, val ? atoi(val) : rstate->tx_power);
+    if (rconf->tx_power == 0)   rconf->tx_power = 32;
     LOGT("rconf->tx_power = %d", rconf->tx_power);
     SCHEMA_SET_STR(rconf->country, rstate->country);
     LOGT("rconf->country = %s", rconf->country);
-    SCHEMA_SET_STR(rconf->ht_mode, rstate->ht_mode);
+    val = radio_state_hw_config_get(rstate, "ht_mode");
+    SCHEMA_SET_STR(rconf->ht_mode, val ? val : rstate->ht_mode);
     LOGT("rconf->ht_mode = %s", rconf->ht_mode);
     SCHEMA_SET_STR(rconf->hw_mode, rstate->hw_mode);
     LOGT("rconf->hw_mode = %s", rconf->hw_mode);
@@ -289,10 +618,282 @@ bool target_radio_init(const struct target_radio_ops *ops)
 {
     g_rops = *ops;
     evsched_task(&healthcheck_task, NULL, EVSCHED_SEC(5));
+    acs_init();
+    tpc_init();
+    spectral_init();
+    airtime_init();
+    thermal_init();
     
     return true;
 }
 
+static int64_t radio_csa_elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000 +
+           (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/*
+ * Write what the radio now runs on. Nothing is reloaded here: the options
+ * reach netifd with the next reload, together with whatever else is
+ * queued, and that reload restarts the radio once on its current channel.
+ */
+static void radio_csa_persist(int radioIndex)
+{
+    struct radio_csa *csa = &g_csa[radioIndex];
+
+    if (!wifi_setRadioChannel(radioIndex, csa->channel, NULL))
+        LOGW("Radio %d: channel %d not persisted", radioIndex, csa->channel);
+
+    if (csa->modes && !wifi_setRadioModes(radioIndex, csa->freq_band, csa->ht_mode, csa->hw_mode))
+        LOGW("Radio %d: %s not persisted", radioIndex, csa->ht_mode);
+
+    csa->modes = false;
+}
+
+static void radio_csa_timeout_task(void *arg)
+{
+    int radioIndex = (intptr_t)arg;
+
+    if (!g_csa[radioIndex].pending)
+        return;
+
+    LOGW("Radio %d: no channel switch to %d after CSA, reloading",
+         radioIndex, g_csa[radioIndex].channel);
+    g_csa[radioIndex].pending = false;
+
+    radio_csa_persist(radioIndex);
+    worker_reload_config();
+}
+
+static void radio_csa_done(int radioIndex, uint32_t freq)
+{
+    struct radio_csa *csa;
+
+    if (radioIndex >= UCI_MAX_RADIOS)
+        return;
+
+    csa = &g_csa[radioIndex];
+    if (!csa->pending || phy_freq_to_channel(freq) != csa->channel)
+        return;
+
+    csa->pending = false;
+    csa->latency_ms = radio_csa_elapsed_ms(&csa->start);
+    evsched_task_cancel_by_find(radio_csa_timeout_task, (void *)(intptr_t)radioIndex,
+                                EVSCHED_FIND_BY_FUNC | EVSCHED_FIND_BY_ARG);
+
+    LOGI("Radio %d: switched to channel %d in %lld ms",
+         radioIndex, csa->channel, (long long)csa->latency_ms);
+
+    radio_csa_persist(radioIndex);
+}
+
+/*
+ * hostapd turns a switch onto a DFS channel that is not available yet
+ * into a full CAC, far longer than RADIO_CSA_TIMEOUT and with the radio
+ * silent. Such channels go through the restart path instead.
+ */
+static bool radio_csa_needs_cac(const struct wifi_phy *phy, uint32_t center, int width)
+{
+    const struct wifi_chan *chan;
+    int center_chan = phy_freq_to_channel(center);
+    int span = (width / 2 - 10) / 5;
+    int c;
+
+    for (c = center_chan - span; c <= center_chan + span; c += 4)
+    {
+        chan = phy_chan_get(phy, c);
+        if (chan && chan->radar && chan->dfs_state != NL80211_DFS_AVAILABLE)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Move a running radio with a channel switch announcement, so associated
+ * clients follow it instead of being dropped by a restart. Returns false
+ * when the radio is not up or hostapd refuses, the caller then falls back
+ * to the UCI write and reload.
+ */
+static bool radio_csa_start(int radioIndex, int channel, const char *ht_mode)
+{
+    struct wifi_oper oper;
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+    char cmd[160];
+    uint32_t freq;
+    uint32_t center;
+    int width = 20;
+    int offset = 0;
+    int len;
+
+    if (radioIndex >= UCI_MAX_RADIOS)
+        return false;
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+    phy = phy_get(phy_name);
+    if (!phy || !phy_get_oper(phy_name, &oper))
+        return false;
+
+    freq = phy_channel_to_freq(channel);
+    if (!freq)
+        return false;
+
+    if (ht_mode && !strncmp(ht_mode, "HT", 2) && atoi(ht_mode + 2) > 0)
+        width = atoi(ht_mode + 2);
+
+    center = freq;
+    if (channel <= 14)
+    {
+        if (width > 40)
+            width = 40;
+        if (width == 40)
+            offset = channel <= 7 ? 1 : -1;
+    }
+    else
+    {
+        int base = channel >= 149 ? 149 : 36;
+
+        switch (width)
+        {
+            case 40:
+                offset = ((channel - base) / 4) % 2 ? -1 : 1;
+                break;
+            case 80:
+                center = phy_channel_to_freq((channel - base) / 16 * 16 + base + 6);
+                offset = ((channel - base) / 4) % 2 ? -1 : 1;
+                break;
+            case 160:
+                center = phy_channel_to_freq((channel - 36) / 32 * 32 + 50);
+                offset = ((channel - base) / 4) % 2 ? -1 : 1;
+                break;
+            default:
+                width = 20;
+                break;
+        }
+    }
+
+    if (width == 40)
+        center = freq + offset * 10;
+
+    if (channel > 14 && radio_csa_needs_cac(phy, center, width))
+    {
+        LOGI("Radio %d: channel %d needs a CAC, not switching with CSA", radioIndex, channel);
+        return false;
+    }
+
+    len = snprintf(cmd, sizeof(cmd), "CHAN_SWITCH %d %u center_freq1=%u bandwidth=%d",
+                   RADIO_CSA_COUNT, freq, center, width);
+    if (offset)
+        len += snprintf(cmd + len, sizeof(cmd) - len, " sec_channel_offset=%d", offset);
+    len += snprintf(cmd + len, sizeof(cmd) - len, " ht");
+    if (phy->vht_capa && channel > 14)
+        len += snprintf(cmd + len, sizeof(cmd) - len, " vht");
+    /* Without it hostapd drops HE operation on the new channel */
+    if (phy->he)
+        snprintf(cmd + len, sizeof(cmd) - len, " he");
+
+    clock_gettime(CLOCK_MONOTONIC, &g_csa[radioIndex].start);
+
+    /* hostapd switches every BSS of the radio, any active one will do */
+    if (!hostapd_cli_ok(oper.ifname, cmd))
+        return false;
+
+    LOGI("Radio %d: CSA to channel %d %s started on %s",
+         radioIndex, channel, ht_mode ? ht_mode : "", oper.ifname);
+
+    g_csa[radioIndex].pending = true;
+    g_csa[radioIndex].channel = channel;
+    g_csa[radioIndex].modes = false;
+    evsched_task(radio_csa_timeout_task, (void *)(intptr_t)radioIndex, RADIO_CSA_TIMEOUT);
+
+    return true;
+}
+
+/*
+ * Channel change outside of Wifi_Radio_Config, e.g. from the local ACS.
+ * Only the channel is persisted, a narrower width stays in effect until
+ * the next radio restart brings back the configured one.
+ */
+bool radio_channel_switch(int radioIndex, int channel, const char *ht_mode)
+{
+    return radio_csa_start(radioIndex, channel, ht_mode);
+}
+
+/*
+ * Push the radio and all of its VIFs straight away. vif_state_update() is
+ * not used here as it reloads the configuration, which would restart the
+ * CAC we are reporting on.
+ */
+static void radio_state_push(int radioIndex)
+{
+    struct schema_Wifi_VIF_State vstate;
+    int ssid_radio_idx;
+    int snum;
+    int s;
+
+    radio_state_update(radioIndex);
+
+    if (wifi_getSSIDNumberOfEntries(&snum) != UCI_OK)
+        return;
+
+    for (s = 0; s < snum; s++)
+    {
+        if (wifi_getSSIDRadioIndex(s, &ssid_radio_idx) != UCI_OK ||
+            ssid_radio_idx != radioIndex)
+            continue;
+
+        if (vif_state_get(s, &vstate))
+            radio_rops_vstate(&vstate);
+    }
+}
+
+static void radio_dfs_event_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+    int radioIndex;
+    uint32_t freq = 0;
+
+    if (tb[NL80211_ATTR_WIPHY_FREQ])
+        freq = nla_get_u32(tb[NL80211_ATTR_WIPHY_FREQ]);
+
+    switch (cmd)
+    {
+        case NL80211_CMD_RADAR_DETECT:
+            phy = phy_radar_event(tb);
+            if (!phy)
+                return;
+            STRSCPY(phy_name, phy->name);
+            break;
+        case NL80211_CMD_CH_SWITCH_NOTIFY:
+            if (!tb[NL80211_ATTR_IFINDEX] ||
+                phy_from_ifindex(nla_get_u32(tb[NL80211_ATTR_IFINDEX]),
+                                 phy_name, sizeof(phy_name)))
+                return;
+            LOGI("%s: channel switched to %u MHz", phy_name, freq);
+            break;
+        default:
+            return;
+    }
+
+    if (wifi_getRadioIndexByPhy(phy_name, &radioIndex) != UCI_OK)
+    {
+        LOGD("%s: no radio for phy", phy_name);
+        return;
+    }
+
+    if (cmd == NL80211_CMD_CH_SWITCH_NOTIFY)
+        radio_csa_done(radioIndex, freq);
+
+    radio_state_push(radioIndex);
+}
+
 bool target_radio_config_init2()
 {
     int r;
@@ -391,17 +992,18 @@ bool target_radio_config_init2()
             g_rops.op_vstate(&vstate);
         }
     }
-/*
+
     if (!dfs_event_cb_registered)
     {
-        if (wifi_chan_eventRegister(chan_event_cb) != RETURN_OK)
+        if (!nl80211_event_register(NL80211_CMD_RADAR_DETECT, radio_dfs_event_cb, NULL) ||
+            !nl80211_event_register(NL80211_CMD_CH_SWITCH_NOTIFY, radio_dfs_event_cb, NULL))
         {
-            LOGE("Failed to register chan event callback\n");
+            LOGE("Failed to register chan event callback");
         }
 
         dfs_event_cb_registered = true;
     }
-*/
+
     return true;
 }
 
@@ -422,10 +1024,29 @@ bool target_radio_config_set2(
  {
      int radioIndex;
      bool rc = true;
+     bool csa = false;
 
      radio_ifname_to_idx(target_map_ifname((char*)rconf->if_name), &radioIndex);
 
-     if (changed->channel || changed->ht_mode)
+     /* Anything else that needs a restart takes the channel along with it */
+     if ((changed->channel || changed->ht_mode) &&
+         !changed->enabled && !changed->hw_mode && !changed->freq_band &&
+         !changed->tx_power && !changed->bcn_int &&
+         radio_csa_start(radioIndex, rconf->channel, rconf->ht_mode))
+     {
+         /* UCI is written once the driver reports the switch */
+         LOGD("%s: channel change deferred to CSA", rconf->if_name);
+         csa = true;
+
+         if (changed->ht_mode)
+         {
+             g_csa[radioIndex].modes = true;
+             STRSCPY(g_csa[radioIndex].freq_band, rconf->freq_band);
+             STRSCPY(g_csa[radioIndex].ht_mode, rconf->ht_mode);
+             STRSCPY(g_csa[radioIndex].hw_mode, rconf->hw_mode);
+         }
+     }
+     else if (changed->channel || changed->ht_mode)
      {
          if (!wifi_setRadioChannel(radioIndex, rconf->channel, rconf->ht_mode))
          {
@@ -464,7 +1085,7 @@ bool target_radio_config_set2(
          }
      }
 
-     if ((changed->ht_mode) || (changed->hw_mode) || (changed->freq_band))
+     if (((changed->ht_mode) && !csa) || (changed->hw_mode) || (changed->freq_band))
      {
         if (!wifi_setRadioModes(radioIndex, rconf->freq_band, rconf->ht_mode, rconf->hw_mode))    
         {
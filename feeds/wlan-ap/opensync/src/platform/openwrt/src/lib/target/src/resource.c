@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include "log.h"
+#include "const.h"
+#include "os_time.h"
+#include "target.h"
+#include "resource.h"
+
+#define RESOURCE_INTERVAL       10.0
+#define RESOURCE_REPORT_MS      (60 * 1000)
+#define RESOURCE_BUF_SIZE       4096
+
+struct resource_proc
+{
+    char            name[16];
+    int             pid;
+    int             stat_fd;
+    int             statm_fd;
+    uint64_t        ticks;
+    bool            valid;
+};
+
+static int res_stat_fd = -1;
+static int res_meminfo_fd = -1;
+static int res_loadavg_fd = -1;
+
+static struct resource_proc res_procs[RESOURCE_MAX_MANAGERS];
+static int res_procs_num = 0;
+
+static uint64_t res_total = 0;
+static uint64_t res_idle = 0;
+static long res_page_kb = 4;
+
+static struct resource_stats res_stats;
+static bool res_valid = false;
+static int64_t res_reported = 0;
+
+static struct ev_loop *res_loop = NULL;
+static ev_timer res_timer;
+
+static ssize_t resource_read(int fd, char *buf, size_t len)
+{
+    ssize_t n;
+
+    if (fd < 0)
+        return -1;
+
+    n = pread(fd, buf, len - 1, 0);
+    if (n < 0)
+        return -1;
+
+    buf[n] = '\0';
+    return n;
+}
+
+/* First line of /proc/stat, the aggregate over all CPUs */
+static bool resource_cpu_sample(void)
+{
+    unsigned long long v[8] = { 0 };
+    char buf[256];
+    uint64_t total = 0;
+    uint64_t idle;
+    int i;
+
+    if (resource_read(res_stat_fd, buf, sizeof(buf)) <= 0)
+        return false;
+
+    if (sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4)
+        return false;
+
+    for (i = 0; i < 8; i++)
+        total += v[i];
+    idle = v[3] + v[4];
+
+    if (res_total && total > res_total)
+        res_stats.cpu = 100 - (idle - res_idle) * 100 / (total - res_total);
+
+    res_total = total;
+    res_idle = idle;
+
+    return true;
+}
+
+static bool resource_mem_sample(void)
+{
+    char buf[RESOURCE_BUF_SIZE];
+    unsigned long val;
+    char *line;
+    char *next;
+    bool avail = false;
+
+    if (resource_read(res_meminfo_fd, buf, sizeof(buf)) <= 0)
+        return false;
+
+    for (line = buf; line && *line; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        if (sscanf(line, "MemTotal: %lu", &val) == 1)
+            res_stats.mem_total_kb = val;
+        else if (sscanf(line, "MemAvailable: %lu", &val) == 1)
+        {
+            res_stats.mem_avail_kb = val;
+            avail = true;
+            break;
+        }
+    }
+
+    if (avail && res_stats.mem_total_kb)
+    {
+        res_stats.mem_pressure = 100 - (uint64_t)res_stats.mem_avail_kb * 100 /
+                                       res_stats.mem_total_kb;
+    }
+
+    return avail;
+}
+
+static bool resource_load_sample(void)
+{
+    char buf[128];
+
+    if (resource_read(res_loadavg_fd, buf, sizeof(buf)) <= 0)
+        return false;
+
+    return sscanf(buf, "%lf %lf %lf", &res_stats.load[0], &res_stats.load[1],
+                  &res_stats.load[2]) == 3;
+}
+
+static void resource_proc_close(struct resource_proc *p)
+{
+    if (p->stat_fd >= 0)
+        close(p->stat_fd);
+    if (p->statm_fd >= 0)
+        close(p->statm_fd);
+
+    p->stat_fd = -1;
+    p->statm_fd = -1;
+    p->pid = 0;
+    p->valid = false;
+}
+
+/* DM keeps a pid file for every manager it starts */
+static bool resource_proc_open(struct resource_proc *p)
+{
+    char path[64];
+    char buf[16];
+    int fd;
+    ssize_t n;
+
+    snprintf(path, sizeof(path), TARGET_MANAGERS_PID_PATH "/%s.pid", p->name);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+
+    p->pid = atoi(buf);
+    if (p->pid <= 0)
+        return false;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", p->pid);
+    p->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/statm", p->pid);
+    p->statm_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (p->stat_fd < 0 || p->statm_fd < 0)
+    {
+        resource_proc_close(p);
+        return false;
+    }
+
+    return true;
+}
+
+static void resource_proc_sample(struct resource_proc *p, struct resource_mgr *m, uint64_t elapsed)
+{
+    unsigned long utime;
+    unsigned long stime;
+    unsigned long size;
+    unsigned long rss;
+    uint32_t rss_kb;
+    char buf[512];
+    char *s;
+
+    STRSCPY(m->name, p->name);
+
+    /* A restarted manager has a new pid, the old descriptors read ESRCH */
+    if (p->stat_fd >= 0 && resource_read(p->stat_fd, buf, sizeof(buf)) <= 0)
+        resource_proc_close(p);
+
+    if (p->stat_fd < 0)
+    {
+        if (!resource_proc_open(p) || resource_read(p->stat_fd, buf, sizeof(buf)) <= 0)
+        {
+            m->pid = 0;
+            m->cpu = 0;
+            return;
+        }
+    }
+
+    m->pid = p->pid;
+
+    /* Fields after the command name, which may contain spaces */
+    s = strrchr(buf, ')');
+    if (!s || sscanf(s + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                     &utime, &stime) != 2)
+        return;
+
+    if (p->valid && elapsed && utime + stime >= p->ticks)
+        m->cpu = (utime + stime - p->ticks) * 100 / elapsed;
+    p->ticks = utime + stime;
+
+    if (resource_read(p->statm_fd, buf, sizeof(buf)) > 0 &&
+        sscanf(buf, "%lu %lu", &size, &rss) == 2)
+    {
+        rss_kb = rss * res_page_kb;
+        m->rss_delta_kb = p->valid ? (int32_t)(rss_kb - m->rss_kb) : 0;
+        m->rss_kb = rss_kb;
+    }
+
+    p->valid = true;
+}
+
+static void resource_report(void)
+{
+    struct resource_mgr *m;
+    int i;
+
+    LOGI("resources: cpu %u%% load %.2f %.2f %.2f mem %u/%u kB available (%u%% used)",
+         res_stats.cpu, res_stats.load[0], res_stats.load[1], res_stats.load[2],
+         res_stats.mem_avail_kb, res_stats.mem_total_kb, res_stats.mem_pressure);
+
+    for (i = 0; i < res_stats.n_mgr; i++)
+    {
+        m = &res_stats.mgr[i];
+        if (!m->pid)
+        {
+            LOGI("resources: %s not running", m->name);
+            continue;
+        }
+
+        LOGI("resources: %s pid %d cpu %u%% rss %u kB (%+d kB)",
+             m->name, m->pid, m->cpu, m->rss_kb, m->rss_delta_kb);
+    }
+}
+
+static void resource_sample(void)
+{
+    uint64_t prev_total = res_total;
+    uint64_t elapsed;
+    int64_t now;
+    int i;
+
+    resource_cpu_sample();
+    resource_mem_sample();
+    resource_load_sample();
+
+    /* Process ticks are compared against the system ones */
+    elapsed = res_total > prev_total ? res_total - prev_total : 0;
+    for (i = 0; i < res_procs_num; i++)
+        resource_proc_sample(&res_procs[i], &res_stats.mgr[i], elapsed);
+    res_stats.n_mgr = res_procs_num;
+
+    res_valid = prev_total != 0;
+
+    now = clock_mono_ms();
+    if (res_valid && now - res_reported >= RESOURCE_REPORT_MS)
+    {
+        resource_report();
+        res_reported = now;
+    }
+}
+
+static void resource_timer_cb(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    resource_sample();
+}
+
+bool resource_get(struct resource_stats *stats)
+{
+    if (!res_valid)
+        return false;
+
+    *stats = res_stats;
+    return true;
+}
+
+bool resource_init(struct ev_loop *loop)
+{
+    char name[64];
+    int i;
+
+    if (res_loop)
+        return true;
+
+    res_stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    res_meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    res_loadavg_fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    res_page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+    res_procs_num = 0;
+    for (i = 0; i < target_managers_num && res_procs_num < RESOURCE_MAX_MANAGERS; i++)
+    {
+        STRSCPY(name, target_managers_config[i].name);
+        STRSCPY(res_procs[res_procs_num].name, basename(name));
+        res_procs[res_procs_num].stat_fd = -1;
+        res_procs[res_procs_num].statm_fd = -1;
+        res_procs_num++;
+    }
+
+    memset(&res_stats, 0, sizeof(res_stats));
+    res_reported = clock_mono_ms();
+
+    res_loop = loop;
+    ev_timer_init(&res_timer, resource_timer_cb, 0.0, RESOURCE_INTERVAL);
+    ev_timer_start(res_loop, &res_timer);
+
+    return res_stat_fd >= 0 && res_meminfo_fd >= 0;
+}
+
+void resource_cleanup(void)
+{
+    int i;
+
+    if (!res_loop)
+        return;
+
+    ev_timer_stop(res_loop, &res_timer);
+    res_loop = NULL;
+
+    for (i = 0; i < res_procs_num; i++)
+        resource_proc_close(&res_procs[i]);
+    res_procs_num = 0;
+
+    if (res_stat_fd >= 0)
+        close(res_stat_fd);
+    if (res_meminfo_fd >= 0)
+        close(res_meminfo_fd);
+    if (res_loadavg_fd >= 0)
+        close(res_loadavg_fd);
+    res_stat_fd = res_meminfo_fd = res_loadavg_fd = -1;
+
+    res_total = 0;
+    res_idle = 0;
+    res_valid = false;
+}
@@ -0,0 +1,459 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "evsched.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "rtnl.h"
+#include "phy.h"
+#include "nbr.h"
+#include "ft.h"
+#include "rrm.h"
+
+#define RRM_INTERVAL    EVSCHED_SEC(30)
+
+/* Neighbor Report element fields, IEEE 802.11-2016 9.4.2.37 */
+#define RRM_INFO_REACHABLE      0x0003
+#define RRM_INFO_SECURITY       0x0004
+#define RRM_INFO_SPECTRUM_MGMT  0x0010
+#define RRM_INFO_QOS            0x0020
+#define RRM_INFO_RRM            0x0080
+#define RRM_INFO_MOBILITY       0x0400
+#define RRM_INFO_HT             0x0800
+#define RRM_INFO_VHT            0x1000
+
+#define RRM_PHY_HT              7
+#define RRM_PHY_VHT             9
+
+struct rrm_nr
+{
+    char            bssid[18];
+    char            nr[27];     /* hex, BSSID through PHY type */
+    bool            seen;
+    bool            pushed;
+    ds_tree_node_t  node;
+};
+
+struct rrm_vif
+{
+    char            ifname[IFNAMSIZ];
+    char            phy[IFNAMSIZ];
+    char            ssid[33];
+    bool            up;
+    bool            enabled;
+    uint32_t        info;       /* BSSID Information shared by all neighbors */
+    char            peers[FT_MAX_PEERS][18];
+    int             n_peers;
+    ds_tree_t       nrs;
+    int             count;
+    ino_t           ctrl_ino;   /* hostapd instance the list went to */
+    ds_tree_node_t  node;
+};
+
+struct rrm_cand
+{
+    char    bssid[18];
+    int     channel;
+    int     rssi;
+    bool    local;
+};
+
+static ds_tree_t rrm_vif_tree = DS_TREE_INIT(ds_str_cmp, struct rrm_vif, node);
+static bool rrm_running = false;
+
+static bool rrm_mac_parse(const char *str, char *mac, size_t len, uint8_t *addr)
+{
+    unsigned int b[6];
+    int i;
+
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+        return false;
+
+    if (mac)
+        snprintf(mac, len, "%02x:%02x:%02x:%02x:%02x:%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+
+    for (i = 0; addr && i < 6; i++)
+        addr[i] = b[i];
+
+    return true;
+}
+
+/* Global operating class of a 20 MHz channel, Annex E table E-4 */
+static int rrm_op_class(int channel)
+{
+    if (channel >= 1 && channel <= 13)
+        return 81;
+    if (channel == 14)
+        return 82;
+    if (channel >= 36 && channel <= 48)
+        return 115;
+    if (channel >= 52 && channel <= 64)
+        return 118;
+    if (channel >= 100 && channel <= 144)
+        return 121;
+    if (channel >= 149 && channel <= 169)
+        return 125;
+
+    return 0;
+}
+
+static bool rrm_nr_build(const struct rrm_vif *vif, const struct rrm_cand *cand, char *hex, size_t len)
+{
+    uint8_t nr[13];
+    uint32_t info = vif->info;
+    size_t i;
+
+    if (!rrm_mac_parse(cand->bssid, NULL, 0, nr))
+        return false;
+
+    nr[10] = rrm_op_class(cand->channel);
+    if (!nr[10])
+        return false;
+
+    info |= cand->channel > 14 ? RRM_INFO_VHT | RRM_INFO_SPECTRUM_MGMT : RRM_INFO_HT;
+    nr[6] = info & 0xff;
+    nr[7] = (info >> 8) & 0xff;
+    nr[8] = (info >> 16) & 0xff;
+    nr[9] = (info >> 24) & 0xff;
+    nr[11] = cand->channel;
+    nr[12] = cand->channel > 14 ? RRM_PHY_VHT : RRM_PHY_HT;
+
+    for (i = 0; i < sizeof(nr) && 2 * i + 2 < len; i++)
+        snprintf(hex + 2 * i, len - 2 * i, "%02x", nr[i]);
+
+    return true;
+}
+
+static void rrm_cand_add(struct rrm_cand *cands, int *n, const char *bssid,
+                         int channel, int rssi, bool local)
+{
+    int weakest = -1;
+    int i;
+
+    for (i = 0; i < *n; i++)
+    {
+        if (!strcmp(cands[i].bssid, bssid))
+            return;
+        if (!cands[i].local && (weakest < 0 || cands[i].rssi < cands[weakest].rssi))
+            weakest = i;
+    }
+
+    /* Full, scanned BSSes make room for local or stronger ones */
+    if (*n == RRM_MAX_NEIGHBORS)
+    {
+        if (weakest < 0 || (!local && rssi <= cands[weakest].rssi))
+            return;
+        i = weakest;
+    }
+    else
+    {
+        i = (*n)++;
+    }
+
+    STRSCPY(cands[i].bssid, bssid);
+    cands[i].channel = channel;
+    cands[i].rssi = rssi;
+    cands[i].local = local;
+}
+
+static bool rrm_peer_known(const struct rrm_vif *vif, const char *bssid)
+{
+    int i;
+
+    for (i = 0; i < vif->n_peers; i++)
+        if (!strcmp(vif->peers[i], bssid))
+            return true;
+
+    return false;
+}
+
+static int rrm_cands_get(const struct rrm_vif *vif, struct rrm_cand *cands)
+{
+    struct rrm_vif *other;
+    struct rrm_vif *prev;
+    struct wifi_oper oper;
+    struct wifi_nbr *nbr;
+    ds_tree_t *nbrs;
+    char bssid[18];
+    char own[18] = "";
+    int n = 0;
+
+    rtnl_link_addr(vif->ifname, own, sizeof(own));
+
+    ds_tree_foreach(&rrm_vif_tree, other)
+    {
+        if (other == vif || !other->up || strcmp(other->ssid, vif->ssid))
+            continue;
+        if (rtnl_link_addr(other->ifname, bssid, sizeof(bssid)) ||
+            !rrm_mac_parse(bssid, bssid, sizeof(bssid), NULL))
+            continue;
+        if (!phy_get_oper(other->phy, &oper))
+            continue;
+
+        rrm_cand_add(cands, &n, bssid, oper.channel, 0, true);
+    }
+
+    ds_tree_foreach(&rrm_vif_tree, other)
+    {
+        /* Each phy's scan cache once */
+        ds_tree_foreach(&rrm_vif_tree, prev)
+            if (prev == other || !strcmp(prev->phy, other->phy))
+                break;
+        if (prev != other || !other->phy[0])
+            continue;
+
+        nbrs = nbr_get(other->phy);
+        if (!nbrs)
+            continue;
+
+        ds_tree_foreach(nbrs, nbr)
+        {
+            if (strcmp(nbr->ssid, vif->ssid) || !strcasecmp(nbr->bssid, own))
+                continue;
+            if (vif->n_peers && !rrm_peer_known(vif, nbr->bssid))
+                continue;
+
+            rrm_cand_add(cands, &n, nbr->bssid, nbr->primary, nbr->rssi, false);
+        }
+    }
+
+    return n;
+}
+
+static void rrm_ssid_hex(const struct rrm_vif *vif, char *hex, size_t len)
+{
+    size_t i;
+
+    hex[0] = '\0';
+    for (i = 0; vif->ssid[i] && 2 * i + 2 < len; i++)
+        snprintf(hex + 2 * i, len - 2 * i, "%02x", (uint8_t)vif->ssid[i]);
+}
+
+static bool rrm_nr_push(struct rrm_vif *vif, struct rrm_nr *entry, bool add)
+{
+    char ssid[65];
+    char cmd[160];
+
+    rrm_ssid_hex(vif, ssid, sizeof(ssid));
+
+    if (add)
+        snprintf(cmd, sizeof(cmd), "SET_NEIGHBOR %s ssid=%s nr=%s", entry->bssid, ssid, entry->nr);
+    else
+        snprintf(cmd, sizeof(cmd), "REMOVE_NEIGHBOR %s ssid=%s", entry->bssid, ssid);
+
+    return hostapd_cli_ok(vif->ifname, cmd);
+}
+
+static void rrm_nrs_free(struct rrm_vif *vif)
+{
+    struct rrm_nr *entry;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&vif->nrs, entry, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(entry);
+    }
+
+    vif->count = 0;
+}
+
+static void rrm_vif_update(struct rrm_vif *vif)
+{
+    struct rrm_cand cands[RRM_MAX_NEIGHBORS];
+    struct rrm_nr *entry;
+    ds_tree_iter_t iter;
+    ino_t ino;
+    char nr[27];
+    int added = 0;
+    int removed = 0;
+    int n;
+    int i;
+
+    if (!vif->enabled)
+        return;
+
+    n = rrm_cands_get(vif, cands);
+
+    ds_tree_foreach(&vif->nrs, entry)
+        entry->seen = false;
+
+    for (i = 0; i < n; i++)
+    {
+        if (!rrm_nr_build(vif, &cands[i], nr, sizeof(nr)))
+            continue;
+
+        entry = ds_tree_find(&vif->nrs, cands[i].bssid);
+        if (!entry)
+        {
+            entry = calloc(1, sizeof(*entry));
+            if (!entry)
+                continue;
+            STRSCPY(entry->bssid, cands[i].bssid);
+            ds_tree_insert(&vif->nrs, entry, entry->bssid);
+            vif->count++;
+        }
+
+        if (strcmp(entry->nr, nr))
+        {
+            STRSCPY(entry->nr, nr);
+            entry->pushed = false;
+        }
+        entry->seen = true;
+    }
+
+    ino = hostapd_ctrl_ino(vif->ifname);
+
+    /* A new hostapd starts with an empty list */
+    if (ino != vif->ctrl_ino)
+    {
+        ds_tree_foreach(&vif->nrs, entry)
+            entry->pushed = false;
+        vif->ctrl_ino = ino;
+    }
+
+    ds_tree_foreach_iter(&vif->nrs, entry, &iter)
+    {
+        if (!entry->seen)
+        {
+            if (entry->pushed && ino)
+                rrm_nr_push(vif, entry, false);
+            ds_tree_iremove(&iter);
+            free(entry);
+            vif->count--;
+            removed++;
+            continue;
+        }
+
+        if (entry->pushed || !ino)
+            continue;
+
+        entry->pushed = rrm_nr_push(vif, entry, true);
+        if (entry->pushed)
+            added++;
+        else
+            LOGD("%s: rrm: hostapd refused neighbor %s", vif->ifname, entry->bssid);
+    }
+
+    if (added || removed)
+        LOGI("%s: rrm: %d neighbors (+%d -%d)", vif->ifname, vif->count, added, removed);
+}
+
+bool rrm_vif_apply(int ssid_index, const struct schema_Wifi_VIF_Config *vconf)
+{
+    const char *encryption = SCHEMA_KEY_VAL_NULL(vconf->security, OVSDB_SECURITY_ENCRYPTION);
+    struct rrm_vif *vif;
+    int radio_idx;
+    int i;
+
+    vif = ds_tree_find(&rrm_vif_tree, (void *)vconf->if_name);
+    if (!vif)
+    {
+        vif = calloc(1, sizeof(*vif));
+        if (!vif)
+            return false;
+        STRSCPY(vif->ifname, vconf->if_name);
+        ds_tree_init(&vif->nrs, ds_str_cmp, struct rrm_nr, node);
+        ds_tree_insert(&rrm_vif_tree, vif, vif->ifname);
+    }
+
+    /* Kept while disabled, the VIF is still a neighbor of the others */
+    if (UCI_OK == wifi_getSSIDRadioIndex(ssid_index, &radio_idx))
+        wifi_getRadioPhyName(radio_idx, vif->phy, sizeof(vif->phy));
+    STRSCPY(vif->ssid, vconf->ssid);
+    vif->up = vconf->enabled;
+
+    vif->enabled = vconf->rrm_exists && vconf->rrm && vif->up;
+    if (!vif->enabled)
+    {
+        /* hostapd restarts without RRM and drops its list */
+        rrm_nrs_free(vif);
+        vif->ctrl_ino = 0;
+        return true;
+    }
+
+    vif->info = RRM_INFO_REACHABLE | RRM_INFO_QOS | RRM_INFO_RRM;
+    if (encryption && strcmp(encryption, OVSDB_SECURITY_ENCRYPTION_OPEN))
+        vif->info |= RRM_INFO_SECURITY;
+    if (vconf->ft_mobility_domain_exists && vconf->ft_mobility_domain)
+        vif->info |= RRM_INFO_MOBILITY;
+
+    vif->n_peers = 0;
+    for (i = 0; i < vconf->security_len && vif->n_peers < FT_MAX_PEERS; i++)
+    {
+        if (strncmp(vconf->security_keys[i], FT_PEER_PREFIX, strlen(FT_PEER_PREFIX)))
+            continue;
+        if (rrm_mac_parse(vconf->security[i], vif->peers[vif->n_peers],
+                          sizeof(vif->peers[vif->n_peers]), NULL))
+            vif->n_peers++;
+    }
+
+    rrm_vif_update(vif);
+
+    return true;
+}
+
+int rrm_neighbor_count(const char *ifname)
+{
+    struct rrm_vif *vif;
+
+    vif = ds_tree_find(&rrm_vif_tree, (void *)ifname);
+
+    return vif ? vif->count : 0;
+}
+
+void rrm_resync(void)
+{
+    struct rrm_vif *vif;
+
+    ds_tree_foreach(&rrm_vif_tree, vif)
+        rrm_vif_update(vif);
+}
+
+/* Channels move, scans come in and hostapd restarts under us */
+static void rrm_task(void *arg)
+{
+    rrm_resync();
+
+    evsched_task_reschedule_ms(RRM_INTERVAL);
+}
+
+bool rrm_init(void)
+{
+    if (rrm_running)
+        return true;
+
+    evsched_task(&rrm_task, NULL, RRM_INTERVAL);
+    rrm_running = true;
+
+    return true;
+}
+
+void rrm_cleanup(void)
+{
+    struct rrm_vif *vif;
+    ds_tree_iter_t iter;
+
+    if (!rrm_running)
+        return;
+
+    evsched_task_cancel_by_find(&rrm_task, NULL, EVSCHED_FIND_BY_FUNC);
+
+    ds_tree_foreach_iter(&rrm_vif_tree, vif, &iter)
+    {
+        ds_tree_iremove(&iter);
+        rrm_nrs_free(vif);
+        free(vif);
+    }
+
+    rrm_running = false;
+}
@@ -0,0 +1,518 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/if_link.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "rtnl.h"
+
+#define RTNL_HANDLER_MAX        16
+#define RTNL_SYSFS_NET          "/sys/class/net"
+#define RTNL_BATCH_SIZE         4096
+#define RTNL_BATCH_MAX          16
+#define RTNL_ACK_TIMEOUT_MS     1000
+
+struct rtnl_handler
+{
+    uint16_t                type;
+    rtnl_event_cb_t         cb;
+    void                    *arg;
+};
+
+/* Requests sent with one sendmsg(), the kernel acks each of them in order */
+struct rtnl_batch
+{
+    uint8_t                 buf[RTNL_BATCH_SIZE];
+    size_t                  len;
+    int                     num;
+    uint32_t                seq;
+};
+
+struct rtnl_link
+{
+    char                    ifname[IFNAMSIZ];
+    char                    addr[18];
+    ds_tree_node_t          node;
+};
+
+static struct nl_sock *rtnl_evt_sock = NULL;
+static struct nl_cb *rtnl_evt_cb = NULL;
+static struct ev_loop *rtnl_evt_loop = NULL;
+static ev_io rtnl_evt_io;
+static struct nl_sock *rtnl_req_sock = NULL;
+static uint32_t rtnl_req_seq = 0;
+
+static struct rtnl_handler rtnl_handlers[RTNL_HANDLER_MAX];
+static int rtnl_handlers_num = 0;
+
+static ds_tree_t rtnl_links = DS_TREE_INIT(ds_str_cmp, struct rtnl_link, node);
+
+static void rtnl_cleanup_links(void)
+{
+    struct rtnl_link *link;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&rtnl_links, link, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(link);
+    }
+}
+
+static void rtnl_link_update(struct nlmsghdr *nlh)
+{
+    struct nlattr *tb[IFLA_MAX + 1];
+    struct rtnl_link *link;
+    const uint8_t *a;
+    const char *ifname;
+
+    if (nlmsg_parse(nlh, sizeof(struct ifinfomsg), tb, IFLA_MAX, NULL) || !tb[IFLA_IFNAME])
+        return;
+
+    ifname = nla_get_string(tb[IFLA_IFNAME]);
+    link = ds_tree_find(&rtnl_links, (void *)ifname);
+    if (!link)
+        return;
+
+    if (nlh->nlmsg_type == RTM_DELLINK)
+    {
+        ds_tree_remove(&rtnl_links, link);
+        free(link);
+        return;
+    }
+
+    if (!tb[IFLA_ADDRESS] || nla_len(tb[IFLA_ADDRESS]) != 6)
+        return;
+
+    a = nla_data(tb[IFLA_ADDRESS]);
+    snprintf(link->addr, sizeof(link->addr), "%02x:%02x:%02x:%02x:%02x:%02x",
+             a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static int rtnl_event_cb(struct nl_msg *msg, void *arg)
+{
+    struct nlmsghdr *nlh = nlmsg_hdr(msg);
+    int i;
+
+    if (nlh->nlmsg_type == RTM_NEWLINK || nlh->nlmsg_type == RTM_DELLINK)
+        rtnl_link_update(nlh);
+
+    for (i = 0; i < rtnl_handlers_num; i++)
+    {
+        if (rtnl_handlers[i].type == nlh->nlmsg_type)
+            rtnl_handlers[i].cb(nlh, rtnl_handlers[i].arg);
+    }
+
+    return NL_SKIP;
+}
+
+static int rtnl_no_seq_check(struct nl_msg *msg, void *arg)
+{
+    return NL_OK;
+}
+
+static void rtnl_evt_io_cb(struct ev_loop *loop, ev_io *io, int revents)
+{
+    int ret;
+
+    ret = nl_recvmsgs(rtnl_evt_sock, rtnl_evt_cb);
+    if (ret < 0 && ret != -NLE_AGAIN)
+    {
+        /* Overruns lose events, start the cache over */
+        LOGW("rtnl: event receive failed: %d", ret);
+        rtnl_cleanup_links();
+    }
+}
+
+bool rtnl_event_register(uint16_t type, rtnl_event_cb_t cb, void *arg)
+{
+    if (rtnl_handlers_num >= RTNL_HANDLER_MAX)
+    {
+        LOGE("rtnl: too many event handlers");
+        return false;
+    }
+
+    rtnl_handlers[rtnl_handlers_num].type = type;
+    rtnl_handlers[rtnl_handlers_num].cb = cb;
+    rtnl_handlers[rtnl_handlers_num].arg = arg;
+    rtnl_handlers_num++;
+
+    return true;
+}
+
+int rtnl_link_addr(const char *ifname, char *mac, size_t len)
+{
+    struct rtnl_link *link;
+    char path[64];
+    char buf[32];
+    FILE *fp;
+
+    link = ds_tree_find(&rtnl_links, (void *)ifname);
+    if (link)
+    {
+        strscpy(mac, link->addr, len);
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), RTNL_SYSFS_NET "/%s/address", ifname);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    if (fscanf(fp, "%31s", buf) != 1)
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    strscpy(mac, buf, len);
+
+    /* Without the event socket there is nothing to invalidate the cache */
+    if (!rtnl_evt_sock)
+        return 0;
+
+    link = calloc(1, sizeof(*link));
+    if (link)
+    {
+        STRSCPY(link->ifname, ifname);
+        STRSCPY(link->addr, buf);
+        ds_tree_insert(&rtnl_links, link, link->ifname);
+    }
+
+    return 0;
+}
+
+static bool rtnl_batch_add(struct rtnl_batch *batch, struct nl_msg *msg)
+{
+    struct nlmsghdr *nlh = nlmsg_hdr(msg);
+    struct nlmsghdr *dst;
+    size_t len = NLMSG_ALIGN(nlh->nlmsg_len);
+
+    if (batch->num >= RTNL_BATCH_MAX || batch->len + len > sizeof(batch->buf))
+    {
+        nlmsg_free(msg);
+        return false;
+    }
+
+    dst = (struct nlmsghdr *)(batch->buf + batch->len);
+    memcpy(dst, nlh, nlh->nlmsg_len);
+    dst->nlmsg_seq = batch->seq + batch->num;
+    dst->nlmsg_pid = 0;
+    batch->len += len;
+    batch->num++;
+    nlmsg_free(msg);
+
+    return true;
+}
+
+static struct nl_msg *rtnl_link_msg(int type, int flags, int ifindex, bool up)
+{
+    struct ifinfomsg ifi = {
+        .ifi_family = AF_UNSPEC,
+        .ifi_index = ifindex,
+        .ifi_flags = up ? IFF_UP : 0,
+        .ifi_change = up ? IFF_UP : 0,
+    };
+    struct nl_msg *msg;
+
+    msg = nlmsg_alloc_simple(type, NLM_F_REQUEST | NLM_F_ACK | flags);
+    if (!msg)
+        return NULL;
+
+    if (nlmsg_append(msg, &ifi, sizeof(ifi), NLMSG_ALIGNTO) < 0)
+    {
+        nlmsg_free(msg);
+        return NULL;
+    }
+
+    return msg;
+}
+
+/* Returns the number of requests the kernel refused or never acked */
+static int rtnl_batch_send(struct rtnl_batch *batch, const char *what)
+{
+    uint8_t buf[RTNL_BATCH_SIZE];
+    struct nlmsgerr *err;
+    struct nlmsghdr *nlh;
+    struct pollfd pfd;
+    int pending = batch->num;
+    int failed = 0;
+    ssize_t len;
+    int fd;
+
+    if (!batch->num)
+        return 0;
+
+    if (!rtnl_req_sock)
+        return batch->num;
+
+    fd = nl_socket_get_fd(rtnl_req_sock);
+    if (send(fd, batch->buf, batch->len, 0) < 0)
+    {
+        LOGE("rtnl: %s: send failed: %s", what, strerror(errno));
+        return batch->num;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (pending > 0)
+    {
+        if (poll(&pfd, 1, RTNL_ACK_TIMEOUT_MS) <= 0)
+            break;
+
+        len = recv(fd, buf, sizeof(buf), 0);
+        if (len <= 0)
+            break;
+
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+        {
+            if (nlh->nlmsg_type != NLMSG_ERROR ||
+                nlh->nlmsg_seq - batch->seq >= (uint32_t)batch->num)
+                continue;
+
+            err = NLMSG_DATA(nlh);
+            if (err->error)
+            {
+                LOGW("rtnl: %s: request %u failed: %s", what,
+                     nlh->nlmsg_seq - batch->seq, strerror(-err->error));
+                failed++;
+            }
+            pending--;
+        }
+    }
+
+    return failed + pending;
+}
+
+static void rtnl_batch_init(struct rtnl_batch *batch)
+{
+    batch->len = 0;
+    batch->num = 0;
+    batch->seq = rtnl_req_seq;
+    rtnl_req_seq += RTNL_BATCH_MAX;
+}
+
+static bool rtnl_add_bridge(struct rtnl_batch *batch, const char *bridge)
+{
+    struct nlattr *info;
+    struct nl_msg *msg;
+
+    msg = rtnl_link_msg(RTM_NEWLINK, NLM_F_CREATE, 0, true);
+    if (!msg)
+        return false;
+
+    nla_put_string(msg, IFLA_IFNAME, bridge);
+    info = nla_nest_start(msg, IFLA_LINKINFO);
+    nla_put_string(msg, IFLA_INFO_KIND, "bridge");
+    nla_nest_end(msg, info);
+
+    return rtnl_batch_add(batch, msg);
+}
+
+static bool rtnl_add_vlan(struct rtnl_batch *batch, const char *ifname, int lower,
+                          int vlan_id, int master)
+{
+    struct nlattr *info;
+    struct nlattr *data;
+    struct nl_msg *msg;
+
+    msg = rtnl_link_msg(RTM_NEWLINK, NLM_F_CREATE, 0, true);
+    if (!msg)
+        return false;
+
+    nla_put_string(msg, IFLA_IFNAME, ifname);
+    nla_put_u32(msg, IFLA_LINK, lower);
+    nla_put_u32(msg, IFLA_MASTER, master);
+    info = nla_nest_start(msg, IFLA_LINKINFO);
+    nla_put_string(msg, IFLA_INFO_KIND, "vlan");
+    data = nla_nest_start(msg, IFLA_INFO_DATA);
+    nla_put_u16(msg, IFLA_VLAN_ID, vlan_id);
+    nla_nest_end(msg, data);
+    nla_nest_end(msg, info);
+
+    return rtnl_batch_add(batch, msg);
+}
+
+static bool rtnl_set_master(struct rtnl_batch *batch, int ifindex, int master, bool up)
+{
+    struct nl_msg *msg;
+
+    msg = rtnl_link_msg(RTM_NEWLINK, 0, ifindex, up);
+    if (!msg)
+        return false;
+
+    nla_put_u32(msg, IFLA_MASTER, master);
+
+    return rtnl_batch_add(batch, msg);
+}
+
+static bool rtnl_del_link(struct rtnl_batch *batch, int ifindex)
+{
+    struct nl_msg *msg;
+
+    msg = rtnl_link_msg(RTM_DELLINK, 0, ifindex, false);
+    if (!msg)
+        return false;
+
+    return rtnl_batch_add(batch, msg);
+}
+
+/*
+ * Put ports on the bridge of a VLAN, creating the bridge and the 802.1Q
+ * interface on top of lower as needed. Enslaving takes the bridge's
+ * ifindex, so a missing bridge costs one extra round trip; everything
+ * else goes out as one batch.
+ */
+int rtnl_vlan_attach(const char *bridge, const char *lower, int vlan_id,
+                     const char (*ports)[IFNAMSIZ], int num_ports)
+{
+    struct rtnl_batch batch;
+    char ifname[IFNAMSIZ];
+    unsigned int lower_idx;
+    unsigned int br_idx;
+    unsigned int idx;
+    int failed;
+    int i;
+
+    lower_idx = if_nametoindex(lower);
+    if (!lower_idx)
+        return -1;
+
+    br_idx = if_nametoindex(bridge);
+    if (!br_idx)
+    {
+        rtnl_batch_init(&batch);
+        rtnl_add_bridge(&batch, bridge);
+        if (rtnl_batch_send(&batch, bridge) || !(br_idx = if_nametoindex(bridge)))
+            return -1;
+    }
+
+    rtnl_batch_init(&batch);
+
+    snprintf(ifname, sizeof(ifname), "%s.%d", lower, vlan_id);
+    idx = if_nametoindex(ifname);
+    if (idx)
+        rtnl_set_master(&batch, idx, br_idx, true);
+    else
+        rtnl_add_vlan(&batch, ifname, lower_idx, vlan_id, br_idx);
+
+    for (i = 0; i < num_ports; i++)
+    {
+        idx = if_nametoindex(ports[i]);
+        if (idx)
+            rtnl_set_master(&batch, idx, br_idx, false);
+    }
+
+    failed = rtnl_batch_send(&batch, bridge);
+    if (failed)
+        return -1;
+
+    LOGI("rtnl: %s up with %s and %d ports", bridge, ifname, num_ports);
+
+    return 0;
+}
+
+int rtnl_vlan_detach(const char *bridge, const char *lower, int vlan_id)
+{
+    struct rtnl_batch batch;
+    char ifname[IFNAMSIZ];
+    unsigned int idx;
+
+    rtnl_batch_init(&batch);
+
+    snprintf(ifname, sizeof(ifname), "%s.%d", lower, vlan_id);
+    if ((idx = if_nametoindex(ifname)) != 0)
+        rtnl_del_link(&batch, idx);
+    if ((idx = if_nametoindex(bridge)) != 0)
+        rtnl_del_link(&batch, idx);
+
+    return rtnl_batch_send(&batch, bridge) ? -1 : 0;
+}
+
+bool rtnl_init(struct ev_loop *loop)
+{
+    int fd;
+
+    if (rtnl_evt_sock)
+        return true;
+
+    rtnl_evt_sock = nl_socket_alloc();
+    if (!rtnl_evt_sock)
+    {
+        LOGE("rtnl: failed to allocate netlink socket");
+        return false;
+    }
+
+    if (nl_connect(rtnl_evt_sock, NETLINK_ROUTE) ||
+        nl_socket_add_membership(rtnl_evt_sock, RTNLGRP_LINK))
+    {
+        LOGE("rtnl: failed to subscribe to link events");
+        goto err;
+    }
+
+    rtnl_evt_cb = nl_cb_alloc(NL_CB_DEFAULT);
+    if (!rtnl_evt_cb)
+        goto err;
+
+    nl_cb_set(rtnl_evt_cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, rtnl_no_seq_check, NULL);
+    nl_cb_set(rtnl_evt_cb, NL_CB_VALID, NL_CB_CUSTOM, rtnl_event_cb, NULL);
+
+    fd = nl_socket_get_fd(rtnl_evt_sock);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    /* Requests get their own socket, their acks must not race the events */
+    rtnl_req_sock = nl_socket_alloc();
+    if (rtnl_req_sock && nl_connect(rtnl_req_sock, NETLINK_ROUTE))
+    {
+        nl_socket_free(rtnl_req_sock);
+        rtnl_req_sock = NULL;
+    }
+    if (!rtnl_req_sock)
+        LOGW("rtnl: no request socket, links can't be set up directly");
+
+    rtnl_evt_loop = loop;
+    ev_io_init(&rtnl_evt_io, rtnl_evt_io_cb, fd, EV_READ);
+    ev_io_start(rtnl_evt_loop, &rtnl_evt_io);
+
+    LOGI("rtnl: listening for link events");
+
+    return true;
+
+err:
+    nl_socket_free(rtnl_evt_sock);
+    rtnl_evt_sock = NULL;
+    return false;
+}
+
+void rtnl_cleanup(void)
+{
+    if (rtnl_evt_sock)
+    {
+        ev_io_stop(rtnl_evt_loop, &rtnl_evt_io);
+        nl_cb_put(rtnl_evt_cb);
+        nl_socket_free(rtnl_evt_sock);
+        rtnl_evt_cb = NULL;
+        rtnl_evt_sock = NULL;
+    }
+
+    if (rtnl_req_sock)
+    {
+        nl_socket_free(rtnl_req_sock);
+        rtnl_req_sock = NULL;
+    }
+
+    rtnl_cleanup_links();
+    rtnl_handlers_num = 0;
+}
@@ -0,0 +1,707 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <net/ethernet.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "os_time.h"
+#include "nl80211.h"
+#include "sampler.h"
+
+#define SAMPLER_MAX_IFACES      16
+#define SAMPLER_MAX_STAS        128
+/* Clients not seen for this long have left */
+#define SAMPLER_STALE_MS        (30 * 1000)
+
+struct sampler_sample
+{
+    int64_t         ts;
+    int             rssi;
+    uint64_t        tx_bytes;
+    uint64_t        rx_bytes;
+    uint32_t        tx_packets;
+    uint32_t        tx_retries;
+};
+
+struct sampler_client
+{
+    char            key[IFNAMSIZ + 18];     /* "<ifname>/<mac>" */
+
+    struct sampler_sample ring[SAMPLER_RING_SIZE];
+    int             head;
+    int             count;
+
+    struct sampler_sta last;
+
+    /* Since the client was last reported */
+    struct sampler_sample start;
+    uint32_t        n;
+    int             rssi_min;
+    int             rssi_max;
+    int64_t         rssi_sum;
+    uint64_t        tx_bps_peak;
+    uint64_t        rx_bps_peak;
+
+    ds_tree_node_t  node;
+};
+
+struct sampler_iface
+{
+    char            ifname[IFNAMSIZ];
+    int             interval_ms;    /* shortest any user asked for */
+    int             user_ms[SAMPLER_USER_MAX];
+    int64_t         due;
+    int64_t         polled;     /* time of the last complete station dump */
+};
+
+struct sampler_dump
+{
+    struct sampler_sta sta[SAMPLER_MAX_STAS];
+    int             num;
+};
+
+struct sampler_entry
+{
+    struct sampler_sta sta;
+    struct sampler_agg agg;
+};
+
+/* Everything below is shared with the worker and guarded by sampler_lock */
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sampler_cond = PTHREAD_COND_INITIALIZER;
+static ds_tree_t sampler_clients = DS_TREE_INIT(ds_str_cmp, struct sampler_client, node);
+static struct sampler_iface sampler_ifaces[SAMPLER_MAX_IFACES];
+static int sampler_ifaces_num = 0;
+static bool sampler_stop = false;
+
+static pthread_t sampler_tid;
+static bool sampler_running = false;
+static bool sampler_events = false;
+static struct nl_sock *sampler_sock = NULL;
+
+static void sampler_key(char *key, size_t len, const char *ifname, const uint8_t *mac)
+{
+    snprintf(key, len, "%s/%02x:%02x:%02x:%02x:%02x:%02x",
+             ifname, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+/* NL80211_RATE_INFO_BITRATE(32) is in units of 100 kbit/s */
+static uint32_t sampler_bitrate(struct nlattr *attr)
+{
+    struct nlattr *rate[NL80211_RATE_INFO_MAX + 1];
+
+    if (nla_parse_nested(rate, NL80211_RATE_INFO_MAX, attr, NULL))
+        return 0;
+
+    if (rate[NL80211_RATE_INFO_BITRATE32])
+        return nla_get_u32(rate[NL80211_RATE_INFO_BITRATE32]);
+    if (rate[NL80211_RATE_INFO_BITRATE])
+        return nla_get_u16(rate[NL80211_RATE_INFO_BITRATE]);
+
+    return 0;
+}
+
+bool sampler_sta_parse(const uint8_t *mac, struct nlattr *sta_info, struct sampler_sta *sta)
+{
+    struct nlattr *sinfo[NL80211_COMPAT_STA_INFO_MAX + 1];
+
+    memset(sta, 0, sizeof(*sta));
+
+    if (nla_parse_nested(sinfo, NL80211_COMPAT_STA_INFO_MAX, sta_info, NULL))
+        return false;
+
+    memcpy(sta->mac, mac, ETH_ALEN);
+
+    if (sinfo[NL80211_STA_INFO_SIGNAL])
+        sta->signal = (int8_t)nla_get_u8(sinfo[NL80211_STA_INFO_SIGNAL]);
+    if (sinfo[NL80211_STA_INFO_SIGNAL_AVG])
+        sta->rssi = (int8_t)nla_get_u8(sinfo[NL80211_STA_INFO_SIGNAL_AVG]);
+    else
+        sta->rssi = sta->signal;
+    if (sinfo[NL80211_STA_INFO_TX_BYTES64])
+        sta->tx_bytes = nla_get_u64(sinfo[NL80211_STA_INFO_TX_BYTES64]);
+    if (sinfo[NL80211_STA_INFO_RX_BYTES64])
+        sta->rx_bytes = nla_get_u64(sinfo[NL80211_STA_INFO_RX_BYTES64]);
+    if (sinfo[NL80211_STA_INFO_TX_PACKETS])
+        sta->tx_packets = nla_get_u32(sinfo[NL80211_STA_INFO_TX_PACKETS]);
+    if (sinfo[NL80211_STA_INFO_RX_PACKETS])
+        sta->rx_packets = nla_get_u32(sinfo[NL80211_STA_INFO_RX_PACKETS]);
+    if (sinfo[NL80211_STA_INFO_TX_RETRIES])
+        sta->tx_retries = nla_get_u32(sinfo[NL80211_STA_INFO_TX_RETRIES]);
+    if (sinfo[NL80211_STA_INFO_TX_FAILED])
+        sta->tx_failed = nla_get_u32(sinfo[NL80211_STA_INFO_TX_FAILED]);
+    if (sinfo[NL80211_STA_INFO_TX_BITRATE])
+        sta->tx_rate = sampler_bitrate(sinfo[NL80211_STA_INFO_TX_BITRATE]);
+    if (sinfo[NL80211_STA_INFO_RX_BITRATE])
+        sta->rx_rate = sampler_bitrate(sinfo[NL80211_STA_INFO_RX_BITRATE]);
+    if (sinfo[NL80211_COMPAT_STA_INFO_TX_DURATION])
+        sta->tx_duration_us = nla_get_u64(sinfo[NL80211_COMPAT_STA_INFO_TX_DURATION]);
+    if (sinfo[NL80211_STA_INFO_RX_DURATION])
+        sta->rx_duration_us = nla_get_u64(sinfo[NL80211_STA_INFO_RX_DURATION]);
+    if (sinfo[NL80211_COMPAT_STA_INFO_AIRTIME_WEIGHT])
+        sta->airtime_weight = nla_get_u16(sinfo[NL80211_COMPAT_STA_INFO_AIRTIME_WEIGHT]);
+
+    return true;
+}
+
+static int sampler_sta_cb(struct nl_msg *msg, void *arg)
+{
+    struct sampler_dump *dump = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+
+    if (dump->num >= SAMPLER_MAX_STAS)
+        return NL_SKIP;
+
+    nl80211_parse(msg, tb);
+
+    if (!tb[NL80211_ATTR_MAC] || !tb[NL80211_ATTR_STA_INFO])
+        return NL_SKIP;
+
+    if (sampler_sta_parse(nla_data(tb[NL80211_ATTR_MAC]), tb[NL80211_ATTR_STA_INFO],
+                          &dump->sta[dump->num]))
+        dump->num++;
+
+    return NL_SKIP;
+}
+
+static uint64_t sampler_rate(uint64_t cur, uint64_t prev, int64_t ms)
+{
+    if (ms <= 0 || cur < prev)
+        return 0;
+
+    return (cur - prev) * 1000 / ms;
+}
+
+/* Called with sampler_lock held */
+static struct sampler_iface *sampler_iface_find(const char *ifname)
+{
+    int i;
+
+    for (i = 0; i < sampler_ifaces_num; i++)
+    {
+        if (!strcmp(sampler_ifaces[i].ifname, ifname))
+            return &sampler_ifaces[i];
+    }
+
+    return NULL;
+}
+
+/* Called with sampler_lock held */
+static bool sampler_client_on(const struct sampler_client *c, const char *ifname)
+{
+    size_t len = strlen(ifname);
+
+    return !strncmp(c->key, ifname, len) && c->key[len] == '/';
+}
+
+/* Called with sampler_lock held */
+static void sampler_iface_interval(struct sampler_iface *iface)
+{
+    int u;
+
+    iface->interval_ms = 0;
+    for (u = 0; u < SAMPLER_USER_MAX; u++)
+    {
+        if (iface->user_ms[u] && (!iface->interval_ms || iface->user_ms[u] < iface->interval_ms))
+            iface->interval_ms = iface->user_ms[u];
+    }
+}
+
+/* Called with sampler_lock held */
+static void sampler_iface_drop(struct sampler_iface *iface)
+{
+    struct sampler_client *c;
+    ds_tree_iter_t iter;
+    char ifname[IFNAMSIZ];
+
+    STRSCPY(ifname, iface->ifname);
+    *iface = sampler_ifaces[--sampler_ifaces_num];
+
+    ds_tree_foreach_iter(&sampler_clients, c, &iter)
+    {
+        if (!sampler_client_on(c, ifname))
+            continue;
+
+        ds_tree_iremove(&iter);
+        free(c);
+    }
+
+    LOGI("sampler: %s no longer sampled", ifname);
+}
+
+/* Called with sampler_lock held */
+static void sampler_push(const char *ifname, const struct sampler_sta *sta, int64_t ts)
+{
+    struct sampler_sample sample;
+    struct sampler_sample *s = &sample;
+    struct sampler_client *c;
+    struct sampler_sample *prev;
+    char key[IFNAMSIZ + 18];
+    uint64_t bps;
+
+    sample.ts = ts;
+    sample.rssi = sta->signal;
+    sample.tx_bytes = sta->tx_bytes;
+    sample.rx_bytes = sta->rx_bytes;
+    sample.tx_packets = sta->tx_packets;
+    sample.tx_retries = sta->tx_retries;
+
+    sampler_key(key, sizeof(key), ifname, sta->mac);
+
+    c = ds_tree_find(&sampler_clients, key);
+    if (!c)
+    {
+        c = calloc(1, sizeof(*c));
+        if (!c)
+            return;
+
+        STRSCPY(c->key, key);
+        c->start = *s;
+        ds_tree_insert(&sampler_clients, c, c->key);
+    }
+
+    if (c->count)
+    {
+        prev = &c->ring[(c->head + SAMPLER_RING_SIZE - 1) % SAMPLER_RING_SIZE];
+
+        /* Counters going backwards mean the client reassociated */
+        if (s->tx_bytes < prev->tx_bytes || s->rx_bytes < prev->rx_bytes)
+        {
+            c->start = *s;
+        }
+        else
+        {
+            bps = sampler_rate(s->tx_bytes, prev->tx_bytes, s->ts - prev->ts);
+            if (bps > c->tx_bps_peak)
+                c->tx_bps_peak = bps;
+            bps = sampler_rate(s->rx_bytes, prev->rx_bytes, s->ts - prev->ts);
+            if (bps > c->rx_bps_peak)
+                c->rx_bps_peak = bps;
+        }
+    }
+
+    c->last = *sta;
+    c->ring[c->head] = *s;
+    c->head = (c->head + 1) % SAMPLER_RING_SIZE;
+    if (c->count < SAMPLER_RING_SIZE)
+        c->count++;
+
+    if (!c->n || s->rssi < c->rssi_min)
+        c->rssi_min = s->rssi;
+    if (!c->n || s->rssi > c->rssi_max)
+        c->rssi_max = s->rssi;
+    c->rssi_sum += s->rssi;
+    c->n++;
+}
+
+/* Called with sampler_lock held */
+static void sampler_prune(int64_t now)
+{
+    struct sampler_client *c;
+    struct sampler_sample *last;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&sampler_clients, c, &iter)
+    {
+        last = &c->ring[(c->head + SAMPLER_RING_SIZE - 1) % SAMPLER_RING_SIZE];
+        if (now - last->ts <= SAMPLER_STALE_MS)
+            continue;
+
+        ds_tree_iremove(&iter);
+        free(c);
+    }
+}
+
+static void sampler_poll(const char *ifname, struct sampler_dump *dump)
+{
+    struct sampler_iface *iface;
+    struct nl_msg *msg;
+    unsigned int ifindex;
+    int64_t now;
+    int i;
+
+    ifindex = if_nametoindex(ifname);
+    if (!ifindex)
+        return;
+
+    msg = nl80211_msg(NL80211_CMD_GET_STATION, NLM_F_DUMP);
+    if (!msg)
+        return;
+
+    nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+
+    dump->num = 0;
+    if (nl80211_send_sock(sampler_sock, msg, sampler_sta_cb, dump))
+        return;
+
+    now = clock_mono_ms();
+
+    pthread_mutex_lock(&sampler_lock);
+    /* Unwatched while the dump ran, nobody asks for these any more */
+    iface = sampler_iface_find(ifname);
+    if (iface)
+    {
+        for (i = 0; i < dump->num; i++)
+            sampler_push(ifname, &dump->sta[i], now);
+        iface->polled = now;
+    }
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+static void *sampler_thread(void *arg)
+{
+    static struct sampler_dump dump;
+    char ifnames[SAMPLER_MAX_IFACES][IFNAMSIZ];
+    struct timespec ts;
+    int64_t next;
+    int64_t now;
+    int num;
+    int i;
+
+    pthread_mutex_lock(&sampler_lock);
+    while (!sampler_stop)
+    {
+        /* Collect the interfaces due, then poll them without the lock */
+        now = clock_mono_ms();
+        num = 0;
+        for (i = 0; i < sampler_ifaces_num; i++)
+        {
+            if (sampler_ifaces[i].due > now)
+                continue;
+
+            STRSCPY(ifnames[num++], sampler_ifaces[i].ifname);
+            sampler_ifaces[i].due = now + sampler_ifaces[i].interval_ms;
+        }
+        pthread_mutex_unlock(&sampler_lock);
+
+        for (i = 0; i < num; i++)
+            sampler_poll(ifnames[i], &dump);
+
+        pthread_mutex_lock(&sampler_lock);
+        now = clock_mono_ms();
+        sampler_prune(now);
+
+        next = now + 1000;
+        for (i = 0; i < sampler_ifaces_num; i++)
+        {
+            if (sampler_ifaces[i].due < next)
+                next = sampler_ifaces[i].due;
+        }
+        if (next <= now)
+            continue;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += (next - now) / 1000;
+        ts.tv_nsec += ((next - now) % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&sampler_cond, &sampler_lock, &ts);
+    }
+    pthread_mutex_unlock(&sampler_lock);
+
+    return NULL;
+}
+
+/* A deleted interface is dropped for every user */
+static void sampler_iface_event_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    struct sampler_iface *iface;
+
+    if (!tb[NL80211_ATTR_IFNAME])
+        return;
+
+    pthread_mutex_lock(&sampler_lock);
+    iface = sampler_iface_find(nla_get_string(tb[NL80211_ATTR_IFNAME]));
+    if (iface)
+        sampler_iface_drop(iface);
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+static bool sampler_start(void)
+{
+    pthread_condattr_t attr;
+
+    if (sampler_running)
+        return true;
+
+    /* Runs on the main loop, the handler stays registered across restarts */
+    if (!sampler_events)
+    {
+        if (!nl80211_event_register(NL80211_CMD_DEL_INTERFACE, sampler_iface_event_cb, NULL))
+            LOGW("sampler: no interface events, deleted interfaces stay watched");
+        sampler_events = true;
+    }
+
+    sampler_sock = nl80211_sock_open();
+    if (!sampler_sock)
+    {
+        LOGE("sampler: failed to open nl80211 socket");
+        return false;
+    }
+
+    /* The worker sleeps on the monotonic clock */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sampler_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    sampler_stop = false;
+    if (pthread_create(&sampler_tid, NULL, sampler_thread, NULL))
+    {
+        LOGE("sampler: failed to start worker: %s", strerror(errno));
+        nl80211_sock_close(sampler_sock);
+        sampler_sock = NULL;
+        return false;
+    }
+
+    sampler_running = true;
+    LOGI("sampler: started");
+
+    return true;
+}
+
+bool sampler_watch(const char *ifname, int user, int interval_ms)
+{
+    struct sampler_iface *iface;
+
+    if (user < 0 || user >= SAMPLER_USER_MAX)
+        return false;
+
+    if (interval_ms < SAMPLER_MIN_MS)
+        interval_ms = SAMPLER_MIN_MS;
+
+    pthread_mutex_lock(&sampler_lock);
+    iface = sampler_iface_find(ifname);
+    if (!iface)
+    {
+        if (sampler_ifaces_num == SAMPLER_MAX_IFACES)
+        {
+            pthread_mutex_unlock(&sampler_lock);
+            LOGW("sampler: too many interfaces, not watching %s", ifname);
+            return false;
+        }
+
+        iface = &sampler_ifaces[sampler_ifaces_num++];
+        memset(iface, 0, sizeof(*iface));
+        STRSCPY(iface->ifname, ifname);
+    }
+    if (iface->user_ms[user] != interval_ms)
+    {
+        iface->user_ms[user] = interval_ms;
+        sampler_iface_interval(iface);
+        LOGI("sampler: %s sampled every %d ms", ifname, iface->interval_ms);
+    }
+    pthread_cond_signal(&sampler_cond);
+    pthread_mutex_unlock(&sampler_lock);
+
+    return sampler_start();
+}
+
+/* The interface stays watched while anyone else still wants it */
+void sampler_unwatch(const char *ifname, int user)
+{
+    struct sampler_iface *iface;
+
+    if (user < 0 || user >= SAMPLER_USER_MAX)
+        return;
+
+    pthread_mutex_lock(&sampler_lock);
+    iface = sampler_iface_find(ifname);
+    if (iface && iface->user_ms[user])
+    {
+        iface->user_ms[user] = 0;
+        sampler_iface_interval(iface);
+        if (!iface->interval_ms)
+            sampler_iface_drop(iface);
+    }
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+static int sampler_int_cmp(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* Called with sampler_lock held, restarts the client's interval */
+static void sampler_agg_take(struct sampler_client *c, struct sampler_agg *agg)
+{
+    int rssi[SAMPLER_RING_SIZE];
+    struct sampler_sample start;
+    struct sampler_sample last;
+    uint32_t packets;
+    int count;
+    int i;
+
+    memset(agg, 0, sizeof(*agg));
+    if (!c->n)
+        return;
+
+    count = c->count < (int)c->n ? c->count : (int)c->n;
+    for (i = 0; i < count; i++)
+        rssi[i] = c->ring[(c->head + SAMPLER_RING_SIZE - 1 - i) % SAMPLER_RING_SIZE].rssi;
+
+    start = c->start;
+    last = c->ring[(c->head + SAMPLER_RING_SIZE - 1) % SAMPLER_RING_SIZE];
+    agg->samples = c->n;
+    agg->rssi_min = c->rssi_min;
+    agg->rssi_max = c->rssi_max;
+    agg->rssi_avg = c->rssi_sum / c->n;
+    agg->tx_bps_peak = c->tx_bps_peak;
+    agg->rx_bps_peak = c->rx_bps_peak;
+
+    /* Next interval starts at the newest sample */
+    c->start = last;
+    c->n = 0;
+    c->rssi_sum = 0;
+    c->tx_bps_peak = 0;
+    c->rx_bps_peak = 0;
+
+    qsort(rssi, count, sizeof(rssi[0]), sampler_int_cmp);
+    agg->rssi_p10 = rssi[count * 10 / 100];
+    agg->rssi_p50 = rssi[count * 50 / 100];
+    agg->rssi_p90 = rssi[count * 90 / 100];
+
+    agg->tx_bps_avg = sampler_rate(last.tx_bytes, start.tx_bytes, last.ts - start.ts);
+    agg->rx_bps_avg = sampler_rate(last.rx_bytes, start.rx_bytes, last.ts - start.ts);
+
+    if (last.tx_packets > start.tx_packets && last.tx_retries >= start.tx_retries)
+    {
+        packets = last.tx_packets - start.tx_packets;
+        agg->retry_pct = (uint64_t)(last.tx_retries - start.tx_retries) * 100 / packets;
+        if (agg->retry_pct > 100)
+            agg->retry_pct = 100;
+    }
+}
+
+/*
+ * Hands out the stations of the interface's latest poll with their
+ * aggregates. Returns -1 while there is no recent poll to report from,
+ * the caller has to dump the stations itself then.
+ */
+int sampler_report(const char *ifname, sampler_report_cb_t *cb, void *arg)
+{
+    struct sampler_entry *entries;
+    struct sampler_iface *iface;
+    struct sampler_client *c;
+    struct sampler_sample *last;
+    int num = 0;
+    int i;
+
+    entries = calloc(SAMPLER_MAX_STAS, sizeof(*entries));
+    if (!entries)
+        return -1;
+
+    pthread_mutex_lock(&sampler_lock);
+    iface = sampler_iface_find(ifname);
+    if (!iface || !iface->polled || clock_mono_ms() - iface->polled > SAMPLER_STALE_MS)
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        free(entries);
+        return -1;
+    }
+
+    ds_tree_foreach(&sampler_clients, c)
+    {
+        if (num == SAMPLER_MAX_STAS || !sampler_client_on(c, ifname))
+            continue;
+
+        /* Gone since, pruned later */
+        last = &c->ring[(c->head + SAMPLER_RING_SIZE - 1) % SAMPLER_RING_SIZE];
+        if (last->ts != iface->polled)
+            continue;
+
+        entries[num].sta = c->last;
+        sampler_agg_take(c, &entries[num].agg);
+        num++;
+    }
+    pthread_mutex_unlock(&sampler_lock);
+
+    for (i = 0; i < num; i++)
+        cb(&entries[i].sta, &entries[i].agg, arg);
+
+    free(entries);
+
+    return num;
+}
+
+/*
+ * The stations of the interface's latest poll as the driver reported
+ * them, aggregates untouched. Returns -1 without a recent poll.
+ */
+int sampler_peek(const char *ifname, sampler_sta_cb_t *cb, void *arg)
+{
+    struct sampler_iface *iface;
+    struct sampler_client *c;
+    struct sampler_sample *last;
+    struct sampler_sta *stas;
+    int num = 0;
+    int i;
+
+    stas = calloc(SAMPLER_MAX_STAS, sizeof(*stas));
+    if (!stas)
+        return -1;
+
+    pthread_mutex_lock(&sampler_lock);
+    iface = sampler_iface_find(ifname);
+    if (!iface || !iface->polled || clock_mono_ms() - iface->polled > SAMPLER_STALE_MS)
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        free(stas);
+        return -1;
+    }
+
+    ds_tree_foreach(&sampler_clients, c)
+    {
+        if (num == SAMPLER_MAX_STAS || !sampler_client_on(c, ifname))
+            continue;
+
+        last = &c->ring[(c->head + SAMPLER_RING_SIZE - 1) % SAMPLER_RING_SIZE];
+        if (last->ts == iface->polled)
+            stas[num++] = c->last;
+    }
+    pthread_mutex_unlock(&sampler_lock);
+
+    for (i = 0; i < num; i++)
+        cb(&stas[i], arg);
+
+    free(stas);
+
+    return num;
+}
+
+void sampler_cleanup(void)
+{
+    struct sampler_client *c;
+    ds_tree_iter_t iter;
+
+    if (sampler_running)
+    {
+        pthread_mutex_lock(&sampler_lock);
+        sampler_stop = true;
+        pthread_cond_signal(&sampler_cond);
+        pthread_mutex_unlock(&sampler_lock);
+
+        pthread_join(sampler_tid, NULL);
+        nl80211_sock_close(sampler_sock);
+        sampler_sock = NULL;
+        sampler_running = false;
+    }
+
+    ds_tree_foreach_iter(&sampler_clients, c, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(c);
+    }
+    sampler_ifaces_num = 0;
+}
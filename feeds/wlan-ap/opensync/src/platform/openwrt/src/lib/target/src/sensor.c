@@ -0,0 +1,220 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "os_time.h"
+#include "sensor.h"
+
+#define SENSOR_HWMON_PATH   "/sys/class/hwmon"
+
+struct sensor
+{
+    char            key[32];
+    char            hwmon[16];
+    int             fd;
+    int             value;          /* millidegrees Celsius */
+    bool            valid;
+    ds_tree_node_t  node;
+};
+
+static ds_tree_t sensor_tree = DS_TREE_INIT(ds_str_cmp, struct sensor, node);
+static int64_t sensor_sampled = 0;
+static bool sensor_discovered = false;
+
+static bool sensor_read_line(const char *path, char *buf, size_t len)
+{
+    FILE *fp;
+    bool ok;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return false;
+
+    ok = fgets(buf, len, fp) != NULL;
+    fclose(fp);
+
+    if (ok)
+        buf[strcspn(buf, "\n")] = '\0';
+
+    return ok;
+}
+
+/* The phy sharing the hwmon's parent device, if there is one */
+static bool sensor_phy_get(const char *hwmon, char *phy, size_t len)
+{
+    struct dirent *de;
+    char path[128];
+    DIR *dir;
+    bool found = false;
+
+    snprintf(path, sizeof(path), SENSOR_HWMON_PATH "/%s/device/ieee80211", hwmon);
+    dir = opendir(path);
+    if (!dir)
+        return false;
+
+    while ((de = readdir(dir)))
+    {
+        if (de->d_name[0] == '.')
+            continue;
+
+        strscpy(phy, de->d_name, len);
+        found = true;
+        break;
+    }
+    closedir(dir);
+
+    return found;
+}
+
+static void sensor_add(const char *hwmon)
+{
+    struct sensor *s;
+    char path[128];
+    char key[32];
+    int fd;
+
+    if (!sensor_phy_get(hwmon, key, sizeof(key)))
+    {
+        snprintf(path, sizeof(path), SENSOR_HWMON_PATH "/%s/name", hwmon);
+        if (!sensor_read_line(path, key, sizeof(key)))
+            return;
+    }
+
+    /* Several chips of one driver share a name, the first one wins */
+    if (ds_tree_find(&sensor_tree, key))
+    {
+        LOGD("sensor: %s already registered, skipping %s", key, hwmon);
+        return;
+    }
+
+    snprintf(path, sizeof(path), SENSOR_HWMON_PATH "/%s/temp1_input", hwmon);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    s = calloc(1, sizeof(*s));
+    if (!s)
+    {
+        close(fd);
+        return;
+    }
+
+    STRSCPY(s->key, key);
+    STRSCPY(s->hwmon, hwmon);
+    s->fd = fd;
+    ds_tree_insert(&sensor_tree, s, s->key);
+
+    LOGI("sensor: %s is %s", s->key, hwmon);
+}
+
+static void sensor_discover(void)
+{
+    struct dirent *de;
+    DIR *dir;
+
+    dir = opendir(SENSOR_HWMON_PATH);
+    if (!dir)
+    {
+        LOGW("sensor: no hwmon class");
+        return;
+    }
+
+    while ((de = readdir(dir)))
+    {
+        if (!strncmp(de->d_name, "hwmon", 5))
+            sensor_add(de->d_name);
+    }
+    closedir(dir);
+
+    sensor_discovered = true;
+}
+
+/* One pass over every sensor, returns how many could be read */
+int sensor_sample(void)
+{
+    struct sensor *s;
+    char buf[16];
+    ssize_t n;
+    int num = 0;
+    bool stale = false;
+
+    if (!sensor_discovered)
+        sensor_discover();
+
+    ds_tree_foreach(&sensor_tree, s)
+    {
+        n = pread(s->fd, buf, sizeof(buf) - 1, 0);
+        if (n <= 0)
+        {
+            /* A driver reload invalidates the descriptor */
+            if (s->valid)
+                LOGW("sensor: %s read failed: %s", s->key, n < 0 ? strerror(errno) : "empty");
+            s->valid = false;
+            stale = stale || (n < 0 && errno == ENODEV);
+            continue;
+        }
+
+        buf[n] = '\0';
+        s->value = strtol(buf, NULL, 10);
+        s->valid = true;
+        num++;
+    }
+
+    sensor_sampled = clock_mono_ms();
+
+    if (stale)
+    {
+        sensor_cleanup();
+        sensor_discover();
+    }
+
+    return num;
+}
+
+bool sensor_temp_get(const char *key, int *millideg)
+{
+    struct sensor *s;
+
+    if (!sensor_discovered || clock_mono_ms() - sensor_sampled > SENSOR_MAX_AGE_MS)
+        sensor_sample();
+
+    s = ds_tree_find(&sensor_tree, (void *)key);
+    if (!s || !s->valid)
+        return false;
+
+    *millideg = s->value;
+    return true;
+}
+
+bool sensor_init(void)
+{
+    if (!sensor_discovered)
+        sensor_discover();
+
+    return true;
+}
+
+void sensor_cleanup(void)
+{
+    struct sensor *s;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&sensor_tree, s, &iter)
+    {
+        close(s->fd);
+        ds_tree_iremove(&iter);
+        free(s);
+    }
+
+    sensor_discovered = false;
+}
@@ -0,0 +1,506 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "evsched.h"
+#include "uci_helper.h"
+#include "phy.h"
+#include "spectral.h"
+
+#define SPECTRAL_INTERVAL       EVSCHED_SEC(30)
+#ifndef SPECTRAL_DEBUGFS
+#define SPECTRAL_DEBUGFS        "/sys/kernel/debug/ieee80211"
+#endif
+#define SPECTRAL_READ_SIZE      (64 * 1024)
+/* Upper bound of one run, so a flood of samples cannot stall the loop */
+#define SPECTRAL_MAX_READ       (4 * 1024 * 1024)
+/* Larger than any single sample, partial ones are carried over */
+#define SPECTRAL_CARRY_SIZE     512
+
+/* A sample this far above the noise floor counts as busy air */
+#define SPECTRAL_BUSY_DB        10
+/* Quiet gap that ends a burst, and the burst periods worth tracking */
+#define SPECTRAL_BURST_GAP_US   2000
+#define SPECTRAL_PERIOD_MIN_US  5000
+#define SPECTRAL_PERIOD_MAX_US  50000
+
+/* Sample layouts from the drivers' spectral_common.h */
+#define ATH_FFT_SAMPLE_HT20     1
+#define ATH_FFT_SAMPLE_HT20_40  2
+#define ATH_FFT_SAMPLE_ATH10K   3
+
+#define FFT_TLV_LEN             3
+#define FFT_HT20_LEN            76
+#define FFT_HT20_BINS           56
+#define FFT_HT20_40_LEN         155
+#define FFT_HT20_40_BINS        128
+#define FFT_ATH10K_HDR_LEN      29
+
+struct spectral_radio
+{
+    char                    phy[IFNAMSIZ];
+    char                    ctl[128];
+    int                     fd;
+    bool                    active;
+    /* Partial sample left from the last read, the read buffer is shared */
+    uint8_t                 carry_buf[SPECTRAL_CARRY_SIZE];
+    size_t                  carry;
+    struct spectral_acc     acc[SPECTRAL_MAX_CHANS];
+    struct spectral_summary sum[SPECTRAL_MAX_CHANS];
+    int                     n_sum;
+};
+
+static struct spectral_radio g_spectral[UCI_MAX_RADIOS];
+static uint8_t *g_spectral_buf = NULL;
+static bool spectral_running = false;
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint64_t get_be64(const uint8_t *p)
+{
+    return ((uint64_t)get_be16(p) << 48) | ((uint64_t)get_be16(p + 2) << 32) |
+           ((uint64_t)get_be16(p + 4) << 16) | get_be16(p + 6);
+}
+
+/******************************************************************************
+ *  Aggregation
+ *****************************************************************************/
+
+static struct spectral_acc *spectral_acc_get(
+        struct spectral_acc *acc,
+        int n_acc,
+        uint32_t freq,
+        int n_bins)
+{
+    int i;
+
+    for (i = 0; i < n_acc; i++)
+    {
+        if (acc[i].freq == freq)
+        {
+            /* Width changed, what we have is not comparable any more */
+            if (acc[i].n_bins != n_bins)
+                break;
+            return &acc[i];
+        }
+
+        if (!acc[i].freq)
+            break;
+    }
+
+    if (i == n_acc)
+        return NULL;
+
+    memset(&acc[i], 0, sizeof(acc[i]));
+    acc[i].freq = freq;
+    acc[i].n_bins = n_bins;
+
+    return &acc[i];
+}
+
+/*
+ * Each bin's power is the sample's total power (noise + rssi) shared out
+ * by the bin's share of the squared magnitudes. The two loops run over
+ * fixed size arrays without branches so the compiler can vectorize them.
+ */
+static void spectral_fold(
+        struct spectral_acc *acc,
+        const uint8_t *data,
+        int max_exp,
+        int noise,
+        int rssi,
+        uint64_t tsf)
+{
+    float sq[SPECTRAL_MAX_BINS] __attribute__((aligned(16)));
+    float sum = 0;
+    float scale;
+    uint32_t v;
+    int n = acc->n_bins;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        v = (uint32_t)data[i] << max_exp;
+        sq[i] = (float)v * (float)v;
+        sum += sq[i];
+    }
+
+    if (sum <= 0)
+        return;
+
+    scale = powf(10.0f, (noise + rssi) / 10.0f) / sum;
+
+    for (i = 0; i < n; i++)
+        acc->pwr[i] += scale * sq[i];
+
+    acc->samples++;
+    acc->noise_sum += noise;
+
+    if (rssi < SPECTRAL_BUSY_DB)
+        return;
+
+    acc->busy++;
+
+    /* Track how often bursts start, microwave ovens follow the mains */
+    if (!acc->last_busy_tsf || tsf - acc->last_busy_tsf > SPECTRAL_BURST_GAP_US)
+    {
+        if (acc->burst_start_tsf && tsf > acc->burst_start_tsf &&
+            tsf - acc->burst_start_tsf >= SPECTRAL_PERIOD_MIN_US &&
+            tsf - acc->burst_start_tsf <= SPECTRAL_PERIOD_MAX_US)
+        {
+            acc->period_sum_us += tsf - acc->burst_start_tsf;
+            acc->periods++;
+        }
+        acc->burst_start_tsf = tsf;
+    }
+
+    acc->last_busy_tsf = tsf;
+}
+
+size_t spectral_parse(const uint8_t *buf, size_t len, struct spectral_acc *acc, int n_acc)
+{
+    struct spectral_acc *a;
+    const uint8_t *s;
+    size_t off = 0;
+    size_t slen;
+    int n_bins;
+    int rssi;
+
+    while (len - off >= FFT_TLV_LEN)
+    {
+        s = buf + off;
+        slen = FFT_TLV_LEN + get_be16(s + 1);
+        if (off + slen > len)
+            break;
+
+        switch (s[0])
+        {
+            case ATH_FFT_SAMPLE_HT20:
+                if (slen < FFT_HT20_LEN)
+                    break;
+                a = spectral_acc_get(acc, n_acc, get_be16(s + 4), FFT_HT20_BINS);
+                if (a)
+                    spectral_fold(a, s + 20, s[3], (int8_t)s[7], (int8_t)s[6],
+                                  get_be64(s + 12));
+                break;
+
+            case ATH_FFT_SAMPLE_HT20_40:
+                if (slen < FFT_HT20_40_LEN)
+                    break;
+                rssi = (int8_t)s[6] > (int8_t)s[7] ? (int8_t)s[6] : (int8_t)s[7];
+                a = spectral_acc_get(acc, n_acc, get_be16(s + 4), FFT_HT20_40_BINS);
+                if (a)
+                    spectral_fold(a, s + 27, s[26], (int8_t)s[16], rssi,
+                                  get_be64(s + 8));
+                break;
+
+            case ATH_FFT_SAMPLE_ATH10K:
+                if (slen <= FFT_ATH10K_HDR_LEN)
+                    break;
+                n_bins = slen - FFT_ATH10K_HDR_LEN;
+                if (n_bins > SPECTRAL_MAX_BINS)
+                    n_bins = SPECTRAL_MAX_BINS;
+                a = spectral_acc_get(acc, n_acc, get_be16(s + 4), n_bins);
+                if (a)
+                    spectral_fold(a, s + FFT_ATH10K_HDR_LEN, s[28], (int16_t)get_be16(s + 8),
+                                  s[25], get_be64(s + 16));
+                break;
+
+            default:
+                break;
+        }
+
+        off += slen;
+    }
+
+    return off;
+}
+
+const char *spectral_interferer_str(enum spectral_interferer intf)
+{
+    switch (intf)
+    {
+        case SPECTRAL_INTF_MICROWAVE:
+            return "microwave";
+        case SPECTRAL_INTF_CONTINUOUS:
+            return "continuous";
+        case SPECTRAL_INTF_NARROWBAND:
+            return "narrowband";
+        default:
+            return "none";
+    }
+}
+
+bool spectral_summarize(const struct spectral_acc *acc, struct spectral_summary *sum)
+{
+    float total = 0;
+    float peak = 0;
+    int i;
+
+    memset(sum, 0, sizeof(*sum));
+
+    if (!acc->samples || !acc->n_bins)
+        return false;
+
+    for (i = 0; i < acc->n_bins; i++)
+    {
+        total += acc->pwr[i];
+        peak = acc->pwr[i] > peak ? acc->pwr[i] : peak;
+    }
+
+    if (total <= 0)
+        return false;
+
+    sum->freq = acc->freq;
+    sum->chan = phy_freq_to_channel(acc->freq);
+    sum->samples = acc->samples;
+    sum->noise = acc->noise_sum / acc->samples;
+    sum->avg_power = lroundf(10.0f * log10f(total / acc->samples));
+    sum->peak_power = lroundf(10.0f * log10f(peak / acc->samples));
+    /* Flat for OFDM, tens of dB for narrowband emitters */
+    sum->flatness = lroundf(10.0f * log10f(peak * acc->n_bins / total));
+    sum->duty = acc->busy * 100 / acc->samples;
+    if (acc->periods)
+        sum->period_ms = acc->period_sum_us / acc->periods / 1000;
+
+    if (sum->chan <= 14 && sum->period_ms >= 14 && sum->period_ms <= 22 &&
+        sum->duty >= 10 && sum->duty <= 80)
+        sum->interferer = SPECTRAL_INTF_MICROWAVE;
+    else if (sum->duty >= 85 && sum->flatness >= 8)
+        sum->interferer = SPECTRAL_INTF_CONTINUOUS;
+    else if (sum->duty >= 5 && sum->flatness >= 12)
+        sum->interferer = SPECTRAL_INTF_NARROWBAND;
+
+    return true;
+}
+
+/******************************************************************************
+ *  Background ingestion
+ *****************************************************************************/
+
+static bool spectral_ctl(struct spectral_radio *radio, const char *cmd)
+{
+    int fd;
+    bool ok;
+
+    fd = open(radio->ctl, O_WRONLY);
+    if (fd < 0)
+        return false;
+
+    ok = write(fd, cmd, strlen(cmd)) == (ssize_t)strlen(cmd);
+    close(fd);
+
+    if (!ok)
+        LOGW("%s: spectral '%s' failed: %s", radio->phy, cmd, strerror(errno));
+
+    return ok;
+}
+
+static bool spectral_start(struct spectral_radio *radio)
+{
+    static const char *drivers[] = { "ath10k", "ath9k" };
+    char path[128];
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(drivers); i++)
+    {
+        snprintf(radio->ctl, sizeof(radio->ctl), SPECTRAL_DEBUGFS "/%s/%s/spectral_scan_ctl",
+                 radio->phy, drivers[i]);
+        if (!access(radio->ctl, W_OK))
+            break;
+    }
+
+    if (i == ARRAY_SIZE(drivers))
+    {
+        LOGW("%s: spectral scan not supported", radio->phy);
+        return false;
+    }
+
+    snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/%s/%s/spectral_scan0",
+             radio->phy, drivers[i]);
+    radio->fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (radio->fd < 0)
+    {
+        LOGW("%s: cannot open %s: %s", radio->phy, path, strerror(errno));
+        return false;
+    }
+
+    if (!spectral_ctl(radio, "background") || !spectral_ctl(radio, "trigger"))
+    {
+        close(radio->fd);
+        return false;
+    }
+
+    memset(radio->acc, 0, sizeof(radio->acc));
+    radio->carry = 0;
+    radio->active = true;
+    LOGI("%s: spectral scan started", radio->phy);
+
+    return true;
+}
+
+static void spectral_stop(struct spectral_radio *radio)
+{
+    if (!radio->active)
+        return;
+
+    spectral_ctl(radio, "disable");
+    close(radio->fd);
+    radio->active = false;
+    radio->n_sum = 0;
+    LOGI("%s: spectral scan stopped", radio->phy);
+}
+
+static void spectral_read(struct spectral_radio *radio)
+{
+    size_t total = 0;
+    size_t used;
+    ssize_t len;
+    int i;
+
+    memcpy(g_spectral_buf, radio->carry_buf, radio->carry);
+
+    while (total < SPECTRAL_MAX_READ)
+    {
+        len = read(radio->fd, g_spectral_buf + radio->carry, SPECTRAL_READ_SIZE);
+        if (len <= 0)
+            break;
+
+        total += len;
+        len += radio->carry;
+
+        used = spectral_parse(g_spectral_buf, len, radio->acc, SPECTRAL_MAX_CHANS);
+
+        radio->carry = len - used;
+        if (radio->carry > SPECTRAL_CARRY_SIZE)
+        {
+            /* Not a sample we know, resynchronizing is hopeless */
+            LOGW("%s: dropping %zu bytes of spectral data", radio->phy, radio->carry);
+            radio->carry = 0;
+        }
+        memmove(g_spectral_buf, g_spectral_buf + used, radio->carry);
+    }
+
+    memcpy(radio->carry_buf, g_spectral_buf, radio->carry);
+
+    radio->n_sum = 0;
+    for (i = 0; i < SPECTRAL_MAX_CHANS; i++)
+    {
+        if (!spectral_summarize(&radio->acc[i], &radio->sum[radio->n_sum]))
+            continue;
+
+        if (radio->sum[radio->n_sum].interferer != SPECTRAL_INTF_NONE)
+        {
+            LOGI("%s: %s interference on channel %d (duty %d%%, %d dBm)",
+                 radio->phy, spectral_interferer_str(radio->sum[radio->n_sum].interferer),
+                 radio->sum[radio->n_sum].chan, radio->sum[radio->n_sum].duty,
+                 radio->sum[radio->n_sum].avg_power);
+        }
+        radio->n_sum++;
+    }
+
+    /* Summaries cover one interval */
+    memset(radio->acc, 0, sizeof(radio->acc));
+
+    LOGD("%s: %zu bytes of spectral samples, %d channels", radio->phy, total, radio->n_sum);
+
+    spectral_ctl(radio, "trigger");
+}
+
+static void spectral_task(void *arg)
+{
+    struct spectral_radio *radio;
+    bool enabled;
+    int rnum;
+    int r;
+
+    if (UCI_OK != wifi_getRadioNumberOfEntries(&rnum))
+        rnum = 0;
+
+    for (r = 0; r < UCI_MAX_RADIOS; r++)
+    {
+        radio = &g_spectral[r];
+
+        enabled = false;
+        if (r < rnum)
+            wifi_getRadioSpectralEnable(r, &enabled);
+
+        if (!enabled)
+        {
+            spectral_stop(radio);
+            continue;
+        }
+
+        if (!radio->active)
+        {
+            wifi_getRadioPhyName(r, radio->phy, sizeof(radio->phy));
+            if (!spectral_start(radio))
+                continue;
+        }
+
+        spectral_read(radio);
+    }
+
+    evsched_task_reschedule_ms(SPECTRAL_INTERVAL);
+}
+
+int spectral_get(int radioIndex, struct spectral_summary *sum, int max)
+{
+    struct spectral_radio *radio;
+    int n;
+
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS)
+        return 0;
+
+    radio = &g_spectral[radioIndex];
+    n = radio->n_sum < max ? radio->n_sum : max;
+    memcpy(sum, radio->sum, n * sizeof(*sum));
+
+    return n;
+}
+
+bool spectral_init(void)
+{
+    if (spectral_running)
+        return true;
+
+    g_spectral_buf = malloc(SPECTRAL_READ_SIZE + SPECTRAL_CARRY_SIZE);
+    if (!g_spectral_buf)
+        return false;
+
+    memset(g_spectral, 0, sizeof(g_spectral));
+    evsched_task(&spectral_task, NULL, SPECTRAL_INTERVAL);
+    spectral_running = true;
+
+    return true;
+}
+
+void spectral_cleanup(void)
+{
+    int r;
+
+    if (!spectral_running)
+        return;
+
+    evsched_task_cancel_by_find(&spectral_task, NULL, EVSCHED_FIND_BY_FUNC);
+
+    for (r = 0; r < UCI_MAX_RADIOS; r++)
+        spectral_stop(&g_spectral[r]);
+
+    free(g_spectral_buf);
+    g_spectral_buf = NULL;
+    spectral_running = false;
+}
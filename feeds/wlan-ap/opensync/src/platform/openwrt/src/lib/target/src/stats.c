@@ -27,9 +27,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "target.h"
 #include <stdio.h>
 #include <stdbool.h>
-#include "iwinfo.h"
-
-#define NUM_MAX_CLIENTS 10
+#include "nl80211.h"
+#include "phy.h"
+#include "sampler.h"
+#include "worker.h"
+#include "sensor.h"
+#include "uci_helper.h"
+#include "vlan.h"
 
 /*****************************************************************************
  *  INTERFACE definitions
@@ -84,6 +88,168 @@ void target_client_record_free(target_client_record_t *record)
     }
 }
 
+/* VIFs plus the AP_VLAN netdevs of RADIUS assigned VLANs */
+#define CLIENTS_MAX_IFACES      64
+
+struct clients_dump_ctx
+{
+    const char          *ifname;    /* VIF the clients are reported on */
+    int                 vlan_id;
+    radio_type_t        radio_type;
+    radio_essid_t       essid;
+    ds_dlist_t          *list;
+    int                 num;
+};
+
+/* 5 GHz radios limited to one half of the band report as 5GL or 5GU */
+static radio_type_t clients_radio_type(const struct wifi_phy *phy)
+{
+    bool lower = false;
+    bool upper = false;
+    int i;
+
+    if (phy->band_2g)
+        return RADIO_TYPE_2G;
+
+    for (i = 0; i < phy->n_chans; i++)
+    {
+        if (phy->chans[i].disabled || phy->chans[i].freq < 5000)
+            continue;
+        if (phy->chans[i].chan < 100)
+            lower = true;
+        else
+            upper = true;
+    }
+
+    if (lower && !upper)
+        return RADIO_TYPE_5GL;
+    if (upper && !lower)
+        return RADIO_TYPE_5GU;
+
+    return RADIO_TYPE_5G;
+}
+
+static void clients_record_add(struct clients_dump_ctx *ctx,
+                               const struct sampler_sta *sta,
+                               const struct sampler_agg *agg)
+{
+    target_client_record_t *client;
+
+    client = target_client_record_alloc();
+    if (!client)
+        return;
+
+    client->info.type = ctx->radio_type;
+    memcpy(client->info.mac, sta->mac, sizeof(client->info.mac));
+    STRSCPY(client->info.ifname, ctx->ifname);
+    STRSCPY(client->info.essid, ctx->essid);
+    client->vlan_id = ctx->vlan_id;
+
+    client->stats.bytes_tx = sta->tx_bytes;
+    client->stats.bytes_rx = sta->rx_bytes;
+    client->stats.frames_tx = sta->tx_packets;
+    client->stats.frames_rx = sta->rx_packets;
+    client->stats.retries_tx = sta->tx_retries;
+    client->stats.errors_tx = sta->tx_failed;
+    client->stats.rssi = sta->rssi;
+    client->stats.rate_tx = sta->tx_rate / 10.0;
+    client->stats.rate_rx = sta->rx_rate / 10.0;
+
+    client->airtime_tx_us = sta->tx_duration_us;
+    client->airtime_rx_us = sta->rx_duration_us;
+    client->airtime_weight = sta->airtime_weight;
+
+    if (agg && agg->samples)
+    {
+        client->stats.rssi = agg->rssi_avg;
+        client->rssi_min = agg->rssi_min;
+        client->rssi_max = agg->rssi_max;
+        client->rssi_p10 = agg->rssi_p10;
+        client->rssi_p50 = agg->rssi_p50;
+        client->rssi_p90 = agg->rssi_p90;
+        client->tx_bps_peak = agg->tx_bps_peak;
+        client->rx_bps_peak = agg->rx_bps_peak;
+        client->retry_pct = agg->retry_pct;
+        client->samples = agg->samples;
+    }
+
+    ds_dlist_insert_tail(ctx->list, client);
+    ctx->num++;
+}
+
+static void clients_report_cb(const struct sampler_sta *sta, const struct sampler_agg *agg, void *arg)
+{
+    clients_record_add(arg, sta, agg);
+}
+
+static int clients_sta_cb(struct nl_msg *msg, void *arg)
+{
+    struct clients_dump_ctx *ctx = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct sampler_sta sta;
+
+    nl80211_parse(msg, tb);
+
+    if (!tb[NL80211_ATTR_MAC] || !tb[NL80211_ATTR_STA_INFO] ||
+        !sampler_sta_parse(nla_data(tb[NL80211_ATTR_MAC]), tb[NL80211_ATTR_STA_INFO], &sta))
+        return NL_SKIP;
+
+    clients_record_add(ctx, &sta, NULL);
+
+    return NL_SKIP;
+}
+
+static void clients_essid_get(const char *ifname, char *essid, size_t len)
+{
+    char vif[IFNAMSIZ];
+    int snum;
+    int s;
+
+    essid[0] = '\0';
+    if (wifi_getSSIDNumberOfEntries(&snum) != UCI_OK)
+        return;
+
+    for (s = 0; s < snum; s++)
+    {
+        memset(vif, 0, sizeof(vif));
+        if (wifi_getVIFName(s, vif, sizeof(vif)) == UCI_OK && !strcmp(vif, ifname))
+        {
+            wifi_getSSIDName(s, essid, len);
+            return;
+        }
+    }
+}
+
+static void clients_vif_vlan_get(const char *ifname, int *vlan_id)
+{
+    char vif[IFNAMSIZ];
+    int snum;
+    int s;
+
+    *vlan_id = 0;
+    if (wifi_getSSIDNumberOfEntries(&snum) != UCI_OK)
+        return;
+
+    for (s = 0; s < snum; s++)
+    {
+        memset(vif, 0, sizeof(vif));
+        if (wifi_getVIFName(s, vif, sizeof(vif)) == UCI_OK && !strcmp(vif, ifname))
+        {
+            /* Anything but a vlan<id> network reads back as VLAN 1 */
+            wifi_getApVlanId(s, vlan_id);
+            if (*vlan_id < VLAN_ID_MIN_PROV)
+                *vlan_id = 0;
+            return;
+        }
+    }
+}
+
+/*
+ * Sampled VIFs are reported from the sampler's latest poll. The others,
+ * and the AP_VLAN netdevs of RADIUS VLANs which are never sampled, are
+ * dumped here. mac80211 has no per-phy station dump, those requests go
+ * back to back on the one nl80211 socket.
+ */
 bool target_stats_clients_get(
         radio_entry_t *radio_cfg,
         radio_essid_t *essid,
@@ -91,80 +257,78 @@ bool target_stats_clients_get(
         ds_dlist_t *client_list,
         void *client_ctx)
 {
-	char                     buf[IWINFO_BUFSIZE];
-	int                      len;
-	struct iwinfo_assoclist_entry  *assoc_client    = NULL;
-	target_client_record_t  *client_entry    = NULL;
-	char stats_if_name[15];
-	radio_type_t radio_type;
-
-	memset(stats_if_name, '\0', sizeof(stats_if_name));
-
-	if(!target_map_cloud_to_iw(radio_cfg->if_name, stats_if_name, sizeof(stats_if_name)))
-	{
-	    return false;
-	}
-
-	if(strcmp(radio_cfg->if_name, "home-ap-24") == 0)
-	{
-		radio_type = RADIO_TYPE_2G;
-	}
-	else if(strcmp(radio_cfg->if_name, "home-ap-l50") == 0)
-	{
-		radio_type = RADIO_TYPE_5GL;
-	}
-	else if(strcmp(radio_cfg->if_name, "home-ap-u50") == 0)
-	{
-		radio_type = RADIO_TYPE_5GU;
-	}
-	else
-	{
-		return true;
-	}
-
-	// find iwinfo type
-	const char *if_type = iwinfo_type(stats_if_name);
-	const struct iwinfo_ops *winfo_ops = iwinfo_backend_by_name(if_type);
-
-	if(0 != winfo_ops->assoclist(stats_if_name, buf, &len))
-	{
-		return false;
-	}
-
-	assoc_client = (struct iwinfo_assoclist_entry *)buf;
-
-	LOGN("%s:%d radiocfg.ifname.%s len.%d", __func__, __LINE__, radio_cfg->if_name, len);
-
-	//add a for loop to traverse through the lists
-	for(int i = 0; i < len; i += sizeof(struct iwinfo_assoclist_entry))
-	{
-		//do all the copy stuff
-		client_entry = target_client_record_alloc();
-		client_entry->info.type = radio_type;
-		memcpy(client_entry->info.mac, assoc_client->mac, sizeof(assoc_client->mac));
-		memcpy(client_entry->info.ifname, radio_cfg->if_name, sizeof(radio_cfg->if_name));
-		client_entry->stats.bytes_tx = assoc_client->tx_bytes;
-		client_entry->stats.bytes_rx = assoc_client->rx_bytes;
-		client_entry->stats.rssi = assoc_client->signal;
-		client_entry->stats.rate_tx = assoc_client->tx_rate.rate;
-		client_entry->stats.rate_rx = assoc_client->tx_rate.rate;
-
-		ds_dlist_insert_tail(client_list, client_entry);
-
-		LOGN("%s:%d mac.%02x:%02x:%02x:%02x:%02x:%02x", __func__, __LINE__,
-				assoc_client->mac[0],
-				assoc_client->mac[1],
-				assoc_client->mac[2],
-				assoc_client->mac[3],
-				assoc_client->mac[4],
-				assoc_client->mac[5]);
-		//move to next client
-		assoc_client++;
-	}
-
-        (*client_cb)(client_list, client_ctx, true);
-
-        return true;
+    char ifnames[CLIENTS_MAX_IFACES][IFNAMSIZ];
+    struct clients_dump_ctx ctx;
+    struct wifi_phy *phy;
+    struct nl_msg *msg;
+    char phy_name[IFNAMSIZ];
+    char parent[IFNAMSIZ];
+    unsigned int ifindex;
+    bool ap_vlan;
+    bool sampled;
+    int radio_idx;
+    int sample_ms = 0;
+    int num;
+    int i;
+
+    if (!target_map_cloud_to_phy(radio_cfg->if_name, phy_name, sizeof(phy_name)))
+        return false;
+
+    phy = phy_get(phy_name);
+    if (!phy)
+    {
+        LOGW("%s: no capabilities cached for %s", phy_name, radio_cfg->if_name);
+        return false;
+    }
+
+    if (wifi_getRadioIndexByPhy(phy_name, &radio_idx) == UCI_OK)
+        wifi_getRadioClientSampleMs(radio_idx, &sample_ms);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.radio_type = clients_radio_type(phy);
+    ctx.list = client_list;
+
+    num = phy_get_ifaces(phy_name, ifnames, CLIENTS_MAX_IFACES);
+    for (i = 0; i < num; i++)
+    {
+        ifindex = if_nametoindex(ifnames[i]);
+        if (!ifindex)
+            continue;
+
+        /* mac80211 keeps RADIUS VLAN clients on the AP_VLAN netdev */
+        ctx.ifname = ifnames[i];
+        ctx.vlan_id = vlan_ap_vlan_parse(ifnames[i], parent, sizeof(parent));
+        ap_vlan = ctx.vlan_id != 0;
+        if (ap_vlan)
+            ctx.ifname = parent;
+        else
+            clients_vif_vlan_get(ifnames[i], &ctx.vlan_id);
+        clients_essid_get(ctx.ifname, ctx.essid, sizeof(ctx.essid));
+
+        /* Keep the sampler on every VIF, it aggregates between reports */
+        sampled = false;
+        if (sample_ms > 0 && !ap_vlan && sampler_watch(ifnames[i], SAMPLER_USER_STATS, sample_ms))
+            sampled = sampler_report(ifnames[i], clients_report_cb, &ctx) >= 0;
+        else if (!ap_vlan)
+            sampler_unwatch(ifnames[i], SAMPLER_USER_STATS);
+        if (sampled)
+            continue;
+
+        msg = nl80211_msg(NL80211_CMD_GET_STATION, NLM_F_DUMP);
+        if (!msg)
+            return false;
+
+        nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+
+        if (nl80211_send(msg, clients_sta_cb, &ctx))
+            LOGW("%s: station dump failed", ifnames[i]);
+    }
+
+    LOGD("%s: %d clients on %d interfaces", phy_name, ctx.num, num);
+
+    (*client_cb)(client_list, client_ctx, true);
+
+    return true;
 }
 
 bool target_stats_clients_convert(
@@ -175,12 +339,54 @@ bool target_stats_clients_convert(
 {
     memcpy(client_record->info.mac, data_new->info.mac, sizeof(data_new->info.mac));
 
+    memcpy(client_record->info.ifname, data_new->info.ifname, sizeof(data_new->info.ifname));
+    memcpy(client_record->info.essid, data_new->info.essid, sizeof(data_new->info.essid));
+    client_record->info.type = data_new->info.type;
+
     client_record->stats.bytes_tx   = data_new->stats.bytes_tx;
     client_record->stats.bytes_rx   = data_new->stats.bytes_rx;
+    client_record->stats.frames_tx  = data_new->stats.frames_tx;
+    client_record->stats.frames_rx  = data_new->stats.frames_rx;
+    client_record->stats.retries_tx = data_new->stats.retries_tx;
+    client_record->stats.errors_tx  = data_new->stats.errors_tx;
     client_record->stats.rssi       = data_new->stats.rssi;
     client_record->stats.rate_tx    = data_new->stats.rate_tx;
     client_record->stats.rate_rx    = data_new->stats.rate_rx;
 
+    /* The DPP client record has no airtime fields yet, log the interval */
+    if (data_new->airtime_tx_us || data_new->airtime_rx_us)
+    {
+        LOGD("%s: client %02x:%02x:%02x:%02x:%02x:%02x airtime tx %llu us rx %llu us weight %d",
+             radio_cfg->if_name,
+             data_new->info.mac[0], data_new->info.mac[1], data_new->info.mac[2],
+             data_new->info.mac[3], data_new->info.mac[4], data_new->info.mac[5],
+             (unsigned long long)(data_new->airtime_tx_us - data_old->airtime_tx_us),
+             (unsigned long long)(data_new->airtime_rx_us - data_old->airtime_rx_us),
+             data_new->airtime_weight);
+    }
+
+    if (data_new->samples)
+    {
+        LOGD("%s: client %02x:%02x:%02x:%02x:%02x:%02x %u samples rssi %d/%d/%d p10/50/90 %d/%d/%d"
+             " peak tx %llu B/s rx %llu B/s retries %u%%",
+             radio_cfg->if_name,
+             data_new->info.mac[0], data_new->info.mac[1], data_new->info.mac[2],
+             data_new->info.mac[3], data_new->info.mac[4], data_new->info.mac[5],
+             data_new->samples, data_new->rssi_min, data_new->stats.rssi, data_new->rssi_max,
+             data_new->rssi_p10, data_new->rssi_p50, data_new->rssi_p90,
+             (unsigned long long)data_new->tx_bps_peak,
+             (unsigned long long)data_new->rx_bps_peak,
+             data_new->retry_pct);
+    }
+
+    /*
+     * The VLAN tells RADIUS assigned clients of one SSID apart, it goes out
+     * as the network id, named like the VLAN's network
+     */
+    if (data_new->vlan_id)
+        snprintf(client_record->info.networkid, sizeof(client_record->info.networkid),
+                 "vlan%d", data_new->vlan_id);
+
     return true;
 }
 
@@ -266,6 +472,55 @@ static uint32_t channel_to_freq(uint32_t chan)
 }
 
 
+/* Written by the scan job, parsed by target_stats_scan_get() */
+#define SCAN_DUMP_FMT   "/tmp/scan.%s.dump"
+
+struct scan_job
+{
+    char                ifname[IFNAMSIZ];
+    char                freq[8];
+    bool                ok;
+    target_scan_cb_t    *scan_cb;
+    void                *scan_ctx;
+};
+
+/*
+ * "iw scan" blocks until the scan is over, run it off the loop. The dump
+ * is taken right after on the same worker, scan_get only reads the file.
+ */
+static void scan_job_run(void *arg)
+{
+    struct scan_job *job = arg;
+    char *const scan[] = { "iw", job->ifname, "scan", "duration", "30", "freq", job->freq, NULL };
+    char *const dump[] = { "iw", job->ifname, "scan", "dump", NULL };
+    char path[64];
+
+    job->ok = worker_exec(scan) != -1;
+    if (!job->ok)
+        return;
+
+    snprintf(path, sizeof(path), SCAN_DUMP_FMT, job->ifname);
+    job->ok = worker_exec_out(dump, path) == 0;
+}
+
+static void scan_abort_run(void *arg)
+{
+    char *const argv[] = { "iw", arg, "scan", "abort", NULL };
+
+    worker_exec(argv);
+}
+
+static void scan_job_done(void *arg)
+{
+    struct scan_job *job = arg;
+
+    if (!job->ok)
+        LOGN("SCAN FAILED");
+
+    (*job->scan_cb)(job->scan_ctx, job->ok);
+    free(job);
+}
+
 bool target_stats_scan_start(
         radio_entry_t *radio_cfg,
         uint32_t *chan_list,
@@ -276,11 +531,10 @@ bool target_stats_scan_start(
         void *scan_ctx)
 {
 
-    char command[64];
+    struct scan_job *job;
     uint32_t frequency;
     char scan_if_name[15];
-    memset(command, 0, strlen(command));
-    memset(scan_if_name, '\0', strlen(scan_if_name));
+    memset(scan_if_name, '\0', sizeof(scan_if_name));
     //sprintf(command,"iw %s scan duration %d", radio_cfg->if_name, dwell_time);
     //sprintf(command,"iw wlan0 scan duration 30");
 
@@ -289,21 +543,30 @@ bool target_stats_scan_start(
         return false;
     }
 
+    job = calloc(1, sizeof(*job));
+    if (job == NULL)
+    {
+        (*scan_cb)(scan_ctx, false);
+        return false;
+    }
+
     frequency = channel_to_freq(chan_list[0]);
-    sprintf(command,"iw %s scan duration 30 freq %d", scan_if_name, frequency);
+    STRSCPY(job->ifname, scan_if_name);
+    snprintf(job->freq, sizeof(job->freq), "%u", frequency);
+    job->scan_cb = scan_cb;
+    job->scan_ctx = scan_ctx;
     LOGN("Freq: %d %d", frequency, chan_list[0]);
-    LOGN("scanning command : %s", command);
+    LOGN("scanning command : iw %s scan duration 30 freq %s", job->ifname, job->freq);
     LOGN("channel num: %d", chan_num);
     LOGN("scan_type : %d", scan_type);
-    if(system(command) == -1)
+
+    if (!worker_submit(scan_job_run, scan_job_done, job))
     {
+        free(job);
         (*scan_cb)(scan_ctx, false);
-        LOGN("SCAN FAILED");
         return false;
     }
 
-    (*scan_cb)(scan_ctx, true);
-
     return true;
 }
 
@@ -311,22 +574,24 @@ bool target_stats_scan_stop(
         radio_entry_t *radio_cfg,
         radio_scan_type_t scan_type)
 {
-    char command[64];
-    char scan_if_name[15];
+    char *ifname;
 
-    memset(scan_if_name, '\0', strlen(scan_if_name));
-    memset(command, 0, strlen(command));
+    ifname = calloc(1, IFNAMSIZ);
+    if (!ifname)
+        return false;
 
-    if(!target_map_cloud_to_iw(radio_cfg->if_name, scan_if_name, sizeof(scan_if_name)))
+    if (!target_map_cloud_to_iw(radio_cfg->if_name, ifname, IFNAMSIZ))
     {
+        free(ifname);
         return false;
     }
 
-    sprintf(command,"iw %s scan abort", scan_if_name);
-    LOGN("stop scan command : %s", command);
+    LOGN("stop scan command : iw %s scan abort", ifname);
 
-    if(system(command) == -1)
+    /* Nobody waits for the abort, the running scan job reports the outcome */
+    if (!worker_submit(scan_abort_run, free, ifname))
     {
+        free(ifname);
         return false;
     }
 
@@ -340,7 +605,7 @@ bool target_stats_scan_get(
         radio_scan_type_t scan_type,
         dpp_neighbor_report_data_t *scan_results)
 {
-    char command[128];
+    char path[64];
     FILE *fp=NULL;
     long int fsize;
     char *buffer=NULL;
@@ -352,22 +617,16 @@ bool target_stats_scan_get(
     char TSF[20];
     char scan_if_name[15];
 
-    memset(scan_if_name, '\0', strlen(scan_if_name));
-    memset(command, 0, strlen(command));
- //   sprintf(command,"iw %s scan dump  > /tmp/scan%s.dump", radio_cfg->if_name, radio_cfg->if_name);
- //   LOGN("dump scan command : %s", command);
+    memset(scan_if_name, '\0', sizeof(scan_if_name));
 
     if(!target_map_cloud_to_iw(radio_cfg->if_name, scan_if_name, sizeof(scan_if_name)))
     {
         return false;
     }
 
-    sprintf(command,"iw %s scan dump  > /tmp/scan.dump", scan_if_name);
-    LOGN("dump scan command : %s", command);
-    if(system(command) != -1)
-    {
-        fp = fopen("/tmp/scan.dump","r");
-    }
+    /* Dumped by the scan job when the scan finished */
+    snprintf(path, sizeof(path), SCAN_DUMP_FMT, scan_if_name);
+    fp = fopen(path, "r");
 
     if(fp == NULL)
       return false;
@@ -456,38 +715,22 @@ bool target_stats_device_temp_get(
         radio_entry_t *radio_cfg,
         dpp_device_temp_t *temp_entry)
 {
-    int32_t temperature;
-    FILE *fp = NULL;
-
-    if(strcmp(radio_cfg->if_name, "home-ap-24") == 0)
-    {
-      fp = fopen("/sys/class/hwmon/hwmon1/temp1_input","r");
-    }
-    else if(strcmp(radio_cfg->if_name, "home-ap-l50") == 0)
-    {
-     fp = fopen("/sys/class/hwmon/hwmon2/temp1_input","r");
-    }
-    else if(strcmp(radio_cfg->if_name, "home-ap-u50") == 0)
-    {
-      fp = fopen("/sys/class/hwmon/hwmon0/temp1_input","r");
-    }
+    char phy_name[IFNAMSIZ];
+    int temperature;
 
-    if(fp==NULL)
+    if (!target_map_cloud_to_phy(radio_cfg->if_name, phy_name, sizeof(phy_name)))
     {
-      LOG(ERR,"Failed to open temp input files");
-      return false;
+        return false;
     }
 
-    if(fscanf(fp,"%d",&temperature) == EOF)
+    if (!sensor_temp_get(phy_name, &temperature))
     {
-      LOG(ERR,"Temperature reading failed");
-      fclose(fp);
-      return false;
+        LOGD("%s: no temperature sensor for %s", phy_name, radio_cfg->if_name);
+        return false;
     }
 
-    LOGN("temperature : %d", temperature);
+    LOGD("%s: temperature %d", phy_name, temperature);
 
-    fclose(fp);
     temp_entry->type  = radio_cfg->type;
     temp_entry->value = (temperature/1000);
 
@@ -498,8 +741,23 @@ bool target_stats_device_txchainmask_get(
         radio_entry_t              *radio_cfg,
         dpp_device_txchainmask_t   *txchainmask_entry)
 {
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+
+    if (!target_map_cloud_to_phy(radio_cfg->if_name, phy_name, sizeof(phy_name)))
+    {
+        return false;
+    }
+
+    phy = phy_get(phy_name);
+    if (!phy)
+    {
+        LOGE("%s: no antenna capabilities for %s", phy_name, radio_cfg->if_name);
+        return false;
+    }
+
     txchainmask_entry->type  = radio_cfg->type;
-    txchainmask_entry->value = 2;
+    txchainmask_entry->value = phy_tx_chainmask(phy);
 
     return true;
 }
@@ -513,15 +771,269 @@ bool target_stats_device_fanrpm_get(uint32_t *fan_rpm)
  *  CAPACITY definitions
  *****************************************************************************/
 
+/* mac80211 counters are always on, there is nothing to switch */
 bool target_stats_capacity_enable(radio_entry_t *radio_cfg, bool enabled)
 {
     return true;
 }
 
+#define CAPACITY_MAX_IFACES     16
+/* TID stats nest one entry per TID (1 based), then one for non-QoS */
+#define CAPACITY_NUM_TIDS       17
+
+static const radio_queue_type_t capacity_tid_to_ac[CAPACITY_NUM_TIDS] =
+{
+    RADIO_QUEUE_TYPE_BE, RADIO_QUEUE_TYPE_BK, RADIO_QUEUE_TYPE_BK, RADIO_QUEUE_TYPE_BE,
+    RADIO_QUEUE_TYPE_VI, RADIO_QUEUE_TYPE_VI, RADIO_QUEUE_TYPE_VO, RADIO_QUEUE_TYPE_VO,
+    RADIO_QUEUE_TYPE_BE, RADIO_QUEUE_TYPE_BE, RADIO_QUEUE_TYPE_BE, RADIO_QUEUE_TYPE_BE,
+    RADIO_QUEUE_TYPE_BE, RADIO_QUEUE_TYPE_BE, RADIO_QUEUE_TYPE_BE, RADIO_QUEUE_TYPE_BE,
+    RADIO_QUEUE_TYPE_BE,
+};
+
+/* Counters of one station as of the last dump */
+struct capacity_sta
+{
+    char            mac[18];
+    uint64_t        bytes_tx;
+    uint64_t        queue_bytes[RADIO_QUEUE_MAX_QTY];
+    uint64_t        queue_frames[RADIO_QUEUE_MAX_QTY];
+    uint32_t        gen;
+    ds_tree_node_t  node;
+};
+
+/*
+ * Running sums of per-station deltas. Station counters start over on
+ * every association and vanish with the station, so a plain sum over the
+ * stations drops or jumps whenever one comes or goes.
+ */
+struct capacity_radio
+{
+    char            phy[IFNAMSIZ];
+    uint64_t        bytes_tx;
+    uint64_t        queue_bytes[RADIO_QUEUE_MAX_QTY];
+    uint64_t        queue_frames[RADIO_QUEUE_MAX_QTY];
+    uint32_t        gen;
+    bool            primed;         /* stations seen so far have a baseline */
+    ds_tree_t       stas;
+    ds_tree_node_t  node;
+};
+
+struct capacity_ctx
+{
+    struct capacity_radio   *radio;
+    target_capacity_data_t  *cap;
+};
+
+static ds_tree_t capacity_radios = DS_TREE_INIT(ds_str_cmp, struct capacity_radio, node);
+
+static void capacity_parse_tid(
+        struct capacity_sta *cur,
+        target_capacity_data_t *cap,
+        radio_queue_type_t ac,
+        struct nlattr *tid)
+{
+    struct nlattr *ts[NL80211_TID_STATS_MAX + 1];
+    struct nlattr *txq[NL80211_TXQ_STATS_MAX + 1];
+
+    if (nla_parse_nested(ts, NL80211_TID_STATS_MAX, tid, NULL))
+        return;
+
+    /* TXQ stats carry bytes and backlog, plain MSDU counts are the fallback */
+    if (ts[NL80211_TID_STATS_TXQ_STATS] &&
+        !nla_parse_nested(txq, NL80211_TXQ_STATS_MAX, ts[NL80211_TID_STATS_TXQ_STATS], NULL))
+    {
+        if (txq[NL80211_TXQ_STATS_TX_BYTES])
+            cur->queue_bytes[ac] += nla_get_u32(txq[NL80211_TXQ_STATS_TX_BYTES]);
+        if (txq[NL80211_TXQ_STATS_TX_PACKETS])
+            cur->queue_frames[ac] += nla_get_u32(txq[NL80211_TXQ_STATS_TX_PACKETS]);
+        if (txq[NL80211_TXQ_STATS_BACKLOG_BYTES])
+            cap->backlog_bytes[ac] += nla_get_u32(txq[NL80211_TXQ_STATS_BACKLOG_BYTES]);
+        if (txq[NL80211_TXQ_STATS_BACKLOG_PACKETS])
+            cap->backlog_frames[ac] += nla_get_u32(txq[NL80211_TXQ_STATS_BACKLOG_PACKETS]);
+    }
+    else if (ts[NL80211_TID_STATS_TX_MSDU])
+    {
+        cur->queue_frames[ac] += nla_get_u64(ts[NL80211_TID_STATS_TX_MSDU]);
+    }
+}
+
+/* A counter below its last value has started over */
+#define CAPACITY_DELTA(n, o)    ((n) >= (o) ? (n) - (o) : (n))
+
+static void capacity_sta_copy(struct capacity_sta *dst, const struct capacity_sta *src)
+{
+    dst->bytes_tx = src->bytes_tx;
+    memcpy(dst->queue_bytes, src->queue_bytes, sizeof(dst->queue_bytes));
+    memcpy(dst->queue_frames, src->queue_frames, sizeof(dst->queue_frames));
+}
+
+static void capacity_sta_account(struct capacity_radio *radio, struct capacity_sta *cur)
+{
+    struct capacity_sta *sta;
+    int q;
+
+    sta = ds_tree_find(&radio->stas, cur->mac);
+    if (!sta)
+    {
+        sta = calloc(1, sizeof(*sta));
+        if (!sta)
+            return;
+        STRSCPY(sta->mac, cur->mac);
+        ds_tree_insert(&radio->stas, sta, sta->mac);
+
+        /* Before the first dump there is no telling what is new */
+        if (!radio->primed)
+            capacity_sta_copy(sta, cur);
+    }
+
+    radio->bytes_tx += CAPACITY_DELTA(cur->bytes_tx, sta->bytes_tx);
+    for (q = 0; q < RADIO_QUEUE_MAX_QTY; q++)
+    {
+        radio->queue_bytes[q] += CAPACITY_DELTA(cur->queue_bytes[q], sta->queue_bytes[q]);
+        radio->queue_frames[q] += CAPACITY_DELTA(cur->queue_frames[q], sta->queue_frames[q]);
+    }
+
+    capacity_sta_copy(sta, cur);
+    sta->gen = radio->gen;
+}
+
+static int capacity_sta_cb(struct nl_msg *msg, void *arg)
+{
+    struct capacity_ctx *ctx = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct nlattr *sinfo[NL80211_STA_INFO_MAX + 1];
+    struct capacity_sta cur;
+    struct nlattr *tid;
+    const uint8_t *mac;
+    int rem;
+
+    nl80211_parse(msg, tb);
+
+    if (!tb[NL80211_ATTR_MAC] || !tb[NL80211_ATTR_STA_INFO] ||
+        nla_parse_nested(sinfo, NL80211_STA_INFO_MAX, tb[NL80211_ATTR_STA_INFO], NULL))
+        return NL_SKIP;
+
+    memset(&cur, 0, sizeof(cur));
+    mac = nla_data(tb[NL80211_ATTR_MAC]);
+    snprintf(cur.mac, sizeof(cur.mac), "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    if (sinfo[NL80211_STA_INFO_TX_BYTES64])
+        cur.bytes_tx = nla_get_u64(sinfo[NL80211_STA_INFO_TX_BYTES64]);
+    else if (sinfo[NL80211_STA_INFO_TX_BYTES])
+        cur.bytes_tx = nla_get_u32(sinfo[NL80211_STA_INFO_TX_BYTES]);
+
+    if (sinfo[NL80211_STA_INFO_TID_STATS])
+    {
+        nla_for_each_nested(tid, sinfo[NL80211_STA_INFO_TID_STATS], rem)
+        {
+            if (nla_type(tid) < 1 || nla_type(tid) > CAPACITY_NUM_TIDS)
+                continue;
+            capacity_parse_tid(&cur, ctx->cap, capacity_tid_to_ac[nla_type(tid) - 1], tid);
+        }
+    }
+
+    capacity_sta_account(ctx->radio, &cur);
+
+    return NL_SKIP;
+}
+
+static struct capacity_radio *capacity_radio_get(const char *phy_name)
+{
+    struct capacity_radio *radio;
+
+    radio = ds_tree_find(&capacity_radios, (void *)phy_name);
+    if (radio)
+        return radio;
+
+    radio = calloc(1, sizeof(*radio));
+    if (!radio)
+        return NULL;
+
+    STRSCPY(radio->phy, phy_name);
+    ds_tree_init(&radio->stas, ds_str_cmp, struct capacity_sta, node);
+    ds_tree_insert(&capacity_radios, radio, radio->phy);
+
+    return radio;
+}
+
 bool target_stats_capacity_get(
         radio_entry_t *radio_cfg,
         target_capacity_data_t *capacity_new)
 {
+    char ifnames[CAPACITY_MAX_IFACES][IFNAMSIZ];
+    struct wifi_survey survey[PHY_MAX_CHANNELS];
+    struct capacity_radio *radio;
+    struct capacity_sta *sta;
+    struct capacity_ctx ctx;
+    struct wifi_oper oper;
+    ds_tree_iter_t iter;
+    struct nl_msg *msg;
+    char phy_name[IFNAMSIZ];
+    unsigned int ifindex;
+    int num;
+    int i;
+
+    memset(capacity_new, 0, sizeof(*capacity_new));
+
+    if (!target_map_cloud_to_phy(radio_cfg->if_name, phy_name, sizeof(phy_name)))
+        return false;
+
+    if (!phy_get_oper(phy_name, &oper))
+    {
+        LOGD("%s: radio is not up, no capacity data", phy_name);
+        return false;
+    }
+
+    radio = capacity_radio_get(phy_name);
+    if (!radio)
+        return false;
+
+    /* Air time comes from the survey entry of the operating channel */
+    num = phy_survey_get(oper.ifname, survey, ARRAY_SIZE(survey));
+    for (i = 0; i < num; i++)
+    {
+        if (!survey[i].in_use)
+            continue;
+        capacity_new->chan_active = survey[i].time;
+        capacity_new->chan_tx = survey[i].tx;
+        break;
+    }
+
+    ctx.radio = radio;
+    ctx.cap = capacity_new;
+    radio->gen++;
+
+    num = phy_get_ifaces(phy_name, ifnames, CAPACITY_MAX_IFACES);
+    for (i = 0; i < num; i++)
+    {
+        ifindex = if_nametoindex(ifnames[i]);
+        if (!ifindex)
+            continue;
+
+        msg = nl80211_msg(NL80211_CMD_GET_STATION, NLM_F_DUMP);
+        if (!msg)
+            return false;
+
+        nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+        if (nl80211_send(msg, capacity_sta_cb, &ctx))
+            LOGD("%s: station dump failed", ifnames[i]);
+    }
+
+    /* Departed stations are done contributing, their totals stay in the sums */
+    ds_tree_foreach_iter(&radio->stas, sta, &iter)
+    {
+        if (sta->gen == radio->gen)
+            continue;
+        ds_tree_iremove(&iter);
+        free(sta);
+    }
+    radio->primed = true;
+
+    capacity_new->bytes_tx = radio->bytes_tx;
+    memcpy(capacity_new->queue_bytes, radio->queue_bytes, sizeof(capacity_new->queue_bytes));
+    memcpy(capacity_new->queue_frames, radio->queue_frames, sizeof(capacity_new->queue_frames));
+
     return true;
 }
 
@@ -530,6 +1042,30 @@ bool target_stats_capacity_convert(
         target_capacity_data_t *capacity_old,
         dpp_capacity_record_t *capacity_entry)
 {
+    uint64_t active;
+    uint64_t tx;
+    int q;
+
+    active = CAPACITY_DELTA(capacity_new->chan_active, capacity_old->chan_active);
+    tx = CAPACITY_DELTA(capacity_new->chan_tx, capacity_old->chan_tx);
+
+    capacity_entry->busy_tx = active ? tx * 100 / active : 0;
+    capacity_entry->bytes_tx = CAPACITY_DELTA(capacity_new->bytes_tx, capacity_old->bytes_tx);
+    capacity_entry->samples = 1;
+
+    /* Frames sent per access category over the interval */
+    for (q = 0; q < RADIO_QUEUE_MAX_QTY; q++)
+    {
+        capacity_entry->queue[q] = CAPACITY_DELTA(capacity_new->queue_frames[q],
+                                                  capacity_old->queue_frames[q]);
+
+        if (capacity_new->backlog_frames[q])
+        {
+            LOGD("capacity: queue %d sent %u frames, %u frames / %u bytes backlogged",
+                 q, capacity_entry->queue[q], capacity_new->backlog_frames[q],
+                 capacity_new->backlog_bytes[q]);
+        }
+    }
+
     return true;
 }
-
@@ -0,0 +1,764 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "evsched.h"
+#include "os_time.h"
+#include "uci_helper.h"
+#include "nl80211.h"
+#include "hostapd.h"
+#include "sampler.h"
+#include "acl.h"
+#include "steer.h"
+
+/* hostapd may come up after BM, or restart under it */
+#ifndef STEER_ATTACH_INTERVAL
+#define STEER_ATTACH_INTERVAL   EVSCHED_SEC(5)
+#endif
+
+struct steer_client
+{
+    char                    mac[18];
+    struct steer_client_cfg cfg;
+    int                     rssi;       /* last probe, 0 if none yet */
+    bool                    denied;     /* on the BSS deny list */
+    bool                    connected;
+    bool                    sampled;    /* bytes/signal below hold a previous poll */
+    bool                    active;
+    int64_t                 last_active;
+    uint64_t                bytes;
+    int                     signal;
+    ds_tree_node_t          node;
+};
+
+struct steer_iface
+{
+    ev_io                   io;         /* first, the watcher is cast back */
+    char                    ifname[IFNAMSIZ];
+    int                     band;
+    struct steer_iface_cfg  cfg;
+    bool                    attached;
+    ino_t                   ino;        /* hostapd instance attached to */
+    ds_tree_t               clients;
+    ds_tree_node_t          node;
+};
+
+struct steer_sta_ctx
+{
+    int     rssi;
+    bool    found;
+};
+
+static ds_tree_t steer_ifaces = DS_TREE_INIT(ds_str_cmp, struct steer_iface, node);
+static struct ev_loop *steer_loop = NULL;
+static steer_event_cb_t *steer_cb = NULL;
+static bool steer_running = false;
+
+static bool steer_mac_parse(const char *str, char *mac, size_t len, uint8_t *addr)
+{
+    unsigned int b[6];
+    int i;
+
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+        return false;
+
+    if (mac)
+        snprintf(mac, len, "%02x:%02x:%02x:%02x:%02x:%02x", b[0], b[1], b[2], b[3], b[4], b[5]);
+
+    for (i = 0; addr && i < 6; i++)
+        addr[i] = b[i];
+
+    return true;
+}
+
+static void steer_event_init(struct steer_event *event, struct steer_iface *iface,
+                             int type, const char *mac)
+{
+    memset(event, 0, sizeof(*event));
+    event->type = type;
+    event->band = iface->band;
+    STRSCPY(event->ifname, iface->ifname);
+    STRSCPY(event->mac, mac);
+}
+
+static void steer_emit(struct steer_iface *iface, int type, const char *mac, int rssi)
+{
+    struct steer_event event;
+
+    if (!steer_cb)
+        return;
+
+    steer_event_init(&event, iface, type, mac);
+    event.rssi = rssi;
+
+    steer_cb(&event);
+}
+
+/* A deny entry the cloud put there (see acl.h) is not ours to lift */
+static bool steer_acl_listed(const char *ifname, const char *mac)
+{
+    char name[IFNAMSIZ];
+    char buf[16];
+    char path[64];
+    char line[64];
+    bool listed = false;
+    FILE *f;
+    int num;
+    int i;
+
+    if (UCI_OK != wifi_getSSIDNumberOfEntries(&num))
+        return false;
+
+    for (i = 0; i < num; i++)
+    {
+        memset(name, 0, sizeof(name));
+        if (UCI_OK == wifi_getVIFName(i, name, sizeof(name) - 1) && !strcmp(name, ifname))
+            break;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if (i == num || UCI_OK != wifi_getApMacFilter(i, buf, sizeof(buf) - 1) || strcmp(buf, "deny"))
+        return false;
+
+    snprintf(path, sizeof(path), ACL_FILE_FMT, ifname);
+    f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    while (!listed && fgets(line, sizeof(line), f))
+        listed = !strncasecmp(line, mac, strlen(mac));
+    fclose(f);
+
+    return listed;
+}
+
+static void steer_deny(struct steer_iface *iface, struct steer_client *client, bool deny)
+{
+    char cmd[64];
+
+    if (client->denied == deny)
+        return;
+
+    if (!deny && steer_acl_listed(iface->ifname, client->mac))
+    {
+        client->denied = false;
+        return;
+    }
+
+    snprintf(cmd, sizeof(cmd), "DENY_ACL %s %s", deny ? "ADD_MAC" : "DEL_MAC", client->mac);
+    if (!hostapd_cli_ok(iface->ifname, cmd))
+        return;
+
+    client->denied = deny;
+    LOGD("%s: steer: %s %s", iface->ifname, client->mac, deny ? "kept away" : "let in");
+}
+
+static bool steer_outside(int rssi, int hwm, int lwm)
+{
+    if (!rssi)
+        return false;
+    if (hwm && rssi >= hwm)
+        return true;
+    if (lwm && rssi < lwm)
+        return true;
+
+    return false;
+}
+
+/* A per-client threshold overrides the interface default */
+static int steer_xing(int prev, int rssi, int client, int iface)
+{
+    int threshold = client ? client : iface;
+
+    if (!threshold)
+        return STEER_XING_NONE;
+    if (prev < threshold && rssi >= threshold)
+        return STEER_XING_HIGHER;
+    if (prev >= threshold && rssi < threshold)
+        return STEER_XING_LOWER;
+
+    return STEER_XING_NONE;
+}
+
+static void steer_client_connected(struct steer_client *client, bool connected)
+{
+    client->connected = connected;
+    client->sampled = false;
+    client->active = connected;
+    client->last_active = clock_mono_ms();
+}
+
+/* Activity and threshold crossings of an associated client between two polls */
+static void steer_client_sample(struct steer_iface *iface, struct steer_client *client,
+                                const struct sampler_sta *sta)
+{
+    struct steer_event event;
+    uint64_t bytes = sta->tx_bytes + sta->rx_bytes;
+    int signal = sta->rssi ? sta->rssi : sta->signal;
+    int64_t now = clock_mono_ms();
+    bool active;
+
+    /* Associated before BM was, or before hostapd told us */
+    if (!client->connected)
+        steer_client_connected(client, true);
+
+    active = client->active;
+
+    if (client->sampled && bytes != client->bytes)
+    {
+        client->last_active = now;
+        active = true;
+    }
+    else if (iface->cfg.inact_tmout_sec &&
+             now - client->last_active >= EVSCHED_SEC(iface->cfg.inact_tmout_sec))
+        active = false;
+
+    if (active != client->active && steer_cb)
+    {
+        LOGD("%s: steer: %s %s", iface->ifname, client->mac, active ? "active" : "inactive");
+        steer_event_init(&event, iface, STEER_EVENT_ACTIVITY, client->mac);
+        event.active = active;
+        steer_cb(&event);
+    }
+    client->active = active;
+
+    if (client->sampled && client->signal && signal && steer_cb)
+    {
+        steer_event_init(&event, iface, STEER_EVENT_RSSI_XING, client->mac);
+        event.rssi = signal;
+        event.inact_xing = steer_xing(client->signal, signal,
+                                      client->cfg.inact_xing, iface->cfg.inact_xing);
+        event.high_xing = steer_xing(client->signal, signal,
+                                     client->cfg.high_xing, iface->cfg.high_xing);
+        event.low_xing = steer_xing(client->signal, signal,
+                                    client->cfg.low_xing, iface->cfg.low_xing);
+
+        if (event.inact_xing || event.high_xing || event.low_xing)
+            steer_cb(&event);
+    }
+
+    client->bytes = bytes;
+    client->signal = signal;
+    client->sampled = true;
+}
+
+/*
+ * The deny list rejects authentication only, probes are answered either
+ * way. With a sample at hand the associated client's activity and RSSI
+ * crossings are evaluated too.
+ */
+static void steer_client_eval(struct steer_iface *iface, struct steer_client *client,
+                              const struct sampler_sta *sta)
+{
+    const struct steer_client_cfg *cfg = &client->cfg;
+    bool auth;
+
+    /* Only the deny list is there to act on, auth thresholds win if given */
+    if (cfg->auth_hwm || cfg->auth_lwm)
+        auth = cfg->blocked || steer_outside(client->rssi, cfg->auth_hwm, cfg->auth_lwm);
+    else
+        auth = cfg->blocked || steer_outside(client->rssi, cfg->probe_hwm, cfg->probe_lwm);
+
+    steer_deny(iface, client, auth);
+
+    if (sta)
+        steer_client_sample(iface, client, sta);
+}
+
+static void steer_btm_resp(struct steer_iface *iface, const char *mac, const char *event)
+{
+    struct steer_event ev;
+    const char *p;
+
+    if (!steer_cb)
+        return;
+
+    steer_event_init(&ev, iface, STEER_EVENT_BTM_RESP, mac);
+    ev.status = (p = strstr(event, "status_code=")) ? atoi(p + 12) : -1;
+    if ((p = strstr(event, "dialog_token=")))
+        ev.dialog_token = atoi(p + 13);
+    if ((p = strstr(event, "bss_termination_delay=")))
+        ev.term_delay = atoi(p + 22);
+    if ((p = strstr(event, "target_bssid=")))
+        steer_mac_parse(p + 13, ev.target_bssid, sizeof(ev.target_bssid), NULL);
+
+    steer_cb(&ev);
+}
+
+static void steer_event_parse(struct steer_iface *iface, const char *event)
+{
+    struct steer_client *client;
+    const char *p;
+    char mac[18];
+    int rssi = 0;
+
+    if (!strncmp(event, "RX-PROBE-REQUEST ", 17))
+    {
+        p = strstr(event, "sa=");
+        if (!p || !steer_mac_parse(p + 3, mac, sizeof(mac), NULL))
+            return;
+
+        p = strstr(event, "signal=");
+        if (p)
+            rssi = atoi(p + 7);
+
+        client = ds_tree_find(&iface->clients, mac);
+        if (client)
+        {
+            client->rssi = rssi;
+            steer_client_eval(iface, client, NULL);
+        }
+
+        steer_emit(iface, STEER_EVENT_PROBE_REQ, mac, rssi);
+    }
+    else if (!strncmp(event, "AP-STA-CONNECTED ", 17))
+    {
+        if (!steer_mac_parse(event + 17, mac, sizeof(mac), NULL))
+            return;
+
+        if ((client = ds_tree_find(&iface->clients, mac)))
+            steer_client_connected(client, true);
+        steer_emit(iface, STEER_EVENT_CONNECT, mac, 0);
+    }
+    else if (!strncmp(event, "AP-STA-DISCONNECTED ", 20))
+    {
+        if (!steer_mac_parse(event + 20, mac, sizeof(mac), NULL))
+            return;
+
+        if ((client = ds_tree_find(&iface->clients, mac)))
+            steer_client_connected(client, false);
+        steer_emit(iface, STEER_EVENT_DISCONNECT, mac, 0);
+    }
+    else if (!strncmp(event, "BSS-TM-RESP ", 12))
+    {
+        if (steer_mac_parse(event + 12, mac, sizeof(mac), NULL))
+            steer_btm_resp(iface, mac, event);
+    }
+}
+
+static void steer_detach(struct steer_iface *iface)
+{
+    if (!iface->attached)
+        return;
+
+    ev_io_stop(steer_loop, &iface->io);
+    hostapd_monitor_close(iface->ifname, iface->io.fd);
+    iface->attached = false;
+}
+
+static void steer_mon_cb(struct ev_loop *loop, ev_io *io, int revents)
+{
+    struct steer_iface *iface = (struct steer_iface *)io;
+    char event[256];
+    int ret;
+
+    while ((ret = hostapd_monitor_recv(io->fd, event, sizeof(event))) > 0)
+        steer_event_parse(iface, event);
+
+    if (ret < 0)
+    {
+        LOGN("%s: steer: lost hostapd, reattaching", iface->ifname);
+        steer_detach(iface);
+    }
+}
+
+static bool steer_attach(struct steer_iface *iface)
+{
+    struct steer_client *client;
+    int fd;
+
+    if (iface->attached)
+        return true;
+
+    /* Taken first, a restart in between shows up on the next tick */
+    iface->ino = hostapd_ctrl_ino(iface->ifname);
+
+    fd = hostapd_monitor_open(iface->ifname);
+    if (fd < 0)
+        return false;
+
+    ev_io_init(&iface->io, steer_mon_cb, fd, EV_READ);
+    ev_io_start(steer_loop, &iface->io);
+    iface->attached = true;
+
+    /* A new hostapd starts from its config, put the blocks back */
+    ds_tree_foreach(&iface->clients, client)
+    {
+        client->denied = false;
+        steer_client_eval(iface, client, NULL);
+    }
+
+    return true;
+}
+
+/* A restarted hostapd doesn't error out the old monitor, it goes quiet */
+static void steer_attach_task(void *arg)
+{
+    struct steer_iface *iface;
+
+    ds_tree_foreach(&steer_ifaces, iface)
+    {
+        if (iface->attached && hostapd_ctrl_ino(iface->ifname) != iface->ino)
+        {
+            LOGN("%s: steer: hostapd restarted, reattaching", iface->ifname);
+            steer_detach(iface);
+        }
+        steer_attach(iface);
+    }
+
+    evsched_task_reschedule_ms(STEER_ATTACH_INTERVAL);
+}
+
+static void steer_sample_cb(const struct sampler_sta *sta, void *arg)
+{
+    struct steer_iface *iface = arg;
+    struct steer_client *client;
+    char mac[18];
+
+    snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x",
+             sta->mac[0], sta->mac[1], sta->mac[2], sta->mac[3], sta->mac[4], sta->mac[5]);
+
+    client = ds_tree_find(&iface->clients, mac);
+    if (client)
+        steer_client_eval(iface, client, sta);
+}
+
+/* Nothing recent from the sampler, the crossings wait for the next check */
+static void steer_eval_task(void *arg)
+{
+    struct steer_iface *iface = arg;
+
+    sampler_peek(iface->ifname, steer_sample_cb, iface);
+
+    evsched_task_reschedule_ms(EVSCHED_SEC(iface->cfg.inact_check_sec));
+}
+
+static void steer_eval_stop(struct steer_iface *iface)
+{
+    evsched_task_cancel_by_find(&steer_eval_task, iface,
+                                EVSCHED_FIND_BY_FUNC | EVSCHED_FIND_BY_ARG);
+    sampler_unwatch(iface->ifname, SAMPLER_USER_STEER);
+}
+
+static void steer_eval_start(struct steer_iface *iface)
+{
+    steer_eval_stop(iface);
+    if (iface->cfg.inact_check_sec <= 0)
+        return;
+
+    if (!sampler_watch(iface->ifname, SAMPLER_USER_STEER, EVSCHED_SEC(iface->cfg.inact_check_sec)))
+        LOGW("%s: steer: no samples, activity and RSSI crossings not reported", iface->ifname);
+
+    evsched_task(&steer_eval_task, iface, EVSCHED_SEC(iface->cfg.inact_check_sec));
+}
+
+static void steer_clients_free(struct steer_iface *iface)
+{
+    struct steer_client *client;
+    ds_tree_iter_t iter;
+
+    ds_tree_foreach_iter(&iface->clients, client, &iter)
+    {
+        steer_deny(iface, client, false);
+        ds_tree_iremove(&iter);
+        free(client);
+    }
+}
+
+void steer_event_cb_set(steer_event_cb_t *cb)
+{
+    steer_cb = cb;
+}
+
+bool steer_iface_add(const char *ifname, int band, const struct steer_iface_cfg *cfg)
+{
+    struct steer_iface *iface;
+    bool restart;
+
+    iface = ds_tree_find(&steer_ifaces, (void *)ifname);
+    if (iface)
+    {
+        restart = iface->cfg.inact_check_sec != cfg->inact_check_sec;
+        iface->band = band;
+        iface->cfg = *cfg;
+        if (restart)
+            steer_eval_start(iface);
+        return true;
+    }
+
+    iface = calloc(1, sizeof(*iface));
+    if (!iface)
+        return false;
+
+    STRSCPY(iface->ifname, ifname);
+    iface->band = band;
+    iface->cfg = *cfg;
+    ds_tree_init(&iface->clients, ds_str_cmp, struct steer_client, node);
+    ds_tree_insert(&steer_ifaces, iface, iface->ifname);
+    steer_eval_start(iface);
+
+    if (!steer_attach(iface))
+        LOGN("%s: steer: hostapd not up yet, will attach later", ifname);
+
+    return true;
+}
+
+bool steer_iface_remove(const char *ifname)
+{
+    struct steer_iface *iface;
+
+    iface = ds_tree_find(&steer_ifaces, (void *)ifname);
+    if (!iface)
+        return false;
+
+    steer_eval_stop(iface);
+    steer_clients_free(iface);
+    steer_detach(iface);
+    ds_tree_remove(&steer_ifaces, iface);
+    free(iface);
+
+    return true;
+}
+
+bool steer_client_set(const char *ifname, const char *mac, const struct steer_client_cfg *cfg)
+{
+    struct steer_client *client;
+    struct steer_iface *iface;
+    char addr[18];
+
+    iface = ds_tree_find(&steer_ifaces, (void *)ifname);
+    if (!iface || !steer_mac_parse(mac, addr, sizeof(addr), NULL))
+        return false;
+
+    client = ds_tree_find(&iface->clients, addr);
+    if (!client)
+    {
+        client = calloc(1, sizeof(*client));
+        if (!client)
+            return false;
+        STRSCPY(client->mac, addr);
+        ds_tree_insert(&iface->clients, client, client->mac);
+    }
+
+    client->cfg = *cfg;
+    steer_client_eval(iface, client, NULL);
+
+    return true;
+}
+
+bool steer_client_remove(const char *ifname, const char *mac)
+{
+    struct steer_client *client;
+    struct steer_iface *iface;
+    char addr[18];
+
+    iface = ds_tree_find(&steer_ifaces, (void *)ifname);
+    if (!iface || !steer_mac_parse(mac, addr, sizeof(addr), NULL))
+        return false;
+
+    client = ds_tree_find(&iface->clients, addr);
+    if (!client)
+        return false;
+
+    steer_deny(iface, client, false);
+    ds_tree_remove(&iface->clients, client);
+    free(client);
+
+    return true;
+}
+
+static int steer_sta_cb(struct nl_msg *msg, void *arg)
+{
+    struct steer_sta_ctx *ctx = arg;
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct nlattr *sinfo[NL80211_STA_INFO_MAX + 1];
+
+    nl80211_parse(msg, tb);
+
+    if (!tb[NL80211_ATTR_STA_INFO] ||
+        nla_parse_nested(sinfo, NL80211_STA_INFO_MAX, tb[NL80211_ATTR_STA_INFO], NULL))
+        return NL_SKIP;
+
+    if (sinfo[NL80211_STA_INFO_SIGNAL])
+    {
+        ctx->rssi = (int8_t)nla_get_u8(sinfo[NL80211_STA_INFO_SIGNAL]);
+        ctx->found = true;
+    }
+
+    return NL_SKIP;
+}
+
+/* Last signal of an associated station from the driver's table */
+bool steer_client_rssi(const char *ifname, const char *mac, int *rssi)
+{
+    struct steer_sta_ctx ctx = { 0 };
+    struct nl_msg *msg;
+    unsigned int ifindex;
+    uint8_t addr[ETH_ALEN];
+
+    ifindex = if_nametoindex(ifname);
+    if (!ifindex || !steer_mac_parse(mac, NULL, 0, addr))
+        return false;
+
+    msg = nl80211_msg(NL80211_CMD_GET_STATION, 0);
+    if (!msg)
+        return false;
+
+    nla_put_u32(msg, NL80211_ATTR_IFINDEX, ifindex);
+    nla_put(msg, NL80211_ATTR_MAC, ETH_ALEN, addr);
+
+    if (nl80211_send(msg, steer_sta_cb, &ctx) || !ctx.found)
+        return false;
+
+    *rssi = ctx.rssi;
+
+    return true;
+}
+
+/* Answered right away with an RSSI event */
+bool steer_client_measure(const char *ifname, const char *mac)
+{
+    struct steer_iface *iface;
+    char str[18];
+    int rssi;
+
+    iface = ds_tree_find(&steer_ifaces, (void *)ifname);
+    if (!iface || !steer_mac_parse(mac, str, sizeof(str), NULL) ||
+        !steer_client_rssi(ifname, str, &rssi))
+        return false;
+
+    steer_emit(iface, STEER_EVENT_RSSI, str, rssi);
+
+    return true;
+}
+
+/* hostapd's view of the station, rssi is 0 when neither it nor the driver knows */
+bool steer_client_info(const char *ifname, const char *mac, struct steer_client_info *info)
+{
+    char reply[1024];
+    char cmd[32];
+    char addr[18];
+    const char *p;
+
+    memset(info, 0, sizeof(*info));
+
+    if (!steer_mac_parse(mac, addr, sizeof(addr), NULL))
+        return false;
+
+    snprintf(cmd, sizeof(cmd), "STA %s", addr);
+    if (hostapd_cli(ifname, cmd, reply, sizeof(reply)) < 0)
+        return false;
+
+    /* Unknown stations get an empty reply or "FAIL" */
+    if (strncasecmp(reply, addr, strlen(addr)))
+        return true;
+
+    info->connected = true;
+    if ((p = strstr(reply, "\nrx_bytes=")))
+        info->rx_bytes = strtoull(p + 10, NULL, 10);
+    if ((p = strstr(reply, "\ntx_bytes=")))
+        info->tx_bytes = strtoull(p + 10, NULL, 10);
+    if ((p = strstr(reply, "\nsignal=")))
+        info->rssi = atoi(p + 8);
+    else
+        steer_client_rssi(ifname, addr, &info->rssi);
+
+    return true;
+}
+
+bool steer_client_kick(const char *ifname, const char *mac, int type, int reason)
+{
+    char cmd[80];
+    char addr[18];
+
+    if (!steer_mac_parse(mac, addr, sizeof(addr), NULL))
+        return false;
+
+    snprintf(cmd, sizeof(cmd), "%s %s reason=%d",
+             type == STEER_KICK_DISASSOC ? "DISASSOCIATE" : "DEAUTHENTICATE", addr, reason);
+
+    return hostapd_cli_ok(ifname, cmd);
+}
+
+bool steer_btm_request(const char *ifname, const char *mac, const struct steer_btm *btm)
+{
+    const struct steer_neighbor *nbr;
+    char cmd[512];
+    char addr[18];
+    char bssid[18];
+    int len;
+    int i;
+
+    if (!steer_mac_parse(mac, addr, sizeof(addr), NULL))
+        return false;
+
+    len = snprintf(cmd, sizeof(cmd), "BSS_TM_REQ %s valid_int=%d pref=1", addr,
+                   btm->valid_int > 0 ? btm->valid_int : 255);
+
+    if (btm->abridged)
+        len += snprintf(cmd + len, sizeof(cmd) - len, " abridged=1");
+    if (btm->disassoc_imminent)
+        len += snprintf(cmd + len, sizeof(cmd) - len, " disassoc_imminent=1");
+    if (btm->disassoc_timer > 0)
+        len += snprintf(cmd + len, sizeof(cmd) - len, " disassoc_timer=%d", btm->disassoc_timer);
+
+    for (i = 0; i < btm->n_neighbors && i < STEER_MAX_NEIGHBORS; i++)
+    {
+        nbr = &btm->neighbors[i];
+        if (!steer_mac_parse(nbr->bssid, bssid, sizeof(bssid), NULL))
+            continue;
+
+        len += snprintf(cmd + len, sizeof(cmd) - len, " neighbor=%s,0x%04x,%d,%d,%d",
+                        bssid, nbr->bssid_info, nbr->op_class, nbr->channel, nbr->phy_type);
+        if (len >= (int)sizeof(cmd))
+            return false;
+    }
+
+    return hostapd_cli_ok(ifname, cmd);
+}
+
+bool steer_init(struct ev_loop *loop)
+{
+    if (steer_running)
+        return true;
+
+    steer_loop = loop;
+    evsched_task(&steer_attach_task, NULL, STEER_ATTACH_INTERVAL);
+    steer_running = true;
+
+    return true;
+}
+
+void steer_cleanup(void)
+{
+    struct steer_iface *iface;
+    ds_tree_iter_t iter;
+
+    if (!steer_running)
+        return;
+
+    evsched_task_cancel_by_find(&steer_attach_task, NULL, EVSCHED_FIND_BY_FUNC);
+
+    /* Nobody steers any more, let everyone in */
+    ds_tree_foreach_iter(&steer_ifaces, iface, &iter)
+    {
+        ds_tree_iremove(&iter);
+        steer_eval_stop(iface);
+        steer_clients_free(iface);
+        steer_detach(iface);
+        free(iface);
+    }
+
+    steer_cb = NULL;
+    steer_running = false;
+}
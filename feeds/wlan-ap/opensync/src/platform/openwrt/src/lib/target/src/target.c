@@ -33,6 +33,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "const.h"
 
 #include "target.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "acs.h"
+#include "tpc.h"
+#include "nbr.h"
+#include "spectral.h"
+#include "sampler.h"
+#include "worker.h"
+#include "rtnl.h"
+#include "sensor.h"
+#include "resource.h"
+#include "thermal.h"
+#include "green.h"
+#include "vlan.h"
+#include "psk.h"
+#include "ft.h"
+#include "acl.h"
+#include "rrm.h"
+#include "steer.h"
 
 struct ev_loop *wifihal_evloop = NULL;
 
@@ -40,6 +59,30 @@ struct ev_loop *wifihal_evloop = NULL;
  *  TARGET definitions
  *****************************************************************************/
 
+#define TARGET_RESYNC_LATE   EVSCHED_SEC(10)
+
+static void target_hostapd_resync_task(void *arg)
+{
+    psk_resync();
+    acl_resync();
+    ft_resync();
+    rrm_resync();
+}
+
+/*
+ * Runs once the last queued hostapd reload finished: updates pushed while
+ * it was going on may have gone to the instance it replaced. netifd may
+ * bring hostapd up a little after reload_config returned, a second pass
+ * catches that one.
+ */
+static void target_hostapd_resync(void *arg)
+{
+    target_hostapd_resync_task(NULL);
+
+    evsched_task_cancel_by_find(&target_hostapd_resync_task, NULL, EVSCHED_FIND_BY_FUNC);
+    evsched_task(&target_hostapd_resync_task, NULL, TARGET_RESYNC_LATE);
+}
+
 bool target_ready(struct ev_loop *loop)
 {
     wifihal_evloop = loop;
@@ -61,6 +104,23 @@ bool target_init(target_init_opt_t opt, struct ev_loop *loop)
     switch (opt)
     {
         case TARGET_INIT_MGR_SM:
+            if (!nl80211_init(loop) || !phy_init())
+            {
+                LOGW("Initializing SM "
+                        "(Failed to initialize nl80211)");
+            }
+
+            if (!worker_init(loop))
+            {
+                LOGW("Initializing SM "
+                        "(Failed to start worker threads)");
+            }
+
+            if (!rtnl_init(loop) || !sensor_init())
+            {
+                LOGW("Initializing SM "
+                        "(Failed to initialize link events)");
+            }
             break;
 
         case TARGET_INIT_MGR_WM:
@@ -71,6 +131,55 @@ bool target_init(target_init_opt_t opt, struct ev_loop *loop)
                 return -1;
             }
 
+            if (!nl80211_init(loop) || !phy_init())
+            {
+                LOGW("Initializing WM "
+                        "(Failed to initialize nl80211)");
+            }
+
+            if (!worker_init(loop))
+            {
+                LOGW("Initializing WM "
+                        "(Failed to start worker threads)");
+            }
+            worker_reload_done_set(target_hostapd_resync, NULL);
+
+            if (!rtnl_init(loop) || !sensor_init())
+            {
+                LOGW("Initializing WM "
+                        "(Failed to initialize link events)");
+            }
+
+            if (!vlan_init())
+            {
+                LOGW("Initializing WM "
+                        "(Failed to load VLAN networks)");
+            }
+
+            if (!green_init(loop))
+            {
+                LOGW("Initializing WM "
+                        "(Failed to start idle power saving)");
+            }
+
+            if (!ft_init())
+            {
+                LOGW("Initializing WM "
+                        "(Failed to start FT key holder updates)");
+            }
+
+            if (!rrm_init())
+            {
+                LOGW("Initializing WM "
+                        "(Failed to start neighbor report updates)");
+            }
+
+            if (!resource_init(loop))
+            {
+                LOGW("Initializing WM "
+                        "(Failed to open resource counters)");
+            }
+
 //            sync_init(SYNC_MGR_WM, NULL);
             break;
 
@@ -79,6 +188,20 @@ bool target_init(target_init_opt_t opt, struct ev_loop *loop)
             break;
 
         case TARGET_INIT_MGR_BM:
+            if (evsched_init(loop) == false)
+            {
+                LOGE("Initializing BM "
+                        "(Failed to initialize EVSCHED)");
+                return -1;
+            }
+
+            if (!nl80211_init(loop))
+            {
+                LOGW("Initializing BM "
+                        "(Failed to initialize nl80211)");
+            }
+
+            /* Steering itself starts with target_bsal_init() */
             break;
 
         default:
@@ -94,9 +217,34 @@ bool target_close(target_init_opt_t opt, struct ev_loop *loop)
     {
         case TARGET_INIT_MGR_WM:
 //            sync_cleanup();
+            worker_cleanup();
+            evsched_task_cancel_by_find(&target_hostapd_resync_task, NULL, EVSCHED_FIND_BY_FUNC);
+            acs_cleanup();
+            tpc_cleanup();
+            thermal_cleanup();
+            green_cleanup();
+            vlan_cleanup();
+            psk_cleanup();
+            ft_cleanup();
+            acl_cleanup();
+            rrm_cleanup();
+            spectral_cleanup();
+            nbr_cleanup();
             /* fall through */
 
         case TARGET_INIT_MGR_SM:
+            resource_cleanup();
+            worker_cleanup();
+            sampler_cleanup();
+            sensor_cleanup();
+            rtnl_cleanup();
+            phy_cleanup();
+            nl80211_cleanup();
+            break;
+
+        case TARGET_INIT_MGR_BM:
+            steer_cleanup();
+            nl80211_cleanup();
             break;
 
         default:
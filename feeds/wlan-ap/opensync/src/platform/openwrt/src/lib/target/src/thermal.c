@@ -0,0 +1,439 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "evsched.h"
+#include "os_time.h"
+#include "uci_helper.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "sensor.h"
+#include "tpc.h"
+#include "thermal.h"
+
+#define THERMAL_INTERVAL            EVSCHED_SEC(10)
+/* Escalate quickly, relax slowly */
+#define THERMAL_UP_HOLDOFF_MS       (30 * 1000)
+#define THERMAL_DOWN_HOLDOFF_MS     (2 * 60 * 1000)
+#define THERMAL_MIN_DBM             6
+/* Share of time the cooling device keeps the transmitter quiet */
+#define THERMAL_DUTY_OFF_PCT        50
+#define THERMAL_COOLING_PATH        "/sys/class/ieee80211/%s/device/cooling_device/%s"
+
+/* What a mitigation step did */
+enum thermal_apply
+{
+    THERMAL_APPLY_FAILED = -1,  /* try again after the holdoff */
+    THERMAL_APPLY_NONE,         /* nothing to shed, move on to the next step */
+    THERMAL_APPLY_OK,
+};
+
+struct thermal_radio
+{
+    struct thermal_state    s;
+    bool                    valid;
+    char                    phy[IFNAMSIZ];
+    int                     txpower;    /* dBm applied, 0 when untouched */
+    int                     width;      /* MHz before narrowing */
+    int                     narrow;     /* MHz applied, 0 when untouched */
+    bool                    duty;
+    int64_t                 last_change;
+};
+
+static struct thermal_radio g_thermal[UCI_MAX_RADIOS];
+static bool thermal_running = false;
+
+static int thermal_width_mhz(int nl_width)
+{
+    switch (nl_width)
+    {
+        case NL80211_CHAN_WIDTH_40:
+            return 40;
+        case NL80211_CHAN_WIDTH_80:
+        case NL80211_CHAN_WIDTH_80P80:
+            return 80;
+        case NL80211_CHAN_WIDTH_160:
+            return 160;
+        default:
+            return 20;
+    }
+}
+
+static int thermal_cooling_read(const char *phy, const char *attr)
+{
+    char path[128];
+    char buf[16];
+    FILE *f;
+    int val = -1;
+
+    snprintf(path, sizeof(path), THERMAL_COOLING_PATH, phy, attr);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+
+    if (fgets(buf, sizeof(buf), f))
+        val = atoi(buf);
+    fclose(f);
+
+    return val;
+}
+
+static bool thermal_cooling_write(const char *phy, int state)
+{
+    char path[128];
+    FILE *f;
+    int ret;
+
+    snprintf(path, sizeof(path), THERMAL_COOLING_PATH, phy, "cur_state");
+    f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    ret = fprintf(f, "%d\n", state);
+    if (fclose(f) || ret < 0)
+        return false;
+
+    return true;
+}
+
+static int thermal_txpower_apply(struct thermal_radio *radio)
+{
+    struct wifi_oper oper;
+    int target;
+
+    if (!phy_get_oper(radio->phy, &oper) || !oper.txpower_valid)
+        return THERMAL_APPLY_FAILED;
+
+    target = oper.txpower - THERMAL_TXPOWER_STEP_DB;
+    if (target < THERMAL_MIN_DBM)
+        target = THERMAL_MIN_DBM;
+    if (target >= oper.txpower)
+        return THERMAL_APPLY_NONE;
+
+    if (!phy_set_txpower(radio->phy, target))
+        return THERMAL_APPLY_FAILED;
+
+    radio->txpower = target;
+
+    return THERMAL_APPLY_OK;
+}
+
+static void thermal_txpower_undo(struct thermal_radio *radio, int radioIndex)
+{
+    if (!radio->txpower)
+        return;
+
+    tpc_restore_txpower(radioIndex);
+    radio->txpower = 0;
+}
+
+static int thermal_width_apply(struct thermal_radio *radio, int radioIndex)
+{
+    struct wifi_oper oper;
+    char ht_mode[16];
+    int width;
+
+    if (!phy_get_oper(radio->phy, &oper))
+        return THERMAL_APPLY_FAILED;
+
+    width = thermal_width_mhz(oper.width);
+    if (width <= 20)
+        return THERMAL_APPLY_NONE;
+
+    snprintf(ht_mode, sizeof(ht_mode), "HT%d", width / 2);
+    if (!radio_channel_switch(radioIndex, oper.channel, ht_mode))
+    {
+        LOGW("%s: thermal: switch to %s failed", radio->phy, ht_mode);
+        return THERMAL_APPLY_FAILED;
+    }
+
+    radio->width = width;
+    radio->narrow = width / 2;
+
+    return THERMAL_APPLY_OK;
+}
+
+/*
+ * The narrower width only lives until the radio restarts: a CSA that
+ * timed out falls back to a reload, and that reload, like any other,
+ * brings the configured width back.
+ */
+static void thermal_width_check(struct thermal_radio *radio)
+{
+    struct wifi_oper oper;
+
+    if (!radio->narrow || !phy_get_oper(radio->phy, &oper) ||
+        thermal_width_mhz(oper.width) <= radio->narrow)
+        return;
+
+    LOGN("%s: thermal: back on %d MHz after a restart", radio->phy, thermal_width_mhz(oper.width));
+    radio->narrow = 0;
+}
+
+static void thermal_width_undo(struct thermal_radio *radio, int radioIndex)
+{
+    struct wifi_oper oper;
+    char ht_mode[16];
+
+    if (!radio->narrow)
+        return;
+
+    radio->narrow = 0;
+    if (!phy_get_oper(radio->phy, &oper))
+        return;
+
+    snprintf(ht_mode, sizeof(ht_mode), "HT%d", radio->width);
+    if (!radio_channel_switch(radioIndex, oper.channel, ht_mode))
+        LOGW("%s: thermal: switch back to %s failed", radio->phy, ht_mode);
+}
+
+/*
+ * There is no nl80211 knob for the tx duty cycle, ath10k exposes its
+ * firmware throttling as a cooling device linked from the wiphy's parent.
+ */
+static int thermal_duty_apply(struct thermal_radio *radio)
+{
+    int max_state;
+
+    max_state = thermal_cooling_read(radio->phy, "max_state");
+    if (max_state <= 0)
+    {
+        LOGI("%s: thermal: no cooling device, duty cycle unavailable", radio->phy);
+        return THERMAL_APPLY_NONE;
+    }
+
+    if (!thermal_cooling_write(radio->phy, max_state * THERMAL_DUTY_OFF_PCT / 100))
+        return THERMAL_APPLY_FAILED;
+
+    radio->duty = true;
+
+    return THERMAL_APPLY_OK;
+}
+
+static void thermal_duty_undo(struct thermal_radio *radio)
+{
+    if (!radio->duty)
+        return;
+
+    thermal_cooling_write(radio->phy, 0);
+    radio->duty = false;
+}
+
+static int thermal_level_apply(struct thermal_radio *radio, int radioIndex, int level)
+{
+    switch (level)
+    {
+        case THERMAL_LEVEL_TXPOWER:
+            return thermal_txpower_apply(radio);
+        case THERMAL_LEVEL_WIDTH:
+            return thermal_width_apply(radio, radioIndex);
+        case THERMAL_LEVEL_DUTY:
+            return thermal_duty_apply(radio);
+        default:
+            return THERMAL_APPLY_NONE;
+    }
+}
+
+static bool thermal_level_applied(const struct thermal_radio *radio, int level)
+{
+    switch (level)
+    {
+        case THERMAL_LEVEL_TXPOWER:
+            return radio->txpower;
+        case THERMAL_LEVEL_WIDTH:
+            return radio->narrow;
+        case THERMAL_LEVEL_DUTY:
+            return radio->duty;
+        default:
+            return false;
+    }
+}
+
+/* Highest level still in effect at or below the given one */
+static int thermal_level_in_effect(const struct thermal_radio *radio, int level)
+{
+    while (level > THERMAL_LEVEL_NONE && !thermal_level_applied(radio, level))
+        level--;
+
+    return level;
+}
+
+static void thermal_level_undo(struct thermal_radio *radio, int radioIndex, int level)
+{
+    switch (level)
+    {
+        case THERMAL_LEVEL_TXPOWER:
+            thermal_txpower_undo(radio, radioIndex);
+            break;
+        case THERMAL_LEVEL_WIDTH:
+            thermal_width_undo(radio, radioIndex);
+            break;
+        case THERMAL_LEVEL_DUTY:
+            thermal_duty_undo(radio);
+            break;
+        default:
+            break;
+    }
+}
+
+static void thermal_radio_reset(struct thermal_radio *radio, int radioIndex)
+{
+    while (radio->s.level > THERMAL_LEVEL_NONE)
+        thermal_level_undo(radio, radioIndex, radio->s.level--);
+
+    memset(radio, 0, sizeof(*radio));
+}
+
+static void thermal_radio_run(int radioIndex)
+{
+    struct thermal_radio *radio = &g_thermal[radioIndex];
+    char mode[16];
+    int64_t since;
+    int millideg;
+    int limit;
+    int level;
+    int ret;
+
+    wifi_getRadioThermalMode(radioIndex, mode, sizeof(mode));
+    if (strcmp(mode, "auto"))
+    {
+        if (radio->valid)
+            thermal_radio_reset(radio, radioIndex);
+        return;
+    }
+
+    wifi_getRadioPhyName(radioIndex, radio->phy, sizeof(radio->phy));
+    if (!sensor_temp_get(radio->phy, &millideg))
+        return;
+
+    wifi_getRadioThermalLimit(radioIndex, &limit);
+
+    radio->valid = true;
+    radio->s.temp = millideg / 1000;
+    if (radio->s.temp > radio->s.max_temp)
+        radio->s.max_temp = radio->s.temp;
+
+    thermal_width_check(radio);
+    radio->s.level = thermal_level_in_effect(radio, radio->s.level);
+
+    level = radio->s.level;
+    since = clock_mono_ms() - radio->last_change;
+
+    if (level < THERMAL_LEVEL_MAX &&
+        radio->s.temp >= limit + level * THERMAL_STEP_C)
+    {
+        if (radio->last_change && since < THERMAL_UP_HOLDOFF_MS)
+            return;
+
+        /* Steps with nothing to shed are passed over, a failed one is retried later */
+        for (ret = THERMAL_APPLY_NONE; ret == THERMAL_APPLY_NONE && level < THERMAL_LEVEL_MAX; )
+            ret = thermal_level_apply(radio, radioIndex, ++level);
+
+        if (ret != THERMAL_APPLY_OK)
+        {
+            LOGW("%s: thermal: %d C, no further mitigation applied", radio->phy, radio->s.temp);
+            radio->last_change = clock_mono_ms();
+            return;
+        }
+
+        LOGW("%s: thermal: %d C, entering mitigation level %d",
+             radio->phy, radio->s.temp, level);
+    }
+    else if (level > THERMAL_LEVEL_NONE &&
+             radio->s.temp < limit + (level - 1) * THERMAL_STEP_C - THERMAL_HYST_C)
+    {
+        if (since < THERMAL_DOWN_HOLDOFF_MS)
+            return;
+
+        LOGN("%s: thermal: %d C, leaving mitigation level %d",
+             radio->phy, radio->s.temp, level);
+        thermal_level_undo(radio, radioIndex, level);
+        level = thermal_level_in_effect(radio, level - 1);
+    }
+    else
+    {
+        return;
+    }
+
+    radio->s.level = level;
+    radio->s.changes++;
+    radio->last_change = clock_mono_ms();
+}
+
+static void thermal_task(void *arg)
+{
+    int rnum;
+    int r;
+
+    if (UCI_OK == wifi_getRadioNumberOfEntries(&rnum))
+    {
+        for (r = 0; r < rnum && r < UCI_MAX_RADIOS; r++)
+            thermal_radio_run(r);
+    }
+
+    evsched_task_reschedule_ms(THERMAL_INTERVAL);
+}
+
+bool thermal_get(int radioIndex, struct thermal_state *state)
+{
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS || !g_thermal[radioIndex].valid)
+        return false;
+
+    *state = g_thermal[radioIndex].s;
+
+    return true;
+}
+
+int thermal_level(int radioIndex)
+{
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS)
+        return THERMAL_LEVEL_NONE;
+
+    return g_thermal[radioIndex].s.level;
+}
+
+/* Widest channel the local ACS may pick while the radio is throttled, 0 if any */
+int thermal_max_width(int radioIndex)
+{
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS)
+        return 0;
+
+    return g_thermal[radioIndex].narrow;
+}
+
+bool thermal_init(void)
+{
+    if (thermal_running)
+        return true;
+
+    memset(g_thermal, 0, sizeof(g_thermal));
+    evsched_task(&thermal_task, NULL, THERMAL_INTERVAL);
+    thermal_running = true;
+
+    return true;
+}
+
+void thermal_cleanup(void)
+{
+    int r;
+
+    if (!thermal_running)
+        return;
+
+    evsched_task_cancel_by_find(&thermal_task, NULL, EVSCHED_FIND_BY_FUNC);
+
+    /* Don't leave a radio crippled behind once nobody watches it */
+    for (r = 0; r < UCI_MAX_RADIOS; r++)
+    {
+        if (g_thermal[r].valid)
+            thermal_radio_reset(&g_thermal[r], r);
+    }
+
+    thermal_running = false;
+}
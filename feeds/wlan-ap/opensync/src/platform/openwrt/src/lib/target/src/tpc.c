@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "log.h"
+#include "const.h"
+#include "evsched.h"
+#include "os_time.h"
+#include "uci_helper.h"
+#include "phy.h"
+#include "nbr.h"
+#include "sampler.h"
+#include "tpc.h"
+#include "thermal.h"
+#include "green.h"
+
+#define TPC_INTERVAL            EVSCHED_SEC(30)
+#define TPC_STEP_DB             2
+/* Never go further below the allowed maximum than this */
+#define TPC_MAX_REDUCTION_DB    12
+#define TPC_MIN_DBM             6
+/* Same-SSID APs heard above this make the deployment dense */
+#define TPC_DENSE_RSSI          -70
+/* Clients below this are at the cell edge and need more power ... */
+#define TPC_EDGE_RSSI           -75
+/* ... and power is only lowered while the weakest has this much margin */
+#define TPC_LOWER_RSSI          (TPC_EDGE_RSSI + TPC_STEP_DB + 6)
+/* Rounds a decision must hold, and minimum time between changes */
+#define TPC_STABLE_ROUNDS       2
+#define TPC_HOLDOFF_MS          (2 * 60 * 1000)
+#define TPC_MAX_IFACES          16
+#define TPC_MAX_CLIENTS         256
+/* Client RSSI comes from the sampler's latest poll, one every few seconds is plenty */
+#define TPC_SAMPLE_MS           5000
+
+struct tpc_radio
+{
+    struct tpc_metrics  m;
+    bool                valid;
+    int                 pending;    /* -1 lower, +1 raise */
+    int                 stable;
+    int64_t             last_change;
+    char                watched[TPC_MAX_IFACES][IFNAMSIZ];
+    int                 n_watched;
+    bool                nbr_seeded;
+};
+
+struct tpc_sta_ctx
+{
+    int     *rssi;
+    int     max;
+    int     num;
+};
+
+static struct tpc_radio g_tpc[UCI_MAX_RADIOS];
+static bool tpc_running = false;
+
+static void tpc_sta_cb(const struct sampler_sta *s, void *arg)
+{
+    struct tpc_sta_ctx *ctx = arg;
+
+    if (ctx->num < ctx->max && s->rssi)
+        ctx->rssi[ctx->num++] = s->rssi;
+}
+
+/* Keep the sampler polling exactly the radio's current interfaces */
+static void tpc_watch(struct tpc_radio *radio, char (*ifnames)[IFNAMSIZ], int num)
+{
+    int i;
+    int j;
+
+    for (i = 0; i < radio->n_watched; i++)
+    {
+        for (j = 0; j < num; j++)
+            if (!strcmp(radio->watched[i], ifnames[j]))
+                break;
+        if (j == num)
+            sampler_unwatch(radio->watched[i], SAMPLER_USER_TPC);
+    }
+
+    radio->n_watched = 0;
+    for (i = 0; i < num; i++)
+    {
+        if (!sampler_watch(ifnames[i], SAMPLER_USER_TPC, TPC_SAMPLE_MS))
+            continue;
+        STRSCPY(radio->watched[radio->n_watched], ifnames[i]);
+        radio->n_watched++;
+    }
+}
+
+static int tpc_int_cmp(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* Same-SSID APs loud enough on our channel to contend with us */
+static int tpc_dense_aps(int radioIndex, const char *phy_name, int channel)
+{
+    char ssids[TPC_MAX_IFACES][33];
+    struct wifi_nbr *nbr;
+    ds_tree_t *nbrs;
+    int ssid_radio_idx;
+    int n_ssids = 0;
+    int snum;
+    int dense = 0;
+    int s;
+    int i;
+
+    if (wifi_getSSIDNumberOfEntries(&snum) != UCI_OK)
+        return 0;
+
+    for (s = 0; s < snum && n_ssids < TPC_MAX_IFACES; s++)
+    {
+        if (wifi_getSSIDRadioIndex(s, &ssid_radio_idx) != UCI_OK ||
+            ssid_radio_idx != radioIndex)
+            continue;
+
+        if (wifi_getSSIDName(s, ssids[n_ssids], sizeof(ssids[n_ssids])) == UCI_OK)
+            n_ssids++;
+    }
+
+    nbrs = nbr_get(phy_name);
+    if (!nbrs)
+        return 0;
+
+    ds_tree_foreach(nbrs, nbr)
+    {
+        if (nbr->rssi < TPC_DENSE_RSSI || channel < nbr->lo || channel > nbr->hi)
+            continue;
+
+        for (i = 0; i < n_ssids; i++)
+        {
+            if (!strcmp(nbr->ssid, ssids[i]))
+            {
+                dense++;
+                break;
+            }
+        }
+    }
+
+    return dense;
+}
+
+static void tpc_radio_run(int radioIndex)
+{
+    struct tpc_radio *radio = &g_tpc[radioIndex];
+    char ifnames[TPC_MAX_IFACES][IFNAMSIZ];
+    int rssi[TPC_MAX_CLIENTS];
+    struct tpc_sta_ctx sta = { .rssi = rssi, .max = TPC_MAX_CLIENTS, .num = 0 };
+    const struct wifi_chan *chan;
+    struct wifi_oper oper;
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+    char mode[16];
+    int cur;
+    int target;
+    int cfg_power;
+    int min_power;
+    int decision = 0;
+    int n_ifaces;
+    bool restore;
+    int i;
+
+    wifi_getRadioTpcMode(radioIndex, mode, sizeof(mode));
+    if (strcmp(mode, "auto"))
+    {
+        /* Engine turned off, give the configured power back */
+        restore = radio->valid && radio->m.txpower;
+        tpc_watch(radio, NULL, 0);
+        memset(radio, 0, sizeof(*radio));
+        if (restore)
+            tpc_restore_txpower(radioIndex);
+        return;
+    }
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+    phy = phy_get(phy_name);
+    if (!phy || !phy_get_oper(phy_name, &oper) || !oper.txpower_valid)
+        return;
+
+    /*
+     * The configured value (0 means max) and the regulatory limit cap us.
+     * The live power is no ceiling, it is what TPC, thermal or idle saving
+     * last left behind.
+     */
+    radio->m.max_txpower = 0;
+    chan = phy_chan_get(phy, oper.channel);
+    if (chan && chan->max_eirp)
+        radio->m.max_txpower = chan->max_eirp;
+    if (UCI_OK == wifi_getRadioTxPower(radioIndex, &cfg_power) && cfg_power > 0 &&
+        (!radio->m.max_txpower || cfg_power < radio->m.max_txpower))
+        radio->m.max_txpower = cfg_power;
+    if (!radio->m.max_txpower)
+    {
+        LOGD("%s: TPC: no configured or regulatory limit on channel %d", phy_name, oper.channel);
+        return;
+    }
+
+    min_power = radio->m.max_txpower - TPC_MAX_REDUCTION_DB;
+    if (min_power < TPC_MIN_DBM)
+        min_power = TPC_MIN_DBM;
+
+    /* Interfaces just watched have no poll yet and count as empty for a round */
+    n_ifaces = phy_get_ifaces(phy_name, ifnames, TPC_MAX_IFACES);
+    if (n_ifaces < 0)
+        n_ifaces = 0;
+    tpc_watch(radio, ifnames, n_ifaces);
+    for (i = 0; i < n_ifaces; i++)
+        sampler_peek(ifnames[i], tpc_sta_cb, &sta);
+
+    radio->m.clients = sta.num;
+    radio->m.edge_clients = 0;
+    radio->m.weakest_rssi = 0;
+    if (sta.num)
+    {
+        qsort(rssi, sta.num, sizeof(rssi[0]), tpc_int_cmp);
+        radio->m.weakest_rssi = rssi[sta.num / 10];
+        for (i = 0; i < sta.num && rssi[i] < TPC_EDGE_RSSI; i++)
+            radio->m.edge_clients++;
+    }
+
+    /*
+     * The cache follows every completed scan by itself, only results
+     * from before we started listening are read once
+     */
+    if (!radio->nbr_seeded)
+    {
+        nbr_refresh(phy_name, oper.ifname);
+        radio->nbr_seeded = true;
+    }
+    radio->m.dense_aps = tpc_dense_aps(radioIndex, phy_name, oper.channel);
+    radio->valid = true;
+
+    /* Thermal mitigation and idle saving own the tx power until they back off */
+    if (thermal_level(radioIndex) >= THERMAL_LEVEL_TXPOWER || green_is_idle(radioIndex))
+    {
+        radio->pending = 0;
+        radio->stable = 0;
+        return;
+    }
+
+    cur = radio->m.txpower ? radio->m.txpower : oper.txpower;
+
+    if (sta.num && radio->m.weakest_rssi < TPC_EDGE_RSSI)
+    {
+        if (cur < radio->m.max_txpower)
+            decision = 1;
+    }
+    else if (radio->m.dense_aps && (!sta.num || radio->m.weakest_rssi >= TPC_LOWER_RSSI))
+    {
+        if (cur > min_power)
+            decision = -1;
+    }
+
+    if (!decision || decision != radio->pending)
+    {
+        radio->pending = decision;
+        radio->stable = decision ? 1 : 0;
+        return;
+    }
+
+    if (++radio->stable < TPC_STABLE_ROUNDS)
+        return;
+
+    if (radio->last_change && clock_mono_ms() - radio->last_change < TPC_HOLDOFF_MS)
+        return;
+
+    target = cur + decision * TPC_STEP_DB;
+    if (target > radio->m.max_txpower)
+        target = radio->m.max_txpower;
+    if (target < min_power)
+        target = min_power;
+
+    LOGI("%s: TPC %d -> %d dBm (%d dense APs, %d clients, %d at edge, p10 %d dBm)",
+         phy_name, cur, target, radio->m.dense_aps, sta.num,
+         radio->m.edge_clients, radio->m.weakest_rssi);
+
+    if (!phy_set_txpower(phy_name, target))
+        return;
+
+    radio->m.txpower = target;
+    radio->m.changes++;
+    radio->last_change = clock_mono_ms();
+    radio->stable = 0;
+}
+
+static void tpc_task(void *arg)
+{
+    int rnum;
+    int r;
+
+    if (UCI_OK == wifi_getRadioNumberOfEntries(&rnum))
+    {
+        for (r = 0; r < rnum && r < UCI_MAX_RADIOS; r++)
+            tpc_radio_run(r);
+    }
+
+    evsched_task_reschedule_ms(TPC_INTERVAL);
+}
+
+/*
+ * Put back the power TPC last chose, or the configured one while TPC
+ * doesn't steer the radio, 0 being automatic. For whoever lowered it
+ * temporarily and backs off.
+ */
+bool tpc_restore_txpower(int radioIndex)
+{
+    char phy_name[IFNAMSIZ];
+    int power = 0;
+
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS)
+        return false;
+
+    if (g_tpc[radioIndex].valid && g_tpc[radioIndex].m.txpower)
+        power = g_tpc[radioIndex].m.txpower;
+    else if (UCI_OK != wifi_getRadioTxPower(radioIndex, &power))
+        power = 0;
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+
+    return phy_set_txpower(phy_name, power);
+}
+
+bool tpc_get(int radioIndex, struct tpc_metrics *metrics)
+{
+    if (radioIndex < 0 || radioIndex >= UCI_MAX_RADIOS || !g_tpc[radioIndex].valid)
+        return false;
+
+    *metrics = g_tpc[radioIndex].m;
+
+    return true;
+}
+
+bool tpc_init(void)
+{
+    if (tpc_running)
+        return true;
+
+    memset(g_tpc, 0, sizeof(g_tpc));
+    nbr_init();
+    evsched_task(&tpc_task, NULL, TPC_INTERVAL);
+    tpc_running = true;
+
+    return true;
+}
+
+void tpc_cleanup(void)
+{
+    int r;
+
+    if (!tpc_running)
+        return;
+
+    evsched_task_cancel_by_find(&tpc_task, NULL, EVSCHED_FIND_BY_FUNC);
+    for (r = 0; r < UCI_MAX_RADIOS; r++)
+        tpc_watch(&g_tpc[r], NULL, 0);
+    tpc_running = false;
+}
@@ -1,7 +1,13 @@
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include "log.h"
 #include "uci_helper.h"
-#include "iwinfo.h"
+#include "phy.h"
+#include "sampler.h"
+#include "thermal.h"
+#include "vlan.h"
+#include "ft.h"
 
 static int g_nRadios = -1;
 static int g_nVIFs = -1;
@@ -239,6 +245,131 @@ bool uci_write_nw(char* type, char* section, char * option, char *uci_value)
     return true;
 }
 
+/*
+ * Batched wifi-iface updates. Options are staged in one context and the
+ * package is committed once at the end, and only if a value really
+ * differs, so an unchanged VIF does not make netifd restart the radio.
+ */
+bool uci_vif_batch_open(struct uci_vif_batch *b, int ssid_index)
+{
+    char uci_cmd[80];
+
+    memset(b, 0, sizeof(*b));
+    b->ssid_index = ssid_index;
+
+    b->ctx = uci_alloc_context();
+    if (!b->ctx) return false;
+
+    snprintf(uci_cmd, sizeof(uci_cmd), "wireless.@wifi-iface[%d]", ssid_index);
+    if (uci_lookup_ptr(b->ctx, &b->ptr, uci_cmd, true) != UCI_OK || !b->ptr.s)
+    {
+        LOGN("UCI batch %s not found", uci_cmd);
+        uci_free_context(b->ctx);
+        b->ctx = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/* NULL removes the option */
+void uci_vif_batch_set(struct uci_vif_batch *b, const char *option, const char *value)
+{
+    struct uci_ptr ptr = {
+        .p = b->ptr.p,
+        .s = b->ptr.s,
+        .option = option,
+        .value = value,
+    };
+
+    ptr.o = uci_lookup_option(b->ctx, b->ptr.s, option);
+
+    if (!value)
+    {
+        if (!ptr.o)
+            return;
+        if (uci_delete(b->ctx, &ptr) != UCI_OK)
+            b->failed = true;
+        b->changed = true;
+        return;
+    }
+
+    if (ptr.o && ptr.o->type == UCI_TYPE_STRING && !strcmp(ptr.o->v.string, value))
+        return;
+
+    if (uci_set(b->ctx, &ptr) != UCI_OK)
+        b->failed = true;
+    b->changed = true;
+}
+
+/* Replaces the whole list, n == 0 removes it */
+void uci_vif_batch_list(struct uci_vif_batch *b, const char *option,
+                        const char *const *values, int n)
+{
+    struct uci_element *e;
+    struct uci_ptr ptr = {
+        .p = b->ptr.p,
+        .s = b->ptr.s,
+        .option = option,
+    };
+    int same = 0;
+    int i = 0;
+
+    ptr.o = uci_lookup_option(b->ctx, b->ptr.s, option);
+
+    if (ptr.o && ptr.o->type == UCI_TYPE_LIST)
+    {
+        uci_foreach_element(&ptr.o->v.list, e)
+        {
+            if (i < n && !strcmp(e->name, values[i]))
+                same++;
+            i++;
+        }
+        if (i == n && same == n)
+            return;
+    }
+    else if (!ptr.o && !n)
+    {
+        return;
+    }
+
+    if (ptr.o && uci_delete(b->ctx, &ptr) != UCI_OK)
+        b->failed = true;
+    ptr.o = NULL;
+
+    for (i = 0; i < n; i++)
+    {
+        ptr.value = values[i];
+        if (uci_add_list(b->ctx, &ptr) != UCI_OK)
+            b->failed = true;
+    }
+
+    b->changed = true;
+}
+
+bool uci_vif_batch_commit(struct uci_vif_batch *b)
+{
+    bool ok = !b->failed;
+    int rc;
+
+    if (!b->ctx)
+        return false;
+
+    if (b->changed && ok && (rc = uci_commit(b->ctx, &b->ptr.p, false)) != UCI_OK)
+    {
+        LOGN("UCI batch wifi-iface[%d] commit error: %d", b->ssid_index, rc);
+        ok = false;
+    }
+
+    if (b->failed)
+        LOGN("UCI batch wifi-iface[%d] discarded", b->ssid_index);
+
+    uci_free_context(b->ctx);
+    b->ctx = NULL;
+
+    return ok;
+}
+
 /* 
  *  WiFi UCI interface - definitions
  */
@@ -336,102 +467,174 @@ int wifi_getRadioBeaconInterval(int radio_idx, int *beacon_int)
     return rc;
 }
 
-int wifi_getTxChainMask(int radioIndex, int *txChainMask)
+int wifi_getRadioPhyName(int radio_idx, char *phy, size_t phy_len)
 {
-    char command[64];
-    FILE *fp = NULL;
-    int fsize = 0;
-    char *buffer=NULL;
-    char *point=NULL;
-
-    memset(command, 0, 64);
+    char path[128];
 
-    sprintf(command,"iw phy%d info | grep 'Available Antennas' > /tmp/antennainfo.txt", radioIndex);
-
-    if(system(command) == -1)
+    memset(path, 0, sizeof(path));
+    if ((UCI_OK == uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "path", path, sizeof(path))) &&
+        !phy_from_path(path, phy, phy_len))
     {
-	return false;
+        return UCI_OK;
     }
 
-    fp = fopen("/tmp/antennainfo.txt","r");
+    /* No path option, fall back to the default phy naming */
+    snprintf(phy, phy_len, "phy%d", radio_idx);
+    return UCI_OK;
+}
 
-    if(fp != NULL)
+int wifi_getRadioIndexByPhy(const char *phy, int *radio_idx)
+{
+    char name[IFNAMSIZ];
+    int rnum;
+    int r;
+
+    if (wifi_getRadioNumberOfEntries(&rnum) != UCI_OK)
+        return UCI_ERR_NOTFOUND;
+
+    for (r = 0; r < rnum; r++)
     {
-	fseek(fp, 0, SEEK_END);
-	fsize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
-	buffer = malloc(fsize+1);
-	fread(buffer, 1, fsize, fp);
-	buffer[fsize] = 0;
-	fclose(fp);
-
-	point = strstr(buffer, "0x");
-	point = point + 2;
-        sscanf(point, "%d", txChainMask);
-
-	return true;
+        wifi_getRadioPhyName(r, name, sizeof(name));
+        if (!strcmp(name, phy))
+        {
+            *radio_idx = r;
+            return UCI_OK;
+        }
     }
 
-    return false;
+    return UCI_ERR_NOTFOUND;
 }
 
-int wifi_getRadioAllowedChannel(int radioIndex, int *allowedChannelList, int *allowedChannelListLen)
+/* "off", "recommend" (default) or "auto", see acs.h */
+int wifi_getRadioAcsMode(int radio_idx, char *mode, size_t mode_len)
 {
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "acs_mode", mode, mode_len))
+        snprintf(mode, mode_len, "recommend");
 
-    char radio_if_name[6];
-    char buf[IWINFO_BUFSIZE];
-    int  buflen;
-    int  numberOfChannels=0;
-    int  rc=false;
-    struct iwinfo_freqlist_entry  *freq_list    = NULL;
+    return UCI_OK;
+}
 
-    memset(radio_if_name, 0, sizeof(radio_if_name));
+/* "off" (default) or "auto", see tpc.h */
+int wifi_getRadioTpcMode(int radio_idx, char *mode, size_t mode_len)
+{
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "tpc_mode", mode, mode_len))
+        snprintf(mode, mode_len, "off");
 
-    if(radioIndex == 0)
-    {
-	strncpy(radio_if_name, "phy0", sizeof(radio_if_name));
-    }
-    else if(radioIndex == 1)
-    {
-	strncpy(radio_if_name, "phy1", sizeof(radio_if_name));
-    }
-    else if(radioIndex == 2)
-    {
-	strncpy(radio_if_name, "phy2", sizeof(radio_if_name));
-    }
-    else
-    {
-	return rc;
-    }
+    return UCI_OK;
+}
 
-    // find iwinfo type
-    const char *if_type = iwinfo_type(radio_if_name);
-    const struct iwinfo_ops *winfo_ops = iwinfo_backend_by_name(if_type);
+/* Background spectral scan, see spectral.h */
+int wifi_getRadioSpectralEnable(int radio_idx, bool *enabled)
+{
+    char buf[8];
 
-    if(0 != winfo_ops->freqlist(radio_if_name, buf, &buflen))
-    {
-	return rc;
-    }
+    *enabled = false;
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "spectral", buf, sizeof(buf)))
+        return UCI_ERR_NOTFOUND;
 
-    freq_list = (struct iwinfo_freqlist_entry *)buf;
+    *enabled = !strcmp(buf, "1");
 
-    for(int i = 0; i < buflen; i += sizeof(struct iwinfo_freqlist_entry))
-    {
-	allowedChannelList[numberOfChannels] = freq_list->channel;
+    return UCI_OK;
+}
+
+/* Client sampling period in ms, 0 turns the sampler off, see sampler.h */
+int wifi_getRadioClientSampleMs(int radio_idx, int *ms)
+{
+    char buf[16];
+
+    *ms = SAMPLER_DEFAULT_MS;
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "client_sample_ms", buf, sizeof(buf)))
+        return UCI_ERR_NOTFOUND;
+
+    *ms = atoi(buf);
+
+    return UCI_OK;
+}
+
+/* Thermal mitigation, see thermal.h */
+int wifi_getRadioThermalMode(int radio_idx, char *mode, size_t mode_len)
+{
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "thermal_mode", mode, mode_len))
+        snprintf(mode, mode_len, "auto");
+
+    return UCI_OK;
+}
+
+int wifi_getRadioThermalLimit(int radio_idx, int *celsius)
+{
+    char buf[16];
+
+    *celsius = THERMAL_DEFAULT_LIMIT_C;
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "thermal_limit", buf, sizeof(buf)) ||
+        atoi(buf) <= 0)
+        return UCI_ERR_NOTFOUND;
+
+    *celsius = atoi(buf);
+
+    return UCI_OK;
+}
 
-	LOGN("iwinfo :radio channel: %d", freq_list->channel);
-	LOGN("iwinfo : state: radio channel: %d", allowedChannelList[numberOfChannels]);
-	freq_list++;
-	numberOfChannels++;
+/* Idle power saving, see green.h */
+int wifi_getRadioGreenIdle(int radio_idx, int *seconds)
+{
+    char buf[16];
+
+    *seconds = 0;
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "green_idle", buf, sizeof(buf)))
+        return UCI_ERR_NOTFOUND;
+
+    *seconds = atoi(buf);
+
+    return UCI_OK;
+}
+
+int wifi_getRadioGreenTxPower(int radio_idx, int *db)
+{
+    char buf[16];
+
+    *db = 0;
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_RADIO_SECTION, radio_idx, "green_txpower", buf, sizeof(buf)))
+        return UCI_ERR_NOTFOUND;
+
+    *db = atoi(buf);
+
+    return UCI_OK;
+}
+
+int wifi_getTxChainMask(int radioIndex, int *txChainMask)
+{
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+
+    phy = phy_get(phy_name);
+    if (!phy)
+    {
+        LOGW("%s: no capabilities cached", phy_name);
+        return UCI_ERR_NOTFOUND;
     }
 
-    *allowedChannelListLen = numberOfChannels;
+    *txChainMask = phy_tx_chainmask(phy);
+    return UCI_OK;
+}
 
-    if(numberOfChannels != 0)
-	rc = true;
+int wifi_getRadioAllowedChannel(int radioIndex, int *allowedChannelList, int *allowedChannelListLen)
+{
+    struct wifi_phy *phy;
+    char phy_name[IFNAMSIZ];
 
-    return rc;
+    *allowedChannelListLen = 0;
+
+    wifi_getRadioPhyName(radioIndex, phy_name, sizeof(phy_name));
+    phy = phy_get(phy_name);
+    if (!phy)
+        return false;
+
+    /* Callers pass Wifi_Radio_State:allowed_channels, sized for PHY_MAX_CHANNELS */
+    *allowedChannelListLen = phy_allowed_channels(phy, allowedChannelList, PHY_MAX_CHANNELS);
 
+    return *allowedChannelListLen != 0;
 }
 
 static eFreqBand freqBand_capture[UCI_MAX_RADIOS] = {eFreqBand_5GU,eFreqBand_24G,eFreqBand_5GL};
@@ -443,7 +646,7 @@ int wifi_getRadioFreqBand(int *allowedChannels, int numberOfChannels, char *freq
     if(numberOfChannels == 0)
 	return rc;
 
-    if(allowedChannels[0] >= 1 && allowedChannels[numberOfChannels -1] <= 11){
+    if(allowedChannels[0] >= 1 && allowedChannels[numberOfChannels -1] <= 14){
 	strcpy(freq_band, "2.4G");
 	rc = true;
     }
@@ -462,33 +665,21 @@ int wifi_getRadioFreqBand(int *allowedChannels, int numberOfChannels, char *freq
 
    return rc;
 }
+/* The phy's first interface, whatever the board named it */
 int wifi_getRadioMacaddress(int radio_idx, char *mac)
 {
-    int rc = UCI_OK;
-    FILE *fd=NULL;
-    char buff[18];
-    char file_name[30];
-    if(radio_idx >= UCI_MAX_RADIOS)
-    {
-        LOG(ERR,"Maximum Radios Exceeded");
-        return rc = UCI_ERR_UNKNOWN;
-    }
-    snprintf(file_name,sizeof(file_name),"/sys/class/net/wlan%d/address",radio_idx);
-    fd=fopen(file_name,"r");
-    if(fd == NULL)
-    {
-        LOG(ERR,"Failed to open mac address input files");
-        return rc=UCI_ERR_UNKNOWN;
-    }
-    if(fscanf(fd,"%s",buff) == EOF)
+    char phy[IFNAMSIZ];
+
+    if (UCI_OK != wifi_getRadioPhyName(radio_idx, phy, sizeof(phy)))
+        return UCI_ERR_NOTFOUND;
+
+    if (!phy_get_addr(phy, NULL, mac, 18))
     {
-        LOG(ERR,"Mac Address reading failed");
-        fclose(fd);
-        return rc = UCI_ERR_UNKNOWN;
+        LOG(ERR,"Failed to get mac address of %s", phy);
+        return UCI_ERR_UNKNOWN;
     }
-    fclose(fd);
-    strcpy(mac,buff);
-    return rc;
+
+    return UCI_OK;
 }
 
 int wifi_getRadioHtMode(int radio_idx, char *ht_mode)
@@ -759,30 +950,72 @@ bool wifi_setSsidEnabled(int ssid_index, bool enabled)
     return uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "disabled", val);
 }
 
+/*
+ * All FT options go out in one commit, the key holder lists included:
+ * one r0kh/r1kh entry per known peer, see ft.h.
+ */
 bool wifi_setFtMode(int ssid_index,
         const struct schema_Wifi_VIF_Config *vconf)
 {
-    int rc;
-    char mobilityDdomain[5];
-    char ft_psk[2];
+    struct uci_vif_batch b;
+    char mobility_domain[5];
+    char peers[FT_MAX_PEERS][18];
+    char nas_id[FT_NAS_ID_LEN];
+    char r0kh[FT_MAX_PEERS][104];
+    char r1kh[FT_MAX_PEERS][104];
+    const char *r0khs[FT_MAX_PEERS];
+    const char *r1khs[FT_MAX_PEERS];
     const char *encryption = SCHEMA_KEY_VAL(vconf->security, SCHEMA_CONSTS_SECURITY_ENCRYPT);
+    const char *key;
+    int mode;
+    int n;
+    int i;
 
-    if(vconf->ft_mobility_domain != 0 && (strcmp(encryption,OVSDB_SECURITY_ENCRYPTION_OPEN) !=0) )
-	{
-	  sprintf(mobilityDdomain, "%02x", vconf->ft_mobility_domain);
-	  sprintf(ft_psk, "%d", vconf->ft_psk);
-	  rc = uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ieee80211r", "1") &&
-          uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "mobility_domain", mobilityDdomain) &&
-          uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ft_psk_generate_local", ft_psk) &&
-          uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ft_over_ds", "0") &&
-          uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "reassociation_deadline", "1");
-	}
-     else
-	{
-	  rc = uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ieee80211r", "0");
-	}
+    mode = ft_vif_mode(vconf, &key);
 
-    return rc;
+    if (!uci_vif_batch_open(&b, ssid_index))
+        return false;
+
+    if (mode == FT_MODE_OFF)
+    {
+        uci_vif_batch_set(&b, "ieee80211r", "0");
+        uci_vif_batch_list(&b, "r0kh", NULL, 0);
+        uci_vif_batch_list(&b, "r1kh", NULL, 0);
+        uci_vif_batch_set(&b, "pmk_r1_push", NULL);
+        return uci_vif_batch_commit(&b);
+    }
+
+    snprintf(mobility_domain, sizeof(mobility_domain), "%04x", vconf->ft_mobility_domain & 0xffff);
+    uci_vif_batch_set(&b, "ieee80211r", "1");
+    uci_vif_batch_set(&b, "mobility_domain", mobility_domain);
+    uci_vif_batch_set(&b, "ft_psk_generate_local",
+                      strcmp(encryption, OVSDB_SECURITY_ENCRYPTION_WPA_EAP) && vconf->ft_psk ? "1" : "0");
+    uci_vif_batch_set(&b, "ft_over_ds", "0");
+    uci_vif_batch_set(&b, "reassociation_deadline", "1");
+
+    if (mode == FT_MODE_KEYS)
+    {
+        n = ft_vif_peers(vconf, peers, FT_MAX_PEERS);
+        for (i = 0; i < n; i++)
+        {
+            ft_nas_id(peers[i], nas_id);
+            snprintf(r0kh[i], sizeof(r0kh[i]), "%s,%s,%s", peers[i], nas_id, key);
+            snprintf(r1kh[i], sizeof(r1kh[i]), "%s,%s,%s", peers[i], peers[i], key);
+            r0khs[i] = r0kh[i];
+            r1khs[i] = r1kh[i];
+        }
+        uci_vif_batch_list(&b, "r0kh", r0khs, n);
+        uci_vif_batch_list(&b, "r1kh", r1khs, n);
+        uci_vif_batch_set(&b, "pmk_r1_push", "1");
+    }
+    else
+    {
+        uci_vif_batch_list(&b, "r0kh", NULL, 0);
+        uci_vif_batch_list(&b, "r1kh", NULL, 0);
+        uci_vif_batch_set(&b, "pmk_r1_push", NULL);
+    }
+
+    return uci_vif_batch_commit(&b);
 }
 
 int wifi_getApBridgeInfo(int ssid_index, char *bridge_info, char *tmp1, char *tmp2, size_t bridge_info_len)
@@ -854,34 +1087,20 @@ int wifi_getBaseBSSID(int ssid_index,char *buf, size_t buf_len, int radio_idx)
 
     if(UCI_OK != rc)
     {
-    int rc = UCI_OK;
-    FILE *fd=NULL;
-    char addr[18];
-    char file_name[30];
+        char ifname[128];
+        char phy[IFNAMSIZ];
 
-    if(radio_idx >= UCI_MAX_RADIOS)
-    {
-        LOG(ERR,"Maximum Radios Exceeded");
-        return rc = UCI_ERR_UNKNOWN;
-    }
-    snprintf(file_name,sizeof(file_name),"/sys/class/net/wlan%d/address",radio_idx);
-    fd=fopen(file_name,"r");
+        /* The VIF's own netdev, the radio's address until it exists */
+        memset(ifname, 0, sizeof(ifname));
+        if (UCI_OK == wifi_getVIFName(ssid_index, ifname, sizeof(ifname) - 1) &&
+            UCI_OK == wifi_getRadioPhyName(radio_idx, phy, sizeof(phy)) &&
+            phy_get_addr(phy, ifname, buf, buf_len))
+            return UCI_OK;
 
-    if(fd == NULL)
-    {
-        LOG(ERR,"Failed to open mac address input files");
-        return rc=UCI_ERR_UNKNOWN;
-    }
+        if (buf_len < 18)
+            return UCI_ERR_UNKNOWN;
 
-    if(fscanf(fd,"%s",addr) == EOF)
-    {
-        LOG(ERR,"Mac Address reading failed");
-        fclose(fd);
-        return rc = UCI_ERR_UNKNOWN;
-    }
-    fclose(fd);
-    strcpy(buf,addr);
-    return rc;
+        return wifi_getRadioMacaddress(radio_idx, buf);
     }
     return rc;
 }
@@ -891,6 +1110,29 @@ bool wifi_setSSIDName(int ssid_index, char* ssidName)
     return uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ssid", ssidName);
 }
 
+/*
+ * RADIUS assigned VLANs. hostapd puts such clients on <vif>.<vid> and,
+ * with these names, bridges them to the same br-vlan<vid> on top of
+ * <uplink>.<vid> that static VLANs use, see vlan.h.
+ */
+static bool wifi_setApDynamicVlan(int ssid_index, int mode)
+{
+    struct uci_vif_batch b;
+    char buf[4];
+    bool on = mode > 0;
+
+    if (!uci_vif_batch_open(&b, ssid_index))
+        return false;
+
+    snprintf(buf, sizeof(buf), "%d", mode > 2 ? 2 : mode);
+    uci_vif_batch_set(&b, "dynamic_vlan", on ? buf : NULL);
+    uci_vif_batch_set(&b, "vlan_naming", on ? "1" : NULL);
+    uci_vif_batch_set(&b, "vlan_tagged_interface", on ? vlan_uplink() : NULL);
+    uci_vif_batch_set(&b, "vlan_bridge", on ? VLAN_BRIDGE_PREFIX : NULL);
+
+    return uci_vif_batch_commit(&b);
+}
+
 bool wifi_setApSecurityModeEnabled(int ssid_index,
         const struct schema_Wifi_VIF_Config *vconf)
 {
@@ -902,6 +1144,7 @@ bool wifi_setApSecurityModeEnabled(int ssid_index,
         UCI_WRITE(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "encryption", "none");
         UCI_REMOVE(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "key");
         UCI_REMOVE(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ieee80211w");
+        rc = wifi_setApDynamicVlan(ssid_index, 0);
     }
     else if (strcmp(encryption, OVSDB_SECURITY_ENCRYPTION_WPA_PSK) == 0)
     {
@@ -929,10 +1172,13 @@ bool wifi_setApSecurityModeEnabled(int ssid_index,
         {
             return false;
         }
+
+        rc = wifi_setApDynamicVlan(ssid_index, 0);
     }
     else if (strcmp(encryption, OVSDB_SECURITY_ENCRYPTION_WPA_EAP) == 0)
     {
         const char *mode = SCHEMA_KEY_VAL(vconf->security, SCHEMA_CONSTS_SECURITY_MODE);
+        const char *dyn = SCHEMA_KEY_VAL_NULL(vconf->security, "dynamic_vlan");
 
         if (strcmp(mode, OVSDB_SECURITY_MODE_WPA2) == 0)
         {
@@ -959,11 +1205,87 @@ bool wifi_setApSecurityModeEnabled(int ssid_index,
                 (char *)SCHEMA_KEY_VAL(vconf->security, SCHEMA_CONSTS_SECURITY_RADIUS_SECRET));
         UCI_WRITE(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ieee80211w", "1");
         UCI_REMOVE(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "key");
+
+        /* "1" accepts clients without a VLAN, "2" requires one */
+        rc = wifi_setApDynamicVlan(ssid_index, dyn ? atoi(dyn) : 0);
     }
 
     return rc;
 }
 
+int wifi_getApMacFilter(int ssid_index, char *buf, size_t buf_len)
+{
+    return(uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "macfilter", buf, buf_len));
+}
+
+/* hostapd.sh copies macfile into its own list at start, see acl.h. NULL disables. */
+bool wifi_setApMacFilter(int ssid_index, const char *filter, const char *file)
+{
+    struct uci_vif_batch b;
+
+    if (!uci_vif_batch_open(&b, ssid_index))
+        return false;
+
+    uci_vif_batch_set(&b, "macfilter", filter);
+    uci_vif_batch_set(&b, "macfile", filter ? file : NULL);
+    uci_vif_batch_list(&b, "maclist", NULL, 0);
+
+    return uci_vif_batch_commit(&b);
+}
+
+int wifi_getNeighborReportActivation(int ssid_index, bool *activate)
+{
+    char result[8];
+
+    *activate = false;
+    if (uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "ieee80211k", result, sizeof(result)) == UCI_OK)
+        *activate = !strcmp(result, "1");
+
+    return UCI_OK;
+}
+
+int wifi_getBSSTransitionActivation(int ssid_index, bool *activate)
+{
+    char result[8];
+
+    *activate = false;
+    if (uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "bss_transition", result, sizeof(result)) == UCI_OK)
+        *activate = !strcmp(result, "1");
+
+    return UCI_OK;
+}
+
+/* ieee80211k turns on rrm_neighbor_report, the list itself is in rrm.h */
+bool wifi_setApRrmBtm(int ssid_index, bool rrm, bool btm)
+{
+    struct uci_vif_batch b;
+
+    if (!uci_vif_batch_open(&b, ssid_index))
+        return false;
+
+    uci_vif_batch_set(&b, "ieee80211k", rrm ? "1" : NULL);
+    uci_vif_batch_set(&b, "bss_transition", btm ? "1" : NULL);
+
+    return uci_vif_batch_commit(&b);
+}
+
+int wifi_getApWpaPskFile(int ssid_index, char *buf, size_t buf_len)
+{
+    return(uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "wpa_psk_file", buf, buf_len));
+}
+
+/* Extra passphrases of a PSK VIF, see psk.h. NULL drops the file. */
+bool wifi_setApWpaPskFile(int ssid_index, const char *path)
+{
+    if (!path)
+    {
+        UCI_REMOVE(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "wpa_psk_file");
+        return true;
+    }
+
+    return uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "wpa_psk_file", (char *)path);
+}
+
 bool wifi_getApSecurityModeEnabled(int ssid_index, char *buf, size_t buf_len)
 {
     return(uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "encryption", buf, buf_len));
@@ -990,89 +1312,117 @@ bool wifi_setApBridgeInfo(int ssid_index, char *bridge_info)
     return( uci_write(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "network", bridge_info));
 }
 
-bool wifi_getApVlanId(int ssid_index, int *vlan_id)
+/*
+ * Airtime weight for a client: a matching "airtime_sta_weight" list entry
+ * ("<mac> <weight>") wins over the VIF wide "airtime_weight" option.
+ */
+int wifi_getApAirtimeWeight(int ssid_index, const char *mac, int *weight)
 {
-    char result[10];
-    char *p = NULL;
-    *vlan_id = 1;
+    struct uci_context *ctx;
+    struct uci_element *e;
+    struct uci_ptr ptr;
+    char uci_cmd[80];
+    char buf[16];
+    char sta[18];
+    int w;
 
-    memset(result, 0, sizeof(result));
-    uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "network", result, 10);
+    *weight = 0;
 
-    if ((p = strstr(result, "vlan")) != NULL)
+    snprintf(uci_cmd, sizeof(uci_cmd), "%s.@%s[%d].airtime_sta_weight",
+             WIFI_TYPE, WIFI_VIF_SECTION, ssid_index);
+
+    ctx = uci_alloc_context();
+    if (!ctx) return UCI_ERR_MEM;
+
+    if (mac && uci_lookup_ptr(ctx, &ptr, uci_cmd, true) == UCI_OK &&
+        ptr.o && ptr.o->type == UCI_TYPE_LIST)
     {
-        long int v = strtol(&p[4], NULL, 10);
+        uci_foreach_element(&ptr.o->v.list, e)
+        {
+            if (sscanf(e->name, "%17s %d", sta, &w) == 2 && !strcasecmp(sta, mac))
+            {
+                *weight = w;
+                break;
+            }
+        }
+    }
 
-	    *vlan_id = (int) v;
-	    LOGN("wifi_getApVlanId: %d", *vlan_id);
+    uci_free_context(ctx);
+
+    if (*weight > 0)
         return UCI_OK;
-    }
 
-    return false;
+    if (UCI_OK != uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "airtime_weight", buf, sizeof(buf)))
+        return UCI_ERR_NOTFOUND;
+
+    *weight = atoi(buf);
+
+    return *weight > 0 ? UCI_OK : UCI_ERR_NOTFOUND;
 }
 
-#define MAX_VLANS 200
-struct vlan_list
+/*
+ * FNV-1a over the airtime options of a VIF, changes whenever a configured
+ * weight does. 0 when neither option is set.
+ */
+uint32_t wifi_getApAirtimeHash(int ssid_index)
 {
-    int vlan[MAX_VLANS];
-    int index;
-} vlist;
+    struct uci_context *ctx;
+    struct uci_element *e;
+    struct uci_ptr ptr;
+    char uci_cmd[80];
+    char buf[16];
+    uint32_t hash = 0;
+    const char *c;
 
-bool wifi_setApVlanNetwork(int ssid_index, int vlan_id)
-{
-    char tmp[10];
-    char eth[10];
-    char vlan[10];
-    char vendor[128];
-    int index = 0;
+    ctx = uci_alloc_context();
+    if (!ctx)
+        return 0;
+
+    snprintf(uci_cmd, sizeof(uci_cmd), "%s.@%s[%d].airtime_sta_weight",
+             WIFI_TYPE, WIFI_VIF_SECTION, ssid_index);
 
-    if (vlan_id > 2)
+    if (uci_lookup_ptr(ctx, &ptr, uci_cmd, true) == UCI_OK &&
+        ptr.o && ptr.o->type == UCI_TYPE_LIST)
     {
-        for (index = 0; index < vlist.index; index++)
+        hash = 2166136261u;
+        uci_foreach_element(&ptr.o->v.list, e)
         {
-            if (vlist.vlan[index] == vlan_id)
-               return true;
+            for (c = e->name; *c; c++)
+                hash = (hash ^ (uint8_t)*c) * 16777619u;
+            hash = (hash ^ ';') * 16777619u;
         }
-        vlist.vlan[vlist.index++] = vlan_id;
+    }
 
-        memset(vlan, 0, sizeof(vlan));
-        snprintf(vlan, sizeof(vlan) - 1, "%d", vlan_id);
+    uci_free_context(ctx);
 
-        LOGI("wifi_setApVlanNetwork =  %d", vlan_id);
-        memset(tmp, 0, sizeof(tmp));
-        snprintf(tmp, sizeof(tmp) - 1, "vlan%d", vlan_id);
+    if (UCI_OK == uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "airtime_weight", buf, sizeof(buf)))
+    {
+        if (!hash)
+            hash = 2166136261u;
+        hash = (hash ^ '=') * 16777619u;
+        for (c = buf; *c; c++)
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
 
-        memset(eth, 0, sizeof(eth));
-        if (target_platform_version_get(vendor, 128))
-        {
-            if (!strncmp(vendor, "OPENWRT_ECW5410", 14) ||
-                !strncmp(vendor, "OPENWRT_ECW5211", 14))
-                snprintf(eth, sizeof(eth) - 1, "eth0.%d", vlan_id);
-            else if (!strncmp(vendor, "OPENWRT_EA8300", 14))
-                snprintf(eth, sizeof(eth) - 1, "eth1.%d", vlan_id);
-            else if (!strncmp(vendor, "OPENWRT_AP2220", 14))
-                snprintf(eth, sizeof(eth) - 1, "eth0.%d", vlan_id);
-            else
-                snprintf(eth, sizeof(eth) - 1, "eth1.%d", vlan_id);
-        }
-        uci_write_nw(NETWORK_TYPE, tmp, NULL, NETWORK_IFACE_SECTION);
-        uci_write_nw(NETWORK_TYPE, tmp, "type", "bridge");
-        uci_write_nw(NETWORK_TYPE, tmp, "ifname", eth);
-        uci_write_nw(NETWORK_TYPE, tmp, "proto", "dhcp");
+    return hash;
+}
 
-        memset(vendor, 0, sizeof(vendor));
+bool wifi_getApVlanId(int ssid_index, int *vlan_id)
+{
+    char result[10];
+    char *p = NULL;
+    *vlan_id = 1;
 
-        if (target_platform_version_get(vendor, 128))
-        {
-            if (!strncmp(vendor, "OPENWRT_EA8300", 14))
-            {
-                uci_add_write("network", "switch_vlan");
-                uci_write("network", "switch_vlan", -1, "device", "switch0");
-                uci_write("network", "switch_vlan", -1, "ports", "0t 5t");
-                uci_write("network", "switch_vlan", -1, "vlan", vlan);
-            }
-        }
-        return wifi_setApBridgeInfo(ssid_index, tmp);
+    memset(result, 0, sizeof(result));
+    uci_read(WIFI_TYPE, WIFI_VIF_SECTION, ssid_index, "network", result, 10);
+
+    if ((p = strstr(result, "vlan")) != NULL)
+    {
+        long int v = strtol(&p[4], NULL, 10);
+
+	    *vlan_id = (int) v;
+	    LOGN("wifi_getApVlanId: %d", *vlan_id);
+        return UCI_OK;
     }
 
     return false;
@@ -37,6 +37,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "target.h"
 #include "evsched.h"
 #include "uci_helper.h"
+#include "phy.h"
+#include "worker.h"
+#include "airtime.h"
+#include "vlan.h"
+#include "psk.h"
+#include "ft.h"
+#include "acl.h"
+#include "rrm.h"
 
 #define MODULE_ID LOG_MODULE_ID_VIF
 #define UCI_BUFFER_SIZE 80
@@ -67,25 +75,6 @@ static c_item_t map_enable_disable[] =
     C_ITEM_STR(false,                   "disabled")
 };
 
-#if 0
-#define ACL_BUF_SIZE   1024
-
-enum
-{
-    WEXT_ACL_MODE_DISABLE       = 0,
-    WEXT_ACL_MODE_WHITELIST,
-    WEXT_ACL_MODE_BLACKLIST,
-    WEXT_ACL_MODE_FLUSH
-};
-
-static c_item_t map_acl_modes[] =
-{
-    C_ITEM_STR(WEXT_ACL_MODE_DISABLE,   "none"),
-    C_ITEM_STR(WEXT_ACL_MODE_WHITELIST, "whitelist"),
-    C_ITEM_STR(WEXT_ACL_MODE_BLACKLIST, "blacklist"),
-    C_ITEM_STR(WEXT_ACL_MODE_FLUSH,     "flush")
-};
-#endif
 typedef enum
 {
     SEC_NONE                = 0,
@@ -109,133 +98,6 @@ static c_item_t map_security[] =
 };
 
 #if 0
-static bool acl_to_state(
-        INT ssid_index,
-        char *ssid_ifname,
-        struct schema_Wifi_VIF_State *vstate)
-{
-    char                    acl_buf[ACL_BUF_SIZE];
-    char                    *p;
-    char                    *s = NULL;
-    INT                     acl_mode;
-    INT                     status = RETURN_ERR;
-    INT                     i;
-
-    status = wifi_getApMacAddressControlMode(ssid_index, &acl_mode);
-    if (status != RETURN_OK)
-    {
-        LOGE("%s: Failed to get ACL mode", ssid_ifname);
-        return false;
-    }
-
-    STRSCPY(vstate->mac_list_type,
-            c_get_str_by_key(map_acl_modes, acl_mode));
-    if (strlen(vstate->mac_list_type) == 0)
-    {
-        LOGE("%s: Unknown ACL mode (%u)", ssid_ifname, acl_mode);
-        return false;
-    }
-    vstate->mac_list_type_exists = true;
-
-    status = wifi_getApAclDevices(ssid_index, acl_buf, sizeof(acl_buf));
-    if (status == RETURN_OK)
-    {
-        if ((strlen(acl_buf) + 2) > sizeof(acl_buf))
-        {
-            LOGE("%s: ACL List too long for buffer size!", ssid_ifname);
-            return false;
-        }
-        strcat(acl_buf, ",");
-
-        i = 0;
-        p = strtok_r(acl_buf, ",\n", &s);
-        while (p)
-        {
-            if (strlen(p) == 0)
-            {
-                break;
-            }
-            else if (strlen(p) != 17)
-            {
-                LOGW("%s: ACL has malformed MAC \"%s\"", ssid_ifname, p);
-            }
-            else
-            {
-                STRSCPY(vstate->mac_list[i], p);
-                i++;
-            }
-
-            p = strtok_r(NULL, ",\n", &s);
-        }
-        vstate->mac_list_len = i;
-    }
-
-    return true;
-}
-
-static bool acl_apply(
-        INT ssid_index,
-        const char *ssid_ifname,
-        const struct schema_Wifi_VIF_Config *vconf)
-{
-    c_item_t                *citem;
-    INT                     acl_mode;
-    INT                     ret;
-    INT                     i;
-
-    // !!! XXX: Cannot touch ACL for home interfaces, since they are currently
-    //          used for band steering.
-    if (!strncmp(ssid_ifname, "home-ap-", 8))
-    {
-        // Don't touch ACL
-        return true;
-    }
-
-    // Set ACL type from mac_list_type
-    if (vconf->mac_list_type_exists)
-    {
-        if (!(citem = c_get_item_by_str(map_acl_modes, vconf->mac_list_type)))
-        {
-            LOGE("%s: Failed to set ACL type (mac_list_type '%s' unknown)",
-                 ssid_ifname, vconf->mac_list_type);
-            return false;
-        }
-        acl_mode = (INT)citem->key;
-
-        ret = wifi_setApMacAddressControlMode(ssid_index, acl_mode);
-        LOGD("[WIFI_HAL SET] wifi_setApMacAddressControlMode(%d, %d) = %d",
-                                              ssid_index, acl_mode, ret);
-        if (ret != RETURN_OK)
-        {
-            LOGE("%s: Failed to set ACL Mode (%d)", ssid_ifname, acl_mode);
-            return false;
-        }
-    }
-
-    if (vconf->mac_list_len > 0)
-    {
-        // First, flush the table
-        ret = wifi_delApAclDevices(ssid_index);
-        LOGD("[WIFI_HAL SET] wifi_delApAclDevices(%d) = %d",
-                                   ssid_index, ret);
-
-        // Set ACL list
-        for (i = 0; i < vconf->mac_list_len; i++)
-        {
-            ret = wifi_addApAclDevice(ssid_index, (char *)vconf->mac_list[i]);
-            LOGD("[WIFI_HAL SET] wifi_addApAclDevice(%d, \"%s\") = %d",
-                                      ssid_index, vconf->mac_list[i], ret);
-            if (ret != RETURN_OK)
-            {
-                LOGW("%s: Failed to add \"%s\" to ACL", ssid_ifname, vconf->mac_list[i]);
-            }
-        }
-    }
-
-    return true;
-}
-
-
 static const char* security_conf_find_by_key(
         const struct schema_Wifi_VIF_Config *vconf,
         char *key)
@@ -289,12 +151,9 @@ static bool set_personal_credentials(
         LOGW("%s: wifi_getApSecurityKeyPassphrase returned empty SSID string", vstate->if_name);
     }
 
-    set_security_key_value(vstate, index, OVSDB_SECURITY_KEY, buf);
+    index = set_security_key_value(vstate, index, OVSDB_SECURITY_KEY, buf);
 
-    // TODO: We temporary removed multi-psk support from generic RDK platform.
-    // The multi-psk support will be added back when proper
-    // Wifi HAL API is created. We don't support direct hostapd-based
-    // multi-psk (it should be handled within the vendor layer).
+    psk_vif_state(vstate, index);
 
     return true;
 }
@@ -735,9 +594,10 @@ bool vif_state_get(int ssidIndex, struct schema_Wifi_VIF_State *vstate)
     int            radio_idx;
     char           ssid_ifname[128];
 //    char           band[128];
-//    bool           rrm;
-//    bool           btm;
+    bool           rrm;
+    bool           btm;
     int vlan_id;
+    struct wifi_oper oper;
 
     memset(vstate, 0, sizeof(*vstate));
     schema_Wifi_VIF_State_mark_all_present(vstate);
@@ -838,14 +698,17 @@ bool vif_state_get(int ssidIndex, struct schema_Wifi_VIF_State *vstate)
     {
         LOGW("%s: cannot get security for %s", __func__, ssid_ifname);
     }
-#if 0
+
     // mac_list_type (w/ exists)
     // mac_list, mac_list_len
-    if (!acl_to_state(ssidIndex, ssid_ifname, vstate))
+    if (!acl_vif_state(ssidIndex, vstate))
     {
         LOGW("%s: cannot get ACL for %s", __func__, ssid_ifname);
+        strscpy(vstate->mac_list_type, "none", sizeof(vstate->mac_list_type));
+        vstate->mac_list_len = 0;
+        vstate->mac_list_type_exists = true;
     }
-
+#if 0
     ret = wifi_getSSIDRadioIndex(ssidIndex, &radio_idx);
     if (ret != UCI_OK)
     {
@@ -853,10 +716,6 @@ bool vif_state_get(int ssidIndex, struct schema_Wifi_VIF_State *vstate)
         return false;
     }
 #endif
-
-    strscpy(vstate->mac_list_type, "none", sizeof(vstate->mac_list_type));
-    vstate->mac_list_len = 0;
-    vstate->mac_list_type_exists = true;
  
 #if 0
     memset(band, 0, sizeof(band));
@@ -934,8 +793,13 @@ bool vif_state_get(int ssidIndex, struct schema_Wifi_VIF_State *vstate)
     }
 
     // channel (w/ exists)
-    ret = wifi_getRadioChannel(radio_idx, &channel);
-    if (ret != UCI_OK)
+    memset(buf, 0, sizeof(buf));
+    wifi_getRadioPhyName(radio_idx, buf, IFNAMSIZ);
+    if (phy_get_oper(buf, &oper))
+    {
+        SCHEMA_SET_INT(vstate->channel, oper.channel);
+    }
+    else if ((ret = wifi_getRadioChannel(radio_idx, &channel)) != UCI_OK)
     {
         LOGW("%s: Failed to get channel from radio idx %d", ssid_ifname, radio_idx);
     }
@@ -944,7 +808,6 @@ bool vif_state_get(int ssidIndex, struct schema_Wifi_VIF_State *vstate)
         SCHEMA_SET_INT(vstate->channel, channel);
     }
 
-#if 0
     ret = wifi_getNeighborReportActivation(ssidIndex, &rrm);
     if (ret != UCI_OK)
     {
@@ -964,7 +827,6 @@ bool vif_state_get(int ssidIndex, struct schema_Wifi_VIF_State *vstate)
     {
         SCHEMA_SET_INT(vstate->btm, btm);
     }
-#endif
 
     return true;
 }
@@ -1118,6 +980,44 @@ bool target_vif_config_set2(
         {
             LOGE("%s: Failed to set Ft paramerters", ssid_ifname);
         }
+
+        if (!ft_vif_apply(ssid_index, vconf))
+        {
+            LOGW("%s: Failed to set FT key holders", ssid_ifname);
+        }
+    }
+
+    /* Credentials come and go without the VIF changing, check every time */
+    ret = psk_vif_apply(ssid_index, vconf, cconfs, num_cconfs);
+    if (ret != true)
+    {
+        LOGE("%s: Failed to set multi-psk keys", ssid_ifname);
+    }
+
+    if (changed->mac_list_type || changed->mac_list)
+    {
+        ret = acl_vif_apply(ssid_index, vconf);
+        if (ret != true)
+        {
+            LOGE("%s: Failed to set MAC ACL", ssid_ifname);
+        }
+    }
+
+    if (changed->rrm || changed->btm)
+    {
+        ret = wifi_setApRrmBtm(ssid_index, vconf->rrm_exists && vconf->rrm,
+                               vconf->btm_exists && vconf->btm);
+        if (ret != true)
+        {
+            LOGE("%s: Failed to set RRM/BTM", ssid_ifname);
+        }
+    }
+
+    /* Neighbors follow the SSID, the peers and the other VIFs, check every time */
+    ret = rrm_vif_apply(ssid_index, vconf);
+    if (ret != true)
+    {
+        LOGE("%s: Failed to set neighbor reports", ssid_ifname);
     }
 
     if (changed->ap_bridge)
@@ -1148,13 +1048,18 @@ bool target_vif_config_set2(
     }
 
     if (changed->vlan_id) {
-        ret = wifi_setApVlanNetwork(ssid_index, vconf->vlan_id);
+        ret = vlan_vif_set(ssid_index, vconf->vlan_id);
         if (ret != true)
         {
             LOGE("%s: Failed to set new vlan Network %d", ssid_ifname, vconf->vlan_id);
         }
     }
 
+    if (!airtime_apply(ssid_index))
+    {
+        LOGW("%s: Failed to apply airtime weights", ssid_ifname);
+    }
+
     return vif_state_update(ssid_index);
 }
 
@@ -1168,7 +1073,7 @@ bool vif_state_update(int ssidIndex)
         return false;
     }
 
-    system("reload_config");
+    worker_reload_config();
 
     LOGN("Updating VIF state for SSID index %d", ssidIndex);
     return radio_rops_vstate(&vstate);
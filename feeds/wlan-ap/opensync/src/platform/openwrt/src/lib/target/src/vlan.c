@@ -0,0 +1,560 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <net/if.h>
+#include <uci.h>
+
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "evsched.h"
+#include "target.h"
+#include "uci_helper.h"
+#include "worker.h"
+#include "nl80211.h"
+#include "rtnl.h"
+#include "vlan.h"
+
+/* Long enough for one OVSDB update's VIF rows to land in the same pass */
+#define VLAN_FLUSH_DELAY    EVSCHED_MS(200)
+#define VLAN_MAP_WORDS      ((VLAN_ID_MAX + 1 + 31) / 32)
+#define VLAN_MAX_PORTS      16
+
+struct vlan_vif
+{
+    int             ssid_index;
+    int             vlan;
+    bool            dirty;      /* wireless network option not written yet */
+    ds_tree_node_t  node;
+};
+
+static ds_tree_t vlan_vifs = DS_TREE_INIT(ds_int_cmp, struct vlan_vif, node);
+
+/* VLANs present in the network package, and the ones it should have */
+static uint32_t vlan_provisioned[VLAN_MAP_WORDS];
+static uint16_t vlan_refs[VLAN_ID_MAX + 1];
+/* AP_VLAN interfaces per VLAN, from hostapd dynamic_vlan */
+static uint16_t vlan_dyn_refs[VLAN_ID_MAX + 1];
+
+static char vlan_eth[IFNAMSIZ] = "eth1";
+static bool vlan_switch = false;
+static bool vlan_flush_pending = false;
+static bool vlan_ready = false;
+static bool vlan_registered = false;
+
+static inline bool vlan_bit_get(const uint32_t *map, int vlan)
+{
+    return map[vlan / 32] & (1u << (vlan % 32));
+}
+
+static inline void vlan_bit_set(uint32_t *map, int vlan, bool on)
+{
+    if (on)
+        map[vlan / 32] |= 1u << (vlan % 32);
+    else
+        map[vlan / 32] &= ~(1u << (vlan % 32));
+}
+
+static int vlan_from_network(const char *network)
+{
+    int vlan;
+
+    if (!network || strncmp(network, "vlan", 4))
+        return 0;
+
+    vlan = atoi(network + 4);
+    if (vlan < VLAN_ID_MIN_PROV || vlan > VLAN_ID_MAX)
+        return 0;
+
+    return vlan;
+}
+
+/* The uplink and whether it sits behind a switch only depend on the board */
+static void vlan_platform_init(void)
+{
+    char vendor[128];
+
+    memset(vendor, 0, sizeof(vendor));
+    if (!target_platform_version_get(vendor, sizeof(vendor)))
+        return;
+
+    if (!strncmp(vendor, "OPENWRT_ECW5410", 14) ||
+        !strncmp(vendor, "OPENWRT_ECW5211", 14) ||
+        !strncmp(vendor, "OPENWRT_AP2220", 14))
+        STRSCPY(vlan_eth, "eth0");
+    else
+        STRSCPY(vlan_eth, "eth1");
+
+    vlan_switch = !strncmp(vendor, "OPENWRT_EA8300", 14);
+}
+
+static bool vlan_uci_set(struct uci_context *ctx, struct uci_package *pkg,
+                         struct uci_section *s, const char *option, const char *value)
+{
+    struct uci_ptr ptr = {
+        .p = pkg,
+        .s = s,
+        .option = option,
+        .value = value,
+    };
+
+    ptr.o = uci_lookup_option(ctx, s, option);
+
+    return uci_set(ctx, &ptr) == UCI_OK;
+}
+
+static void vlan_network_add(struct uci_context *ctx, struct uci_package *pkg, int vlan)
+{
+    struct uci_ptr ptr = { .p = pkg };
+    struct uci_section *sw = NULL;
+    char section[16];
+    char eth[IFNAMSIZ + 8];
+    char id[8];
+
+    snprintf(section, sizeof(section), "vlan%d", vlan);
+    snprintf(eth, sizeof(eth), "%s.%d", vlan_eth, vlan);
+    snprintf(id, sizeof(id), "%d", vlan);
+
+    ptr.section = section;
+    ptr.value = "interface";
+    ptr.s = uci_lookup_section(ctx, pkg, section);
+    if (uci_set(ctx, &ptr) != UCI_OK || !ptr.s)
+    {
+        LOGE("vlan: failed to add network %s", section);
+        return;
+    }
+
+    vlan_uci_set(ctx, pkg, ptr.s, "type", "bridge");
+    vlan_uci_set(ctx, pkg, ptr.s, "ifname", eth);
+    vlan_uci_set(ctx, pkg, ptr.s, "proto", "dhcp");
+
+    if (vlan_switch && uci_add_section(ctx, pkg, "switch_vlan", &sw) == UCI_OK)
+    {
+        vlan_uci_set(ctx, pkg, sw, "device", "switch0");
+        vlan_uci_set(ctx, pkg, sw, "ports", "0t 5t");
+        vlan_uci_set(ctx, pkg, sw, "vlan", id);
+    }
+}
+
+static void vlan_network_del(struct uci_context *ctx, struct uci_package *pkg, int vlan)
+{
+    struct uci_element *e;
+    struct uci_element *tmp;
+    struct uci_section *s;
+    struct uci_ptr ptr;
+    const char *val;
+    char section[16];
+
+    snprintf(section, sizeof(section), "vlan%d", vlan);
+
+    uci_foreach_element_safe(&pkg->sections, tmp, e)
+    {
+        s = uci_to_section(e);
+
+        if (!strcmp(s->type, "interface"))
+        {
+            if (strcmp(s->e.name, section))
+                continue;
+        }
+        else if (!strcmp(s->type, "switch_vlan"))
+        {
+            /* Only the trunk we added, not the board's own lan/wan VLANs */
+            val = uci_lookup_option_string(ctx, s, "vlan");
+            if (!val || atoi(val) != vlan)
+                continue;
+            val = uci_lookup_option_string(ctx, s, "ports");
+            if (!val || strcmp(val, "0t 5t"))
+                continue;
+        }
+        else
+        {
+            continue;
+        }
+
+        memset(&ptr, 0, sizeof(ptr));
+        ptr.p = pkg;
+        ptr.s = s;
+        uci_delete(ctx, &ptr);
+    }
+}
+
+/*
+ * Bring the bridges up and move the VIFs onto them right away, netifd
+ * takes over the same devices once reload_config ran. Boards with a
+ * switch still need that reload before tagged frames reach the CPU port.
+ */
+static void vlan_links_apply(const uint32_t *removed)
+{
+    char ports[VLAN_MAX_PORTS][IFNAMSIZ];
+    uint32_t done[VLAN_MAP_WORDS];
+    struct vlan_vif *vif;
+    struct vlan_vif *other;
+    char bridge[IFNAMSIZ];
+    int n;
+    int vlan;
+
+    memset(done, 0, sizeof(done));
+
+    ds_tree_foreach(&vlan_vifs, vif)
+    {
+        if (!vif->dirty || vif->vlan < VLAN_ID_MIN_PROV || vlan_bit_get(done, vif->vlan))
+            continue;
+
+        n = 0;
+        ds_tree_foreach(&vlan_vifs, other)
+        {
+            if (other->dirty && other->vlan == vif->vlan && n < VLAN_MAX_PORTS &&
+                UCI_OK == wifi_getVIFName(other->ssid_index, ports[n], sizeof(ports[n])))
+                n++;
+        }
+
+        vlan_bit_set(done, vif->vlan, true);
+        snprintf(bridge, sizeof(bridge), VLAN_BRIDGE_PREFIX "%d", vif->vlan);
+        if (rtnl_vlan_attach(bridge, vlan_eth, vif->vlan, (const char (*)[IFNAMSIZ])ports, n))
+            LOGW("vlan: %s not set up directly, waiting for netifd", bridge);
+    }
+
+    for (vlan = VLAN_ID_MIN_PROV; vlan <= VLAN_ID_MAX; vlan++)
+    {
+        if (!vlan_bit_get(removed, vlan))
+            continue;
+
+        snprintf(bridge, sizeof(bridge), VLAN_BRIDGE_PREFIX "%d", vlan);
+        rtnl_vlan_detach(bridge, vlan_eth, vlan);
+    }
+}
+
+/* Both packages go out in one commit each, whatever the number of VLANs */
+void vlan_flush(void)
+{
+    struct schema_Wifi_VIF_State vstate;
+    struct uci_context *ctx;
+    struct uci_package *pkg = NULL;
+    struct uci_package *wpkg = NULL;
+    struct uci_ptr ptr;
+    struct vlan_vif *vif;
+    ds_tree_iter_t iter;
+    uint32_t gone[VLAN_MAP_WORDS];
+    char uci_cmd[80];
+    char network[16];
+    int added = 0;
+    int removed = 0;
+    int vifs = 0;
+    int vlan;
+
+    vlan_flush_pending = false;
+    memset(gone, 0, sizeof(gone));
+
+    ctx = uci_alloc_context();
+    if (!ctx)
+        return;
+
+    if (uci_load(ctx, "network", &pkg) == UCI_OK)
+    {
+        for (vlan = VLAN_ID_MIN_PROV; vlan <= VLAN_ID_MAX; vlan++)
+        {
+            if (vlan_refs[vlan] && !vlan_bit_get(vlan_provisioned, vlan))
+            {
+                vlan_network_add(ctx, pkg, vlan);
+                vlan_bit_set(vlan_provisioned, vlan, true);
+                added++;
+            }
+            else if (!vlan_refs[vlan] && vlan_bit_get(vlan_provisioned, vlan))
+            {
+                vlan_network_del(ctx, pkg, vlan);
+                vlan_bit_set(vlan_provisioned, vlan, false);
+                /* Links stay while RADIUS clients still sit on them */
+                if (!vlan_dyn_refs[vlan])
+                    vlan_bit_set(gone, vlan, true);
+                removed++;
+            }
+        }
+
+        if ((added || removed) && uci_commit(ctx, &pkg, false) != UCI_OK)
+            LOGE("vlan: network commit failed");
+    }
+
+    ds_tree_foreach(&vlan_vifs, vif)
+    {
+        if (!vif->dirty || vif->vlan < VLAN_ID_MIN_PROV)
+            continue;
+
+        snprintf(uci_cmd, sizeof(uci_cmd), "wireless.@wifi-iface[%d].network", vif->ssid_index);
+        snprintf(network, sizeof(network), "vlan%d", vif->vlan);
+        if (uci_lookup_ptr(ctx, &ptr, uci_cmd, true) != UCI_OK || !ptr.s)
+            continue;
+
+        ptr.value = network;
+        if (uci_set(ctx, &ptr) == UCI_OK)
+        {
+            wpkg = ptr.p;
+            vifs++;
+        }
+    }
+
+    if (wpkg && uci_commit(ctx, &wpkg, false) != UCI_OK)
+        LOGE("vlan: wireless commit failed");
+
+    uci_free_context(ctx);
+
+    LOGI("vlan: %d added, %d removed, %d VIFs moved", added, removed, vifs);
+
+    if (vlan_ready)
+        vlan_links_apply(gone);
+
+    ds_tree_foreach_iter(&vlan_vifs, vif, &iter)
+    {
+        if (vif->dirty)
+        {
+            vif->dirty = false;
+            if (vlan_ready && vif_state_get(vif->ssid_index, &vstate))
+                radio_rops_vstate(&vstate);
+        }
+
+        if (!vif->vlan)
+        {
+            ds_tree_iremove(&iter);
+            free(vif);
+        }
+    }
+
+    if ((added || removed || vifs) && vlan_ready)
+        worker_reload_config();
+}
+
+static void vlan_flush_task(void *arg)
+{
+    vlan_flush();
+}
+
+static void vlan_flush_schedule(void)
+{
+    if (vlan_flush_pending)
+        return;
+
+    vlan_flush_pending = true;
+    evsched_task(&vlan_flush_task, NULL, VLAN_FLUSH_DELAY);
+}
+
+/*
+ * Record the VLAN for a VIF. Nothing is written here, the VIF's network
+ * option and any new or unused VLAN networks are handled by the next
+ * flush. VLANs below VLAN_ID_MIN_PROV just release the VIF's reference,
+ * the bridge setting puts the VIF back on lan or wan.
+ */
+bool vlan_vif_set(int ssid_index, int vlan_id)
+{
+    struct vlan_vif *vif;
+
+    if (vlan_id < 0 || vlan_id > VLAN_ID_MAX)
+        return false;
+
+    if (vlan_id < VLAN_ID_MIN_PROV)
+        vlan_id = 0;
+
+    vif = ds_tree_find(&vlan_vifs, &ssid_index);
+    if (vif && vif->vlan == vlan_id)
+        return true;
+
+    if (!vif)
+    {
+        if (!vlan_id)
+            return true;
+
+        vif = calloc(1, sizeof(*vif));
+        if (!vif)
+            return false;
+
+        vif->ssid_index = ssid_index;
+        ds_tree_insert(&vlan_vifs, vif, &vif->ssid_index);
+    }
+
+    if (vif->vlan && vlan_refs[vif->vlan])
+        vlan_refs[vif->vlan]--;
+    if (vlan_id)
+        vlan_refs[vlan_id]++;
+
+    LOGI("vlan: SSID index %d moves from VLAN %d to %d", ssid_index, vif->vlan, vlan_id);
+
+    vif->vlan = vlan_id;
+    vif->dirty = true;
+    vlan_flush_schedule();
+
+    return true;
+}
+
+const char *vlan_uplink(void)
+{
+    return vlan_eth;
+}
+
+/* VLAN of an AP_VLAN interface "<vif>.<vid>", 0 for anything else */
+int vlan_ap_vlan_parse(const char *ifname, char *parent, size_t len)
+{
+    const char *dot;
+    char *end;
+    long vid;
+
+    dot = strrchr(ifname, '.');
+    if (!dot || dot == ifname || !dot[1])
+        return 0;
+
+    vid = strtol(dot + 1, &end, 10);
+    if (*end || vid < 1 || vid > VLAN_ID_MAX)
+        return 0;
+
+    if (parent)
+        snprintf(parent, len, "%.*s", (int)(dot - ifname), ifname);
+
+    return vid;
+}
+
+static void vlan_ap_vlan_event_cb(uint8_t cmd, struct nlattr **tb, void *arg)
+{
+    char ports[1][IFNAMSIZ];
+    char bridge[IFNAMSIZ];
+    int vid;
+
+    if (!tb[NL80211_ATTR_IFTYPE] || !tb[NL80211_ATTR_IFNAME] ||
+        nla_get_u32(tb[NL80211_ATTR_IFTYPE]) != NL80211_IFTYPE_AP_VLAN)
+        return;
+
+    STRSCPY(ports[0], nla_get_string(tb[NL80211_ATTR_IFNAME]));
+    vid = vlan_ap_vlan_parse(ports[0], NULL, 0);
+    if (vid < VLAN_ID_MIN_PROV)
+        return;
+
+    snprintf(bridge, sizeof(bridge), VLAN_BRIDGE_PREFIX "%d", vid);
+
+    if (cmd == NL80211_CMD_NEW_INTERFACE)
+    {
+        /* hostapd may do the same with full dynamic VLAN, both are idempotent */
+        vlan_dyn_refs[vid]++;
+        if (rtnl_vlan_attach(bridge, vlan_eth, vid, (const char (*)[IFNAMSIZ])ports, 1))
+            LOGW("vlan: %s not bridged to %s", ports[0], bridge);
+        else
+            LOGI("vlan: RADIUS VLAN %d on %s", vid, ports[0]);
+        return;
+    }
+
+    if (vlan_dyn_refs[vid] && !--vlan_dyn_refs[vid] && !vlan_refs[vid] &&
+        !vlan_bit_get(vlan_provisioned, vid))
+        rtnl_vlan_detach(bridge, vlan_eth, vid);
+}
+
+int vlan_count(void)
+{
+    int count = 0;
+    int i;
+
+    for (i = 0; i < VLAN_MAP_WORDS; i++)
+        count += __builtin_popcount(vlan_provisioned[i]);
+
+    return count;
+}
+
+/*
+ * Rebuild the bitmap and reference counts from what a previous run left
+ * in UCI. VLAN networks nobody refers to any more are collected by the
+ * first flush.
+ */
+bool vlan_init(void)
+{
+    struct uci_context *ctx;
+    struct uci_package *pkg = NULL;
+    struct uci_element *e;
+    struct uci_section *s;
+    struct vlan_vif *vif;
+    const char *type;
+    int ssid_index = 0;
+    int vlan;
+
+    if (vlan_ready)
+        return true;
+
+    vlan_platform_init();
+    memset(vlan_provisioned, 0, sizeof(vlan_provisioned));
+    memset(vlan_refs, 0, sizeof(vlan_refs));
+    memset(vlan_dyn_refs, 0, sizeof(vlan_dyn_refs));
+
+    if (!vlan_registered)
+    {
+        if (!nl80211_event_register(NL80211_CMD_NEW_INTERFACE, vlan_ap_vlan_event_cb, NULL) ||
+            !nl80211_event_register(NL80211_CMD_DEL_INTERFACE, vlan_ap_vlan_event_cb, NULL))
+            LOGW("vlan: no AP_VLAN events, RADIUS VLANs rely on hostapd");
+        vlan_registered = true;
+    }
+
+    ctx = uci_alloc_context();
+    if (!ctx)
+        return false;
+
+    if (uci_load(ctx, "network", &pkg) == UCI_OK)
+    {
+        uci_foreach_element(&pkg->sections, e)
+        {
+            s = uci_to_section(e);
+            type = uci_lookup_option_string(ctx, s, "type");
+            vlan = vlan_from_network(s->e.name);
+            if (vlan && !strcmp(s->type, "interface") && type && !strcmp(type, "bridge"))
+                vlan_bit_set(vlan_provisioned, vlan, true);
+        }
+    }
+
+    pkg = NULL;
+    if (uci_load(ctx, "wireless", &pkg) == UCI_OK)
+    {
+        uci_foreach_element(&pkg->sections, e)
+        {
+            s = uci_to_section(e);
+            if (strcmp(s->type, "wifi-iface"))
+                continue;
+
+            vlan = vlan_from_network(uci_lookup_option_string(ctx, s, "network"));
+            if (vlan && (vif = calloc(1, sizeof(*vif))) != NULL)
+            {
+                vif->ssid_index = ssid_index;
+                vif->vlan = vlan;
+                ds_tree_insert(&vlan_vifs, vif, &vif->ssid_index);
+                vlan_refs[vlan]++;
+            }
+            ssid_index++;
+        }
+    }
+
+    uci_free_context(ctx);
+
+    LOGI("vlan: %d VLAN networks provisioned, uplink %s%s", vlan_count(), vlan_eth,
+         vlan_switch ? " via switch0" : "");
+
+    vlan_ready = true;
+    vlan_flush_schedule();
+
+    return true;
+}
+
+void vlan_cleanup(void)
+{
+    struct vlan_vif *vif;
+    ds_tree_iter_t iter;
+
+    if (!vlan_ready)
+        return;
+
+    evsched_task_cancel_by_find(&vlan_flush_task, NULL, EVSCHED_FIND_BY_FUNC);
+
+    /* Persist what was asked for, the reload is left to the next start */
+    vlan_ready = false;
+    if (vlan_flush_pending)
+        vlan_flush();
+
+    ds_tree_foreach_iter(&vlan_vifs, vif, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(vif);
+    }
+}
@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "log.h"
+#include "const.h"
+#include "os_time.h"
+#include "worker.h"
+
+/* A loop iteration taking longer than this counts as a stall */
+#define WORKER_STALL_MS         50
+#define WORKER_REPORT_MS        (60 * 1000)
+
+extern char **environ;
+
+struct worker_loop_stats
+{
+    uint32_t        iterations;
+    uint32_t        stalls;         /* iterations over WORKER_STALL_MS */
+    int64_t         max_ms;
+    int64_t         total_ms;
+};
+
+struct worker_job
+{
+    worker_fn_t         fn;
+    worker_fn_t         done;
+    void                *arg;
+    struct worker_job   *next;
+};
+
+/* Submitted jobs, guarded by worker_lock */
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static struct worker_job *worker_head = NULL;
+static struct worker_job *worker_tail = NULL;
+static bool worker_stop = false;
+
+/* Finished jobs, pushed by the workers and drained by the loop */
+static struct worker_job *worker_done_list = NULL;
+
+static pthread_t worker_tids[WORKER_THREADS];
+static int worker_num = 0;
+static struct ev_loop *worker_loop = NULL;
+static ev_async worker_async;
+
+static ev_prepare worker_prepare;
+static ev_check worker_check;
+static int64_t worker_woken = 0;
+static int64_t worker_reported = 0;
+static struct worker_loop_stats worker_stats;
+
+static bool reload_running = false;
+static bool reload_pending = false;
+static worker_fn_t reload_done_fn = NULL;
+static void *reload_done_arg = NULL;
+
+static void worker_done_push(struct worker_job *job)
+{
+    struct worker_job *head = __atomic_load_n(&worker_done_list, __ATOMIC_RELAXED);
+
+    do
+    {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&worker_done_list, &head, job, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker_job *job;
+
+    pthread_mutex_lock(&worker_lock);
+    while (!worker_stop)
+    {
+        job = worker_head;
+        if (!job)
+        {
+            pthread_cond_wait(&worker_cond, &worker_lock);
+            continue;
+        }
+
+        worker_head = job->next;
+        if (!worker_head)
+            worker_tail = NULL;
+        pthread_mutex_unlock(&worker_lock);
+
+        job->fn(job->arg);
+
+        worker_done_push(job);
+        ev_async_send(worker_loop, &worker_async);
+
+        pthread_mutex_lock(&worker_lock);
+    }
+    pthread_mutex_unlock(&worker_lock);
+
+    return NULL;
+}
+
+static void worker_async_cb(struct ev_loop *loop, ev_async *w, int revents)
+{
+    struct worker_job *list;
+    struct worker_job *fifo = NULL;
+    struct worker_job *job;
+
+    list = __atomic_exchange_n(&worker_done_list, NULL, __ATOMIC_ACQUIRE);
+
+    /* The list is LIFO, restore completion order */
+    while (list)
+    {
+        job = list;
+        list = list->next;
+        job->next = fifo;
+        fifo = job;
+    }
+
+    while (fifo)
+    {
+        job = fifo;
+        fifo = fifo->next;
+        if (job->done)
+            job->done(job->arg);
+        free(job);
+    }
+}
+
+bool worker_submit(worker_fn_t fn, worker_fn_t done, void *arg)
+{
+    struct worker_job *job;
+
+    if (!worker_num)
+    {
+        /* No pool in this manager, run inline */
+        fn(arg);
+        if (done)
+            done(arg);
+        return true;
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+        return false;
+
+    job->fn = fn;
+    job->done = done;
+    job->arg = arg;
+
+    pthread_mutex_lock(&worker_lock);
+    if (worker_tail)
+        worker_tail->next = job;
+    else
+        worker_head = job;
+    worker_tail = job;
+    pthread_cond_signal(&worker_cond);
+    pthread_mutex_unlock(&worker_lock);
+
+    return true;
+}
+
+/* The loop woke up from poll, callbacks run until the next prepare */
+static void worker_check_cb(struct ev_loop *loop, ev_check *w, int revents)
+{
+    worker_woken = clock_mono_ms();
+}
+
+static void worker_prepare_cb(struct ev_loop *loop, ev_prepare *w, int revents)
+{
+    int64_t now = clock_mono_ms();
+    int64_t busy;
+
+    if (!worker_woken)
+        return;
+
+    busy = now - worker_woken;
+    worker_woken = 0;
+
+    worker_stats.iterations++;
+    worker_stats.total_ms += busy;
+    if (busy > worker_stats.max_ms)
+        worker_stats.max_ms = busy;
+    if (busy > WORKER_STALL_MS)
+        worker_stats.stalls++;
+
+    if (now - worker_reported < WORKER_REPORT_MS)
+        return;
+
+    if (worker_stats.stalls)
+    {
+        LOGI("loop: %u of %u iterations over %d ms, longest %lld ms",
+             worker_stats.stalls, worker_stats.iterations, WORKER_STALL_MS,
+             (long long)worker_stats.max_ms);
+    }
+
+    worker_reported = now;
+    memset(&worker_stats, 0, sizeof(worker_stats));
+}
+
+bool worker_init(struct ev_loop *loop)
+{
+    int i;
+
+    if (worker_num)
+        return true;
+
+    worker_loop = loop;
+    worker_stop = false;
+
+    ev_async_init(&worker_async, worker_async_cb);
+    ev_async_start(loop, &worker_async);
+
+    ev_check_init(&worker_check, worker_check_cb);
+    ev_check_start(loop, &worker_check);
+    ev_prepare_init(&worker_prepare, worker_prepare_cb);
+    ev_prepare_start(loop, &worker_prepare);
+    worker_reported = clock_mono_ms();
+
+    for (i = 0; i < WORKER_THREADS; i++)
+    {
+        if (pthread_create(&worker_tids[i], NULL, worker_thread, NULL))
+        {
+            LOGE("worker: failed to start thread %d", i);
+            break;
+        }
+        worker_num++;
+    }
+
+    LOGI("worker: %d threads", worker_num);
+
+    return worker_num > 0;
+}
+
+void worker_cleanup(void)
+{
+    struct worker_job *job;
+    int i;
+
+    if (!worker_loop)
+        return;
+
+    pthread_mutex_lock(&worker_lock);
+    worker_stop = true;
+    pthread_cond_broadcast(&worker_cond);
+    pthread_mutex_unlock(&worker_lock);
+
+    for (i = 0; i < worker_num; i++)
+        pthread_join(worker_tids[i], NULL);
+    worker_num = 0;
+
+    /* Jobs that never ran are dropped, finished ones still complete */
+    while (worker_head)
+    {
+        job = worker_head;
+        worker_head = job->next;
+        free(job);
+    }
+    worker_tail = NULL;
+
+    worker_async_cb(worker_loop, &worker_async, 0);
+
+    ev_async_stop(worker_loop, &worker_async);
+    ev_check_stop(worker_loop, &worker_check);
+    ev_prepare_stop(worker_loop, &worker_prepare);
+    worker_loop = NULL;
+}
+
+/*
+ * system() forks the whole manager and blocks SIGCHLD process wide while
+ * it waits, which is not safe from a worker. Spawn the command directly
+ * and reap only our own child. With a path, stdout goes to that file.
+ */
+int worker_exec_out(char *const argv[], const char *path)
+{
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+    int status;
+    int err;
+
+    posix_spawn_file_actions_init(&actions);
+    if (path)
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, path,
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err)
+    {
+        LOGW("%s: spawn failed: %s", argv[0], strerror(err));
+        return -1;
+    }
+
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            LOGW("%s: wait failed: %s", argv[0], strerror(errno));
+            return -1;
+        }
+    }
+
+    if (!WIFEXITED(status))
+        return -1;
+
+    return WEXITSTATUS(status);
+}
+
+int worker_exec(char *const argv[])
+{
+    return worker_exec_out(argv, NULL);
+}
+
+/*
+ * reload_config can take seconds when it restarts hostapd. Requests made
+ * while one runs are folded into a single follow-up run, which still
+ * sees every UCI change committed before it was asked for.
+ */
+static void reload_job(void *arg)
+{
+    char *const argv[] = { "reload_config", NULL };
+
+    if (worker_exec(argv) != 0)
+        LOGW("reload_config failed");
+}
+
+static void reload_done(void *arg)
+{
+    reload_running = false;
+
+    if (reload_pending)
+    {
+        worker_reload_config();
+        return;
+    }
+
+    /* No reload left to replace hostapd, see worker.h */
+    if (reload_done_fn)
+        reload_done_fn(reload_done_arg);
+}
+
+void worker_reload_done_set(worker_fn_t fn, void *arg)
+{
+    reload_done_fn = fn;
+    reload_done_arg = arg;
+}
+
+bool worker_reload_config(void)
+{
+    if (reload_running)
+    {
+        reload_pending = true;
+        return true;
+    }
+
+    reload_running = true;
+    reload_pending = false;
+
+    return worker_submit(reload_job, reload_done, NULL);
+}
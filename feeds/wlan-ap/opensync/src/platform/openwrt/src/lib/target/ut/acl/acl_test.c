@@ -0,0 +1,326 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * acl_vif_apply() and acl_resync() with stubbed UCI and hostapd. The
+ * stub hostapd knows which stations are associated and what its
+ * ACCEPT_ACL/DENY_ACL SHOW lists, the tests check the set diff it is
+ * sent, who gets kicked and the file ACL_FILE_FMT leaves in /tmp.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+
+#include "unity.h"
+#include "log.h"
+#include "const.h"
+#include "schema.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "acl.h"
+
+#define UT_IFNAME       "wlan0"
+#define UT_MAC_A        "aa:bb:cc:00:00:01"
+#define UT_MAC_B        "aa:bb:cc:00:00:02"
+#define UT_MAC_C        "aa:bb:cc:00:00:03"
+#define UT_MAX_CMDS     16
+
+static struct schema_Wifi_VIF_Config ut_vconf;
+static char ut_path[64];
+
+static char ut_uci_filter[16];
+static char ut_uci_file[64];
+static int ut_uci_sets;
+
+static char ut_hapd_cmds[UT_MAX_CMDS][64];
+static int ut_hapd_ncmds;
+static char ut_hapd_sta[18];        /* the one associated station */
+static char ut_hapd_show[256];
+static ino_t ut_hapd_ino;
+
+int wifi_getApMacFilter(int ssid_index, char *buf, size_t buf_len)
+{
+    if (!ut_uci_filter[0])
+        return UCI_ERR_NOTFOUND;
+
+    strscpy(buf, ut_uci_filter, buf_len);
+    return UCI_OK;
+}
+
+bool wifi_setApMacFilter(int ssid_index, const char *filter, const char *file)
+{
+    STRSCPY(ut_uci_filter, filter ? filter : "");
+    STRSCPY(ut_uci_file, file ? file : "");
+    ut_uci_sets++;
+    return true;
+}
+
+static void ut_hapd_record(const char *cmd)
+{
+    if (ut_hapd_ncmds < UT_MAX_CMDS)
+        STRSCPY(ut_hapd_cmds[ut_hapd_ncmds], cmd);
+    ut_hapd_ncmds++;
+}
+
+bool hostapd_cli_ok(const char *ifname, const char *cmd)
+{
+    ut_hapd_record(cmd);
+    return true;
+}
+
+/* Answers STA and SHOW, the only queries acl.c makes */
+int hostapd_cli(const char *ifname, const char *cmd, char *reply, size_t reply_len)
+{
+    if (!strncmp(cmd, "STA ", 4))
+    {
+        if (strcmp(cmd + 4, ut_hapd_sta))
+            return strscpy(reply, "FAIL\n", reply_len);
+        return snprintf(reply, reply_len, "%s\nflags=[AUTH][ASSOC]\n", ut_hapd_sta);
+    }
+
+    ut_hapd_record(cmd);
+    return strscpy(reply, ut_hapd_show, reply_len);
+}
+
+ino_t hostapd_ctrl_ino(const char *ifname)
+{
+    return ut_hapd_ino;
+}
+
+static void ut_list(const char *type, int n, ...)
+{
+    va_list ap;
+    int i;
+
+    STRSCPY(ut_vconf.mac_list_type, type);
+    ut_vconf.mac_list_type_exists = true;
+
+    va_start(ap, n);
+    for (i = 0; i < n; i++)
+        STRSCPY(ut_vconf.mac_list[i], va_arg(ap, const char *));
+    va_end(ap);
+    ut_vconf.mac_list_len = n;
+}
+
+static int ut_file_lines(void)
+{
+    char line[64];
+    int num = 0;
+    FILE *f;
+
+    f = fopen(ut_path, "r");
+    if (!f)
+        return -1;
+
+    while (fgets(line, sizeof(line), f))
+        num++;
+    fclose(f);
+
+    return num;
+}
+
+static bool ut_sent(const char *cmd)
+{
+    int i;
+
+    for (i = 0; i < ut_hapd_ncmds && i < UT_MAX_CMDS; i++)
+        if (!strcmp(ut_hapd_cmds[i], cmd))
+            return true;
+
+    return false;
+}
+
+void setUp(void)
+{
+    snprintf(ut_path, sizeof(ut_path), ACL_FILE_FMT, UT_IFNAME);
+    unlink(ut_path);
+
+    memset(&ut_vconf, 0, sizeof(ut_vconf));
+    STRSCPY(ut_vconf.if_name, UT_IFNAME);
+
+    ut_uci_filter[0] = '\0';
+    ut_uci_file[0] = '\0';
+    ut_uci_sets = 0;
+    ut_hapd_ncmds = 0;
+    ut_hapd_sta[0] = '\0';
+    ut_hapd_show[0] = '\0';
+    ut_hapd_ino = 1;
+}
+
+void tearDown(void)
+{
+    acl_cleanup();
+    unlink(ut_path);
+}
+
+void test_policy_goes_to_uci(void)
+{
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_B);
+
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    /* A new policy means a new hostapd, nothing is pushed */
+    TEST_ASSERT_EQUAL_INT(1, ut_uci_sets);
+    TEST_ASSERT_EQUAL_STRING("allow", ut_uci_filter);
+    TEST_ASSERT_EQUAL_STRING(ut_path, ut_uci_file);
+    TEST_ASSERT_EQUAL_INT(2, ut_file_lines());
+    TEST_ASSERT_EQUAL_INT(2, acl_vif_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+void test_unchanged_list_not_pushed(void)
+{
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_B);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    /* Same set, different case and order */
+    ut_list("whitelist", 2, "AA:BB:CC:00:00:02", UT_MAC_A);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(1, ut_uci_sets);
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+void test_whitelist_diff(void)
+{
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_B);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    STRSCPY(ut_hapd_sta, UT_MAC_B);
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_C);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    /* B lost access while associated */
+    TEST_ASSERT_EQUAL_INT(3, ut_hapd_ncmds);
+    TEST_ASSERT_TRUE(ut_sent("ACCEPT_ACL DEL_MAC " UT_MAC_B));
+    TEST_ASSERT_TRUE(ut_sent("DEAUTHENTICATE " UT_MAC_B));
+    TEST_ASSERT_TRUE(ut_sent("ACCEPT_ACL ADD_MAC " UT_MAC_C));
+    TEST_ASSERT_EQUAL_INT(1, ut_uci_sets);
+    TEST_ASSERT_EQUAL_INT(2, ut_file_lines());
+}
+
+void test_blacklist_add_kicks_associated_only(void)
+{
+    ut_list("blacklist", 1, UT_MAC_A);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    STRSCPY(ut_hapd_sta, UT_MAC_B);
+    ut_list("blacklist", 3, UT_MAC_A, UT_MAC_B, UT_MAC_C);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(3, ut_hapd_ncmds);
+    TEST_ASSERT_TRUE(ut_sent("DENY_ACL ADD_MAC " UT_MAC_B));
+    TEST_ASSERT_TRUE(ut_sent("DEAUTHENTICATE " UT_MAC_B));
+    TEST_ASSERT_TRUE(ut_sent("DENY_ACL ADD_MAC " UT_MAC_C));
+
+    /* Coming off the blacklist takes no kick */
+    ut_hapd_ncmds = 0;
+    ut_list("blacklist", 1, UT_MAC_A);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(2, ut_hapd_ncmds);
+    TEST_ASSERT_TRUE(ut_sent("DENY_ACL DEL_MAC " UT_MAC_B));
+    TEST_ASSERT_TRUE(ut_sent("DENY_ACL DEL_MAC " UT_MAC_C));
+}
+
+void test_malformed_ignored(void)
+{
+    ut_list("blacklist", 3, UT_MAC_A, "aa:bb:cc:00:00", "aa:bb:cc:00:0g:02");
+
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(1, acl_vif_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(1, ut_file_lines());
+}
+
+void test_disabled(void)
+{
+    ut_list("whitelist", 1, UT_MAC_A);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    ut_list("none", 0);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(2, ut_uci_sets);
+    TEST_ASSERT_EQUAL_STRING("", ut_uci_filter);
+    TEST_ASSERT_EQUAL_INT(-1, ut_file_lines());
+    TEST_ASSERT_EQUAL_INT(0, acl_vif_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+/* Restored from UCI and the file after a manager restart */
+void test_restored_state_diffed(void)
+{
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_B);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+    acl_cleanup();
+
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_C);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(1, ut_uci_sets);
+    TEST_ASSERT_EQUAL_INT(2, ut_hapd_ncmds);
+    TEST_ASSERT_TRUE(ut_sent("ACCEPT_ACL DEL_MAC " UT_MAC_B));
+    TEST_ASSERT_TRUE(ut_sent("ACCEPT_ACL ADD_MAC " UT_MAC_C));
+}
+
+void test_resync_same_instance(void)
+{
+    ut_list("whitelist", 1, UT_MAC_A);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_B);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+    ut_hapd_ncmds = 0;
+
+    acl_resync();
+
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+/* A new instance read an old file: its list is diffed, not reloaded */
+void test_resync_new_instance(void)
+{
+    ut_list("whitelist", 1, UT_MAC_A);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+    ut_list("whitelist", 2, UT_MAC_A, UT_MAC_B);
+    TEST_ASSERT_TRUE(acl_vif_apply(0, &ut_vconf));
+    ut_hapd_ncmds = 0;
+
+    ut_hapd_ino++;
+    STRSCPY(ut_hapd_sta, UT_MAC_C);
+    STRSCPY(ut_hapd_show, UT_MAC_A " VLAN_ID=0\n" UT_MAC_C " VLAN_ID=0\n");
+    acl_resync();
+
+    TEST_ASSERT_EQUAL_INT(4, ut_hapd_ncmds);
+    TEST_ASSERT_TRUE(ut_sent("ACCEPT_ACL SHOW"));
+    TEST_ASSERT_TRUE(ut_sent("ACCEPT_ACL DEL_MAC " UT_MAC_C));
+    TEST_ASSERT_TRUE(ut_sent("DEAUTHENTICATE " UT_MAC_C));
+    TEST_ASSERT_TRUE(ut_sent("ACCEPT_ACL ADD_MAC " UT_MAC_B));
+
+    /* In sync with that instance now */
+    ut_hapd_ncmds = 0;
+    acl_resync();
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+int main(int argc, char *argv[])
+{
+    log_open("TARGET_ACL_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_policy_goes_to_uci);
+    RUN_TEST(test_unchanged_list_not_pushed);
+    RUN_TEST(test_whitelist_diff);
+    RUN_TEST(test_blacklist_add_kicks_associated_only);
+    RUN_TEST(test_malformed_ignored);
+    RUN_TEST(test_disabled);
+    RUN_TEST(test_restored_state_diffed);
+    RUN_TEST(test_resync_same_instance);
+    RUN_TEST(test_resync_new_instance);
+
+    return UNITY_END();
+}
@@ -0,0 +1,560 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * ACS replayed from recorded data.
+ *
+ * Each fixture holds two consecutive survey dumps of a radio, 10 s apart,
+ * and the scan results seen at the same time. They go through the same
+ * acs_survey_apply() and acs_nbr_apply() the background task uses, then
+ * through acs_score() and acs_select(). The last tests run the task itself
+ * on the 5 GHz recording to check what "auto" mode does with DFS channels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "log.h"
+#include "const.h"
+#include "evsched.h"
+#include "uci_helper.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "nbr.h"
+#include "thermal.h"
+#include "acs.h"
+
+#define UT_MAX_SWITCHES     8
+
+struct ut_survey_rec
+{
+    int             chan;
+    bool            radar;
+    bool            cac_done;
+    uint64_t        time[2];    /* ms, cumulative */
+    uint64_t        busy[2];
+    uint64_t        tx[2];
+};
+
+struct ut_fixture
+{
+    const struct ut_survey_rec  *survey;
+    int                         n_survey;
+    const struct wifi_nbr       *nbrs;
+    int                         n_nbrs;
+};
+
+/* 2.4 GHz, apartment block, operating on 1 */
+static const struct ut_survey_rec ut_24g_survey[] =
+{
+    {  1, false, false, { 412300, 422300 }, { 201000, 207000 }, { 80500, 82500 } },
+    {  2, false, false, { 412300, 422300 }, { 150000, 154000 }, { 0, 0 } },
+    {  3, false, false, { 412300, 422300 }, { 120000, 123000 }, { 0, 0 } },
+    {  4, false, false, { 412300, 422300 }, {  99000, 101500 }, { 0, 0 } },
+    {  5, false, false, { 412300, 422300 }, { 110000, 113000 }, { 0, 0 } },
+    {  6, false, false, { 412300, 422300 }, { 180000, 184500 }, { 0, 0 } },
+    {  7, false, false, { 412300, 422300 }, { 121000, 124000 }, { 0, 0 } },
+    {  8, false, false, { 412300, 422300 }, {  90000,  92000 }, { 0, 0 } },
+    {  9, false, false, { 412300, 422300 }, {  70000,  71500 }, { 0, 0 } },
+    { 10, false, false, { 412300, 422300 }, {  60000,  61200 }, { 0, 0 } },
+    { 11, false, false, { 412300, 422300 }, {  41000,  42000 }, { 0, 0 } },
+};
+
+static const struct wifi_nbr ut_24g_nbrs[] =
+{
+    { .bssid = "0a:00:00:00:01:01", .ssid = "flat-12",  .primary = 1,  .lo = 1,  .hi = 1,  .rssi = -45, .load = 70 },
+    { .bssid = "0a:00:00:00:06:01", .ssid = "flat-7",   .primary = 6,  .lo = 6,  .hi = 6,  .rssi = -60, .load = 40 },
+    { .bssid = "0a:00:00:00:06:02", .ssid = "printer",  .primary = 6,  .lo = 6,  .hi = 6,  .rssi = -70, .load = -1 },
+    { .bssid = "0a:00:00:00:0b:01", .ssid = "flat-31",  .primary = 11, .lo = 11, .hi = 11, .rssi = -88, .load = -1 },
+};
+
+/*
+ * 5 GHz office on 36/80. 52-64 passed their CAC already, 100-140 would
+ * need one, 144 is not allowed.
+ */
+static const struct ut_survey_rec ut_5g_survey[] =
+{
+    {  36, false, false, { 905000, 915000 }, { 300000, 303500 }, { 120000, 121500 } },
+    {  40, false, false, { 905000, 915000 }, { 310000, 313500 }, { 0, 0 } },
+    {  44, false, false, { 905000, 915000 }, { 310000, 313500 }, { 0, 0 } },
+    {  48, false, false, { 905000, 915000 }, { 310000, 313500 }, { 0, 0 } },
+    {  52, true,  true,  { 905000, 915000 }, { 230000, 232500 }, { 0, 0 } },
+    {  56, true,  true,  { 905000, 915000 }, { 230000, 232500 }, { 0, 0 } },
+    {  60, true,  true,  { 905000, 915000 }, { 230000, 232500 }, { 0, 0 } },
+    {  64, true,  true,  { 905000, 915000 }, { 230000, 232500 }, { 0, 0 } },
+    { 100, true,  false, { 905000, 915000 }, {  20000,  20200 }, { 0, 0 } },
+    { 104, true,  false, { 905000, 915000 }, {  20000,  20200 }, { 0, 0 } },
+    { 108, true,  false, { 905000, 915000 }, {  20000,  20200 }, { 0, 0 } },
+    { 112, true,  false, { 905000, 915000 }, {  20000,  20200 }, { 0, 0 } },
+    { 116, true,  false, { 905000, 915000 }, {  45000,  45500 }, { 0, 0 } },
+    { 120, true,  false, { 905000, 915000 }, {  45000,  45500 }, { 0, 0 } },
+    { 124, true,  false, { 905000, 915000 }, {  45000,  45500 }, { 0, 0 } },
+    { 128, true,  false, { 905000, 915000 }, {  45000,  45500 }, { 0, 0 } },
+    { 132, true,  false, { 905000, 915000 }, {  27000,  27300 }, { 0, 0 } },
+    { 136, true,  false, { 905000, 915000 }, {  27000,  27300 }, { 0, 0 } },
+    { 140, true,  false, { 905000, 915000 }, {  27000,  27300 }, { 0, 0 } },
+    { 149, false, false, { 905000, 915000 }, { 270000, 273000 }, { 0, 0 } },
+    { 153, false, false, { 905000, 915000 }, { 270000, 273000 }, { 0, 0 } },
+    { 157, false, false, { 905000, 915000 }, { 270000, 273000 }, { 0, 0 } },
+    { 161, false, false, { 905000, 915000 }, { 270000, 273000 }, { 0, 0 } },
+    { 165, false, false, { 905000, 915000 }, { 450000, 455000 }, { 0, 0 } },
+};
+
+static const struct wifi_nbr ut_5g_nbrs[] =
+{
+    { .bssid = "0e:00:00:00:24:01", .ssid = "corp",     .primary = 36,  .lo = 36,  .hi = 48,  .rssi = -55, .load = 60 },
+    { .bssid = "0e:00:00:00:34:01", .ssid = "lab",      .primary = 52,  .lo = 52,  .hi = 56,  .rssi = -80, .load = -1 },
+    { .bssid = "0e:00:00:00:95:01", .ssid = "cafe",     .primary = 149, .lo = 149, .hi = 161, .rssi = -65, .load = 30 },
+};
+
+static const struct ut_fixture ut_24g = { ut_24g_survey, ARRAY_SIZE(ut_24g_survey), ut_24g_nbrs, ARRAY_SIZE(ut_24g_nbrs) };
+static const struct ut_fixture ut_5g = { ut_5g_survey, ARRAY_SIZE(ut_5g_survey), ut_5g_nbrs, ARRAY_SIZE(ut_5g_nbrs) };
+
+static struct wifi_nbr ut_nbr_copy[16];
+static ds_tree_t ut_nbrs;
+
+/* What the background task sees */
+static evsched_task_t *ut_task;
+static const struct ut_fixture *ut_radio;
+static struct wifi_phy ut_phy;
+static char ut_mode[16];
+static int ut_round;
+static int ut_switch_chan[UT_MAX_SWITCHES];
+static char ut_switch_mode[UT_MAX_SWITCHES][16];
+static int ut_switches;
+
+int wifi_getRadioNumberOfEntries(int *numberOfEntries)
+{
+    *numberOfEntries = 1;
+    return UCI_OK;
+}
+
+int wifi_getRadioAcsMode(int radio_idx, char *mode, size_t mode_len)
+{
+    strscpy(mode, ut_mode, mode_len);
+    return UCI_OK;
+}
+
+int wifi_getRadioPhyName(int radio_idx, char *phy_name, size_t phy_name_len)
+{
+    strscpy(phy_name, "phy0", phy_name_len);
+    return UCI_OK;
+}
+
+int wifi_getRadioHtMode(int radio_idx, char *ht_mode)
+{
+    strcpy(ht_mode, "HT80");
+    return UCI_OK;
+}
+
+int thermal_max_width(int radioIndex)
+{
+    return 0;
+}
+
+bool radio_channel_switch(int radioIndex, int channel, const char *ht_mode)
+{
+    if (ut_switches < UT_MAX_SWITCHES)
+    {
+        ut_switch_chan[ut_switches] = channel;
+        STRSCPY(ut_switch_mode[ut_switches], ht_mode);
+    }
+    ut_switches++;
+    return true;
+}
+
+struct wifi_phy *phy_get(const char *name)
+{
+    return &ut_phy;
+}
+
+bool phy_get_oper(const char *name, struct wifi_oper *oper)
+{
+    memset(oper, 0, sizeof(*oper));
+    STRSCPY(oper->ifname, "wlan0");
+    oper->channel = ut_radio->survey[0].chan;
+    oper->width = oper->channel <= 14 ? NL80211_CHAN_WIDTH_20 : NL80211_CHAN_WIDTH_80;
+    return true;
+}
+
+int phy_freq_to_channel(uint32_t freq)
+{
+    if (freq >= 2412 && freq < 2484)
+        return (freq - 2407) / 5;
+    if (freq >= 5000 && freq < 5950)
+        return (freq - 5000) / 5;
+    return 0;
+}
+
+static uint32_t ut_freq(int chan)
+{
+    return chan <= 14 ? 2407 + chan * 5 : 5000 + chan * 5;
+}
+
+/* Round r of the recording, the counters keep their recorded pace after the second */
+static uint64_t ut_counter(const uint64_t *v, int round)
+{
+    return round ? v[1] + (round - 1) * (v[1] - v[0]) : v[0];
+}
+
+static int ut_survey_fill(const struct ut_fixture *fx, int round, struct wifi_survey *survey)
+{
+    const struct ut_survey_rec *rec;
+    int i;
+
+    for (i = 0; i < fx->n_survey; i++)
+    {
+        rec = &fx->survey[i];
+        memset(&survey[i], 0, sizeof(survey[i]));
+        survey[i].freq = ut_freq(rec->chan);
+        survey[i].time = ut_counter(rec->time, round);
+        survey[i].busy = ut_counter(rec->busy, round);
+        survey[i].tx = ut_counter(rec->tx, round);
+    }
+
+    return fx->n_survey;
+}
+
+int phy_survey_get(const char *ifname, struct wifi_survey *survey, int max)
+{
+    return ut_survey_fill(ut_radio, ut_round++, survey);
+}
+
+bool nbr_init(void)
+{
+    return true;
+}
+
+void nbr_refresh(const char *phy, const char *ifname)
+{
+}
+
+ds_tree_t *nbr_get(const char *phy)
+{
+    return &ut_nbrs;
+}
+
+bool evsched_task(evsched_task_t *task, void *ctx, uint64_t ms)
+{
+    ut_task = task;
+    return true;
+}
+
+bool evsched_task_reschedule_ms(uint64_t ms)
+{
+    return true;
+}
+
+bool evsched_task_cancel_by_find(evsched_task_t *task, void *ctx, int flags)
+{
+    ut_task = NULL;
+    return true;
+}
+
+static void ut_nbrs_load(const struct ut_fixture *fx)
+{
+    int i;
+
+    ds_tree_init(&ut_nbrs, ds_str_cmp, struct wifi_nbr, node);
+    for (i = 0; i < fx->n_nbrs; i++)
+    {
+        ut_nbr_copy[i] = fx->nbrs[i];
+        ds_tree_insert(&ut_nbrs, &ut_nbr_copy[i], ut_nbr_copy[i].bssid);
+    }
+}
+
+static void ut_phy_load(const struct ut_fixture *fx)
+{
+    struct wifi_chan *c;
+    int i;
+
+    memset(&ut_phy, 0, sizeof(ut_phy));
+    STRSCPY(ut_phy.name, "phy0");
+    for (i = 0; i < fx->n_survey; i++)
+    {
+        c = &ut_phy.chans[ut_phy.n_chans++];
+        c->chan = fx->survey[i].chan;
+        c->freq = ut_freq(c->chan);
+        c->radar = fx->survey[i].radar;
+        c->dfs_state = fx->survey[i].cac_done ? NL80211_DFS_AVAILABLE : NL80211_DFS_USABLE;
+    }
+}
+
+/* The channel list as the task builds it, then both recorded dumps applied */
+static int ut_chans_load(const struct ut_fixture *fx, struct acs_chan *chans)
+{
+    struct wifi_survey prev[PHY_MAX_CHANNELS];
+    struct wifi_survey cur[PHY_MAX_CHANNELS];
+    int i;
+
+    for (i = 0; i < fx->n_survey; i++)
+    {
+        memset(&chans[i], 0, sizeof(chans[i]));
+        chans[i].chan = fx->survey[i].chan;
+        chans[i].needs_cac = fx->survey[i].radar && !fx->survey[i].cac_done;
+    }
+
+    ut_survey_fill(fx, 0, prev);
+    ut_survey_fill(fx, 1, cur);
+    acs_survey_apply(chans, fx->n_survey, cur, fx->n_survey, prev, fx->n_survey);
+
+    ut_nbrs_load(fx);
+    acs_nbr_apply(chans, fx->n_survey, &ut_nbrs);
+
+    return fx->n_survey;
+}
+
+static const struct acs_chan *ut_chan(const struct acs_chan *chans, int n, int chan)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (chans[i].chan == chan)
+            return &chans[i];
+    }
+
+    TEST_FAIL_MESSAGE("channel not in fixture");
+    return NULL;
+}
+
+static void ut_task_run(const struct ut_fixture *fx, const char *mode, int rounds)
+{
+    ut_radio = fx;
+    ut_phy_load(fx);
+    ut_nbrs_load(fx);
+    STRSCPY(ut_mode, mode);
+
+    TEST_ASSERT_TRUE(acs_init());
+    TEST_ASSERT_NOT_NULL(ut_task);
+    while (rounds--)
+        ut_task(NULL);
+}
+
+void setUp(void)
+{
+    ut_task = NULL;
+    ut_round = 0;
+    ut_switches = 0;
+}
+
+void tearDown(void)
+{
+    acs_cleanup();
+}
+
+void test_survey_delta(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    int n;
+
+    n = ut_chans_load(&ut_24g, chans);
+
+    /* Our own transmissions are not someone else's air time */
+    TEST_ASSERT_EQUAL_INT(40, ut_chan(chans, n, 1)->busy);
+    TEST_ASSERT_EQUAL_INT(45, ut_chan(chans, n, 6)->busy);
+    TEST_ASSERT_EQUAL_INT(10, ut_chan(chans, n, 11)->busy);
+}
+
+void test_survey_counter_reset(void)
+{
+    struct wifi_survey prev[PHY_MAX_CHANNELS];
+    struct wifi_survey cur[PHY_MAX_CHANNELS];
+    struct acs_chan chan = { .chan = 6 };
+
+    /* A driver reset: the cumulative counters are used instead of a delta */
+    ut_survey_fill(&ut_24g, 1, prev);
+    ut_survey_fill(&ut_24g, 1, cur);
+    cur[5].time = 10000;
+    cur[5].busy = 2000;
+    cur[5].tx = 0;
+    acs_survey_apply(&chan, 1, cur, ut_24g.n_survey, prev, ut_24g.n_survey);
+
+    TEST_ASSERT_EQUAL_INT(20, chan.busy);
+}
+
+void test_neighbor_cost(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    int n;
+
+    n = ut_chans_load(&ut_24g, chans);
+
+    /* -45 dBm costs the full 20, 2.4 GHz overlap fades over 4 channels */
+    TEST_ASSERT_EQUAL_INT(20, ut_chan(chans, n, 1)->nbr_cost);
+    TEST_ASSERT_EQUAL_INT(16 + 3 + 2, ut_chan(chans, n, 2)->nbr_cost);
+    TEST_ASSERT_EQUAL_INT(29, ut_chan(chans, n, 6)->nbr_cost);
+    TEST_ASSERT_EQUAL_INT(3, ut_chan(chans, n, 11)->nbr_cost);
+    TEST_ASSERT_EQUAL_INT(70, ut_chan(chans, n, 1)->bss_load);
+    TEST_ASSERT_EQUAL_INT(0, ut_chan(chans, n, 11)->bss_load);
+
+    n = ut_chans_load(&ut_5g, chans);
+
+    /* Secondary channels of a wide neighbor cost half */
+    TEST_ASSERT_EQUAL_INT(20, ut_chan(chans, n, 36)->nbr_cost);
+    TEST_ASSERT_EQUAL_INT(10, ut_chan(chans, n, 44)->nbr_cost);
+    TEST_ASSERT_EQUAL_INT(0, ut_chan(chans, n, 100)->nbr_cost);
+}
+
+void test_score_24g(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    int n;
+
+    n = ut_chans_load(&ut_24g, chans);
+
+    TEST_ASSERT_EQUAL_INT(5, acs_score(chans, n, 1, 20));
+    TEST_ASSERT_EQUAL_INT(87, acs_score(chans, n, 11, 20));
+    TEST_ASSERT_EQUAL_INT(-1, acs_score(chans, n, 11, 80));
+}
+
+void test_score_5g_dfs(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    int n;
+
+    n = ut_chans_load(&ut_5g, chans);
+
+    TEST_ASSERT_EQUAL_INT(196, acs_score(chans, n, 36, 80));
+    /* The same block from any of its channels */
+    TEST_ASSERT_EQUAL_INT(196, acs_score(chans, n, 44, 80));
+    TEST_ASSERT_EQUAL_INT(292, acs_score(chans, n, 52, 80));
+    /* Idle, but the CAC costs 20 on every channel */
+    TEST_ASSERT_EQUAL_INT(312, acs_score(chans, n, 100, 80));
+    /* No 144, no 132/80 */
+    TEST_ASSERT_EQUAL_INT(-1, acs_score(chans, n, 132, 80));
+    TEST_ASSERT_EQUAL_INT(-1, acs_score(chans, n, 165, 40));
+    TEST_ASSERT_EQUAL_INT(616, acs_score(chans, n, 100, 160));
+}
+
+void test_select_24g(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    struct acs_result res;
+    int n;
+
+    n = ut_chans_load(&ut_24g, chans);
+
+    TEST_ASSERT_TRUE(acs_select(chans, n, 1, 20, 20, &res));
+    TEST_ASSERT_EQUAL_INT(11, res.channel);
+    TEST_ASSERT_EQUAL_INT(20, res.width);
+    TEST_ASSERT_EQUAL_INT(87, res.score);
+    TEST_ASSERT_EQUAL_INT(5, res.cur_score);
+    TEST_ASSERT_FALSE(res.needs_cac);
+    TEST_ASSERT_TRUE(res.switch_recommended);
+}
+
+void test_select_5g_recommends_cac(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    struct acs_result res;
+    int n;
+
+    n = ut_chans_load(&ut_5g, chans);
+
+    TEST_ASSERT_TRUE(acs_select(chans, n, 36, 80, 80, &res));
+    TEST_ASSERT_EQUAL_INT(100, res.channel);
+    TEST_ASSERT_EQUAL_INT(80, res.width);
+    TEST_ASSERT_TRUE(res.needs_cac);
+    TEST_ASSERT_TRUE(res.switch_recommended);
+}
+
+void test_select_hysteresis(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    struct acs_result res;
+    int n;
+
+    n = ut_chans_load(&ut_5g, chans);
+
+    /* 116/80 scores 300, 100/80 is not 25% better */
+    TEST_ASSERT_TRUE(acs_select(chans, n, 116, 80, 80, &res));
+    TEST_ASSERT_EQUAL_INT(100, res.channel);
+    TEST_ASSERT_EQUAL_INT(300, res.cur_score);
+    TEST_ASSERT_FALSE(res.switch_recommended);
+}
+
+void test_select_current_unusable(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    struct acs_result res;
+    int n;
+    int i;
+
+    n = ut_chans_load(&ut_5g, chans);
+
+    /* Radar on 52: the block goes into NOP */
+    for (i = 0; i < n; i++)
+    {
+        if (chans[i].chan >= 52 && chans[i].chan <= 64)
+            chans[i].excluded = true;
+    }
+
+    TEST_ASSERT_TRUE(acs_select(chans, n, 52, 80, 80, &res));
+    TEST_ASSERT_EQUAL_INT(-1, res.cur_score);
+    TEST_ASSERT_TRUE(res.switch_recommended);
+}
+
+void test_select_nothing_usable(void)
+{
+    struct acs_chan chans[PHY_MAX_CHANNELS];
+    struct acs_result res;
+    int n;
+    int i;
+
+    n = ut_chans_load(&ut_24g, chans);
+    for (i = 0; i < n; i++)
+        chans[i].excluded = true;
+
+    TEST_ASSERT_FALSE(acs_select(chans, n, 1, 20, 20, &res));
+}
+
+void test_auto_skips_cac_channels(void)
+{
+    struct acs_result res;
+
+    ut_task_run(&ut_5g, "auto", 5);
+
+    /* The CSA can't reach 100, the best block without a CAC is taken */
+    TEST_ASSERT_TRUE(acs_get(0, &res));
+    TEST_ASSERT_EQUAL_INT(52, res.channel);
+    TEST_ASSERT_FALSE(res.needs_cac);
+    TEST_ASSERT_EQUAL_INT(1, ut_switches);
+    TEST_ASSERT_EQUAL_INT(52, ut_switch_chan[0]);
+    TEST_ASSERT_EQUAL_STRING("HT80", ut_switch_mode[0]);
+}
+
+void test_recommend_reports_cac(void)
+{
+    struct acs_result res;
+
+    ut_task_run(&ut_5g, "recommend", 5);
+
+    TEST_ASSERT_TRUE(acs_get(0, &res));
+    TEST_ASSERT_EQUAL_INT(100, res.channel);
+    TEST_ASSERT_TRUE(res.needs_cac);
+    TEST_ASSERT_TRUE(res.switch_recommended);
+    TEST_ASSERT_EQUAL_INT(0, ut_switches);
+}
+
+int main(int argc, char *argv[])
+{
+    log_open("TARGET_ACS_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_survey_delta);
+    RUN_TEST(test_survey_counter_reset);
+    RUN_TEST(test_neighbor_cost);
+    RUN_TEST(test_score_24g);
+    RUN_TEST(test_score_5g_dfs);
+    RUN_TEST(test_select_24g);
+    RUN_TEST(test_select_5g_recommends_cac);
+    RUN_TEST(test_select_hysteresis);
+    RUN_TEST(test_select_current_unusable);
+    RUN_TEST(test_select_nothing_usable);
+    RUN_TEST(test_auto_skips_cac_channels);
+    RUN_TEST(test_recommend_reports_cac);
+    return UNITY_END();
+}
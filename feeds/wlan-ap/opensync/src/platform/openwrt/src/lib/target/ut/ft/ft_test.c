@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * FT mode selection and key holder generation with stubbed hostapd: the
+ * r0kh/r1kh entries ft_vif_apply() pushes for the "ft_peer-<n>" BSSIDs,
+ * and which of them a restarted hostapd gets again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "log.h"
+#include "const.h"
+#include "schema.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "rtnl.h"
+#include "ft.h"
+
+#define UT_IFNAME       "wlan0"
+#define UT_OWN          "02:00:00:00:00:01"
+#define UT_PEER_A       "02:00:00:00:00:0a"
+#define UT_PEER_B       "02:00:00:00:00:0b"
+#define UT_KEY          "000102030405060708090a0b0c0d0e0f"
+#define UT_MAX_CMDS     16
+
+static struct schema_Wifi_VIF_Config ut_vconf;
+
+static char ut_hapd_cmds[UT_MAX_CMDS][160];
+static int ut_hapd_ncmds;
+static ino_t ut_hapd_ino;
+static time_t ut_hapd_start;
+
+int rtnl_link_addr(const char *ifname, char *mac, size_t len)
+{
+    strscpy(mac, UT_OWN, len);
+    return 0;
+}
+
+bool hostapd_cli_ok(const char *ifname, const char *cmd)
+{
+    if (ut_hapd_ncmds < UT_MAX_CMDS)
+        STRSCPY(ut_hapd_cmds[ut_hapd_ncmds], cmd);
+    ut_hapd_ncmds++;
+    return true;
+}
+
+ino_t hostapd_ctrl_ino(const char *ifname)
+{
+    return ut_hapd_ino;
+}
+
+time_t hostapd_ctrl_start(const char *ifname)
+{
+    return ut_hapd_start;
+}
+
+static void ut_security_add(const char *key, const char *val)
+{
+    STRSCPY(ut_vconf.security_keys[ut_vconf.security_len], key);
+    STRSCPY(ut_vconf.security[ut_vconf.security_len], val);
+    ut_vconf.security_len++;
+}
+
+static bool ut_sent(const char *cmd)
+{
+    int i;
+
+    for (i = 0; i < ut_hapd_ncmds && i < UT_MAX_CMDS; i++)
+        if (!strcmp(ut_hapd_cmds[i], cmd))
+            return true;
+
+    return false;
+}
+
+void setUp(void)
+{
+    memset(&ut_vconf, 0, sizeof(ut_vconf));
+    STRSCPY(ut_vconf.if_name, UT_IFNAME);
+    ut_vconf.ft_mobility_domain_exists = true;
+    ut_vconf.ft_mobility_domain = 0x4f57;
+    ut_security_add(OVSDB_SECURITY_ENCRYPTION, OVSDB_SECURITY_ENCRYPTION_WPA_EAP);
+
+    ut_hapd_ncmds = 0;
+    ut_hapd_ino = 1;
+    /* Running since before the config was applied */
+    ut_hapd_start = time(NULL) - 60;
+
+    TEST_ASSERT_TRUE(ft_init());
+}
+
+void tearDown(void)
+{
+    ft_cleanup();
+}
+
+void test_nas_id(void)
+{
+    char nas_id[FT_NAS_ID_LEN];
+
+    ft_nas_id("02:1a:2b:3c:4d:5e", nas_id);
+
+    TEST_ASSERT_EQUAL_STRING("021a2b3c4d5e", nas_id);
+}
+
+void test_mode(void)
+{
+    const char *key;
+
+    /* WPA-EAP can't derive keys locally */
+    TEST_ASSERT_EQUAL_INT(FT_MODE_OFF, ft_vif_mode(&ut_vconf, &key));
+
+    ut_security_add(OVSDB_SECURITY_FT_KEY, "0001");
+    TEST_ASSERT_EQUAL_INT(FT_MODE_OFF, ft_vif_mode(&ut_vconf, &key));
+
+    STRSCPY(ut_vconf.security[1], UT_KEY);
+    TEST_ASSERT_EQUAL_INT(FT_MODE_KEYS, ft_vif_mode(&ut_vconf, &key));
+    TEST_ASSERT_EQUAL_STRING(UT_KEY, key);
+
+    STRSCPY(ut_vconf.security[0], OVSDB_SECURITY_ENCRYPTION_WPA_PSK);
+    ut_vconf.security_len = 1;
+    TEST_ASSERT_EQUAL_INT(FT_MODE_LOCAL, ft_vif_mode(&ut_vconf, &key));
+    TEST_ASSERT_NULL(key);
+
+    ut_vconf.ft_mobility_domain = 0;
+    TEST_ASSERT_EQUAL_INT(FT_MODE_OFF, ft_vif_mode(&ut_vconf, &key));
+}
+
+void test_peers_normalized_own_left_out(void)
+{
+    char peers[FT_MAX_PEERS][18];
+
+    ut_security_add(FT_PEER_PREFIX "1", "02:00:00:00:00:0A");
+    ut_security_add(FT_PEER_PREFIX "2", UT_OWN);
+    ut_security_add(FT_PEER_PREFIX "3", "not-a-mac");
+    ut_security_add(FT_PEER_PREFIX "4", UT_PEER_B);
+
+    TEST_ASSERT_EQUAL_INT(2, ft_vif_peers(&ut_vconf, peers, FT_MAX_PEERS));
+    TEST_ASSERT_EQUAL_STRING(UT_PEER_A, peers[0]);
+    TEST_ASSERT_EQUAL_STRING(UT_PEER_B, peers[1]);
+}
+
+void test_key_holders_pushed(void)
+{
+    ut_security_add(OVSDB_SECURITY_FT_KEY, UT_KEY);
+    ut_security_add(FT_PEER_PREFIX "1", UT_PEER_A);
+    ut_security_add(FT_PEER_PREFIX "2", UT_PEER_B);
+
+    TEST_ASSERT_TRUE(ft_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(2, ft_peer_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(4, ut_hapd_ncmds);
+    TEST_ASSERT_EQUAL_STRING("SET r0kh " UT_PEER_A " 02000000000a " UT_KEY, ut_hapd_cmds[0]);
+    TEST_ASSERT_EQUAL_STRING("SET r1kh " UT_PEER_A " " UT_PEER_A " " UT_KEY, ut_hapd_cmds[1]);
+    TEST_ASSERT_EQUAL_STRING("SET r0kh " UT_PEER_B " 02000000000b " UT_KEY, ut_hapd_cmds[2]);
+    TEST_ASSERT_EQUAL_STRING("SET r1kh " UT_PEER_B " " UT_PEER_B " " UT_KEY, ut_hapd_cmds[3]);
+}
+
+void test_only_new_peer_pushed(void)
+{
+    ut_security_add(OVSDB_SECURITY_FT_KEY, UT_KEY);
+    ut_security_add(FT_PEER_PREFIX "1", UT_PEER_A);
+    TEST_ASSERT_TRUE(ft_vif_apply(0, &ut_vconf));
+    ut_hapd_ncmds = 0;
+
+    ut_security_add(FT_PEER_PREFIX "2", UT_PEER_B);
+    TEST_ASSERT_TRUE(ft_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(2, ut_hapd_ncmds);
+    TEST_ASSERT_TRUE(ut_sent("SET r0kh " UT_PEER_B " 02000000000b " UT_KEY));
+    TEST_ASSERT_TRUE(ut_sent("SET r1kh " UT_PEER_B " " UT_PEER_B " " UT_KEY));
+
+    /* Removals only reach hostapd with its next start */
+    ut_hapd_ncmds = 0;
+    ut_vconf.security_len--;
+    TEST_ASSERT_TRUE(ft_vif_apply(0, &ut_vconf));
+
+    TEST_ASSERT_EQUAL_INT(1, ft_peer_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+/* A restart older than the commit is missing key holders, a newer one read them */
+void test_restart_against_commit(void)
+{
+    ut_security_add(OVSDB_SECURITY_FT_KEY, UT_KEY);
+    ut_security_add(FT_PEER_PREFIX "1", UT_PEER_A);
+    TEST_ASSERT_TRUE(ft_vif_apply(0, &ut_vconf));
+    ut_hapd_ncmds = 0;
+
+    ut_hapd_ino++;
+    ft_resync();
+    TEST_ASSERT_EQUAL_INT(2, ut_hapd_ncmds);
+
+    ut_hapd_ncmds = 0;
+    ut_hapd_ino++;
+    ut_hapd_start = time(NULL) + 1;
+    ft_resync();
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+
+    /* Still the same instance */
+    ft_resync();
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+void test_not_running_pushes_later(void)
+{
+    ut_security_add(OVSDB_SECURITY_FT_KEY, UT_KEY);
+    ut_security_add(FT_PEER_PREFIX "1", UT_PEER_A);
+
+    ut_hapd_ino = 0;
+    TEST_ASSERT_TRUE(ft_vif_apply(0, &ut_vconf));
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+
+    ut_hapd_ino = 1;
+    ft_resync();
+    TEST_ASSERT_EQUAL_INT(2, ut_hapd_ncmds);
+}
+
+int main(int argc, char *argv[])
+{
+    log_open("TARGET_FT_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_nas_id);
+    RUN_TEST(test_mode);
+    RUN_TEST(test_peers_normalized_own_left_out);
+    RUN_TEST(test_key_holders_pushed);
+    RUN_TEST(test_only_new_peer_pushed);
+    RUN_TEST(test_restart_against_commit);
+    RUN_TEST(test_not_running_pushes_later);
+
+    return UNITY_END();
+}
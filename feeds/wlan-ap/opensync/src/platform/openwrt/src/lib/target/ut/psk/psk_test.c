@@ -0,0 +1,344 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * psk_vif_apply() with stubbed UCI and hostapd. PSK_FILE_FMT points into
+ * /tmp and the tests check the file it leaves there: one line per key,
+ * additions appended in place, removals rewritten under a new inode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "unity.h"
+#include "log.h"
+#include "const.h"
+#include "schema.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "psk.h"
+
+#define UT_IFNAME       "wlan0"
+#define UT_SSID         "mdu"
+#define UT_OTHER_SSID   "guest"
+#define UT_MANY         10000
+#define UT_MAX_CMDS     8
+
+static struct schema_Wifi_VIF_Config ut_vconf;
+static struct schema_Wifi_Credential_Config *ut_cconfs;
+static char ut_path[64];
+
+static char ut_uci_file[64];
+static int ut_uci_sets;
+
+static bool ut_hapd_ok;
+static char ut_hapd_cmds[UT_MAX_CMDS][32];
+static int ut_hapd_ncmds;
+
+int wifi_getApWpaPskFile(int ssid_index, char *buf, size_t buf_len)
+{
+    if (!ut_uci_file[0])
+        return UCI_ERR_NOTFOUND;
+
+    strscpy(buf, ut_uci_file, buf_len);
+    return UCI_OK;
+}
+
+bool wifi_setApWpaPskFile(int ssid_index, const char *path)
+{
+    STRSCPY(ut_uci_file, path ? path : "");
+    ut_uci_sets++;
+    return true;
+}
+
+bool hostapd_cli_ok(const char *ifname, const char *cmd)
+{
+    if (ut_hapd_ncmds < UT_MAX_CMDS)
+        STRSCPY(ut_hapd_cmds[ut_hapd_ncmds], cmd);
+    ut_hapd_ncmds++;
+    return ut_hapd_ok;
+}
+
+ino_t hostapd_ctrl_ino(const char *ifname)
+{
+    return 1;
+}
+
+static void ut_security_add(char (*keys)[65], char (*vals)[129], int *len,
+                            const char *key, const char *val)
+{
+    STRSCPY(keys[*len], key);
+    STRSCPY(vals[*len], val);
+    (*len)++;
+}
+
+static void ut_vif_add(const char *key, const char *val)
+{
+    ut_security_add(ut_vconf.security_keys, ut_vconf.security, &ut_vconf.security_len, key, val);
+}
+
+static void ut_key(int i, char *key, size_t len)
+{
+    snprintf(key, len, "tenant%05dpass", i);
+}
+
+/* Credentials 0..num-1 of the VIF's SSID, each with its own key */
+static void ut_creds(int num)
+{
+    struct schema_Wifi_Credential_Config *cconf;
+    char key[32];
+    int i;
+
+    for (i = 0; i < num; i++)
+    {
+        cconf = &ut_cconfs[i];
+        memset(cconf->security_keys, 0, sizeof(cconf->security_keys));
+        STRSCPY(cconf->ssid, UT_SSID);
+        ut_key(i, key, sizeof(key));
+        cconf->security_len = 0;
+        ut_security_add(cconf->security_keys, cconf->security, &cconf->security_len,
+                        OVSDB_SECURITY_KEY, key);
+    }
+}
+
+static bool ut_apply(int num)
+{
+    return psk_vif_apply(0, &ut_vconf, ut_cconfs, num);
+}
+
+static int ut_file_lines(void)
+{
+    char line[256];
+    int num = 0;
+    FILE *f;
+
+    f = fopen(ut_path, "r");
+    if (!f)
+        return -1;
+
+    while (fgets(line, sizeof(line), f))
+        num++;
+    fclose(f);
+
+    return num;
+}
+
+static bool ut_file_has(const char *line)
+{
+    char buf[256];
+    bool found = false;
+    FILE *f;
+
+    f = fopen(ut_path, "r");
+    if (!f)
+        return false;
+
+    while (!found && fgets(buf, sizeof(buf), f))
+    {
+        buf[strcspn(buf, "\n")] = '\0';
+        found = !strcmp(buf, line);
+    }
+    fclose(f);
+
+    return found;
+}
+
+static ino_t ut_file_ino(void)
+{
+    struct stat st;
+
+    if (stat(ut_path, &st))
+        return 0;
+
+    return st.st_ino;
+}
+
+void setUp(void)
+{
+    snprintf(ut_path, sizeof(ut_path), PSK_FILE_FMT, UT_IFNAME);
+    unlink(ut_path);
+
+    memset(&ut_vconf, 0, sizeof(ut_vconf));
+    STRSCPY(ut_vconf.if_name, UT_IFNAME);
+    STRSCPY(ut_vconf.ssid, UT_SSID);
+    ut_vif_add(OVSDB_SECURITY_ENCRYPTION, OVSDB_SECURITY_ENCRYPTION_WPA_PSK);
+    ut_vif_add(OVSDB_SECURITY_KEY, "mainpassword");
+
+    ut_uci_file[0] = '\0';
+    ut_uci_sets = 0;
+    ut_hapd_ok = true;
+    ut_hapd_ncmds = 0;
+}
+
+void tearDown(void)
+{
+    psk_cleanup();
+    unlink(ut_path);
+}
+
+void test_many_keys_written_once(void)
+{
+    ut_creds(UT_MANY);
+
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+    TEST_ASSERT_EQUAL_INT(UT_MANY, psk_vif_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(UT_MANY, ut_file_lines());
+    TEST_ASSERT_TRUE(ut_file_has("00:00:00:00:00:00 tenant00000pass"));
+    TEST_ASSERT_TRUE(ut_file_has("00:00:00:00:00:00 tenant09999pass"));
+
+    /* The first extra key goes to UCI, hostapd reads the file when it starts */
+    TEST_ASSERT_EQUAL_INT(1, ut_uci_sets);
+    TEST_ASSERT_EQUAL_STRING(ut_path, ut_uci_file);
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+void test_unchanged_set_leaves_file(void)
+{
+    ino_t ino;
+
+    ut_creds(UT_MANY);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+    ino = ut_file_ino();
+
+    ut_creds(UT_MANY);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+
+    TEST_ASSERT_EQUAL_UINT64(ino, ut_file_ino());
+    TEST_ASSERT_EQUAL_INT(UT_MANY, ut_file_lines());
+    TEST_ASSERT_EQUAL_INT(1, ut_uci_sets);
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+void test_addition_appended(void)
+{
+    ino_t ino;
+
+    ut_creds(UT_MANY + 1);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+    ino = ut_file_ino();
+
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY + 1));
+
+    TEST_ASSERT_EQUAL_UINT64(ino, ut_file_ino());
+    TEST_ASSERT_EQUAL_INT(UT_MANY + 1, ut_file_lines());
+    TEST_ASSERT_TRUE(ut_file_has("00:00:00:00:00:00 tenant10000pass"));
+    TEST_ASSERT_EQUAL_INT(1, ut_uci_sets);
+    TEST_ASSERT_EQUAL_INT(1, ut_hapd_ncmds);
+    TEST_ASSERT_EQUAL_STRING("RELOAD_WPA_PSK", ut_hapd_cmds[0]);
+}
+
+void test_removal_rewrites(void)
+{
+    char tmp[80];
+    ino_t ino;
+
+    ut_creds(UT_MANY);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+    ino = ut_file_ino();
+
+    STRSCPY(ut_cconfs[UT_MANY / 2].ssid, UT_OTHER_SSID);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+
+    TEST_ASSERT_TRUE(ino != ut_file_ino());
+    TEST_ASSERT_EQUAL_INT(UT_MANY - 1, psk_vif_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(UT_MANY - 1, ut_file_lines());
+    TEST_ASSERT_FALSE(ut_file_has("00:00:00:00:00:00 tenant05000pass"));
+    TEST_ASSERT_TRUE(ut_file_has("00:00:00:00:00:00 tenant05001pass"));
+    TEST_ASSERT_EQUAL_INT(1, ut_hapd_ncmds);
+    TEST_ASSERT_EQUAL_STRING("RELOAD_WPA_PSK", ut_hapd_cmds[0]);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", ut_path);
+    TEST_ASSERT_TRUE(access(tmp, F_OK) < 0);
+}
+
+void test_addition_and_removal_rewrite(void)
+{
+    ino_t ino;
+
+    ut_creds(UT_MANY + 1);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+    ino = ut_file_ino();
+
+    /* Drop the first credential and add the last in one pass */
+    STRSCPY(ut_cconfs[0].ssid, UT_OTHER_SSID);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY + 1));
+
+    TEST_ASSERT_TRUE(ino != ut_file_ino());
+    TEST_ASSERT_EQUAL_INT(UT_MANY, ut_file_lines());
+    TEST_ASSERT_FALSE(ut_file_has("00:00:00:00:00:00 tenant00000pass"));
+    TEST_ASSERT_TRUE(ut_file_has("00:00:00:00:00:00 tenant10000pass"));
+}
+
+void test_vif_keys_duplicates_and_invalid(void)
+{
+    ut_vif_add("key-1", "vifextrakey");
+    ut_vif_add(PSK_TAG_PREFIX "key-1", "staff");
+    ut_vif_add("key-2", "short");
+    ut_creds(2);
+    /* The same passphrase from two credentials is written once */
+    STRSCPY(ut_cconfs[1].security[0], "tenant00000pass");
+
+    TEST_ASSERT_TRUE(ut_apply(2));
+
+    TEST_ASSERT_EQUAL_INT(2, psk_vif_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(2, ut_file_lines());
+    TEST_ASSERT_TRUE(ut_file_has("keyid=staff 00:00:00:00:00:00 vifextrakey"));
+    TEST_ASSERT_TRUE(ut_file_has("00:00:00:00:00:00 tenant00000pass"));
+    TEST_ASSERT_FALSE(ut_file_has("00:00:00:00:00:00 short"));
+}
+
+void test_reload_failure_keeps_bss(void)
+{
+    ut_creds(UT_MANY + 1);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+
+    ut_hapd_ok = false;
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY + 1));
+
+    /* The keys wait for the next start, the BSS is not reloaded for them */
+    TEST_ASSERT_EQUAL_INT(1, ut_hapd_ncmds);
+    TEST_ASSERT_EQUAL_STRING("RELOAD_WPA_PSK", ut_hapd_cmds[0]);
+    TEST_ASSERT_EQUAL_INT(UT_MANY + 1, ut_file_lines());
+}
+
+void test_last_key_removed(void)
+{
+    ut_creds(UT_MANY);
+    TEST_ASSERT_TRUE(ut_apply(UT_MANY));
+
+    TEST_ASSERT_TRUE(ut_apply(0));
+
+    TEST_ASSERT_EQUAL_INT(0, psk_vif_count(UT_IFNAME));
+    TEST_ASSERT_EQUAL_INT(-1, ut_file_lines());
+    TEST_ASSERT_EQUAL_STRING("", ut_uci_file);
+    TEST_ASSERT_EQUAL_INT(0, ut_hapd_ncmds);
+}
+
+int main(int argc, char *argv[])
+{
+    int rc;
+
+    log_open("TARGET_PSK_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    ut_cconfs = calloc(UT_MANY + 1, sizeof(*ut_cconfs));
+    if (!ut_cconfs)
+        return 1;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_many_keys_written_once);
+    RUN_TEST(test_unchanged_set_leaves_file);
+    RUN_TEST(test_addition_appended);
+    RUN_TEST(test_removal_rewrites);
+    RUN_TEST(test_addition_and_removal_rewrite);
+    RUN_TEST(test_vif_keys_duplicates_and_invalid);
+    RUN_TEST(test_reload_failure_keeps_bss);
+    RUN_TEST(test_last_key_removed);
+    rc = UNITY_END();
+
+    free(ut_cconfs);
+
+    return rc;
+}
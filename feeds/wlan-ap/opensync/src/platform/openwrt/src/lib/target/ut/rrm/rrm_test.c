@@ -0,0 +1,332 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * rrm_vif_apply() and rrm_resync() with stubbed hostapd, scan cache and
+ * driver. Two VIFs of one SSID sit on a 5 GHz and a 2.4 GHz phy and list
+ * each other; scanned BSSes come and go in the 5 GHz phy's cache. The
+ * tests check the SET_NEIGHBOR/REMOVE_NEIGHBOR commands hostapd gets,
+ * down to the 13 bytes of each Neighbor Report element.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "log.h"
+#include "const.h"
+#include "ds_tree.h"
+#include "schema.h"
+#include "uci_helper.h"
+#include "hostapd.h"
+#include "rtnl.h"
+#include "phy.h"
+#include "nbr.h"
+#include "ft.h"
+#include "rrm.h"
+
+#define UT_SSID         "mdu"
+#define UT_SSID_HEX     "6d6475"
+#define UT_VIF_5G       "wlan0"
+#define UT_VIF_2G       "wlan1"
+#define UT_BSSID_5G     "02:00:00:00:00:01"
+#define UT_BSSID_2G     "02:00:00:00:00:02"
+#define UT_SCANNED      "04:00:00:00:00:01"
+#define UT_STRANGER     "06:00:00:00:00:01"
+#define UT_MAX_CMDS     16
+
+struct ut_cmd
+{
+    char    ifname[IFNAMSIZ];
+    char    cmd[160];
+};
+
+static struct schema_Wifi_VIF_Config ut_vconf_5g;
+static struct schema_Wifi_VIF_Config ut_vconf_2g;
+
+static struct ut_cmd ut_cmds[UT_MAX_CMDS];
+static int ut_ncmds;
+static ino_t ut_ino;
+
+static ds_tree_t ut_nbrs = DS_TREE_INIT(ds_str_cmp, struct wifi_nbr, node);
+
+/* SSID index 0 is the 5 GHz VIF on phy0, anything else the 2.4 GHz one on phy1 */
+int wifi_getSSIDRadioIndex(int ssid_index, int *radio_index)
+{
+    *radio_index = ssid_index;
+    return UCI_OK;
+}
+
+int wifi_getRadioPhyName(int radio_idx, char *phy, size_t phy_len)
+{
+    snprintf(phy, phy_len, "phy%d", radio_idx);
+    return UCI_OK;
+}
+
+int rtnl_link_addr(const char *ifname, char *mac, size_t len)
+{
+    strscpy(mac, strcmp(ifname, UT_VIF_5G) ? UT_BSSID_2G : UT_BSSID_5G, len);
+    return 0;
+}
+
+bool phy_get_oper(const char *name, struct wifi_oper *oper)
+{
+    memset(oper, 0, sizeof(*oper));
+    oper->channel = strcmp(name, "phy0") ? 6 : 36;
+    return true;
+}
+
+ds_tree_t *nbr_get(const char *phy)
+{
+    return strcmp(phy, "phy0") ? NULL : &ut_nbrs;
+}
+
+bool hostapd_cli_ok(const char *ifname, const char *cmd)
+{
+    if (ut_ncmds < UT_MAX_CMDS)
+    {
+        STRSCPY(ut_cmds[ut_ncmds].ifname, ifname);
+        STRSCPY(ut_cmds[ut_ncmds].cmd, cmd);
+    }
+    ut_ncmds++;
+    return true;
+}
+
+ino_t hostapd_ctrl_ino(const char *ifname)
+{
+    return ut_ino;
+}
+
+static void ut_vconf_init(struct schema_Wifi_VIF_Config *vconf, const char *ifname, bool rrm)
+{
+    memset(vconf, 0, sizeof(*vconf));
+    STRSCPY(vconf->if_name, ifname);
+    STRSCPY(vconf->ssid, UT_SSID);
+    vconf->enabled = true;
+    vconf->rrm_exists = true;
+    vconf->rrm = rrm;
+    STRSCPY(vconf->security_keys[0], OVSDB_SECURITY_ENCRYPTION);
+    STRSCPY(vconf->security[0], OVSDB_SECURITY_ENCRYPTION_OPEN);
+    vconf->security_len = 1;
+}
+
+static void ut_security_add(struct schema_Wifi_VIF_Config *vconf, const char *key, const char *val)
+{
+    STRSCPY(vconf->security_keys[vconf->security_len], key);
+    STRSCPY(vconf->security[vconf->security_len], val);
+    vconf->security_len++;
+}
+
+static void ut_scanned_add(const char *bssid, const char *ssid, int channel, int rssi)
+{
+    struct wifi_nbr *nbr;
+
+    nbr = calloc(1, sizeof(*nbr));
+    TEST_ASSERT_NOT_NULL(nbr);
+    STRSCPY(nbr->bssid, bssid);
+    STRSCPY(nbr->ssid, ssid);
+    nbr->primary = channel;
+    nbr->rssi = rssi;
+    ds_tree_insert(&ut_nbrs, nbr, nbr->bssid);
+}
+
+static void ut_scanned_del(const char *bssid)
+{
+    struct wifi_nbr *nbr;
+
+    nbr = ds_tree_find(&ut_nbrs, (void *)bssid);
+    TEST_ASSERT_NOT_NULL(nbr);
+    ds_tree_remove(&ut_nbrs, nbr);
+    free(nbr);
+}
+
+/* Both VIFs up, only the 5 GHz one serving neighbor reports */
+static void ut_apply(void)
+{
+    TEST_ASSERT_TRUE(rrm_vif_apply(1, &ut_vconf_2g));
+    TEST_ASSERT_TRUE(rrm_vif_apply(0, &ut_vconf_5g));
+}
+
+static bool ut_sent(const char *ifname, const char *cmd)
+{
+    int i;
+
+    for (i = 0; i < ut_ncmds && i < UT_MAX_CMDS; i++)
+        if (!strcmp(ut_cmds[i].ifname, ifname) && !strcmp(ut_cmds[i].cmd, cmd))
+            return true;
+
+    return false;
+}
+
+void setUp(void)
+{
+    ut_vconf_init(&ut_vconf_5g, UT_VIF_5G, true);
+    ut_vconf_init(&ut_vconf_2g, UT_VIF_2G, false);
+    ut_ncmds = 0;
+    ut_ino = 1;
+    TEST_ASSERT_TRUE(rrm_init());
+}
+
+void tearDown(void)
+{
+    struct wifi_nbr *nbr;
+    ds_tree_iter_t iter;
+
+    rrm_cleanup();
+
+    ds_tree_foreach_iter(&ut_nbrs, nbr, &iter)
+    {
+        ds_tree_iremove(&iter);
+        free(nbr);
+    }
+}
+
+/*
+ * BSSID, BSSID Information (reachable, QoS, RRM, HT, little endian),
+ * operating class 81, channel 6, PHY type HT
+ */
+void test_element_open_2g(void)
+{
+    ut_apply();
+
+    TEST_ASSERT_EQUAL_INT(1, ut_ncmds);
+    TEST_ASSERT_EQUAL_STRING(UT_VIF_5G, ut_cmds[0].ifname);
+    TEST_ASSERT_EQUAL_STRING("SET_NEIGHBOR " UT_BSSID_2G " ssid=" UT_SSID_HEX
+                             " nr=020000000002" "a3080000" "51" "06" "07", ut_cmds[0].cmd);
+    TEST_ASSERT_EQUAL_INT(1, rrm_neighbor_count(UT_VIF_5G));
+    TEST_ASSERT_EQUAL_INT(0, rrm_neighbor_count(UT_VIF_2G));
+}
+
+/* Security and mobility domain set, 5 GHz adds VHT and spectrum management */
+void test_element_secured_5g(void)
+{
+    STRSCPY(ut_vconf_2g.security[0], OVSDB_SECURITY_ENCRYPTION_WPA_PSK);
+    ut_vconf_2g.rrm = true;
+    ut_vconf_2g.ft_mobility_domain_exists = true;
+    ut_vconf_2g.ft_mobility_domain = 0x4f57;
+    ut_vconf_5g.rrm = false;
+
+    TEST_ASSERT_TRUE(rrm_vif_apply(0, &ut_vconf_5g));
+    TEST_ASSERT_TRUE(rrm_vif_apply(1, &ut_vconf_2g));
+
+    TEST_ASSERT_EQUAL_INT(1, ut_ncmds);
+    TEST_ASSERT_EQUAL_STRING(UT_VIF_2G, ut_cmds[0].ifname);
+    TEST_ASSERT_EQUAL_STRING("SET_NEIGHBOR " UT_BSSID_5G " ssid=" UT_SSID_HEX
+                             " nr=020000000001" "b7140000" "73" "24" "09", ut_cmds[0].cmd);
+}
+
+void test_unchanged_list_not_pushed(void)
+{
+    ut_apply();
+    ut_ncmds = 0;
+
+    rrm_resync();
+    ut_apply();
+
+    TEST_ASSERT_EQUAL_INT(0, ut_ncmds);
+}
+
+void test_scanned_added_and_removed(void)
+{
+    ut_apply();
+    ut_ncmds = 0;
+
+    ut_scanned_add(UT_SCANNED, UT_SSID, 44, -60);
+    ut_scanned_add(UT_STRANGER, "other", 48, -50);
+    rrm_resync();
+
+    /* Only the new one, the other SSID is no neighbor */
+    TEST_ASSERT_EQUAL_INT(1, ut_ncmds);
+    TEST_ASSERT_EQUAL_STRING("SET_NEIGHBOR " UT_SCANNED " ssid=" UT_SSID_HEX
+                             " nr=040000000001" "b3100000" "73" "2c" "09", ut_cmds[0].cmd);
+    TEST_ASSERT_EQUAL_INT(2, rrm_neighbor_count(UT_VIF_5G));
+
+    ut_ncmds = 0;
+    ut_scanned_del(UT_SCANNED);
+    rrm_resync();
+
+    TEST_ASSERT_EQUAL_INT(1, ut_ncmds);
+    TEST_ASSERT_EQUAL_STRING("REMOVE_NEIGHBOR " UT_SCANNED " ssid=" UT_SSID_HEX, ut_cmds[0].cmd);
+    TEST_ASSERT_EQUAL_INT(1, rrm_neighbor_count(UT_VIF_5G));
+}
+
+void test_moved_neighbor_replaced(void)
+{
+    ut_scanned_add(UT_SCANNED, UT_SSID, 44, -60);
+    ut_apply();
+    ut_ncmds = 0;
+
+    ut_scanned_del(UT_SCANNED);
+    ut_scanned_add(UT_SCANNED, UT_SSID, 149, -60);
+    rrm_resync();
+
+    /* SET_NEIGHBOR replaces hostapd's entry for the BSSID */
+    TEST_ASSERT_EQUAL_INT(1, ut_ncmds);
+    TEST_ASSERT_EQUAL_STRING("SET_NEIGHBOR " UT_SCANNED " ssid=" UT_SSID_HEX
+                             " nr=040000000001" "b3100000" "7d" "95" "09", ut_cmds[0].cmd);
+}
+
+void test_peers_limit_scanned(void)
+{
+    ut_security_add(&ut_vconf_5g, FT_PEER_PREFIX "1", UT_SCANNED);
+    ut_scanned_add(UT_SCANNED, UT_SSID, 44, -60);
+    ut_scanned_add(UT_STRANGER, UT_SSID, 48, -50);
+
+    ut_apply();
+
+    /* Same SSID but not one of ours */
+    TEST_ASSERT_EQUAL_INT(2, rrm_neighbor_count(UT_VIF_5G));
+    TEST_ASSERT_TRUE(ut_sent(UT_VIF_5G, "SET_NEIGHBOR " UT_SCANNED " ssid=" UT_SSID_HEX
+                             " nr=040000000001" "b3100000" "73" "2c" "09"));
+    TEST_ASSERT_FALSE(ut_sent(UT_VIF_5G, "SET_NEIGHBOR " UT_STRANGER " ssid=" UT_SSID_HEX
+                              " nr=060000000001" "b3100000" "73" "30" "09"));
+}
+
+void test_restart_pushes_all(void)
+{
+    ut_scanned_add(UT_SCANNED, UT_SSID, 44, -60);
+    ut_apply();
+    ut_ncmds = 0;
+
+    ut_ino++;
+    rrm_resync();
+
+    TEST_ASSERT_EQUAL_INT(2, ut_ncmds);
+    TEST_ASSERT_TRUE(ut_sent(UT_VIF_5G, "SET_NEIGHBOR " UT_BSSID_2G " ssid=" UT_SSID_HEX
+                             " nr=020000000002" "a3080000" "51" "06" "07"));
+    TEST_ASSERT_TRUE(ut_sent(UT_VIF_5G, "SET_NEIGHBOR " UT_SCANNED " ssid=" UT_SSID_HEX
+                             " nr=040000000001" "b3100000" "73" "2c" "09"));
+}
+
+void test_not_running_pushes_later(void)
+{
+    ut_ino = 0;
+    ut_apply();
+
+    TEST_ASSERT_EQUAL_INT(0, ut_ncmds);
+    TEST_ASSERT_EQUAL_INT(1, rrm_neighbor_count(UT_VIF_5G));
+
+    ut_ino = 1;
+    rrm_resync();
+
+    TEST_ASSERT_EQUAL_INT(1, ut_ncmds);
+}
+
+int main(int argc, char *argv[])
+{
+    log_open("TARGET_RRM_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_element_open_2g);
+    RUN_TEST(test_element_secured_5g);
+    RUN_TEST(test_unchanged_list_not_pushed);
+    RUN_TEST(test_scanned_added_and_removed);
+    RUN_TEST(test_moved_neighbor_replaced);
+    RUN_TEST(test_peers_limit_scanned);
+    RUN_TEST(test_restart_pushes_all);
+    RUN_TEST(test_not_running_pushes_later);
+
+    return UNITY_END();
+}
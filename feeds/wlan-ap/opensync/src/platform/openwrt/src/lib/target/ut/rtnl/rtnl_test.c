@@ -0,0 +1,334 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * rtnl_vlan_attach/detach against the kernel, inside a network namespace
+ * unshared at startup so the host's links are never touched. The lower
+ * device and the ports are veth pairs. Cases are ignored without
+ * CAP_NET_ADMIN, and the ones creating 802.1Q links when the kernel has
+ * no 8021q support.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <net/if.h>
+#include <linux/if_link.h>
+#include <linux/veth.h>
+
+#include <ev.h>
+
+#include "unity.h"
+#include "log.h"
+#include "rtnl.h"
+
+#define UT_LOWER        "ut0"
+#define UT_VID          100
+#define UT_VLAN         "ut0.100"
+#define UT_BRIDGE       "br-ut100"
+#define UT_PORT_A       "utp0"
+#define UT_PORT_B       "utp1"
+#define UT_MISSING      "utnone"
+
+static bool ut_netns = false;
+static bool ut_vlan = false;
+static struct nl_sock *ut_sock;
+
+/* One request on a socket of the test's own, returns the kernel's error */
+static int ut_request(struct nl_msg *msg)
+{
+    int err;
+
+    err = nl_send_auto_complete(ut_sock, msg);
+    nlmsg_free(msg);
+    if (err < 0)
+        return err;
+
+    return nl_wait_for_ack(ut_sock);
+}
+
+static struct nl_msg *ut_link_msg(int type, int flags, int ifindex)
+{
+    struct ifinfomsg ifi = { .ifi_family = AF_UNSPEC, .ifi_index = ifindex };
+    struct nl_msg *msg;
+
+    msg = nlmsg_alloc_simple(type, NLM_F_REQUEST | NLM_F_ACK | flags);
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_TRUE(nlmsg_append(msg, &ifi, sizeof(ifi), NLMSG_ALIGNTO) >= 0);
+
+    return msg;
+}
+
+static int ut_veth_add(const char *ifname, const char *peer)
+{
+    struct ifinfomsg ifi = { .ifi_family = AF_UNSPEC };
+    struct nlattr *info;
+    struct nlattr *data;
+    struct nlattr *nest;
+    struct nl_msg *msg;
+
+    msg = ut_link_msg(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, 0);
+    nla_put_string(msg, IFLA_IFNAME, ifname);
+    info = nla_nest_start(msg, IFLA_LINKINFO);
+    nla_put_string(msg, IFLA_INFO_KIND, "veth");
+    data = nla_nest_start(msg, IFLA_INFO_DATA);
+    nest = nla_nest_start(msg, VETH_INFO_PEER);
+    nlmsg_append(msg, &ifi, sizeof(ifi), NLMSG_ALIGNTO);
+    nla_put_string(msg, IFLA_IFNAME, peer);
+    nla_nest_end(msg, nest);
+    nla_nest_end(msg, data);
+    nla_nest_end(msg, info);
+
+    return ut_request(msg);
+}
+
+static int ut_vlan_add(const char *ifname, const char *lower, int vlan_id)
+{
+    struct nlattr *info;
+    struct nlattr *data;
+    struct nl_msg *msg;
+
+    msg = ut_link_msg(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, 0);
+    nla_put_string(msg, IFLA_IFNAME, ifname);
+    nla_put_u32(msg, IFLA_LINK, if_nametoindex(lower));
+    info = nla_nest_start(msg, IFLA_LINKINFO);
+    nla_put_string(msg, IFLA_INFO_KIND, "vlan");
+    data = nla_nest_start(msg, IFLA_INFO_DATA);
+    nla_put_u16(msg, IFLA_VLAN_ID, vlan_id);
+    nla_nest_end(msg, data);
+    nla_nest_end(msg, info);
+
+    return ut_request(msg);
+}
+
+static void ut_link_del(const char *ifname)
+{
+    unsigned int idx = if_nametoindex(ifname);
+
+    if (idx)
+        ut_request(ut_link_msg(RTM_DELLINK, 0, idx));
+}
+
+struct ut_link
+{
+    bool            found;
+    unsigned int    flags;
+    unsigned int    master;
+};
+
+static int ut_link_cb(struct nl_msg *msg, void *arg)
+{
+    struct nlmsghdr *nlh = nlmsg_hdr(msg);
+    struct nlattr *tb[IFLA_MAX + 1];
+    struct ut_link *link = arg;
+    struct ifinfomsg *ifi;
+
+    if (nlh->nlmsg_type != RTM_NEWLINK ||
+        nlmsg_parse(nlh, sizeof(*ifi), tb, IFLA_MAX, NULL))
+        return NL_SKIP;
+
+    ifi = nlmsg_data(nlh);
+    link->found = true;
+    link->flags = ifi->ifi_flags;
+    link->master = tb[IFLA_MASTER] ? nla_get_u32(tb[IFLA_MASTER]) : 0;
+
+    return NL_SKIP;
+}
+
+static struct ut_link ut_link_get(const char *ifname)
+{
+    struct ut_link link = { 0 };
+    struct nl_msg *msg;
+    struct nl_cb *cb;
+    unsigned int idx;
+
+    idx = if_nametoindex(ifname);
+    if (!idx)
+        return link;
+
+    cb = nl_cb_alloc(NL_CB_DEFAULT);
+    TEST_ASSERT_NOT_NULL(cb);
+    nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, ut_link_cb, &link);
+
+    msg = ut_link_msg(RTM_GETLINK, 0, idx);
+    TEST_ASSERT_TRUE(nl_send_auto_complete(ut_sock, msg) >= 0);
+    nlmsg_free(msg);
+    nl_recvmsgs(ut_sock, cb);
+    nl_wait_for_ack(ut_sock);
+    nl_cb_put(cb);
+
+    return link;
+}
+
+static void ut_assert_enslaved(const char *ifname, const char *bridge)
+{
+    struct ut_link link = ut_link_get(ifname);
+
+    TEST_ASSERT_TRUE_MESSAGE(link.found, ifname);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(if_nametoindex(bridge), link.master, ifname);
+}
+
+static void ut_require_vlan(void)
+{
+    if (!ut_vlan)
+        TEST_IGNORE_MESSAGE("kernel has no 802.1Q support");
+}
+
+void setUp(void)
+{
+    if (!ut_netns)
+        TEST_IGNORE_MESSAGE("no network namespace, needs CAP_NET_ADMIN");
+
+    TEST_ASSERT_EQUAL_INT(0, ut_veth_add(UT_LOWER, UT_LOWER "p"));
+    TEST_ASSERT_EQUAL_INT(0, ut_veth_add(UT_PORT_A, UT_PORT_A "p"));
+    TEST_ASSERT_EQUAL_INT(0, ut_veth_add(UT_PORT_B, UT_PORT_B "p"));
+}
+
+void tearDown(void)
+{
+    if (!ut_netns)
+        return;
+
+    ut_link_del(UT_VLAN);
+    ut_link_del(UT_BRIDGE);
+    ut_link_del(UT_LOWER);
+    ut_link_del(UT_PORT_A);
+    ut_link_del(UT_PORT_B);
+}
+
+static const char ut_ports[][IFNAMSIZ] = { UT_PORT_A, UT_PORT_B };
+
+void test_attach_creates_bridge_and_vlan(void)
+{
+    struct ut_link link;
+
+    ut_require_vlan();
+
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_attach(UT_BRIDGE, UT_LOWER, UT_VID, ut_ports, 2));
+
+    link = ut_link_get(UT_BRIDGE);
+    TEST_ASSERT_TRUE(link.found);
+    TEST_ASSERT_TRUE(link.flags & IFF_UP);
+
+    ut_assert_enslaved(UT_VLAN, UT_BRIDGE);
+    TEST_ASSERT_TRUE(ut_link_get(UT_VLAN).flags & IFF_UP);
+    ut_assert_enslaved(UT_PORT_A, UT_BRIDGE);
+    ut_assert_enslaved(UT_PORT_B, UT_BRIDGE);
+
+    /* Ports come up when hostapd starts them, not before */
+    TEST_ASSERT_FALSE(ut_link_get(UT_PORT_A).flags & IFF_UP);
+}
+
+void test_attach_twice(void)
+{
+    ut_require_vlan();
+
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_attach(UT_BRIDGE, UT_LOWER, UT_VID, ut_ports, 1));
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_attach(UT_BRIDGE, UT_LOWER, UT_VID, ut_ports, 2));
+
+    ut_assert_enslaved(UT_VLAN, UT_BRIDGE);
+    ut_assert_enslaved(UT_PORT_A, UT_BRIDGE);
+    ut_assert_enslaved(UT_PORT_B, UT_BRIDGE);
+}
+
+void test_attach_existing_vlan(void)
+{
+    ut_require_vlan();
+
+    /* Left behind by netifd, only gets a master */
+    TEST_ASSERT_EQUAL_INT(0, ut_vlan_add(UT_VLAN, UT_LOWER, UT_VID));
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_attach(UT_BRIDGE, UT_LOWER, UT_VID, ut_ports, 0));
+
+    ut_assert_enslaved(UT_VLAN, UT_BRIDGE);
+}
+
+void test_attach_skips_missing_port(void)
+{
+    static const char ports[][IFNAMSIZ] = { UT_MISSING, UT_PORT_B };
+
+    ut_require_vlan();
+
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_attach(UT_BRIDGE, UT_LOWER, UT_VID, ports, 2));
+
+    ut_assert_enslaved(UT_PORT_B, UT_BRIDGE);
+    TEST_ASSERT_EQUAL_INT(0, ut_link_get(UT_PORT_A).master);
+}
+
+void test_attach_missing_lower(void)
+{
+    TEST_ASSERT_EQUAL_INT(-1, rtnl_vlan_attach(UT_BRIDGE, UT_MISSING, UT_VID, ut_ports, 2));
+
+    /* Nothing is set up before the lower device is known */
+    TEST_ASSERT_EQUAL_INT(0, if_nametoindex(UT_BRIDGE));
+    TEST_ASSERT_EQUAL_INT(0, ut_link_get(UT_PORT_A).master);
+}
+
+void test_detach(void)
+{
+    ut_require_vlan();
+
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_attach(UT_BRIDGE, UT_LOWER, UT_VID, ut_ports, 2));
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_detach(UT_BRIDGE, UT_LOWER, UT_VID));
+
+    TEST_ASSERT_EQUAL_INT(0, if_nametoindex(UT_VLAN));
+    TEST_ASSERT_EQUAL_INT(0, if_nametoindex(UT_BRIDGE));
+
+    /* Ports outlive the bridge, released */
+    TEST_ASSERT_TRUE(ut_link_get(UT_PORT_A).found);
+    TEST_ASSERT_EQUAL_INT(0, ut_link_get(UT_PORT_A).master);
+    TEST_ASSERT_TRUE(if_nametoindex(UT_LOWER) != 0);
+}
+
+void test_detach_nothing(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, rtnl_vlan_detach(UT_BRIDGE, UT_LOWER, UT_VID));
+    TEST_ASSERT_TRUE(if_nametoindex(UT_LOWER) != 0);
+}
+
+static void ut_netns_setup(void)
+{
+    if (unshare(CLONE_NEWNET))
+        return;
+
+    ut_sock = nl_socket_alloc();
+    if (!ut_sock || nl_connect(ut_sock, NETLINK_ROUTE))
+        return;
+
+    ut_netns = true;
+
+    /* 8021q may be missing or modular with nothing to load it from */
+    if (!ut_veth_add(UT_LOWER, UT_LOWER "p"))
+    {
+        ut_vlan = !ut_vlan_add(UT_VLAN, UT_LOWER, UT_VID);
+        ut_link_del(UT_VLAN);
+        ut_link_del(UT_LOWER);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    log_open("TARGET_RTNL_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    ut_netns_setup();
+    if (ut_netns)
+        rtnl_init(EV_DEFAULT);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_attach_creates_bridge_and_vlan);
+    RUN_TEST(test_attach_twice);
+    RUN_TEST(test_attach_existing_vlan);
+    RUN_TEST(test_attach_skips_missing_port);
+    RUN_TEST(test_attach_missing_lower);
+    RUN_TEST(test_detach);
+    RUN_TEST(test_detach_nothing);
+
+    rtnl_cleanup();
+    if (ut_sock)
+        nl_socket_free(ut_sock);
+
+    return UNITY_END();
+}
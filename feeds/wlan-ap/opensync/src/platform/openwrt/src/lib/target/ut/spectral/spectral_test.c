@@ -0,0 +1,528 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Spectral sample replay on the build host.
+ *
+ * The sample streams are ath9k HT20 FFT reports laid out byte for byte
+ * as the driver's relay hands them out, one second of each signal
+ * class at the background scan's 500 us rate. They are replayed through
+ * the parser in one go, in arbitrary chunks, and through the background
+ * task reading a fake debugfs tree under SPECTRAL_DEBUGFS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "unity.h"
+#include "log.h"
+#include "evsched.h"
+#include "uci_helper.h"
+#include "phy.h"
+#include "spectral.h"
+
+#define UT_HT20_LEN         76
+#define UT_HT20_BINS        56
+#define UT_SAMPLE_US        500
+#define UT_SAMPLES          2000        /* one second */
+#define UT_NOISE            (-95)
+#define UT_BUSY_RSSI        30
+
+#define UT_FREQ_MICROWAVE   2437
+#define UT_FREQ_CONTINUOUS  2412
+#define UT_FREQ_NARROWBAND  2462
+#define UT_FREQ_WIFI        5180
+
+#define UT_BENCH_BYTES      (64 * 1024 * 1024)
+#define UT_READ_SIZE        (64 * 1024)
+
+struct ut_buf
+{
+    uint8_t     *data;
+    size_t      len;
+    size_t      cap;
+};
+
+static evsched_task_t *ut_task;
+static int ut_radios;
+
+/* Only what the background task asks for */
+int wifi_getRadioNumberOfEntries(int *numberOfEntries)
+{
+    *numberOfEntries = ut_radios;
+    return UCI_OK;
+}
+
+int wifi_getRadioSpectralEnable(int radio_idx, bool *enabled)
+{
+    *enabled = true;
+    return UCI_OK;
+}
+
+int wifi_getRadioPhyName(int radio_idx, char *phy, size_t phy_len)
+{
+    snprintf(phy, phy_len, "phy%d", radio_idx);
+    return UCI_OK;
+}
+
+int phy_freq_to_channel(uint32_t freq)
+{
+    if (freq == 2484)
+        return 14;
+    if (freq < 2484)
+        return (freq - 2407) / 5;
+
+    return (freq - 5000) / 5;
+}
+
+bool evsched_task(evsched_task_t *task, void *ctx, uint64_t ms)
+{
+    ut_task = task;
+    return true;
+}
+
+bool evsched_task_reschedule_ms(uint64_t ms)
+{
+    return true;
+}
+
+bool evsched_task_cancel_by_find(evsched_task_t *task, void *ctx, int flags)
+{
+    ut_task = NULL;
+    return true;
+}
+
+static void ut_put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void ut_put_be64(uint8_t *p, uint64_t v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        p[i] = v >> (56 - 8 * i);
+}
+
+static void ut_sample(struct ut_buf *b, uint16_t freq, int rssi, uint64_t tsf, const uint8_t *bins)
+{
+    uint8_t *s;
+
+    if (b->len + UT_HT20_LEN > b->cap)
+    {
+        b->cap = b->cap ? b->cap * 2 : 64 * 1024;
+        b->data = realloc(b->data, b->cap);
+        TEST_ASSERT_NOT_NULL(b->data);
+    }
+
+    /* struct fft_sample_ht20 */
+    s = b->data + b->len;
+    memset(s, 0, UT_HT20_LEN);
+    s[0] = 1;
+    ut_put_be16(s + 1, UT_HT20_LEN - 3);
+    ut_put_be16(s + 4, freq);
+    s[6] = (uint8_t)rssi;
+    s[7] = (uint8_t)UT_NOISE;
+    ut_put_be64(s + 12, tsf);
+    memcpy(s + 20, bins, UT_HT20_BINS);
+
+    b->len += UT_HT20_LEN;
+}
+
+/* 8 ms of flat energy every 20 ms */
+static void ut_gen_microwave(struct ut_buf *b, uint64_t tsf)
+{
+    uint8_t busy[UT_HT20_BINS];
+    uint8_t idle[UT_HT20_BINS];
+    uint64_t t;
+    int i;
+
+    memset(busy, 40, sizeof(busy));
+    memset(idle, 2, sizeof(idle));
+
+    for (i = 0; i < UT_SAMPLES; i++)
+    {
+        t = (uint64_t)i * UT_SAMPLE_US;
+        if (t % 20000 < 8000)
+            ut_sample(b, UT_FREQ_MICROWAVE, UT_BUSY_RSSI, tsf + t, busy);
+        else
+            ut_sample(b, UT_FREQ_MICROWAVE, 0, tsf + t, idle);
+    }
+}
+
+/* Always on, a few bins wide */
+static void ut_gen_continuous(struct ut_buf *b, uint64_t tsf)
+{
+    uint8_t bins[UT_HT20_BINS];
+    int i;
+
+    memset(bins, 5, sizeof(bins));
+    memset(bins + 20, 100, 4);
+
+    for (i = 0; i < UT_SAMPLES; i++)
+        ut_sample(b, UT_FREQ_CONTINUOUS, UT_BUSY_RSSI, tsf + (uint64_t)i * UT_SAMPLE_US, bins);
+}
+
+/* A single bin, 20 ms out of every 100 ms */
+static void ut_gen_narrowband(struct ut_buf *b, uint64_t tsf)
+{
+    uint8_t busy[UT_HT20_BINS];
+    uint8_t idle[UT_HT20_BINS];
+    uint64_t t;
+    int i;
+
+    memset(busy, 1, sizeof(busy));
+    busy[30] = 100;
+    memset(idle, 1, sizeof(idle));
+
+    for (i = 0; i < UT_SAMPLES; i++)
+    {
+        t = (uint64_t)i * UT_SAMPLE_US;
+        if (t % 100000 < 20000)
+            ut_sample(b, UT_FREQ_NARROWBAND, UT_BUSY_RSSI, tsf + t, busy);
+        else
+            ut_sample(b, UT_FREQ_NARROWBAND, 0, tsf + t, idle);
+    }
+}
+
+/* OFDM traffic at half the airtime, flat and periodic but on 5 GHz */
+static void ut_gen_wifi(struct ut_buf *b, uint64_t tsf)
+{
+    uint8_t busy[UT_HT20_BINS];
+    uint8_t idle[UT_HT20_BINS];
+    uint64_t t;
+    int i;
+
+    memset(busy, 50, sizeof(busy));
+    memset(idle, 2, sizeof(idle));
+
+    for (i = 0; i < UT_SAMPLES; i++)
+    {
+        t = (uint64_t)i * UT_SAMPLE_US;
+        if (t % 10000 < 5000)
+            ut_sample(b, UT_FREQ_WIFI, UT_BUSY_RSSI, tsf + t, busy);
+        else
+            ut_sample(b, UT_FREQ_WIFI, 0, tsf + t, idle);
+    }
+}
+
+static void ut_gen_all(struct ut_buf *b)
+{
+    ut_gen_microwave(b, 1000000);
+    ut_gen_continuous(b, 2000000);
+    ut_gen_narrowband(b, 3000000);
+    ut_gen_wifi(b, 4000000);
+}
+
+/* Same carry handling as the background read, with the chunk sizes given */
+static void ut_replay_chunked(const struct ut_buf *b, struct spectral_acc *acc, unsigned int seed)
+{
+    static uint8_t buf[UT_READ_SIZE + 512];
+    size_t carry = 0;
+    size_t off = 0;
+    size_t chunk;
+    size_t used;
+
+    srand(seed);
+
+    while (off < b->len)
+    {
+        chunk = 1 + rand() % 4096;
+        if (chunk > b->len - off)
+            chunk = b->len - off;
+
+        memcpy(buf + carry, b->data + off, chunk);
+        off += chunk;
+
+        used = spectral_parse(buf, carry + chunk, acc, SPECTRAL_MAX_CHANS);
+        carry = carry + chunk - used;
+        TEST_ASSERT_TRUE(carry < UT_HT20_LEN);
+        memmove(buf, buf + used, carry);
+    }
+
+    TEST_ASSERT_EQUAL_INT(0, carry);
+}
+
+static const struct spectral_summary *ut_find(const struct spectral_summary *sum, int n, uint32_t freq)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (sum[i].freq == freq)
+            return &sum[i];
+    }
+
+    return NULL;
+}
+
+static int ut_summarize(const struct spectral_acc *acc, struct spectral_summary *sum)
+{
+    int n = 0;
+    int i;
+
+    for (i = 0; i < SPECTRAL_MAX_CHANS; i++)
+    {
+        if (spectral_summarize(&acc[i], &sum[n]))
+            n++;
+    }
+
+    return n;
+}
+
+static void ut_write_file(const char *path, const void *data, size_t len, bool append)
+{
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_INT(len, write(fd, data, len));
+    close(fd);
+}
+
+static void ut_debugfs_radio(int r, const void *data, size_t len)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d", r);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d/ath9k", r);
+    mkdir(path, 0755);
+
+    snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d/ath9k/spectral_scan_ctl", r);
+    ut_write_file(path, "", 0, false);
+    snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d/ath9k/spectral_scan0", r);
+    ut_write_file(path, data, len, false);
+}
+
+static void ut_debugfs_append(int r, const void *data, size_t len)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d/ath9k/spectral_scan0", r);
+    ut_write_file(path, data, len, true);
+}
+
+static void ut_debugfs_remove(int nradios)
+{
+    char path[256];
+    int r;
+
+    for (r = 0; r < nradios; r++)
+    {
+        snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d/ath9k/spectral_scan_ctl", r);
+        unlink(path);
+        snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d/ath9k/spectral_scan0", r);
+        unlink(path);
+        snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d/ath9k", r);
+        rmdir(path);
+        snprintf(path, sizeof(path), SPECTRAL_DEBUGFS "/phy%d", r);
+        rmdir(path);
+    }
+
+    rmdir(SPECTRAL_DEBUGFS);
+}
+
+void setUp(void)
+{
+    ut_task = NULL;
+    ut_radios = 0;
+}
+
+void tearDown(void)
+{
+    spectral_cleanup();
+    ut_debugfs_remove(2);
+}
+
+void test_replay_classifies(void)
+{
+    struct spectral_acc acc[SPECTRAL_MAX_CHANS];
+    struct spectral_summary sum[SPECTRAL_MAX_CHANS];
+    const struct spectral_summary *s;
+    struct ut_buf b = { 0 };
+    int n;
+
+    ut_gen_all(&b);
+
+    memset(acc, 0, sizeof(acc));
+    TEST_ASSERT_EQUAL_INT(b.len, spectral_parse(b.data, b.len, acc, SPECTRAL_MAX_CHANS));
+    n = ut_summarize(acc, sum);
+    TEST_ASSERT_EQUAL_INT(4, n);
+
+    s = ut_find(sum, n, UT_FREQ_MICROWAVE);
+    TEST_ASSERT_NOT_NULL(s);
+    TEST_ASSERT_EQUAL_INT(6, s->chan);
+    TEST_ASSERT_EQUAL_INT(UT_SAMPLES, s->samples);
+    TEST_ASSERT_EQUAL_INT(UT_NOISE, s->noise);
+    TEST_ASSERT_EQUAL_INT(40, s->duty);
+    TEST_ASSERT_EQUAL_INT(20, s->period_ms);
+    TEST_ASSERT_EQUAL_INT(SPECTRAL_INTF_MICROWAVE, s->interferer);
+
+    s = ut_find(sum, n, UT_FREQ_CONTINUOUS);
+    TEST_ASSERT_NOT_NULL(s);
+    TEST_ASSERT_EQUAL_INT(100, s->duty);
+    TEST_ASSERT_EQUAL_INT(UT_NOISE + UT_BUSY_RSSI, s->avg_power);
+    TEST_ASSERT_EQUAL_INT(SPECTRAL_INTF_CONTINUOUS, s->interferer);
+
+    s = ut_find(sum, n, UT_FREQ_NARROWBAND);
+    TEST_ASSERT_NOT_NULL(s);
+    TEST_ASSERT_EQUAL_INT(20, s->duty);
+    TEST_ASSERT_EQUAL_INT(0, s->period_ms);
+    TEST_ASSERT_GREATER_OR_EQUAL(12, s->flatness);
+    TEST_ASSERT_EQUAL_INT(SPECTRAL_INTF_NARROWBAND, s->interferer);
+
+    s = ut_find(sum, n, UT_FREQ_WIFI);
+    TEST_ASSERT_NOT_NULL(s);
+    TEST_ASSERT_EQUAL_INT(36, s->chan);
+    TEST_ASSERT_EQUAL_INT(50, s->duty);
+    TEST_ASSERT_EQUAL_INT(0, s->flatness);
+    TEST_ASSERT_EQUAL_INT(SPECTRAL_INTF_NONE, s->interferer);
+
+    free(b.data);
+}
+
+/* Samples split across reads come out the same as a single pass */
+void test_replay_chunked_matches(void)
+{
+    struct spectral_acc whole[SPECTRAL_MAX_CHANS];
+    struct spectral_acc chunked[SPECTRAL_MAX_CHANS];
+    struct spectral_summary sw[SPECTRAL_MAX_CHANS];
+    struct spectral_summary sc[SPECTRAL_MAX_CHANS];
+    struct ut_buf b = { 0 };
+    int n;
+    int i;
+
+    ut_gen_all(&b);
+
+    memset(whole, 0, sizeof(whole));
+    spectral_parse(b.data, b.len, whole, SPECTRAL_MAX_CHANS);
+    n = ut_summarize(whole, sw);
+
+    memset(chunked, 0, sizeof(chunked));
+    ut_replay_chunked(&b, chunked, 42);
+    TEST_ASSERT_EQUAL_INT(n, ut_summarize(chunked, sc));
+
+    for (i = 0; i < n; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(sw[i].freq, sc[i].freq);
+        TEST_ASSERT_EQUAL_INT(sw[i].samples, sc[i].samples);
+        TEST_ASSERT_EQUAL_INT(sw[i].duty, sc[i].duty);
+        TEST_ASSERT_EQUAL_INT(sw[i].avg_power, sc[i].avg_power);
+        TEST_ASSERT_EQUAL_INT(sw[i].period_ms, sc[i].period_ms);
+        TEST_ASSERT_EQUAL_INT(sw[i].interferer, sc[i].interferer);
+    }
+
+    free(b.data);
+}
+
+/*
+ * A radio whose relay stopped mid-sample must pick up its own partial
+ * sample on the next run, even after another radio was read in between.
+ */
+void test_carry_stays_with_radio(void)
+{
+    struct spectral_summary sum[SPECTRAL_MAX_CHANS];
+    struct ut_buf a = { 0 };
+    struct ut_buf b = { 0 };
+    struct ut_buf tail = { 0 };
+    size_t cut = UT_HT20_LEN / 2;
+    int n;
+
+    ut_gen_microwave(&a, 1000000);
+    ut_gen_wifi(&b, 1000000);
+    ut_gen_microwave(&tail, 2000000);
+
+    mkdir(SPECTRAL_DEBUGFS, 0755);
+    ut_debugfs_radio(0, a.data, a.len - cut);
+    ut_debugfs_radio(1, b.data, b.len);
+    ut_radios = 2;
+
+    TEST_ASSERT_TRUE(spectral_init());
+    TEST_ASSERT_NOT_NULL(ut_task);
+
+    ut_task(NULL);
+    n = spectral_get(0, sum, SPECTRAL_MAX_CHANS);
+    TEST_ASSERT_EQUAL_INT(1, n);
+    TEST_ASSERT_EQUAL_INT(UT_SAMPLES - 1, sum[0].samples);
+    n = spectral_get(1, sum, SPECTRAL_MAX_CHANS);
+    TEST_ASSERT_EQUAL_INT(1, n);
+    TEST_ASSERT_EQUAL_INT(UT_FREQ_WIFI, sum[0].freq);
+
+    /* The rest of the cut sample, then another second */
+    ut_debugfs_append(0, a.data + a.len - cut, cut);
+    ut_debugfs_append(0, tail.data, tail.len);
+
+    ut_task(NULL);
+    n = spectral_get(0, sum, SPECTRAL_MAX_CHANS);
+    TEST_ASSERT_EQUAL_INT(1, n);
+    TEST_ASSERT_EQUAL_INT(UT_FREQ_MICROWAVE, sum[0].freq);
+    TEST_ASSERT_EQUAL_INT(UT_SAMPLES + 1, sum[0].samples);
+    TEST_ASSERT_EQUAL_INT(SPECTRAL_INTF_MICROWAVE, sum[0].interferer);
+
+    free(a.data);
+    free(b.data);
+    free(tail.data);
+}
+
+/* Reported, not asserted on: hosts vary too much for a hard limit */
+void test_parse_throughput(void)
+{
+    struct spectral_acc acc[SPECTRAL_MAX_CHANS];
+    struct ut_buf b = { 0 };
+    struct timespec t0;
+    struct timespec t1;
+    uint64_t samples = 0;
+    size_t off;
+    size_t used;
+    double secs;
+    char msg[128];
+    int i;
+
+    while (b.len < UT_BENCH_BYTES)
+        ut_gen_all(&b);
+
+    memset(acc, 0, sizeof(acc));
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (off = 0; off < b.len; off += used)
+    {
+        used = spectral_parse(b.data + off, b.len - off < UT_READ_SIZE ? b.len - off : UT_READ_SIZE,
+                              acc, SPECTRAL_MAX_CHANS);
+        TEST_ASSERT_TRUE(used > 0);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (i = 0; i < SPECTRAL_MAX_CHANS; i++)
+        samples += acc[i].samples;
+    TEST_ASSERT_EQUAL_UINT64(b.len / UT_HT20_LEN, samples);
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    snprintf(msg, sizeof(msg), "spectral_parse: %.0f MB/s, %.2f M samples/s",
+             b.len / secs / (1024 * 1024), samples / secs / 1e6);
+    TEST_MESSAGE(msg);
+
+    free(b.data);
+}
+
+int main(int argc, char *argv[])
+{
+    log_open("TARGET_SPECTRAL_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_replay_classifies);
+    RUN_TEST(test_replay_chunked_matches);
+    RUN_TEST(test_carry_stays_with_radio);
+    RUN_TEST(test_parse_throughput);
+
+    return UNITY_END();
+}
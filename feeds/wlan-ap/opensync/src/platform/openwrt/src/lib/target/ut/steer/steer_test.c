@@ -0,0 +1,615 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * target_bsal_* against a stub hostapd: a thread serving a datagram
+ * control socket under HOSTAPD_CTRL_DIR that records the commands it
+ * gets, answers them and pushes events to whoever ATTACHed. The sampler
+ * is stubbed by a single station whose counters the tests set.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <ev.h>
+
+#include "unity.h"
+#include "log.h"
+#include "evsched.h"
+#include "target.h"
+#include "uci_helper.h"
+#include "nl80211.h"
+#include "phy.h"
+#include "rtnl.h"
+#include "sampler.h"
+#include "hostapd.h"
+
+#define UT_IFNAME       "wlan0"
+#define UT_STA          "aa:bb:cc:00:00:01"
+#define UT_STA_OTHER    "aa:bb:cc:00:00:02"
+#define UT_BSSID        "02:00:00:00:00:01"
+#define UT_MAX_CMDS     64
+#define UT_MAX_EVENTS   16
+
+static const uint8_t ut_sta[6] = { 0xaa, 0xbb, 0xcc, 0x00, 0x00, 0x01 };
+
+static struct ev_loop *ut_loop;
+
+static pthread_t ut_hapd_thread;
+static pthread_mutex_t ut_hapd_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ut_hapd_fd = -1;
+static struct sockaddr_un ut_hapd_mon;
+static bool ut_hapd_attached;
+static char ut_hapd_cmds[UT_MAX_CMDS][256];
+static int ut_hapd_ncmds;
+
+static bsal_event_t ut_events[UT_MAX_EVENTS];
+static int ut_nevents;
+
+static struct sampler_sta ut_sample;
+static bool ut_sampled;
+
+/*
+ * Stubs for what steer.c and bsal.c reach outside the control socket.
+ * There is no UCI MAC filter and no driver, so RSSI lookups fail and
+ * the interface steers as 2.4G.
+ */
+int wifi_getSSIDNumberOfEntries(int *num)
+{
+    return UCI_ERR_NOTFOUND;
+}
+
+int wifi_getVIFName(int ssid_index, char *name, size_t len)
+{
+    return UCI_ERR_NOTFOUND;
+}
+
+int wifi_getApMacFilter(int ssid_index, char *buf, size_t len)
+{
+    return UCI_ERR_NOTFOUND;
+}
+
+struct nl_msg *nl80211_msg(uint8_t cmd, int flags)
+{
+    return NULL;
+}
+
+int nl80211_send(struct nl_msg *msg, nl80211_resp_cb_t cb, void *arg)
+{
+    return -1;
+}
+
+int nl80211_parse(struct nl_msg *msg, struct nlattr **tb)
+{
+    return -1;
+}
+
+int phy_from_ifindex(uint32_t ifindex, char *phy, size_t len)
+{
+    return -1;
+}
+
+struct wifi_phy *phy_get(const char *name)
+{
+    return NULL;
+}
+
+int rtnl_link_addr(const char *ifname, char *mac, size_t len)
+{
+    snprintf(mac, len, UT_BSSID);
+    return 0;
+}
+
+bool sampler_watch(const char *ifname, int user, int interval_ms)
+{
+    ut_sampled = user == SAMPLER_USER_STEER;
+    return true;
+}
+
+void sampler_unwatch(const char *ifname, int user)
+{
+    ut_sampled = false;
+}
+
+int sampler_peek(const char *ifname, sampler_sta_cb_t *cb, void *arg)
+{
+    if (!ut_sampled)
+        return -1;
+
+    cb(&ut_sample, arg);
+
+    return 1;
+}
+
+static void *ut_hapd_run(void *arg)
+{
+    struct sockaddr_un from;
+    socklen_t fromlen;
+    char buf[256];
+    const char *reply;
+    ssize_t len;
+
+    for (;;)
+    {
+        fromlen = sizeof(from);
+        len = recvfrom(ut_hapd_fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&from, &fromlen);
+        if (len < 0)
+            continue;
+        buf[len] = '\0';
+
+        if (!strcmp(buf, "UT_QUIT"))
+            break;
+
+        reply = "OK\n";
+
+        pthread_mutex_lock(&ut_hapd_lock);
+        if (!strcmp(buf, "ATTACH"))
+        {
+            ut_hapd_mon = from;
+            ut_hapd_attached = true;
+        }
+        else if (!strcmp(buf, "DETACH"))
+        {
+            ut_hapd_attached = false;
+        }
+        else if (!strncmp(buf, "STA ", 4))
+        {
+            reply = strcmp(buf + 4, UT_STA) ? "FAIL\n" :
+                    UT_STA "\nflags=[AUTH][ASSOC][AUTHORIZED]\n"
+                    "rx_bytes=1000\ntx_bytes=2000\nsignal=-55\n";
+        }
+        else if (ut_hapd_ncmds < UT_MAX_CMDS)
+        {
+            snprintf(ut_hapd_cmds[ut_hapd_ncmds++], sizeof(ut_hapd_cmds[0]), "%s", buf);
+        }
+        pthread_mutex_unlock(&ut_hapd_lock);
+
+        sendto(ut_hapd_fd, reply, strlen(reply), 0, (struct sockaddr *)&from, fromlen);
+    }
+
+    return NULL;
+}
+
+static void ut_hapd_start(void)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    mkdir(HOSTAPD_CTRL_DIR, 0755);
+    snprintf(addr.sun_path, sizeof(addr.sun_path), HOSTAPD_CTRL_DIR "/" UT_IFNAME);
+    unlink(addr.sun_path);
+
+    ut_hapd_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(ut_hapd_fd >= 0);
+    TEST_ASSERT_EQUAL_INT(0, bind(ut_hapd_fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&ut_hapd_thread, NULL, ut_hapd_run, NULL));
+}
+
+static void ut_hapd_quit(void)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), HOSTAPD_CTRL_DIR "/" UT_IFNAME);
+
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    sendto(fd, "UT_QUIT", 7, 0, (struct sockaddr *)&addr, sizeof(addr));
+    close(fd);
+
+    pthread_join(ut_hapd_thread, NULL);
+    unlink(addr.sun_path);
+}
+
+static void ut_hapd_stop(void)
+{
+    ut_hapd_quit();
+    close(ut_hapd_fd);
+    rmdir(HOSTAPD_CTRL_DIR);
+}
+
+/*
+ * A new instance on the same path, silently. The old socket stays open
+ * until the new one is bound so the two can't share an inode.
+ */
+static void ut_hapd_restart(void)
+{
+    int fd = ut_hapd_fd;
+
+    ut_hapd_quit();
+    ut_hapd_attached = false;
+    ut_hapd_ncmds = 0;
+    ut_hapd_start();
+    close(fd);
+}
+
+static void ut_hapd_event(const char *event)
+{
+    bool attached;
+
+    pthread_mutex_lock(&ut_hapd_lock);
+    attached = ut_hapd_attached;
+    if (attached)
+        sendto(ut_hapd_fd, event, strlen(event), 0, (struct sockaddr *)&ut_hapd_mon, sizeof(ut_hapd_mon));
+    pthread_mutex_unlock(&ut_hapd_lock);
+
+    TEST_ASSERT_TRUE(attached);
+}
+
+static bool ut_hapd_sent(const char *cmd)
+{
+    bool found = false;
+    int i;
+
+    pthread_mutex_lock(&ut_hapd_lock);
+    for (i = 0; i < ut_hapd_ncmds && !found; i++)
+        found = !strcmp(ut_hapd_cmds[i], cmd);
+    pthread_mutex_unlock(&ut_hapd_lock);
+
+    return found;
+}
+
+static void ut_hapd_clear(void)
+{
+    pthread_mutex_lock(&ut_hapd_lock);
+    ut_hapd_ncmds = 0;
+    pthread_mutex_unlock(&ut_hapd_lock);
+}
+
+static void ut_event_cb(bsal_event_t *event)
+{
+    if (ut_nevents < UT_MAX_EVENTS)
+        ut_events[ut_nevents++] = *event;
+}
+
+static void ut_spin(int ms)
+{
+    int i;
+
+    for (i = 0; i < ms / 5; i++)
+    {
+        ev_run(ut_loop, EVRUN_NOWAIT);
+        usleep(5000);
+    }
+}
+
+/* Events come in on the manager's loop, spin it until one is delivered */
+static bsal_event_t *ut_event_wait_ms(int ms)
+{
+    int count = ut_nevents;
+    int i;
+
+    for (i = 0; i < ms / 5 && ut_nevents == count; i++)
+    {
+        ev_run(ut_loop, EVRUN_NOWAIT);
+        usleep(5000);
+    }
+
+    TEST_ASSERT_EQUAL_INT(count + 1, ut_nevents);
+
+    return &ut_events[count];
+}
+
+static bsal_event_t *ut_event_wait(void)
+{
+    return ut_event_wait_ms(1000);
+}
+
+/* Activity and crossings evaluated every second */
+static void ut_iface_sampled(int inact_tmout_sec)
+{
+    bsal_ifconfig_t ifcfg;
+
+    memset(&ifcfg, 0, sizeof(ifcfg));
+    snprintf(ifcfg.ifname, sizeof(ifcfg.ifname), UT_IFNAME);
+    ifcfg.inact_check_sec = 1;
+    ifcfg.inact_tmout_sec_normal = inact_tmout_sec;
+
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_iface_update(&ifcfg));
+    TEST_ASSERT_TRUE(ut_sampled);
+}
+
+static void ut_client_add(const bsal_client_config_t *conf)
+{
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_client_add(UT_IFNAME, ut_sta, conf));
+}
+
+void setUp(void)
+{
+    bsal_ifconfig_t ifcfg;
+
+    memset(&ifcfg, 0, sizeof(ifcfg));
+    snprintf(ifcfg.ifname, sizeof(ifcfg.ifname), UT_IFNAME);
+
+    ut_nevents = 0;
+    ut_hapd_ncmds = 0;
+    memset(&ut_sample, 0, sizeof(ut_sample));
+    memcpy(ut_sample.mac, ut_sta, sizeof(ut_sta));
+    ut_hapd_start();
+
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_init(ut_event_cb, ut_loop));
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_iface_add(&ifcfg));
+    TEST_ASSERT_TRUE(ut_hapd_attached);
+}
+
+void tearDown(void)
+{
+    target_bsal_cleanup();
+    ut_hapd_stop();
+}
+
+void test_probe_forwarded_as_snr(void)
+{
+    bsal_event_t *event;
+
+    ut_hapd_event("<3>RX-PROBE-REQUEST sa=" UT_STA_OTHER " signal=-60");
+    event = ut_event_wait();
+
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_PROBE_REQ, event->type);
+    TEST_ASSERT_EQUAL_STRING(UT_IFNAME, event->ifname);
+    TEST_ASSERT_EQUAL_INT(BSAL_BAND_24G, event->band);
+    TEST_ASSERT_EQUAL_HEX8(0x02, event->data.probe_req.client_addr[5]);
+    TEST_ASSERT_EQUAL_INT(35, event->data.probe_req.rssi);
+    TEST_ASSERT_FALSE(event->data.probe_req.blocked);
+}
+
+/* The deny list rejects authentication, hostapd still answers the probe */
+void test_blacklist_denies_auth_not_probes(void)
+{
+    bsal_client_config_t conf = { .blacklist = 1 };
+    bsal_event_t *event;
+
+    ut_client_add(&conf);
+    TEST_ASSERT_TRUE(ut_hapd_sent("DENY_ACL ADD_MAC " UT_STA));
+
+    ut_hapd_event("<3>RX-PROBE-REQUEST sa=" UT_STA " signal=-40");
+    event = ut_event_wait();
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_PROBE_REQ, event->type);
+    TEST_ASSERT_FALSE(event->data.probe_req.blocked);
+
+    ut_hapd_clear();
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_client_remove(UT_IFNAME, ut_sta));
+    TEST_ASSERT_TRUE(ut_hapd_sent("DENY_ACL DEL_MAC " UT_STA));
+}
+
+void test_rssi_window_follows_probes(void)
+{
+    /* -75 dBm and -45 dBm */
+    bsal_client_config_t conf = { .rssi_probe_lwm = 20, .rssi_probe_hwm = 50 };
+    bsal_event_t *event;
+
+    ut_client_add(&conf);
+    TEST_ASSERT_FALSE(ut_hapd_sent("DENY_ACL ADD_MAC " UT_STA));
+
+    ut_hapd_event("<3>RX-PROBE-REQUEST sa=" UT_STA " signal=-85");
+    event = ut_event_wait();
+    TEST_ASSERT_FALSE(event->data.probe_req.blocked);
+    TEST_ASSERT_TRUE(ut_hapd_sent("DENY_ACL ADD_MAC " UT_STA));
+
+    ut_hapd_event("<3>RX-PROBE-REQUEST sa=" UT_STA " signal=-60");
+    event = ut_event_wait();
+    TEST_ASSERT_FALSE(event->data.probe_req.blocked);
+    TEST_ASSERT_TRUE(ut_hapd_sent("DENY_ACL DEL_MAC " UT_STA));
+
+    ut_hapd_clear();
+    ut_hapd_event("<3>RX-PROBE-REQUEST sa=" UT_STA " signal=-40");
+    event = ut_event_wait();
+    TEST_ASSERT_FALSE(event->data.probe_req.blocked);
+    TEST_ASSERT_TRUE(ut_hapd_sent("DENY_ACL ADD_MAC " UT_STA));
+}
+
+void test_connect_disconnect(void)
+{
+    bsal_event_t *event;
+
+    ut_hapd_event("<3>AP-STA-CONNECTED " UT_STA);
+    event = ut_event_wait();
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_CLIENT_CONNECT, event->type);
+    TEST_ASSERT_EQUAL_MEMORY(ut_sta, event->data.connect.client_addr, 6);
+
+    ut_hapd_event("<3>AP-STA-DISCONNECTED " UT_STA);
+    event = ut_event_wait();
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_CLIENT_DISCONNECT, event->type);
+    TEST_ASSERT_EQUAL_MEMORY(ut_sta, event->data.disconnect.client_addr, 6);
+}
+
+void test_disconnect_commands(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_client_disconnect(UT_IFNAME, ut_sta, BSAL_DISC_TYPE_DEAUTH, 5));
+    TEST_ASSERT_TRUE(ut_hapd_sent("DEAUTHENTICATE " UT_STA " reason=5"));
+
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_client_disconnect(UT_IFNAME, ut_sta, BSAL_DISC_TYPE_DISASSOC, 8));
+    TEST_ASSERT_TRUE(ut_hapd_sent("DISASSOCIATE " UT_STA " reason=8"));
+}
+
+void test_client_info(void)
+{
+    static const uint8_t other[6] = { 0xaa, 0xbb, 0xcc, 0x00, 0x00, 0x02 };
+    bsal_client_info_t info;
+
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_client_info(UT_IFNAME, ut_sta, &info));
+    TEST_ASSERT_TRUE(info.connected);
+    TEST_ASSERT_EQUAL_INT(40, info.snr);
+    TEST_ASSERT_EQUAL_UINT64(1000, info.rx_bytes);
+    TEST_ASSERT_EQUAL_UINT64(2000, info.tx_bytes);
+
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_client_info(UT_IFNAME, other, &info));
+    TEST_ASSERT_FALSE(info.connected);
+}
+
+void test_bss_tm_request(void)
+{
+    bsal_btm_params_t btm;
+
+    memset(&btm, 0, sizeof(btm));
+    btm.valid_int = 100;
+    btm.disassoc_imminent = 1;
+    btm.num_neigh = 1;
+    memcpy(btm.neigh[0].bssid, (uint8_t[]){ 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 }, 6);
+    btm.neigh[0].bssid_info = 0x8f;
+    btm.neigh[0].op_class = 115;
+    btm.neigh[0].channel = 36;
+    btm.neigh[0].phy_type = 9;
+
+    TEST_ASSERT_EQUAL_INT(0, target_bsal_bss_tm_request(UT_IFNAME, ut_sta, &btm));
+    TEST_ASSERT_TRUE(ut_hapd_sent("BSS_TM_REQ " UT_STA " valid_int=100 pref=1 disassoc_imminent=1"
+                                  " neighbor=02:11:22:33:44:55,0x008f,115,36,9"));
+}
+
+void test_btm_response_forwarded_as_action_frame(void)
+{
+    static const uint8_t bssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    static const uint8_t target[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    bsal_event_t *event;
+    const uint8_t *frame;
+
+    ut_hapd_event("<3>BSS-TM-RESP " UT_STA " dialog_token=5 status_code=0"
+                  " bss_termination_delay=0 target_bssid=02:11:22:33:44:55");
+    event = ut_event_wait();
+
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_ACTION_FRAME, event->type);
+    TEST_ASSERT_EQUAL_INT(24 + 5 + 6, event->data.action_frame.data_len);
+
+    frame = event->data.action_frame.data;
+    TEST_ASSERT_EQUAL_HEX8(0xd0, frame[0]);
+    TEST_ASSERT_EQUAL_MEMORY(bssid, frame + 4, 6);
+    TEST_ASSERT_EQUAL_MEMORY(ut_sta, frame + 10, 6);
+    TEST_ASSERT_EQUAL_MEMORY(bssid, frame + 16, 6);
+    TEST_ASSERT_EQUAL_INT(10, frame[24]);
+    TEST_ASSERT_EQUAL_INT(8, frame[25]);
+    TEST_ASSERT_EQUAL_INT(5, frame[26]);
+    TEST_ASSERT_EQUAL_INT(0, frame[27]);
+    TEST_ASSERT_EQUAL_MEMORY(target, frame + 29, 6);
+}
+
+void test_btm_reject_has_no_target(void)
+{
+    bsal_event_t *event;
+
+    ut_hapd_event("<3>BSS-TM-RESP " UT_STA " dialog_token=6 status_code=7 bss_termination_delay=0");
+    event = ut_event_wait();
+
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_ACTION_FRAME, event->type);
+    TEST_ASSERT_EQUAL_INT(24 + 5, event->data.action_frame.data_len);
+    TEST_ASSERT_EQUAL_INT(7, event->data.action_frame.data[27]);
+}
+
+void test_activity_follows_counters(void)
+{
+    bsal_client_config_t conf;
+    bsal_event_t *event;
+
+    memset(&conf, 0, sizeof(conf));
+    ut_client_add(&conf);
+    ut_iface_sampled(1);
+
+    ut_hapd_event("<3>AP-STA-CONNECTED " UT_STA);
+    event = ut_event_wait();
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_CLIENT_CONNECT, event->type);
+
+    ut_sample.rx_bytes = 100;
+    event = ut_event_wait_ms(3500);
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_CLIENT_ACTIVITY, event->type);
+    TEST_ASSERT_EQUAL_MEMORY(ut_sta, event->data.activity.client_addr, 6);
+    TEST_ASSERT_FALSE(event->data.activity.active);
+
+    ut_sample.rx_bytes = 200;
+    event = ut_event_wait_ms(2500);
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_CLIENT_ACTIVITY, event->type);
+    TEST_ASSERT_TRUE(event->data.activity.active);
+}
+
+void test_rssi_crossing(void)
+{
+    /* -45 dBm */
+    bsal_client_config_t conf = { .rssi_high_xing = 50 };
+    bsal_event_t *event;
+
+    ut_client_add(&conf);
+    ut_iface_sampled(0);
+
+    ut_sample.rssi = -60;
+    ut_spin(1500);
+    TEST_ASSERT_EQUAL_INT(0, ut_nevents);
+
+    ut_sample.rssi = -40;
+    event = ut_event_wait_ms(2500);
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_RSSI_XING, event->type);
+    TEST_ASSERT_EQUAL_INT(55, event->data.rssi_change.rssi);
+    TEST_ASSERT_EQUAL_INT(BSAL_RSSI_HIGHER, event->data.rssi_change.high_xing);
+    TEST_ASSERT_EQUAL_INT(BSAL_RSSI_UNCHANGED, event->data.rssi_change.inact_xing);
+    TEST_ASSERT_EQUAL_INT(BSAL_RSSI_UNCHANGED, event->data.rssi_change.low_xing);
+
+    ut_spin(1500);
+    TEST_ASSERT_EQUAL_INT(1, ut_nevents);
+}
+
+/* A restarted hostapd gets the monitor and the blocks back */
+void test_reattach_after_hostapd_restart(void)
+{
+    bsal_client_config_t conf = { .blacklist = 1 };
+    bsal_event_t *event;
+    int i;
+
+    ut_client_add(&conf);
+    ut_hapd_restart();
+
+    for (i = 0; i < 200 && !ut_hapd_attached; i++)
+        ut_spin(5);
+    TEST_ASSERT_TRUE(ut_hapd_attached);
+    TEST_ASSERT_TRUE(ut_hapd_sent("DENY_ACL ADD_MAC " UT_STA));
+
+    ut_hapd_event("<3>AP-STA-CONNECTED " UT_STA_OTHER);
+    event = ut_event_wait();
+    TEST_ASSERT_EQUAL_INT(BSAL_EVENT_CLIENT_CONNECT, event->type);
+}
+
+/* No driver behind the stub, a measurement can't be answered */
+void test_measure_unknown_station(void)
+{
+    TEST_ASSERT_EQUAL_INT(-1, target_bsal_client_measure(UT_IFNAME, ut_sta, 1));
+}
+
+void test_cleanup_lifts_blocks(void)
+{
+    bsal_client_config_t conf = { .blacklist = 1 };
+
+    ut_client_add(&conf);
+    ut_hapd_clear();
+
+    target_bsal_cleanup();
+    TEST_ASSERT_TRUE(ut_hapd_sent("DENY_ACL DEL_MAC " UT_STA));
+    TEST_ASSERT_FALSE(ut_hapd_attached);
+}
+
+int main(int argc, char *argv[])
+{
+    log_open("TARGET_STEER_TEST", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_DISABLED);
+
+    ut_loop = EV_DEFAULT;
+    evsched_init(ut_loop);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_probe_forwarded_as_snr);
+    RUN_TEST(test_blacklist_denies_auth_not_probes);
+    RUN_TEST(test_rssi_window_follows_probes);
+    RUN_TEST(test_connect_disconnect);
+    RUN_TEST(test_disconnect_commands);
+    RUN_TEST(test_client_info);
+    RUN_TEST(test_bss_tm_request);
+    RUN_TEST(test_btm_response_forwarded_as_action_frame);
+    RUN_TEST(test_btm_reject_has_no_target);
+    RUN_TEST(test_activity_follows_counters);
+    RUN_TEST(test_rssi_crossing);
+    RUN_TEST(test_reattach_after_hostapd_restart);
+    RUN_TEST(test_measure_unknown_station);
+    RUN_TEST(test_cleanup_lifts_blocks);
+
+    return UNITY_END();
+}